@@ -70,6 +70,7 @@ cvar_t	*cl_showTimeDelta;
 cvar_t	*cl_freezeDemo;
 
 cvar_t	*cl_shownet;
+cvar_t	*cl_loopbackSnapshots;
 cvar_t	*cl_showSend;
 cvar_t	*cl_timedemo;
 cvar_t	*cl_timedemoLog;
@@ -3007,6 +3008,9 @@ void CL_Frame ( int msec ) {
 	// drop the connection
 	CL_CheckTimeout();
 
+	// let a server in this process hand us snapshots without encoding them
+	NET_SetLoopSnapshots( cl_loopbackSnapshots->integer && !clc.demorecording );
+
 	// send intentions now
 	CL_SendCmd();
 
@@ -3440,6 +3444,7 @@ void CL_Init( void ) {
 
 	cl_timeNudge = Cvar_Get ("cl_timeNudge", "0", CVAR_TEMP );
 	cl_shownet = Cvar_Get ("cl_shownet", "0", CVAR_TEMP );
+	cl_loopbackSnapshots = Cvar_Get ("cl_loopbackSnapshots", "1", 0 );
 	cl_showSend = Cvar_Get ("cl_showSend", "0", CVAR_TEMP );
 	cl_showTimeDelta = Cvar_Get ("cl_showTimeDelta", "0", CVAR_TEMP );
 	cl_freezeDemo = Cvar_Get ("cl_freezeDemo", "0", CVAR_TEMP );
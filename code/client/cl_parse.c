@@ -35,6 +35,7 @@ char *svc_strings[256] = {
 	"svc_snapshot",
 	"svc_EOF",
 	"svc_voip",
+	"svc_loopSnapshot",
 };
 
 void SHOWNET( msg_t *msg, char *s) {
@@ -190,6 +191,53 @@ void CL_ParsePacketEntities( msg_t *msg, clSnapshot_t *oldframe, clSnapshot_t *n
 }
 
 
+/*
+================
+CL_StoreSnapshot
+
+Makes a valid snapshot the current one and saves it for
+later delta comparisons
+================
+*/
+static void CL_StoreSnapshot( clSnapshot_t *newSnap ) {
+	int			oldMessageNum;
+	int			i, packetNum;
+
+	// clear the valid flags of any snapshots between the last
+	// received and this one, so if there was a dropped packet
+	// it won't look like something valid to delta from next
+	// time we wrap around in the buffer
+	oldMessageNum = cl.snap.messageNum + 1;
+
+	if ( newSnap->messageNum - oldMessageNum >= PACKET_BACKUP ) {
+		oldMessageNum = newSnap->messageNum - ( PACKET_BACKUP - 1 );
+	}
+	for ( ; oldMessageNum < newSnap->messageNum ; oldMessageNum++ ) {
+		cl.snapshots[oldMessageNum & PACKET_MASK].valid = qfalse;
+	}
+
+	// copy to the current good spot
+	cl.snap = *newSnap;
+	cl.snap.ping = 999;
+	// calculate ping time
+	for ( i = 0 ; i < PACKET_BACKUP ; i++ ) {
+		packetNum = ( clc.netchan.outgoingSequence - 1 - i ) & PACKET_MASK;
+		if ( cl.snap.ps.commandTime >= cl.outPackets[ packetNum ].p_serverTime ) {
+			cl.snap.ping = cls.realtime - cl.outPackets[ packetNum ].p_realtime;
+			break;
+		}
+	}
+	// save the frame off in the backup array for later delta comparisons
+	cl.snapshots[cl.snap.messageNum & PACKET_MASK] = cl.snap;
+
+	if (cl_shownet->integer == 3) {
+		Com_Printf( "   snapshot:%i  delta:%i  ping:%i\n", cl.snap.messageNum,
+		cl.snap.deltaNum, cl.snap.ping );
+	}
+
+	cl.newSnapshots = qtrue;
+}
+
 /*
 ================
 CL_ParseSnapshot
@@ -204,8 +252,6 @@ void CL_ParseSnapshot( msg_t *msg ) {
 	clSnapshot_t	*old;
 	clSnapshot_t	newSnap;
 	int			deltaNum;
-	int			oldMessageNum;
-	int			i, packetNum;
 
 	// get the reliable sequence acknowledge number
 	// NOTE: now sent with all server to client messages
@@ -288,42 +334,65 @@ void CL_ParseSnapshot( msg_t *msg ) {
 		return;
 	}
 
-	// clear the valid flags of any snapshots between the last
-	// received and this one, so if there was a dropped packet
-	// it won't look like something valid to delta from next
-	// time we wrap around in the buffer
-	oldMessageNum = cl.snap.messageNum + 1;
+	CL_StoreSnapshot( &newSnap );
+}
 
-	if ( newSnap.messageNum - oldMessageNum >= PACKET_BACKUP ) {
-		oldMessageNum = newSnap.messageNum - ( PACKET_BACKUP - 1 );
+/*
+================
+CL_ParseLoopSnapshot
+
+A snapshot from the server in this process, handed over without
+being encoded.  It is stored just like a parsed uncompressed one,
+so later encoded snapshots can still delta from it.
+================
+*/
+void CL_ParseLoopSnapshot( msg_t *msg ) {
+	const loopSnapshot_t	*snap;
+	clSnapshot_t	newSnap;
+	int				i;
+
+	if ( clc.demoplaying || clc.netchan.remoteAddress.type != NA_LOOPBACK ) {
+		Com_Error( ERR_DROP, "CL_ParseLoopSnapshot: not from a local server" );
 	}
-	for ( ; oldMessageNum < newSnap.messageNum ; oldMessageNum++ ) {
-		cl.snapshots[oldMessageNum & PACKET_MASK].valid = qfalse;
+
+	snap = NET_GetLoopSnapshot( MSG_ReadLong( msg ) );
+	if ( !snap ) {
+		// overwritten before we got to it, same as a dropped packet
+		Com_DPrintf( "Loopback snapshot lost.\n" );
+		return;
 	}
 
-	// copy to the current good spot
-	cl.snap = newSnap;
-	cl.snap.ping = 999;
-	// calculate ping time
-	for ( i = 0 ; i < PACKET_BACKUP ; i++ ) {
-		packetNum = ( clc.netchan.outgoingSequence - 1 - i ) & PACKET_MASK;
-		if ( cl.snap.ps.commandTime >= cl.outPackets[ packetNum ].p_serverTime ) {
-			cl.snap.ping = cls.realtime - cl.outPackets[ packetNum ].p_realtime;
-			break;
-		}
+	// these can't be written to a demo, wait for an encoded one
+	if ( clc.demorecording ) {
+		clc.demowaiting = qtrue;
 	}
-	// save the frame off in the backup array for later delta comparisons
-	cl.snapshots[cl.snap.messageNum & PACKET_MASK] = cl.snap;
 
-	if (cl_shownet->integer == 3) {
-		Com_Printf( "   snapshot:%i  delta:%i  ping:%i\n", cl.snap.messageNum,
-		cl.snap.deltaNum, cl.snap.ping );
+	Com_Memset( &newSnap, 0, sizeof( newSnap ) );
+
+	newSnap.serverCommandNum = clc.serverCommandSequence;
+	newSnap.serverTime = snap->serverTime;
+	cl_paused->modified = 0;
+
+	newSnap.messageNum = clc.serverMessageSequence;
+	newSnap.deltaNum = -1;
+	newSnap.snapFlags = snap->snapFlags;
+	newSnap.valid = qtrue;
+
+	Com_Memcpy( newSnap.areamask, snap->areamask, snap->areabytes );
+	newSnap.ps = snap->ps;
+
+	newSnap.parseEntitiesNum = cl.parseEntitiesNum;
+	newSnap.numEntities = snap->numEntities;
+	for ( i = 0 ; i < snap->numEntities ; i++ ) {
+		cl.parseEntities[cl.parseEntitiesNum & (MAX_PARSE_ENTITIES-1)] = snap->entities[i];
+		cl.parseEntitiesNum++;
 	}
 
-	cl.newSnapshots = qtrue;
+	CL_StoreSnapshot( &newSnap );
 }
 
 
+
 //=====================================================================
 
 int cl_connectedToPureServer;
@@ -921,6 +990,9 @@ void CL_ParseServerMessage( msg_t *msg ) {
 		case svc_snapshot:
 			CL_ParseSnapshot( msg );
 			break;
+		case svc_loopSnapshot:
+			CL_ParseLoopSnapshot( msg );
+			break;
 		case svc_download:
 			CL_ParseDownload( msg );
 			break;
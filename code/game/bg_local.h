@@ -53,8 +53,15 @@ typedef struct {
 	int			previous_waterlevel;
 } pml_t;
 
-extern	pmove_t		*pm;
-extern	pml_t		pml;
+// the game module moves several clients at once, each on its own thread
+#ifdef __cplusplus
+#define	BG_THREADLOCAL	thread_local
+#else
+#define	BG_THREADLOCAL
+#endif
+
+extern	BG_THREADLOCAL pmove_t	*pm;
+extern	BG_THREADLOCAL pml_t	pml;
 
 // movement parameters
 extern	float	pm_stopspeed;
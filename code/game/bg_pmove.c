@@ -27,13 +27,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "bg_public.h"
 #include "bg_local.h"
 
-// lgodlewski
-#ifdef __cplusplus
-	#include <tbb/tbb.h>
-#endif
-
-pmove_t		*pm;
-pml_t		pml;
+BG_THREADLOCAL pmove_t	*pm;
+BG_THREADLOCAL pml_t	pml;
 
 // movement parameters
 float	pm_stopspeed = 100.0f;
@@ -2028,12 +2023,6 @@ Can be called by either the server or the client
 ================
 */
 void Pmove (pmove_t *pmove) {
-	// lgodlewski: all pmove code is **thread-unsafe** because it uses globals
-	#ifdef __cplusplus
-	static tbb::mutex pmoveMutex;
-	tbb::mutex::scoped_lock lock(pmoveMutex);
-	#endif
-
 	int			finalTime;
 
 	finalTime = pmove->cmd.serverTime;
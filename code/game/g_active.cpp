@@ -23,6 +23,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "g_local.h"
 
+#include <tbb/task_group.h>
+
+// created in vmMain
+extern tbb::task_group	*g_clientThinkTasks;
+
+// clients with thinkPending set
+static int	numPendingThinks;
+
 
 /*
 ===============
@@ -740,12 +748,24 @@ usually be a couple times for each server frame on fast clients.
 
 If "g_synchronousClients 1" is set, this will be called exactly
 once for each server frame, which makes for smooth demo recording.
+
+A think is split in three: ClientThink_begin and ClientThink_finish can
+touch any entity, ClientThink_move only changes the client itself, so
+the moves of several clients can run at once (see G_ClientThinkSync).
 ==============
 */
-void ClientThink_real( EntPtr ent ) {
+
+/*
+==============
+ClientThink_begin
+
+Everything before the move.  Returns qfalse if the client doesn't move,
+otherwise client->thinkPm is ready for ClientThink_move.
+==============
+*/
+static qboolean ClientThink_begin( EntPtr ent ) {
 	gclient_t	*client;
-	pmove_t		pm;
-	int			oldEventSequence;
+	pmove_t		*pm;
 	int			msec;
 	usercmd_t	*ucmd;
 
@@ -753,7 +773,7 @@ void ClientThink_real( EntPtr ent ) {
 
 	// don't think if the client is not yet connected (and thus not yet spawned in)
 	if (client->pers.connected != CON_CONNECTED) {
-		return;
+		return qfalse;
 	}
 	// mark the time, so the connection sprite can be removed
 	ucmd = &ent->client->pers.cmd;
@@ -772,7 +792,7 @@ void ClientThink_real( EntPtr ent ) {
 	// following others may result in bad times, but we still want
 	// to check for follow toggles
 	if ( msec < 1 && client->sess.spectatorState != SPECTATOR_FOLLOW ) {
-		return;
+		return qfalse;
 	}
 	if ( msec > 200 ) {
 		msec = 200;
@@ -796,21 +816,21 @@ void ClientThink_real( EntPtr ent ) {
 	//
 	if ( level.intermissiontime ) {
 		ClientIntermissionThink( client );
-		return;
+		return qfalse;
 	}
 
 	// spectators don't do much
 	if ( client->sess.sessionTeam == TEAM_SPECTATOR ) {
 		if ( client->sess.spectatorState == SPECTATOR_SCOREBOARD ) {
-			return;
+			return qfalse;
 		}
 		SpectatorThink( ent, ucmd );
-		return;
+		return qfalse;
 	}
 
 	// check for inactivity timer, but never drop the local client of a non-dedicated server
 	if ( !ClientInactivityTimer( client ) ) {
-		return;
+		return qfalse;
 	}
 
 	// clear the rewards if time
@@ -848,15 +868,17 @@ void ClientThink_real( EntPtr ent ) {
 	}
 
 	// set up for pmove
-	oldEventSequence = client->ps.eventSequence;
+	client->thinkOldEventSequence = client->ps.eventSequence;
+	client->thinkMsec = msec;
 
-	memset (&pm, 0, sizeof(pm));
+	pm = &client->thinkPm;
+	memset (pm, 0, sizeof(*pm));
 
 	// check for the hit-scan gauntlet, don't let the action
 	// go through as an attack unless it actually hits something
 	if ( client->ps.weapon == WP_GAUNTLET && !( ucmd->buttons & BUTTON_TALK ) &&
 		( ucmd->buttons & BUTTON_ATTACK ) && client->ps.weaponTime <= 0 ) {
-		pm.gauntletHit = CheckGauntletAttack( ent );
+		pm->gauntletHit = CheckGauntletAttack( ent );
 	}
 
 	if ( ent->flags & FL_FORCE_GESTURE ) {
@@ -891,47 +913,63 @@ void ClientThink_real( EntPtr ent ) {
 	}
 #endif
 
-	pm.ps = &client->ps;
-	pm.cmd = *ucmd;
-	if ( pm.ps->pm_type == PM_DEAD ) {
-		pm.tracemask = MASK_PLAYERSOLID & ~CONTENTS_BODY;
+	pm->ps = &client->ps;
+	pm->cmd = *ucmd;
+	if ( pm->ps->pm_type == PM_DEAD ) {
+		pm->tracemask = MASK_PLAYERSOLID & ~CONTENTS_BODY;
 	}
 	else if ( ent->r.svFlags & SVF_BOT ) {
-		pm.tracemask = MASK_PLAYERSOLID | CONTENTS_BOTCLIP;
+		pm->tracemask = MASK_PLAYERSOLID | CONTENTS_BOTCLIP;
 	}
 	else {
-		pm.tracemask = MASK_PLAYERSOLID;
+		pm->tracemask = MASK_PLAYERSOLID;
 	}
-	pm.trace = trap_Trace;
-	pm.pointcontents = trap_PointContents;
-	pm.debugLevel = g_debugMove.integer;
-	pm.noFootsteps = (qboolean)(( g_dmflags.integer & DF_NO_FOOTSTEPS ) > 0);
+	pm->trace = trap_Trace;
+	pm->pointcontents = trap_PointContents;
+	pm->debugLevel = g_debugMove.integer;
+	pm->noFootsteps = (qboolean)(( g_dmflags.integer & DF_NO_FOOTSTEPS ) > 0);
 
-	pm.pmove_fixed = pmove_fixed.integer | client->pers.pmoveFixed;
-	pm.pmove_msec = pmove_msec.integer;
+	pm->pmove_fixed = pmove_fixed.integer | client->pers.pmoveFixed;
+	pm->pmove_msec = pmove_msec.integer;
 
 	VectorCopy( client->ps.origin, client->oldOrigin );
 
 #ifdef MISSIONPACK
 		if (level.intermissionQueued != 0 && g_singlePlayer.integer) {
 			if ( level.time - level.intermissionQueued >= 1000  ) {
-				pm.cmd.buttons = 0;
-				pm.cmd.forwardmove = 0;
-				pm.cmd.rightmove = 0;
-				pm.cmd.upmove = 0;
+				pm->cmd.buttons = 0;
+				pm->cmd.forwardmove = 0;
+				pm->cmd.rightmove = 0;
+				pm->cmd.upmove = 0;
 				if ( level.time - level.intermissionQueued >= 2000 && level.time - level.intermissionQueued <= 2500 ) {
 					trap_SendConsoleCommand( EXEC_APPEND, "centerview\n");
 				}
 				ent->client->ps.pm_type = PM_SPINTERMISSION;
 			}
 		}
-		Pmove (&pm);
-#else
-		Pmove (&pm);
 #endif
 
+	return qtrue;
+}
+
+/*
+==============
+ClientThink_move
+
+Runs the move and keeps the results on the client's own entity state.
+The entity isn't relinked until ClientThink_finish, so the other moves
+of the round still see it where it was.
+==============
+*/
+static void ClientThink_move( EntPtr ent ) {
+	gclient_t	*client;
+
+	client = ent->client;
+
+	Pmove (&client->thinkPm);
+
 	// save results of pmove
-	if ( ent->client->ps.eventSequence != oldEventSequence ) {
+	if ( ent->client->ps.eventSequence != client->thinkOldEventSequence ) {
 		ent->eventTime = level.time;
 	}
 	if (g_smoothClients.integer) {
@@ -940,23 +978,41 @@ void ClientThink_real( EntPtr ent ) {
 	else {
 		BG_PlayerStateToEntityState( &ent->client->ps, &ent->s, qtrue );
 	}
-	SendPendingPredictableEvents( &ent->client->ps );
 
 	if ( !( ent->client->ps.eFlags & EF_FIRING ) ) {
 		client->fireHeld = qfalse;		// for grapple
 	}
+}
+
+/*
+==============
+ClientThink_finish
+
+Everything after the move: events, triggers and impacts.
+==============
+*/
+static void ClientThink_finish( EntPtr ent ) {
+	gclient_t	*client;
+	pmove_t		*pm;
+	usercmd_t	*ucmd;
+
+	client = ent->client;
+	pm = &client->thinkPm;
+	ucmd = &client->pers.cmd;
+
+	SendPendingPredictableEvents( &ent->client->ps );
 
 	// use the snapped origin for linking so it matches client predicted versions
 	VectorCopy( ent->s.pos.trBase, ent->r.currentOrigin );
 
-	VectorCopy (pm.mins, ent->r.mins);
-	VectorCopy (pm.maxs, ent->r.maxs);
+	VectorCopy (pm->mins, ent->r.mins);
+	VectorCopy (pm->maxs, ent->r.maxs);
 
-	ent->waterlevel = pm.waterlevel;
-	ent->watertype = pm.watertype;
+	ent->waterlevel = pm->waterlevel;
+	ent->watertype = pm->watertype;
 
 	// execute client events
-	ClientEvents( ent, oldEventSequence );
+	ClientEvents( ent, client->thinkOldEventSequence );
 
 	// link entity now, after any personal teleporters have been used
 	trap_LinkEntity (ent);
@@ -971,10 +1027,10 @@ void ClientThink_real( EntPtr ent ) {
 	BotTestAAS(ent->r.currentOrigin);
 
 	// touch other objects
-	ClientImpacts( ent, &pm );
+	ClientImpacts( ent, pm );
 
 	// save results of triggers and client events
-	if (ent->client->ps.eventSequence != oldEventSequence) {
+	if (ent->client->ps.eventSequence != client->thinkOldEventSequence) {
 		ent->eventTime = level.time;
 	}
 
@@ -1003,7 +1059,20 @@ void ClientThink_real( EntPtr ent ) {
 	}
 
 	// perform once-a-second actions
-	ClientTimerActions( ent, msec );
+	ClientTimerActions( ent, client->thinkMsec );
+}
+
+/*
+==============
+ClientThink_real
+==============
+*/
+void ClientThink_real( EntPtr ent ) {
+	if ( !ClientThink_begin( ent ) ) {
+		return;
+	}
+	ClientThink_move( ent );
+	ClientThink_finish( ent );
 }
 
 /*
@@ -1028,6 +1097,77 @@ void ClientThink( int clientNum ) {
 	}
 }
 
+/*
+==================
+G_QueueClientThink
+
+Like ClientThink, but the move is left for G_ClientThinkSync, which
+runs the moves of all the queued clients at once.
+==================
+*/
+void G_QueueClientThink( int clientNum ) {
+	EntPtr ent;
+
+	ent = g_entities + clientNum;
+
+	// a client only has one move in flight
+	if ( ent->client->thinkPending ) {
+		G_ClientThinkSync();
+	}
+
+	trap_GetUsercmd( clientNum, &ent->client->pers.cmd );
+	ent->client->lastCmdTime = level.time;
+
+	if ( !(ent->r.svFlags & SVF_BOT) && !g_synchronousClients.integer ) {
+		if ( ClientThink_begin( ent ) ) {
+			ent->client->thinkPending = qtrue;
+			numPendingThinks++;
+		}
+	}
+}
+
+/*
+==================
+G_ClientThinkSync
+
+Runs the queued moves in parallel, then finishes those thinks one
+client at a time.
+==================
+*/
+void G_ClientThinkSync( void ) {
+	static qboolean	syncing;
+	int			i;
+	EntPtr		ent;
+
+	// finishing a think can drop a client, which calls back in here
+	if ( syncing || !numPendingThinks ) {
+		return;
+	}
+	syncing = qtrue;
+
+	for ( i = 0 ; i < level.maxclients ; i++ ) {
+		ent = g_entities + i;
+		if ( ent->client->thinkPending ) {
+			g_clientThinkTasks->run( [ent]{ ClientThink_move( ent ); } );
+		}
+	}
+	g_clientThinkTasks->wait();
+
+	for ( i = 0 ; i < level.maxclients ; i++ ) {
+		ent = g_entities + i;
+		if ( !ent->client->thinkPending ) {
+			continue;
+		}
+		ent->client->thinkPending = qfalse;
+		if ( ent->client->pers.connected == CON_CONNECTED ) {
+			ClientThink_finish( ent );
+		}
+	}
+
+	numPendingThinks = 0;
+	syncing = qfalse;
+}
+
 
 void G_RunClient( EntPtr ent ) {
 	if ( !(ent->r.svFlags & SVF_BOT) && !g_synchronousClients.integer ) {
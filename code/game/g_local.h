@@ -319,6 +319,12 @@ struct gclient_s {
 #endif
 
 	char		*areabits;
+
+	// a queued think waiting for its move, see G_ClientThinkSync
+	qboolean	thinkPending;
+	pmove_t		thinkPm;
+	int			thinkOldEventSequence;
+	int			thinkMsec;
 };
 
 
@@ -624,6 +630,8 @@ void ClientCommand( int clientNum );
 // g_active.c
 //
 void ClientThink( int clientNum );
+void G_QueueClientThink( int clientNum );
+void G_ClientThinkSync( void );
 void ClientEndFrame( EntPtr ent );
 void G_RunClient( EntPtr ent );
 
@@ -232,7 +232,7 @@ struct gameTimeMeasurement
 		if (command == GAME_RUN_FRAME || command == GAME_SHUTDOWN)
 		{
 			// log end-of-frame stats
-			G_LogPrintf("%s FRAME TIMES:%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
+			G_LogPrintf("%s FRAME TIMES:%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
 				(command == GAME_RUN_FRAME) ? "REG" : "END",
 				level.framenum,
 				trap_Cvar_VariableIntegerValue("g_timeSpent0"),
@@ -245,7 +245,8 @@ struct gameTimeMeasurement
 				trap_Cvar_VariableIntegerValue("g_timeSpent7"),
 				trap_Cvar_VariableIntegerValue("g_timeSpent8"),
 				trap_Cvar_VariableIntegerValue("g_timeSpent9"),
-				trap_Cvar_VariableIntegerValue("g_timeSpent10"));
+				trap_Cvar_VariableIntegerValue("g_timeSpent10"),
+				trap_Cvar_VariableIntegerValue("g_timeSpent11"));
 
 			// if this is a dedicated server, clear all cvars so that they don't linger
 			if (is_dedicated)
@@ -261,6 +262,7 @@ struct gameTimeMeasurement
 				trap_Cvar_Set("g_timeSpent8", "0");
 				trap_Cvar_Set("g_timeSpent9", "0");
 				trap_Cvar_Set("g_timeSpent10", "0");
+				trap_Cvar_Set("g_timeSpent11", "0");
 			}
 		}
 	}
@@ -299,6 +301,11 @@ Q_EXPORT intptr_t vmMain( int command, int arg0, int arg1, int arg2, int arg3, i
 	// lgodlewski
 	gameTimeMeasurement foo(command);
 
+	// the queued client moves have to land before anything else looks at the world
+	if ( command != GAME_CLIENT_THINK ) {
+		G_ClientThinkSync();
+	}
+
 	switch ( command ) {
 	case GAME_INIT:
 		// lgodlewski: initialize the threading infrastructure
@@ -322,8 +329,10 @@ Q_EXPORT intptr_t vmMain( int command, int arg0, int arg1, int arg2, int arg3, i
 	case GAME_CLIENT_CONNECT:
 		return (intptr_t)ClientConnect( arg0, (qboolean)arg1, (qboolean)arg2 );
 	case GAME_CLIENT_THINK:
-		// lgodlewski: schedule client updates an async background tasks
-		g_clientThinkTasks->run([arg0]{ClientThink( arg0 );});
+		// the move runs at the next GAME_CLIENT_THINK_SYNC, in parallel with the others
+		G_QueueClientThink( arg0 );
+		return 0;
+	case GAME_CLIENT_THINK_SYNC:
 		return 0;
 	case GAME_CLIENT_USERINFO_CHANGED:
 		ClientUserinfoChanged( arg0 );
@@ -338,9 +347,6 @@ Q_EXPORT intptr_t vmMain( int command, int arg0, int arg1, int arg2, int arg3, i
 		ClientCommand( arg0 );
 		return 0;
 	case GAME_RUN_FRAME:
-		// lgodlewski: synchronize clients *before* updating entities
-		g_clientThinkTasks->wait();
-
 		G_RunFrame( arg0 );
 		return 0;
 	case GAME_CONSOLE_COMMAND:
@@ -541,8 +547,9 @@ void G_InitGame( int levelTime, int randomSeed, int restart ) {
 
 	G_InitMemory();
 
-	// set some level globals
-	memset( &level, 0, sizeof( level ) );
+	// set some level globals, value-initialized since the EntPtr
+	// members make memset of these structures undefined for g++
+	level = level_locals_t();
 	level.time = levelTime;
 	level.startTime = levelTime;
 
@@ -571,12 +578,16 @@ void G_InitGame( int levelTime, int randomSeed, int restart ) {
 	G_InitWorldSession();
 
 	// initialize all entities for this game
-	memset( g_entities, 0, MAX_GENTITIES * sizeof(g_entities[0]) );
+	for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+		g_entities[i] = gentity_t();
+	}
 	level.gentities = g_entities;
 
 	// initialize all clients for this game
 	level.maxclients = g_maxclients.integer;
-	memset( g_clients, 0, MAX_CLIENTS * sizeof(g_clients[0]) );
+	for ( i = 0 ; i < MAX_CLIENTS ; i++ ) {
+		g_clients[i] = gclient_t();
+	}
 	level.clients = g_clients;
 
 	// set client fields on player ents
@@ -230,6 +230,8 @@ typedef enum {
 	// 1.32
 	G_FS_SEEK,
 
+	G_CVAR_TABLE,	// const cvar_t * ( void ); native modules only, see trap_Cvar_Update
+
 	BOTLIB_SETUP = 200,				// ( void );
 	BOTLIB_SHUTDOWN,				// ( void );
 	BOTLIB_LIBVAR_SET,
@@ -425,6 +427,11 @@ typedef enum {
 	// The game can issue trap_argc() / trap_argv() commands to get the command
 	// and parameters.  Return qfalse if the game doesn't recognize it as a command.
 
-	BOTAI_START_FRAME				// ( int time );
+	BOTAI_START_FRAME,				// ( int time );
+
+	GAME_CLIENT_THINK_SYNC			// ( void );
+	// sent after each round of queued GAME_CLIENT_THINK calls, every
+	// client gets at most one command per round, so their movement
+	// can run in parallel up to here
 } gameExport_t;
 
@@ -35,6 +35,10 @@ static intptr_t (QDECL *g_syscall)( intptr_t arg, ... ) = (intptr_t (QDECL *)( i
 #include <tbb/tbb.h>
 static tbb::recursive_mutex g_syscallMutex;
 
+// traces and other queries of the linked entities only read the world, so
+// they take this shared and skip g_syscallMutex; (un)linking takes it exclusive
+static tbb::spin_rw_mutex g_worldMutex;
+
 Q_EXPORT void dllEntry( intptr_t (QDECL *syscallptr)( intptr_t arg,... ) ) {
 	g_syscall = syscallptr;
 }
@@ -110,12 +114,25 @@ void	trap_SendConsoleCommand( int exec_when, const char *text ) {
 	g_syscall( G_SEND_CONSOLE_COMMAND, exec_when, text );
 }
 
+// the engine's cvars by vmCvar_t handle, so unchanged cvars can be
+// skipped without a syscall
+static const cvar_t *g_cvarTable;
+
 void	trap_Cvar_Register( vmCvar_t *cvar, const char *var_name, const char *value, int flags ) {
 	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
 	g_syscall( G_CVAR_REGISTER, cvar, var_name, value, flags );
+	if ( !g_cvarTable ) {
+		g_cvarTable = (const cvar_t *)g_syscall( G_CVAR_TABLE );
+	}
 }
 
 void	trap_Cvar_Update( vmCvar_t *cvar ) {
+	// the engine bumps modificationCount only after the new value is in place
+	if ( g_cvarTable && cvar->modificationCount ==
+		*(volatile const int *)&g_cvarTable[cvar->handle].modificationCount ) {
+		return;
+	}
+
 	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
 	g_syscall( G_CVAR_UPDATE, cvar );
 }
@@ -179,67 +196,71 @@ void trap_GetServerinfo( char *buffer, int bufferSize ) {
 
 void trap_SetBrushModel( gentity_t *ent, const char *name ) {
 	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, true);
 	g_syscall( G_SET_BRUSH_MODEL, ent, name );
 }
 
 void trap_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask ) {
-	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, false);
 	g_syscall( G_TRACE, results, start, mins, maxs, end, passEntityNum, contentmask );
 }
 
 void trap_TraceCapsule( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask ) {
-	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, false);
 	g_syscall( G_TRACECAPSULE, results, start, mins, maxs, end, passEntityNum, contentmask );
 }
 
 int trap_PointContents( const vec3_t point, int passEntityNum ) {
-	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, false);
 	return g_syscall( G_POINT_CONTENTS, point, passEntityNum );
 }
 
 
 qboolean trap_InPVS( const vec3_t p1, const vec3_t p2 ) {
-	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, false);
 	return (qboolean)g_syscall( G_IN_PVS, p1, p2 );
 }
 
 qboolean trap_InPVSIgnorePortals( const vec3_t p1, const vec3_t p2 ) {
-	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, false);
 	return (qboolean)g_syscall( G_IN_PVS_IGNORE_PORTALS, p1, p2 );
 }
 
 void trap_AdjustAreaPortalState( gentity_t *ent, qboolean open ) {
 	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, true);
 	g_syscall( G_ADJUST_AREA_PORTAL_STATE, ent, open );
 }
 
 qboolean trap_AreasConnected( int area1, int area2 ) {
-	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, false);
 	return (qboolean)g_syscall( G_AREAS_CONNECTED, area1, area2 );
 }
 
 void trap_LinkEntity( gentity_t *ent ) {
 	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, true);
 	g_syscall( G_LINKENTITY, ent );
 }
 
 void trap_UnlinkEntity( gentity_t *ent ) {
 	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, true);
 	g_syscall( G_UNLINKENTITY, ent );
 }
 
 int trap_EntitiesInBox( const vec3_t mins, const vec3_t maxs, int *list, int maxcount ) {
-	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, false);
 	return g_syscall( G_ENTITIES_IN_BOX, mins, maxs, list, maxcount );
 }
 
 qboolean trap_EntityContact( const vec3_t mins, const vec3_t maxs, const gentity_t *ent ) {
-	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, false);
 	return (qboolean)g_syscall( G_ENTITY_CONTACT, mins, maxs, ent );
 }
 
 qboolean trap_EntityContactCapsule( const vec3_t mins, const vec3_t maxs, const gentity_t *ent ) {
-	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
+	tbb::spin_rw_mutex::scoped_lock worldLock(g_worldMutex, false);
 	return (qboolean)g_syscall( G_ENTITY_CONTACTCAPSULE, mins, maxs, ent );
 }
 
@@ -279,7 +300,6 @@ int trap_RealTime( qtime_t *qtime ) {
 }
 
 void trap_SnapVector( float *v ) {
-	tbb::recursive_mutex::scoped_lock lock(g_syscallMutex);	// lgodlewski
 	g_syscall( G_SNAPVECTOR, v );
 }
 
@@ -22,6 +22,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // cmodel.c -- model loading
 
 #include "cm_local.h"
+#include "cm_patch.h"
+
+#if !defined( BSPC ) && !defined( _WIN32 )
+#include <pthread.h>
+#include <unistd.h>
+#define	CM_PATCH_THREADS
+#endif
 
 #ifdef BSPC
 
@@ -42,11 +49,12 @@ void SetPlaneSignbits (cplane_t *out) {
 #endif //BSPC
 
 // to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
-#define	BOX_BRUSHES		1
-#define	BOX_SIDES		6
+// some extra indexes along with those needed by the map,
+// one box for each thread that may trace
+#define	BOX_BRUSHES		CM_BOX_SLOTS
+#define	BOX_SIDES		( 6 * CM_BOX_SLOTS )
 #define	BOX_LEAFS		2
-#define	BOX_PLANES		12
+#define	BOX_PLANES		( 12 * CM_BOX_SLOTS )
 
 #define	LL(x) x=LittleLong(x)
 
@@ -62,15 +70,28 @@ byte		*cmod_base;
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_debugSurfaceUpdate;
+cvar_t		*cm_simdBrushes;
+cvar_t		*cm_patchTree;
+cvar_t		*cm_nodeBounds;
+cvar_t		*cm_patchThreads;
+cvar_t		*cm_patchCache;
 #endif
 
-cmodel_t	box_model;
-cplane_t	*box_planes;
-cbrush_t	*box_brush;
+typedef struct {
+	cmodel_t	model;
+	cplane_t	*planes;
+	cbrush_t	*brush;
+} cmBox_t;
+
+static cmBox_t	cm_boxes[CM_BOX_SLOTS];
+static int		cm_boxSlotsUsed;
+static CM_THREADLOCAL int	cm_boxSlot = -1;
 
 
 
 void	CM_InitBoxHull (void);
+static cmBox_t	*CM_ThreadBox( void );
 void	CM_FloodAreaConnections (void);
 
 
@@ -206,6 +227,182 @@ void CMod_LoadNodes( lump_t *l ) {
 
 }
 
+/*
+=================
+CMod_ClipNodeBounds
+
+Shrinks the bounds to the side of the plane, keeping everything on it
+=================
+*/
+static void CMod_ClipNodeBounds( const cplane_t *plane, int side, vec3_t mins, vec3_t maxs ) {
+	vec3_t	normal;
+	float	dist, rest, limit;
+	int		i, j;
+
+	if ( plane->type < 3 ) {
+		if ( side ) {
+			if ( plane->dist < maxs[plane->type] ) {
+				maxs[plane->type] = plane->dist;
+			}
+		} else if ( plane->dist > mins[plane->type] ) {
+			mins[plane->type] = plane->dist;
+		}
+		return;
+	}
+
+	// keep normal . p >= dist
+	if ( side ) {
+		VectorNegate( plane->normal, normal );
+		dist = -plane->dist;
+	} else {
+		VectorCopy( plane->normal, normal );
+		dist = plane->dist;
+	}
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		if ( normal[i] == 0 ) {
+			continue;
+		}
+
+		// the most the other axes can add
+		rest = 0;
+		for ( j = 0 ; j < 3 ; j++ ) {
+			if ( j != i ) {
+				rest += normal[j] * ( normal[j] > 0 ? maxs[j] : mins[j] );
+			}
+		}
+
+		// a unit of slack for the rounding
+		limit = ( dist - rest ) / normal[i];
+		if ( normal[i] > 0 ) {
+			if ( limit - 1 > mins[i] ) {
+				mins[i] = limit - 1;
+			}
+		} else if ( limit + 1 < maxs[i] ) {
+			maxs[i] = limit + 1;
+		}
+	}
+}
+
+/*
+=================
+CMod_CountBoxLeafs_r
+
+Counts the leafs going down the planes from the node reaches, like CM_BoxLeafnums_r
+=================
+*/
+static int CMod_CountBoxLeafs_r( vec3_t mins, vec3_t maxs, int nodenum ) {
+	cNode_t	*node;
+	int		s, count;
+
+	count = 0;
+	while ( nodenum >= 0 ) {
+		node = &cm.nodes[nodenum];
+		s = BoxOnPlaneSide( mins, maxs, node->plane );
+		if ( s == 1 ) {
+			nodenum = node->children[0];
+		} else if ( s == 2 ) {
+			nodenum = node->children[1];
+		} else {
+			count += CMod_CountBoxLeafs_r( mins, maxs, node->children[0] );
+			nodenum = node->children[1];
+		}
+	}
+
+	return count + 1;
+}
+
+/*
+=================
+CMod_BoundNodes_r
+=================
+*/
+static int CMod_BoundNodes_r( int nodenum, const vec3_t mins, const vec3_t maxs, int depth ) {
+	cNode_t	*node;
+	vec3_t	childMins, childMaxs;
+	int		i, child, last;
+
+	if ( depth > cm.numNodes ) {
+		Com_DPrintf( "CMod_BoundNodes: node %i is its own child\n", nodenum );
+		cm.nodeBoundsValid = qfalse;
+		return -1;
+	}
+
+	node = &cm.nodes[nodenum];
+	VectorCopy( mins, node->bounds[0] );
+	VectorCopy( maxs, node->bounds[1] );
+	node->firstLeaf = cm.numNodeLeafs;
+	node->lastClusterLeaf = -1;
+
+	for ( i = 0 ; i < 2 ; i++ ) {
+		child = node->children[i];
+		if ( child >= 0 ) {
+			VectorCopy( mins, childMins );
+			VectorCopy( maxs, childMaxs );
+			CMod_ClipNodeBounds( node->plane, i, childMins, childMaxs );
+			last = CMod_BoundNodes_r( child, childMins, childMaxs, depth + 1 );
+			if ( !cm.nodeBoundsValid ) {
+				return -1;
+			}
+		} else {
+			if ( cm.numNodeLeafs == cm.numLeafs ) {
+				Com_DPrintf( "CMod_BoundNodes: leaf %i is reached twice\n", -1 - child );
+				cm.nodeBoundsValid = qfalse;
+				return -1;
+			}
+			cm.nodeLeafs[cm.numNodeLeafs++] = -1 - child;
+			last = cm.leafs[-1 - child].cluster != -1 ? -1 - child : -1;
+		}
+		if ( last != -1 ) {
+			node->lastClusterLeaf = last;
+		}
+	}
+
+	node->numLeafs = cm.numNodeLeafs - node->firstLeaf;
+
+	// the bounds only hold the node's part of the world, so they are only
+	// kept if a box of them goes down to every leaf, which any bigger box
+	// then does too
+	for ( i = 0 ; i < 3 ; i++ ) {
+		if ( node->bounds[0][i] > node->bounds[1][i] ) {
+			break;
+		}
+	}
+	if ( i != 3 || CMod_CountBoxLeafs_r( node->bounds[0], node->bounds[1], nodenum ) != node->numLeafs ) {
+		VectorSet( node->bounds[0], -2 * WORLD_SIZE, -2 * WORLD_SIZE, -2 * WORLD_SIZE );
+		VectorSet( node->bounds[1], 2 * WORLD_SIZE, 2 * WORLD_SIZE, 2 * WORLD_SIZE );
+	}
+
+	return node->lastClusterLeaf;
+}
+
+/*
+=================
+CMod_BoundNodes
+
+Gives every node a box around its part of the world and lists the leafs
+under it together, so a box query that covers a whole node can take
+all of its leafs without going down the node's planes.
+
+Trees that reach a leaf more than once or loop back on themselves still
+load, box queries then always go down the planes.
+=================
+*/
+void CMod_BoundNodes( void ) {
+	vec3_t	mins, maxs;
+	int		i;
+
+	cm.nodeLeafs = Hunk_Alloc( cm.numLeafs * sizeof( *cm.nodeLeafs ), h_high );
+	cm.numNodeLeafs = 0;
+	cm.nodeBoundsValid = qtrue;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		mins[i] = cm.cmodels[0].mins[i] - 1;
+		maxs[i] = cm.cmodels[0].maxs[i] + 1;
+	}
+	CMod_BoundNodes_r( 0, mins, maxs, 0 );
+}
+
 /*
 =================
 CM_BoundBrush
@@ -224,6 +421,51 @@ void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+/*
+=================
+CMod_LoadBrushPlanes
+
+Copies the side planes of every brush into one array, four sides to a
+block with the normals and dists in separate rows, so CM_TraceThroughBrush
+can test four sides at once.  Unused slots get a plane nothing is in front
+of.  The box brushes are rebuilt for every temp box and keep using the
+planes through their sides.
+=================
+*/
+static void CMod_LoadBrushPlanes( void ) {
+#if idx64
+	cbrush_t	*brush;
+	cplane_t	*plane;
+	float		*block, *slot;
+	int			i, j, numBlocks;
+
+	numBlocks = 0;
+	for ( i = 0 ; i < cm.numBrushes ; i++ ) {
+		numBlocks += ( cm.brushes[i].numsides + 3 ) >> 2;
+	}
+
+	block = Hunk_Alloc( numBlocks * SIDE_BLOCK_FLOATS * sizeof( float ), h_high );
+
+	for ( i = 0, brush = cm.brushes ; i < cm.numBrushes ; i++, brush++ ) {
+		brush->sidePlanes = block;
+		for ( j = 0 ; j < brush->numsides ; j++ ) {
+			plane = brush->sides[j].plane;
+			slot = block + ( j >> 2 ) * SIDE_BLOCK_FLOATS + ( j & 3 );
+			slot[0] = plane->normal[0];
+			slot[4] = plane->normal[1];
+			slot[8] = plane->normal[2];
+			slot[12] = plane->dist;
+		}
+		// the hunk is cleared, so the padding only needs its dist
+		for ( ; j & 3 ; j++ ) {
+			slot = block + ( j >> 2 ) * SIDE_BLOCK_FLOATS + ( j & 3 );
+			slot[12] = 1e30f;
+		}
+		block += ( j >> 2 ) * SIDE_BLOCK_FLOATS;
+	}
+#endif
+}
+
 /*
 =================
 CMod_LoadBrushes
@@ -259,6 +501,7 @@ void CMod_LoadBrushes( lump_t *l ) {
 		CM_BoundBrush( out );
 	}
 
+	CMod_LoadBrushPlanes();
 }
 
 /*
@@ -302,6 +545,8 @@ void CMod_LoadLeafs (lump_t *l)
 
 	cm.areas = Hunk_Alloc( cm.numAreas * sizeof( *cm.areas ), h_high );
 	cm.areaPortals = Hunk_Alloc( cm.numAreas * cm.numAreas * sizeof( *cm.areaPortals ), h_high );
+	cm.areaBytes = ( cm.numAreas + 7 ) >> 3;
+	cm.areaBits = Hunk_Alloc( cm.numAreas * cm.areaBytes, h_high );
 }
 
 /*
@@ -478,19 +723,316 @@ void CMod_LoadVisibility( lump_t *l ) {
 /*
 =================
 CMod_LoadPatches
+
+Patch collides are generated on cm_patchThreads threads and kept in
+maps/<name>.patches under the game directory, so the next load of the
+same bsp can skip it
 =================
 */
 #define	MAX_PATCH_VERTS		1024
-void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
-	drawVert_t	*dv, *dv_p;
+#define	MAX_PATCH_THREADS	16
+
+#define	PATCH_CACHE_IDENT	(('S'<<24)+('H'<<16)+('C'<<8)+'P')	// "PCHS"
+#define	PATCH_CACHE_VERSION	1
+
+typedef struct {
+	int			ident;				// also tells a cache of the other byte order
+	int			version;
+	int			checksum;			// of the whole bsp
+	int			numSurfaces;
+	int			numPatches;
+	int			blockSizes;			// catches builds with other patch structures
+} patchCacheHeader_t;
+
+// followed by the patchCollide_t block, padded to 8 bytes
+typedef struct {
+	int			surfaceNum;
+	int			size;
+	int			checksum;			// of the block
+	int			pad;
+} patchCacheBlock_t;
+
+typedef struct {
+	int			surfaceNum;
+	int			width, height;
+	drawVert_t	*verts;
+	patchCollide_t	*block;			// from CM_GeneratePatchBlock
+	char		*messages;			// malloced, if there were any
+	char		*error;
+} patchJob_t;
+
+static patchJob_t	*patchJobs;
+static int			numPatchJobs;
+static int			nextPatchJob;
+
+/*
+=================
+CMod_CopyText
+
+Z_Malloc isn't thread safe
+=================
+*/
+static char *CMod_CopyText( const char *text ) {
+	char	*out;
+	int		len;
+
+	len = strlen( text ) + 1;
+	out = malloc( len );
+	if ( out ) {
+		Com_Memcpy( out, text, len );
+	}
+	return out;
+}
+
+/*
+=================
+CMod_RunPatchJobs
+
+Takes patches off the job list until it's empty, on as many threads as
+there are.  Nothing but the patch work and the job is touched here.
+=================
+*/
+static void CMod_RunPatchJobs( patchWork_t *pw ) {
+	vec3_t		points[MAX_PATCH_VERTS];
+	patchJob_t	*job;
+	drawVert_t	*dv_p;
+	int			i, jobNum;
+
+	while ( ( jobNum = CM_AtomicIncrement( &nextPatchJob ) - 1 ) < numPatchJobs ) {
+		job = &patchJobs[jobNum];
+
+		// load the full drawverts onto the stack
+		dv_p = job->verts;
+		for ( i = 0 ; i < job->width * job->height ; i++, dv_p++ ) {
+			points[i][0] = LittleFloat( dv_p->xyz[0] );
+			points[i][1] = LittleFloat( dv_p->xyz[1] );
+			points[i][2] = LittleFloat( dv_p->xyz[2] );
+		}
+
+		// create the internal facet structure
+		job->block = CM_GeneratePatchBlock( pw, job->width, job->height, points );
+		if ( pw->messages[0] ) {
+			job->messages = CMod_CopyText( pw->messages );
+		}
+		if ( !job->block ) {
+			job->error = CMod_CopyText( pw->error );
+		}
+	}
+}
+
+#ifdef CM_PATCH_THREADS
+/*
+=================
+CMod_PatchThread
+=================
+*/
+static void *CMod_PatchThread( void *arg ) {
+	CMod_RunPatchJobs( arg );
+	return NULL;
+}
+#endif
+
+/*
+=================
+CMod_GeneratePatches
+=================
+*/
+static void CMod_GeneratePatches( void ) {
+	patchWork_t	*work[MAX_PATCH_THREADS];
+	int			i, numThreads;
+#ifdef CM_PATCH_THREADS
+	pthread_t	threads[MAX_PATCH_THREADS];
+	qboolean	started[MAX_PATCH_THREADS];
+
+	numThreads = cm_patchThreads->integer;
+	if ( numThreads <= 0 ) {
+		numThreads = sysconf( _SC_NPROCESSORS_ONLN );
+	}
+	if ( numThreads > MAX_PATCH_THREADS ) {
+		numThreads = MAX_PATCH_THREADS;
+	}
+	if ( numThreads > numPatchJobs ) {
+		numThreads = numPatchJobs;
+	}
+	if ( numThreads < 1 ) {
+		numThreads = 1;
+	}
+#else
+	numThreads = 1;
+#endif
+
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		work[i] = CM_AllocPatchWork();
+	}
+
+	nextPatchJob = 0;
+#ifdef CM_PATCH_THREADS
+	for ( i = 1 ; i < numThreads ; i++ ) {
+		started[i] = !pthread_create( &threads[i], NULL, CMod_PatchThread, work[i] );
+	}
+#endif
+
+	// the main thread takes its share
+	CMod_RunPatchJobs( work[0] );
+
+#ifdef CM_PATCH_THREADS
+	for ( i = 1 ; i < numThreads ; i++ ) {
+		if ( started[i] ) {
+			pthread_join( threads[i], NULL );
+		}
+	}
+#endif
+
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		CM_FreePatchWork( work[i] );
+	}
+}
+
+#ifndef BSPC
+/*
+=================
+CMod_PatchCachePath
+=================
+*/
+static void CMod_PatchCachePath( const char *name, char *path, int size ) {
+	char	base[MAX_QPATH];
+
+	COM_StripExtension( name, base, sizeof( base ) );
+	Com_sprintf( path, size, "%s/%s.patches", FS_GetCurrentGameDir(), base );
+}
+
+/*
+=================
+CMod_LoadPatchCache
+
+Fills in every patch from the cache, or none if it doesn't match the bsp
+=================
+*/
+static qboolean CMod_LoadPatchCache( const char *name, int checksum ) {
+	char				path[MAX_OSPATH];
+	fileHandle_t		f;
+	byte				*buf, *p, *end;
+	patchCacheHeader_t	*header;
+	patchCacheBlock_t	*cb;
+	int					length, i, pass;
+	qboolean			ok;
+
+	CMod_PatchCachePath( name, path, sizeof( path ) );
+	length = FS_SV_FOpenFileRead( path, &f );
+	if ( !f ) {
+		return qfalse;
+	}
+	if ( length < (int)sizeof( *header ) ) {
+		FS_FCloseFile( f );
+		return qfalse;
+	}
+
+	buf = Hunk_AllocateTempMemory( length );
+	ok = ( FS_Read( buf, length, f ) == length );
+	FS_FCloseFile( f );
+
+	header = (patchCacheHeader_t *)buf;
+	if ( header->ident != PATCH_CACHE_IDENT || header->version != PATCH_CACHE_VERSION
+		|| header->checksum != checksum || header->numSurfaces != cm.numSurfaces
+		|| header->numPatches != numPatchJobs
+		|| header->blockSizes != sizeof( patchCollide_t ) + sizeof( facet_t ) + sizeof( patchNode_t ) ) {
+		ok = qfalse;
+	}
+
+	// check it all before anything goes on the hunk
+	end = buf + length;
+	for ( pass = 0 ; pass < 2 && ok ; pass++ ) {
+		p = buf + sizeof( *header );
+		for ( i = 0 ; i < numPatchJobs ; i++ ) {
+			cb = (patchCacheBlock_t *)p;
+			p += sizeof( *cb );
+			if ( !pass && p > end ) {
+				ok = qfalse;
+				break;
+			}
+			if ( pass ) {
+				cm.surfaces[cb->surfaceNum]->pc = CM_HunkPatchBlock( (patchCollide_t *)p );
+			} else if ( cb->surfaceNum != patchJobs[i].surfaceNum || cb->size < 0 || cb->size > end - p
+				|| cb->checksum != Com_BlockChecksum( p, cb->size )
+				|| !CM_ValidatePatchBlock( (patchCollide_t *)p, cb->size ) ) {
+				ok = qfalse;
+				break;
+			}
+			p += PAD( cb->size, 8 );
+		}
+	}
+
+	Hunk_FreeTempMemory( buf );
+
+	if ( ok ) {
+		Com_DPrintf( "%i patches from %s\n", numPatchJobs, path );
+	}
+	return ok;
+}
+
+/*
+=================
+CMod_WritePatchCache
+=================
+*/
+static void CMod_WritePatchCache( const char *name, int checksum ) {
+	static const byte	zeros[8];
+	char				path[MAX_OSPATH];
+	fileHandle_t		f;
+	patchCacheHeader_t	header;
+	patchCacheBlock_t	cb;
+	patchJob_t			*job;
+	int					i;
+
+	CMod_PatchCachePath( name, path, sizeof( path ) );
+	f = FS_SV_FOpenFileWrite( path );
+	if ( !f ) {
+		Com_DPrintf( "Couldn't write %s\n", path );
+		return;
+	}
+
+	header.ident = PATCH_CACHE_IDENT;
+	header.version = PATCH_CACHE_VERSION;
+	header.checksum = checksum;
+	header.numSurfaces = cm.numSurfaces;
+	header.numPatches = numPatchJobs;
+	header.blockSizes = sizeof( patchCollide_t ) + sizeof( facet_t ) + sizeof( patchNode_t );
+	FS_Write( &header, sizeof( header ), f );
+
+	for ( i = 0, job = patchJobs ; i < numPatchJobs ; i++, job++ ) {
+		// the pointers are set again on load, the hunk has its own copy
+		job->block->planes = NULL;
+		job->block->facets = NULL;
+		job->block->nodes = NULL;
+		job->block->nodeFacets = NULL;
+
+		cb.surfaceNum = job->surfaceNum;
+		cb.size = CM_PatchBlockSize( job->block );
+		cb.checksum = Com_BlockChecksum( job->block, cb.size );
+		cb.pad = 0;
+		FS_Write( &cb, sizeof( cb ), f );
+		FS_Write( job->block, cb.size, f );
+		FS_Write( zeros, PADLEN( cb.size, 8 ), f );
+	}
+
+	FS_FCloseFile( f );
+}
+#endif
+
+/*
+=================
+CMod_LoadPatches
+=================
+*/
+void CMod_LoadPatches( lump_t *surfs, lump_t *verts, const char *name, int checksum ) {
+	drawVert_t	*dv;
 	dsurface_t	*in;
 	int			count;
-	int			i, j;
-	int			c;
+	int			i;
 	cPatch_t	*patch;
-	vec3_t		points[MAX_PATCH_VERTS];
-	int			width, height;
+	patchJob_t	*job;
 	int			shaderNum;
+	char		error[MAX_STRING_CHARS];
 
 	in = (void *)(cmod_base + surfs->fileofs);
 	if (surfs->filelen % sizeof(*in))
@@ -502,6 +1044,9 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	if (verts->filelen % sizeof(*dv))
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 
+	patchJobs = Hunk_AllocateTempMemory( count * sizeof( *patchJobs ) );
+	numPatchJobs = 0;
+
 	// scan through all the surfaces, but only load patches,
 	// not planar faces
 	for ( i = 0 ; i < count ; i++, in++ ) {
@@ -512,27 +1057,63 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 
 		cm.surfaces[ i ] = patch = Hunk_Alloc( sizeof( *patch ), h_high );
 
-		// load the full drawverts onto the stack
-		width = LittleLong( in->patchWidth );
-		height = LittleLong( in->patchHeight );
-		c = width * height;
-		if ( c > MAX_PATCH_VERTS ) {
+		job = &patchJobs[numPatchJobs++];
+		Com_Memset( job, 0, sizeof( *job ) );
+		job->surfaceNum = i;
+		job->width = LittleLong( in->patchWidth );
+		job->height = LittleLong( in->patchHeight );
+		if ( job->width < 0 || job->height < 0 || job->width * job->height > MAX_PATCH_VERTS ) {
+			Hunk_FreeTempMemory( patchJobs );
 			Com_Error( ERR_DROP, "ParseMesh: MAX_PATCH_VERTS" );
 		}
-
-		dv_p = dv + LittleLong( in->firstVert );
-		for ( j = 0 ; j < c ; j++, dv_p++ ) {
-			points[j][0] = LittleFloat( dv_p->xyz[0] );
-			points[j][1] = LittleFloat( dv_p->xyz[1] );
-			points[j][2] = LittleFloat( dv_p->xyz[2] );
-		}
+		job->verts = dv + LittleLong( in->firstVert );
 
 		shaderNum = LittleLong( in->shaderNum );
 		patch->contents = cm.shaders[shaderNum].contentFlags;
 		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
+	}
 
-		// create the internal facet structure
-		patch->pc = CM_GeneratePatchCollide( width, height, points );
+#ifndef BSPC
+	if ( numPatchJobs && cm_patchCache->integer && CMod_LoadPatchCache( name, checksum ) ) {
+		Hunk_FreeTempMemory( patchJobs );
+		return;
+	}
+#endif
+
+	if ( numPatchJobs ) {
+		CMod_GeneratePatches();
+	}
+
+	error[0] = 0;
+	for ( i = 0, job = patchJobs ; i < numPatchJobs ; i++, job++ ) {
+		if ( job->messages ) {
+			Com_Printf( "%s", job->messages );
+		}
+		if ( !job->block && !error[0] ) {
+			Q_strncpyz( error, job->error ? job->error : "CMod_LoadPatches: out of memory", sizeof( error ) );
+		}
+	}
+
+	if ( !error[0] ) {
+		for ( i = 0, job = patchJobs ; i < numPatchJobs ; i++, job++ ) {
+			cm.surfaces[job->surfaceNum]->pc = CM_HunkPatchBlock( job->block );
+		}
+#ifndef BSPC
+		if ( numPatchJobs && cm_patchCache->integer ) {
+			CMod_WritePatchCache( name, checksum );
+		}
+#endif
+	}
+
+	for ( i = 0, job = patchJobs ; i < numPatchJobs ; i++, job++ ) {
+		free( job->block );
+		free( job->messages );
+		free( job->error );
+	}
+	Hunk_FreeTempMemory( patchJobs );
+
+	if ( error[0] ) {
+		Com_Error( ERR_DROP, "%s", error );
 	}
 }
 
@@ -584,6 +1165,14 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT );
+	// registered here rather than on the first patch trace, which may be on any thread
+	cm_debugSurfaceUpdate = Cvar_Get ("r_debugSurfaceUpdate", "1", 0);
+	// off until it matches the scalar traces exactly, see CM_TraceThroughBrushSides
+	cm_simdBrushes = Cvar_Get ("cm_simdBrushes", "0", CVAR_CHEAT);
+	cm_patchTree = Cvar_Get ("cm_patchTree", "1", CVAR_CHEAT);
+	cm_nodeBounds = Cvar_Get ("cm_nodeBounds", "1", CVAR_CHEAT);
+	cm_patchThreads = Cvar_Get ("cm_patchThreads", "0", CVAR_ARCHIVE);
+	cm_patchCache = Cvar_Get ("cm_patchCache", "1", CVAR_ARCHIVE);
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
@@ -600,6 +1189,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 		cm.numLeafs = 1;
 		cm.numClusters = 1;
 		cm.numAreas = 1;
+		cm.areaBytes = 1;
 		cm.cmodels = Hunk_Alloc( sizeof( *cm.cmodels ), h_high );
 		*checksum = 0;
 		return;
@@ -643,9 +1233,10 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	CMod_LoadBrushes (&header.lumps[LUMP_BRUSHES]);
 	CMod_LoadSubmodels (&header.lumps[LUMP_MODELS]);
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
+	CMod_BoundNodes ();
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
-	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], name, last_checksum );
 
 	// we are NOT freeing the file, because it is cached for the ref
 	FS_FreeFile (buf.v);
@@ -683,7 +1274,7 @@ cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle ) {
 		return &cm.cmodels[handle];
 	}
 	if ( handle == BOX_MODEL_HANDLE ) {
-		return &box_model;
+		return &CM_ThreadBox()->model;
 	}
 	if ( handle < MAX_SUBMODELS ) {
 		Com_Error( ERR_DROP, "CM_ClipHandleToModel: bad handle %i < %i < %i", 
@@ -736,6 +1327,22 @@ int		CM_LeafArea( int leafnum ) {
 //=======================================================================
 
 
+/*
+===================
+CM_ThreadBox
+
+The box set by CM_TempBoxModel has to stay put until the trace that
+uses it is done, so each thread that traces gets a box of its own.
+Threads past CM_BOX_SLOTS share slots again.
+===================
+*/
+static cmBox_t *CM_ThreadBox( void ) {
+	if ( cm_boxSlot < 0 ) {
+		cm_boxSlot = ( CM_AtomicIncrement( &cm_boxSlotsUsed ) - 1 ) % CM_BOX_SLOTS;
+	}
+	return &cm_boxes[cm_boxSlot];
+}
+
 /*
 ===================
 CM_InitBoxHull
@@ -746,47 +1353,51 @@ can just be stored out and get a proper clipping hull structure.
 */
 void CM_InitBoxHull (void)
 {
-	int			i;
+	int			i, j;
 	int			side;
 	cplane_t	*p;
 	cbrushside_t	*s;
+	cmBox_t		*box;
 
-	box_planes = &cm.planes[cm.numPlanes];
+	for ( j = 0 ; j < CM_BOX_SLOTS ; j++ ) {
+		box = &cm_boxes[j];
 
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
+		box->planes = &cm.planes[cm.numPlanes + j*12];
 
-	box_model.leaf.numLeafBrushes = 1;
-//	box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
+		box->brush = &cm.brushes[cm.numBrushes + j];
+		box->brush->numsides = 6;
+		box->brush->sides = cm.brushsides + cm.numBrushSides + j*6;
+		box->brush->contents = CONTENTS_BODY;
 
-	for (i=0 ; i<6 ; i++)
-	{
-		side = i&1;
-
-		// brush sides
-		s = &cm.brushsides[cm.numBrushSides+i];
-		s->plane = 	cm.planes + (cm.numPlanes+i*2+side);
-		s->surfaceFlags = 0;
-
-		// planes
-		p = &box_planes[i*2];
-		p->type = i>>1;
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i>>1] = 1;
-
-		p = &box_planes[i*2+1];
-		p->type = 3 + (i>>1);
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i>>1] = -1;
+		box->model.leaf.numLeafBrushes = 1;
+		box->model.leaf.firstLeafBrush = cm.numLeafBrushes + j;
+		cm.leafbrushes[cm.numLeafBrushes + j] = cm.numBrushes + j;
 
-		SetPlaneSignbits( p );
-	}	
+		for (i=0 ; i<6 ; i++)
+		{
+			side = i&1;
+
+			// brush sides
+			s = &box->brush->sides[i];
+			s->plane = box->planes + (i*2+side);
+			s->surfaceFlags = 0;
+
+			// planes
+			p = &box->planes[i*2];
+			p->type = i>>1;
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i>>1] = 1;
+
+			p = &box->planes[i*2+1];
+			p->type = 3 + (i>>1);
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i>>1] = -1;
+
+			SetPlaneSignbits( p );
+		}
+	}
 }
 
 /*
@@ -799,29 +1410,30 @@ Capsules are handled differently though.
 ===================
 */
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
+	cmBox_t		*box = CM_ThreadBox();
 
-	VectorCopy( mins, box_model.mins );
-	VectorCopy( maxs, box_model.maxs );
+	VectorCopy( mins, box->model.mins );
+	VectorCopy( maxs, box->model.maxs );
 
 	if ( capsule ) {
 		return CAPSULE_MODEL_HANDLE;
 	}
 
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = -maxs[0];
-	box_planes[2].dist = mins[0];
-	box_planes[3].dist = -mins[0];
-	box_planes[4].dist = maxs[1];
-	box_planes[5].dist = -maxs[1];
-	box_planes[6].dist = mins[1];
-	box_planes[7].dist = -mins[1];
-	box_planes[8].dist = maxs[2];
-	box_planes[9].dist = -maxs[2];
-	box_planes[10].dist = mins[2];
-	box_planes[11].dist = -mins[2];
-
-	VectorCopy( mins, box_brush->bounds[0] );
-	VectorCopy( maxs, box_brush->bounds[1] );
+	box->planes[0].dist = maxs[0];
+	box->planes[1].dist = -maxs[0];
+	box->planes[2].dist = mins[0];
+	box->planes[3].dist = -mins[0];
+	box->planes[4].dist = maxs[1];
+	box->planes[5].dist = -maxs[1];
+	box->planes[6].dist = mins[1];
+	box->planes[7].dist = -mins[1];
+	box->planes[8].dist = maxs[2];
+	box->planes[9].dist = -maxs[2];
+	box->planes[10].dist = mins[2];
+	box->planes[11].dist = -mins[2];
+
+	VectorCopy( mins, box->brush->bounds[0] );
+	VectorCopy( maxs, box->brush->bounds[1] );
 
 	return BOX_MODEL_HANDLE;
 }
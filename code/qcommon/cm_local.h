@@ -28,10 +28,29 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define	BOX_MODEL_HANDLE		255
 #define CAPSULE_MODEL_HANDLE	254
 
+// every thread that traces gets its own temp box, see CM_TempBoxModel
+#define	CM_BOX_SLOTS			128
+
+// traces can run on several of the game module's threads at once
+#ifdef _MSC_VER
+#include <intrin.h>
+#define	CM_THREADLOCAL			__declspec(thread)
+#define	CM_AtomicIncrement(p)	_InterlockedIncrement( (volatile long *)(p) )
+#define	CM_AtomicAdd(p, n)		( _InterlockedExchangeAdd( (volatile long *)(p), (n) ) + (n) )
+#else
+#define	CM_THREADLOCAL			__thread
+#define	CM_AtomicIncrement(p)	__sync_add_and_fetch( (p), 1 )
+#define	CM_AtomicAdd(p, n)		__sync_add_and_fetch( (p), (n) )
+#endif
+
 
 typedef struct {
 	cplane_t	*plane;
 	int			children[2];		// negative numbers are leafs
+	vec3_t		bounds[2];			// any box covering these reaches all the leafs below, see CMod_BoundNodes
+	int			firstLeaf;			// the leafs under the node are nodeLeafs[firstLeaf] on
+	int			numLeafs;
+	int			lastClusterLeaf;	// the last of them that has a cluster, or -1
 } cNode_t;
 
 typedef struct {
@@ -62,12 +81,11 @@ typedef struct {
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
+	float		*sidePlanes;	// side normals and dists in blocks of four, see CMod_LoadBrushPlanes
 } cbrush_t;
 
 
 typedef struct {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -75,7 +93,7 @@ typedef struct {
 
 
 typedef struct {
-	int			floodnum;
+	int			floodnum;		// the area the flood started from, see CM_AdjustAreaPortalState
 	int			floodvalid;
 } cArea_t;
 
@@ -93,6 +111,9 @@ typedef struct {
 
 	int			numNodes;
 	cNode_t		*nodes;
+	int			numNodeLeafs;
+	int			*nodeLeafs;		// every leaf in the order CM_BoxLeafnums_r reaches them
+	qboolean	nodeBoundsValid;	// qfalse if the tree can't be bounded, see CMod_BoundNodes
 
 	int			numLeafs;
 	cLeaf_t		*leafs;
@@ -120,12 +141,13 @@ typedef struct {
 	int			numAreas;
 	cArea_t		*areas;
 	int			*areaPortals;	// [ numAreas*numAreas ] reference counts
+	int			areaBytes;
+	byte		*areaBits;		// [ numAreas*areaBytes ] the areas in the flood of each floodnum
 
 	int			numSurfaces;
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
 } clipMap_t;
 
 
@@ -133,12 +155,22 @@ typedef struct {
 // and to avoid various numeric issues
 #define	SURFACE_CLIP_EPSILON	(0.125)
 
+// taken off CM_BoxLeafnumsSlack results for rounding in the plane tests
+#define	SLACK_EPSILON			(0.01f)
+
+// a block of sidePlanes holds the x, y and z normals and then the dists of four sides
+#define	SIDE_BLOCK_FLOATS		16
+
 extern	clipMap_t	cm;
 extern	int			c_pointcontents;
 extern	int			c_traces, c_brush_traces, c_patch_traces;
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
+extern	cvar_t		*cm_debugSurfaceUpdate;
+extern	cvar_t		*cm_simdBrushes;
+extern	cvar_t		*cm_patchTree;
+extern	cvar_t		*cm_nodeBounds;
 
 // cm_test.c
 
@@ -151,6 +183,18 @@ typedef struct
 	vec3_t		offset;
 } sphere_t;
 
+// the trace four wide for CM_TraceThroughBrushSides, filled at the first brush
+typedef struct {
+	int			mode;		// 0 until filled, then 1 for boxes and 2 for capsules
+	float		start[3][4];
+	float		end[3][4];
+	float		start2[3][4];	// capsules: start and end moved the other way along the offset
+	float		end2[3][4];
+	float		lo[3][4];	// boxes: size[0] and size[1], capsules: the offset in lo
+	float		hi[3][4];
+	float		radius[4];
+} sideTest_t;
+
 typedef struct {
 	vec3_t		start;
 	vec3_t		end;
@@ -164,6 +208,10 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	int			checkcount;	// brushes and patches already tested are marked with this, see CM_NewCheckCount
+	int			*brushChecks;	// [ numBrushes + CM_BOX_SLOTS ] of the tracing thread
+	int			*surfaceChecks;	// [ numSurfaces ] of the tracing thread
+	sideTest_t	sideTest;
 } traceWork_t;
 
 typedef struct leafList_s {
@@ -173,6 +221,8 @@ typedef struct leafList_s {
 	int		*list;
 	vec3_t	bounds[2];
 	int		lastLeaf;		// for overflows where each leaf can't be stored individually
+	float	*slack;			// if set, lowered to how far the bounds can move without changing the result
+	byte	*brushBits;		// brushes already stored, one bit each
 	void	(*storeLeafs)( struct leafList_s *ll, int nodenum );
 } leafList_t;
 
@@ -190,7 +240,6 @@ qboolean CM_BoundsIntersectPoint( const vec3_t mins, const vec3_t maxs, const ve
 
 // cm_patch.c
 
-struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points );
 void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 void CM_ClearLevelPatches( void );
@@ -28,7 +28,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 This file does not reference any globals, and has these entry points:
 
 void CM_ClearLevelPatches( void );
-struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, const vec3_t *points );
+patchCollide_t *CM_GeneratePatchBlock( patchWork_t *pw, int width, int height, vec3_t *points );
+patchCollide_t *CM_HunkPatchBlock( const patchCollide_t *block );
 void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 void CM_DrawDebugSurface( void (*drawPoly)(int color, int numPoints, flaot *points) );
@@ -87,6 +88,7 @@ int	c_totalPatchEdges;
 static const patchCollide_t	*debugPatchCollide;
 static const facet_t		*debugFacet;
 static qboolean		debugBlock;
+static int			debugBlockClaims;	// generation threads race for setting the block
 static vec3_t		debugBlockPoints[4];
 
 /*
@@ -414,11 +416,80 @@ PATCH COLLIDE GENERATION
 ================================================================================
 */
 
-static	int				numPlanes;
-static	patchPlane_t	planes[MAX_PATCH_PLANES];
+/*
+==================
+CM_PatchError
+
+Generation runs on the threads of CMod_LoadPatches, which can't longjmp
+to the main loop, so they give up on the patch and leave the error
+==================
+*/
+static void QDECL CM_PatchError( patchWork_t *pw, const char *fmt, ... ) __attribute__ ((noreturn, format(printf, 2, 3)));
+static void QDECL CM_PatchError( patchWork_t *pw, const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( pw->error, sizeof( pw->error ), fmt, argptr );
+	va_end( argptr );
+
+	longjmp( pw->abort, 1 );
+}
 
-static	int				numFacets;
-static	facet_t			facets[MAX_PATCH_PLANES]; //maybe MAX_FACETS ??
+/*
+==================
+CM_PatchWindingError
+
+Polylib errors inside a generation abort the patch like any other
+==================
+*/
+static void CM_PatchWindingError( void *data, const char *text ) {
+	CM_PatchError( (patchWork_t *)data, "%s", text );
+}
+
+/*
+==================
+CM_PatchPrintf
+
+Warnings are kept until the main thread prints them
+==================
+*/
+static void QDECL CM_PatchPrintf( patchWork_t *pw, qboolean developer, const char *fmt, ... ) __attribute__ ((format(printf, 3, 4)));
+static void QDECL CM_PatchPrintf( patchWork_t *pw, qboolean developer, const char *fmt, ... ) {
+	va_list		argptr;
+	char		text[MAX_STRING_CHARS];
+
+	if ( developer && !com_developer->integer ) {
+		return;
+	}
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, argptr );
+	va_end( argptr );
+
+	Q_strcat( pw->messages, sizeof( pw->messages ), text );
+}
+
+/*
+==================
+CM_AddPlane
+==================
+*/
+static int CM_AddPlane( patchWork_t *pw, float plane[4] ) {
+	int		hash;
+
+	if ( pw->numPlanes == MAX_PATCH_PLANES ) {
+		CM_PatchError( pw, "MAX_PATCH_PLANES" );
+	}
+
+	Vector4Copy( plane, pw->planes[pw->numPlanes].plane );
+	pw->planes[pw->numPlanes].signbits = CM_SignbitsForNormal( plane );
+
+	hash = (int)floor( fabs( plane[3] ) ) & ( PLANE_HASHES - 1 );
+	pw->planeChain[pw->numPlanes] = pw->planeHash[hash];
+	pw->planeHash[hash] = pw->numPlanes;
+
+	return pw->numPlanes++;
+}
 
 #define	NORMAL_EPSILON	0.0001
 #define	DIST_EPSILON	0.02
@@ -487,27 +558,35 @@ void CM_SnapVector(vec3_t normal) {
 CM_FindPlane2
 ==================
 */
-int CM_FindPlane2(float plane[4], int *flipped) {
-	int i;
-
-	// see if the points are close enough to an existing plane
-	for ( i = 0 ; i < numPlanes ; i++ ) {
-		if (CM_PlaneEqual(&planes[i], plane, flipped)) return i;
+int CM_FindPlane2(patchWork_t *pw, float plane[4], int *flipped) {
+	int i, j, hash, best, bestFlipped, f;
+
+	// see if the points are close enough to an existing plane, all that can
+	// be within DIST_EPSILON are in the bucket or the ones on either side
+	best = -1;
+	bestFlipped = qfalse;
+	hash = (int)floor( fabs( plane[3] ) );
+	for ( j = hash - 1 ; j <= hash + 1 ; j++ ) {
+		for ( i = pw->planeHash[j & ( PLANE_HASHES - 1 )] ; i != -1 ; i = pw->planeChain[i] ) {
+			if ( best != -1 && i >= best ) {
+				continue;
+			}
+			if (CM_PlaneEqual(&pw->planes[i], plane, &f)) {
+				best = i;
+				bestFlipped = f;
+			}
+		}
 	}
-
-	// add a new plane
-	if ( numPlanes == MAX_PATCH_PLANES ) {
-		Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
+	if ( best != -1 ) {
+		// the lowest one, as searching them in order would find
+		*flipped = bestFlipped;
+		return best;
 	}
 
-	Vector4Copy( plane, planes[numPlanes].plane );
-	planes[numPlanes].signbits = CM_SignbitsForNormal( plane );
-
-	numPlanes++;
-
+	// add a new plane
 	*flipped = qfalse;
 
-	return numPlanes-1;
+	return CM_AddPlane( pw, plane );
 }
 
 /*
@@ -515,7 +594,7 @@ int CM_FindPlane2(float plane[4], int *flipped) {
 CM_FindPlane
 ==================
 */
-static int CM_FindPlane( float *p1, float *p2, float *p3 ) {
+static int CM_FindPlane( patchWork_t *pw, float *p1, float *p2, float *p3 ) {
 	float	plane[4];
 	int		i;
 	float	d;
@@ -525,22 +604,22 @@ static int CM_FindPlane( float *p1, float *p2, float *p3 ) {
 	}
 
 	// see if the points are close enough to an existing plane
-	for ( i = 0 ; i < numPlanes ; i++ ) {
-		if ( DotProduct( plane, planes[i].plane ) < 0 ) {
+	for ( i = 0 ; i < pw->numPlanes ; i++ ) {
+		if ( DotProduct( plane, pw->planes[i].plane ) < 0 ) {
 			continue;	// allow backwards planes?
 		}
 
-		d = DotProduct( p1, planes[i].plane ) - planes[i].plane[3];
+		d = DotProduct( p1, pw->planes[i].plane ) - pw->planes[i].plane[3];
 		if ( d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON ) {
 			continue;
 		}
 
-		d = DotProduct( p2, planes[i].plane ) - planes[i].plane[3];
+		d = DotProduct( p2, pw->planes[i].plane ) - pw->planes[i].plane[3];
 		if ( d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON ) {
 			continue;
 		}
 
-		d = DotProduct( p3, planes[i].plane ) - planes[i].plane[3];
+		d = DotProduct( p3, pw->planes[i].plane ) - pw->planes[i].plane[3];
 		if ( d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON ) {
 			continue;
 		}
@@ -550,16 +629,7 @@ static int CM_FindPlane( float *p1, float *p2, float *p3 ) {
 	}
 
 	// add a new plane
-	if ( numPlanes == MAX_PATCH_PLANES ) {
-		Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
-	}
-
-	Vector4Copy( plane, planes[numPlanes].plane );
-	planes[numPlanes].signbits = CM_SignbitsForNormal( plane );
-
-	numPlanes++;
-
-	return numPlanes-1;
+	return CM_AddPlane( pw, plane );
 }
 
 /*
@@ -567,14 +637,14 @@ static int CM_FindPlane( float *p1, float *p2, float *p3 ) {
 CM_PointOnPlaneSide
 ==================
 */
-static int CM_PointOnPlaneSide( float *p, int planeNum ) {
+static int CM_PointOnPlaneSide( patchWork_t *pw, float *p, int planeNum ) {
 	float	*plane;
 	float	d;
 
 	if ( planeNum == -1 ) {
 		return SIDE_ON;
 	}
-	plane = planes[ planeNum ].plane;
+	plane = pw->planes[ planeNum ].plane;
 
 	d = DotProduct( p, plane ) - plane[3];
 
@@ -594,7 +664,7 @@ static int CM_PointOnPlaneSide( float *p, int planeNum ) {
 CM_GridPlane
 ==================
 */
-static int	CM_GridPlane( int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i, int j, int tri ) {
+static int	CM_GridPlane( patchWork_t *pw, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i, int j, int tri ) {
 	int		p;
 
 	p = gridPlanes[i][j][tri];
@@ -607,7 +677,7 @@ static int	CM_GridPlane( int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i,
 	}
 
 	// should never happen
-	Com_Printf( "WARNING: CM_GridPlane unresolvable\n" );
+	CM_PatchPrintf( pw, qfalse, "WARNING: CM_GridPlane unresolvable\n" );
 	return -1;
 }
 
@@ -616,7 +686,7 @@ static int	CM_GridPlane( int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i,
 CM_EdgePlaneNum
 ==================
 */
-static int CM_EdgePlaneNum( cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i, int j, int k ) {
+static int CM_EdgePlaneNum( patchWork_t *pw, cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i, int j, int k ) {
 	float	*p1, *p2;
 	vec3_t		up;
 	int			p;
@@ -625,48 +695,48 @@ static int CM_EdgePlaneNum( cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRI
 	case 0:	// top border
 		p1 = grid->points[i][j];
 		p2 = grid->points[i+1][j];
-		p = CM_GridPlane( gridPlanes, i, j, 0 );
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p1, p2, up );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 0 );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p1, p2, up );
 
 	case 2:	// bottom border
 		p1 = grid->points[i][j+1];
 		p2 = grid->points[i+1][j+1];
-		p = CM_GridPlane( gridPlanes, i, j, 1 );
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p2, p1, up );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 1 );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p2, p1, up );
 
 	case 3: // left border
 		p1 = grid->points[i][j];
 		p2 = grid->points[i][j+1];
-		p = CM_GridPlane( gridPlanes, i, j, 1 );
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p2, p1, up );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 1 );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p2, p1, up );
 
 	case 1:	// right border
 		p1 = grid->points[i+1][j];
 		p2 = grid->points[i+1][j+1];
-		p = CM_GridPlane( gridPlanes, i, j, 0 );
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p1, p2, up );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 0 );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p1, p2, up );
 
 	case 4:	// diagonal out of triangle 0
 		p1 = grid->points[i+1][j+1];
 		p2 = grid->points[i][j];
-		p = CM_GridPlane( gridPlanes, i, j, 0 );
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p1, p2, up );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 0 );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p1, p2, up );
 
 	case 5:	// diagonal out of triangle 1
 		p1 = grid->points[i][j];
 		p2 = grid->points[i+1][j+1];
-		p = CM_GridPlane( gridPlanes, i, j, 1 );
-		VectorMA( p1, 4, planes[ p ].plane, up );
-		return CM_FindPlane( p1, p2, up );
+		p = CM_GridPlane( pw, gridPlanes, i, j, 1 );
+		VectorMA( p1, 4, pw->planes[ p ].plane, up );
+		return CM_FindPlane( pw, p1, p2, up );
 
 	}
 
-	Com_Error( ERR_DROP, "CM_EdgePlaneNum: bad k" );
+	CM_PatchError( pw, "CM_EdgePlaneNum: bad k" );
 	return -1;
 }
 
@@ -675,7 +745,7 @@ static int CM_EdgePlaneNum( cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRI
 CM_SetBorderInward
 ===================
 */
-static void CM_SetBorderInward( facet_t *facet, cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2],
+static void CM_SetBorderInward( patchWork_t *pw, facet_t *facet, cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2],
 						  int i, int j, int which ) {
 	int		k, l;
 	float	*points[4];
@@ -702,7 +772,7 @@ static void CM_SetBorderInward( facet_t *facet, cGrid_t *grid, int gridPlanes[MA
 		numPoints = 3;
 		break;
 	default:
-		Com_Error( ERR_FATAL, "CM_SetBorderInward: bad parameter" );
+		CM_PatchError( pw, "CM_SetBorderInward: bad parameter" );
 		numPoints = 0;
 		break;
 	}
@@ -716,7 +786,7 @@ static void CM_SetBorderInward( facet_t *facet, cGrid_t *grid, int gridPlanes[MA
 		for ( l = 0 ; l < numPoints ; l++ ) {
 			int		side;
 
-			side = CM_PointOnPlaneSide( points[l], facet->borderPlanes[k] );
+			side = CM_PointOnPlaneSide( pw, points[l], facet->borderPlanes[k] );
 			if ( side == SIDE_FRONT ) {
 				front++;
 			} if ( side == SIDE_BACK ) {
@@ -733,14 +803,14 @@ static void CM_SetBorderInward( facet_t *facet, cGrid_t *grid, int gridPlanes[MA
 			facet->borderPlanes[k] = -1;
 		} else {
 			// bisecting side border
-			Com_DPrintf( "WARNING: CM_SetBorderInward: mixed plane sides\n" );
+			CM_PatchPrintf( pw, qtrue, "WARNING: CM_SetBorderInward: mixed plane sides\n" );
 			facet->borderInward[k] = qfalse;
-			if ( !debugBlock ) {
-				debugBlock = qtrue;
+			if ( !debugBlock && CM_AtomicIncrement( &debugBlockClaims ) == 1 ) {
 				VectorCopy( grid->points[i][j], debugBlockPoints[0] );
 				VectorCopy( grid->points[i+1][j], debugBlockPoints[1] );
 				VectorCopy( grid->points[i+1][j+1], debugBlockPoints[2] );
 				VectorCopy( grid->points[i][j+1], debugBlockPoints[3] );
+				debugBlock = qtrue;
 			}
 		}
 	}
@@ -753,7 +823,7 @@ CM_ValidateFacet
 If the facet isn't bounded by its borders, we screwed up.
 ==================
 */
-static qboolean CM_ValidateFacet( facet_t *facet ) {
+static qboolean CM_ValidateFacet( patchWork_t *pw, facet_t *facet ) {
 	float		plane[4];
 	int			j;
 	winding_t	*w;
@@ -763,14 +833,14 @@ static qboolean CM_ValidateFacet( facet_t *facet ) {
 		return qfalse;
 	}
 
-	Vector4Copy( planes[ facet->surfacePlane ].plane, plane );
+	Vector4Copy( pw->planes[ facet->surfacePlane ].plane, plane );
 	w = BaseWindingForPlane( plane,  plane[3] );
 	for ( j = 0 ; j < facet->numBorders && w ; j++ ) {
 		if ( facet->borderPlanes[j] == -1 ) {
 			FreeWinding( w );
 			return qfalse;
 		}
-		Vector4Copy( planes[ facet->borderPlanes[j] ].plane, plane );
+		Vector4Copy( pw->planes[ facet->borderPlanes[j] ].plane, plane );
 		if ( !facet->borderInward[j] ) {
 			VectorSubtract( vec3_origin, plane, plane );
 			plane[3] = -plane[3];
@@ -805,7 +875,7 @@ static qboolean CM_ValidateFacet( facet_t *facet ) {
 CM_AddFacetBevels
 ==================
 */
-void CM_AddFacetBevels( facet_t *facet ) {
+void CM_AddFacetBevels( patchWork_t *pw, facet_t *facet ) {
 
 	int i, j, k, l;
 	int axis, dir, order, flipped;
@@ -813,12 +883,16 @@ void CM_AddFacetBevels( facet_t *facet ) {
 	winding_t *w, *w2;
 	vec3_t mins, maxs, vec, vec2;
 
-	Vector4Copy( planes[ facet->surfacePlane ].plane, plane );
+	// facets without a winding can't be bounded tighter than the patch
+	VectorSet( facet->bounds[0], -MAX_MAP_BOUNDS, -MAX_MAP_BOUNDS, -MAX_MAP_BOUNDS );
+	VectorSet( facet->bounds[1], MAX_MAP_BOUNDS, MAX_MAP_BOUNDS, MAX_MAP_BOUNDS );
+
+	Vector4Copy( pw->planes[ facet->surfacePlane ].plane, plane );
 
 	w = BaseWindingForPlane( plane,  plane[3] );
 	for ( j = 0 ; j < facet->numBorders && w ; j++ ) {
 		if (facet->borderPlanes[j] == facet->surfacePlane) continue;
-		Vector4Copy( planes[ facet->borderPlanes[j] ].plane, plane );
+		Vector4Copy( pw->planes[ facet->borderPlanes[j] ].plane, plane );
 
 		if ( !facet->borderInward[j] ) {
 			VectorSubtract( vec3_origin, plane, plane );
@@ -833,6 +907,13 @@ void CM_AddFacetBevels( facet_t *facet ) {
 
 	WindingBounds(w, mins, maxs);
 
+	// the axial bevels keep collisions inside the winding bounds,
+	// with a unit of slack for the plane epsilons like the patch bounds
+	for ( axis = 0 ; axis < 3 ; axis++ ) {
+		facet->bounds[0][axis] = mins[axis] - 1;
+		facet->bounds[1][axis] = maxs[axis] + 1;
+	}
+
 	// add the axial planes
 	order = 0;
 	for ( axis = 0 ; axis < 3 ; axis++ )
@@ -848,18 +929,23 @@ void CM_AddFacetBevels( facet_t *facet ) {
 				plane[3] = -mins[axis];
 			}
 			//if it's the surface plane
-			if (CM_PlaneEqual(&planes[facet->surfacePlane], plane, &flipped)) {
+			if (CM_PlaneEqual(&pw->planes[facet->surfacePlane], plane, &flipped)) {
+#ifdef BSPC
+				// no opposite plane closes the back side
+				facet->bounds[0][axis] = -MAX_MAP_BOUNDS;
+				facet->bounds[1][axis] = MAX_MAP_BOUNDS;
+#endif
 				continue;
 			}
 			// see if the plane is allready present
 			for ( i = 0 ; i < facet->numBorders ; i++ ) {
-				if (CM_PlaneEqual(&planes[facet->borderPlanes[i]], plane, &flipped))
+				if (CM_PlaneEqual(&pw->planes[facet->borderPlanes[i]], plane, &flipped))
 					break;
 			}
 
 			if ( i == facet->numBorders ) {
-				if (facet->numBorders > 4 + 6 + 16) Com_Printf("ERROR: too many bevels\n");
-				facet->borderPlanes[facet->numBorders] = CM_FindPlane2(plane, &flipped);
+				if (facet->numBorders > 4 + 6 + 16) CM_PatchPrintf( pw, qfalse, "ERROR: too many bevels\n");
+				facet->borderPlanes[facet->numBorders] = CM_FindPlane2(pw, plane, &flipped);
 				facet->borderNoAdjust[facet->numBorders] = 0;
 				facet->borderInward[facet->numBorders] = flipped;
 				facet->numBorders++;
@@ -909,30 +995,30 @@ void CM_AddFacetBevels( facet_t *facet ) {
 					continue;
 
 				//if it's the surface plane
-				if (CM_PlaneEqual(&planes[facet->surfacePlane], plane, &flipped)) {
+				if (CM_PlaneEqual(&pw->planes[facet->surfacePlane], plane, &flipped)) {
 					continue;
 				}
 				// see if the plane is allready present
 				for ( i = 0 ; i < facet->numBorders ; i++ ) {
-					if (CM_PlaneEqual(&planes[facet->borderPlanes[i]], plane, &flipped)) {
+					if (CM_PlaneEqual(&pw->planes[facet->borderPlanes[i]], plane, &flipped)) {
 							break;
 					}
 				}
 
 				if ( i == facet->numBorders ) {
-					if (facet->numBorders > 4 + 6 + 16) Com_Printf("ERROR: too many bevels\n");
-					facet->borderPlanes[facet->numBorders] = CM_FindPlane2(plane, &flipped);
+					if (facet->numBorders > 4 + 6 + 16) CM_PatchPrintf( pw, qfalse, "ERROR: too many bevels\n");
+					facet->borderPlanes[facet->numBorders] = CM_FindPlane2(pw, plane, &flipped);
 
 					for ( k = 0 ; k < facet->numBorders ; k++ ) {
 						if (facet->borderPlanes[facet->numBorders] ==
-							facet->borderPlanes[k]) Com_Printf("WARNING: bevel plane already used\n");
+							facet->borderPlanes[k]) CM_PatchPrintf( pw, qfalse, "WARNING: bevel plane already used\n");
 					}
 
 					facet->borderNoAdjust[facet->numBorders] = 0;
 					facet->borderInward[facet->numBorders] = flipped;
 					//
 					w2 = CopyWinding(w);
-					Vector4Copy(planes[facet->borderPlanes[facet->numBorders]].plane, newplane);
+					Vector4Copy(pw->planes[facet->borderPlanes[facet->numBorders]].plane, newplane);
 					if (!facet->borderInward[facet->numBorders])
 					{
 						VectorNegate(newplane, newplane);
@@ -940,7 +1026,7 @@ void CM_AddFacetBevels( facet_t *facet ) {
 					} //end if
 					ChopWindingInPlace( &w2, newplane, newplane[3], 0.1f );
 					if (!w2) {
-						Com_DPrintf("WARNING: CM_AddFacetBevels... invalid bevel\n");
+						CM_PatchPrintf( pw, qtrue, "WARNING: CM_AddFacetBevels... invalid bevel\n");
 						continue;
 					}
 					else {
@@ -973,21 +1059,201 @@ typedef enum {
 	EN_LEFT
 } edgeName_t;
 
+/*
+================================================================================
+
+FACET TREE
+
+================================================================================
+*/
+
+
+/*
+==================
+CM_BuildPatchTree_r
+
+Splits the facets in the middle of the longest axis of their centers
+until no more than PATCH_LEAF_FACETS are left in a node
+==================
+*/
+static int CM_BuildPatchTree_r( patchWork_t *pw, int first, int count ) {
+	patchNode_t	*node;
+	const facet_t	*facet;
+	vec3_t		mins, maxs;
+	float		mid, size;
+	int			i, j, axis, nodenum, temp;
+
+	nodenum = pw->numNodes++;
+	node = &pw->nodes[nodenum];
+
+	ClearBounds( node->bounds[0], node->bounds[1] );
+	ClearBounds( mins, maxs );
+	for ( i = first ; i < first + count ; i++ ) {
+		facet = &pw->facets[ pw->nodeFacets[i] ];
+		AddPointToBounds( facet->bounds[0], node->bounds[0], node->bounds[1] );
+		AddPointToBounds( facet->bounds[1], node->bounds[0], node->bounds[1] );
+		for ( j = 0 ; j < 3 ; j++ ) {
+			mid = ( facet->bounds[0][j] + facet->bounds[1][j] ) * 0.5f;
+			if ( mid < mins[j] ) {
+				mins[j] = mid;
+			}
+			if ( mid > maxs[j] ) {
+				maxs[j] = mid;
+			}
+		}
+	}
+
+	if ( count <= PATCH_LEAF_FACETS ) {
+		node->children[0] = node->children[1] = 0;
+		node->firstFacet = first;
+		node->numFacets = count;
+		return nodenum;
+	}
+
+	axis = 0;
+	size = 0;
+	for ( j = 0 ; j < 3 ; j++ ) {
+		if ( maxs[j] - mins[j] > size ) {
+			size = maxs[j] - mins[j];
+			axis = j;
+		}
+	}
+
+	// partition around the middle, or just in half if they all fall on one side
+	mid = ( mins[axis] + maxs[axis] ) * 0.5f;
+	j = first;
+	for ( i = first ; i < first + count ; i++ ) {
+		facet = &pw->facets[ pw->nodeFacets[i] ];
+		if ( facet->bounds[0][axis] + facet->bounds[1][axis] < mid * 2 ) {
+			temp = pw->nodeFacets[i];
+			pw->nodeFacets[i] = pw->nodeFacets[j];
+			pw->nodeFacets[j] = temp;
+			j++;
+		}
+	}
+	if ( j == first || j == first + count ) {
+		j = first + count / 2;
+	}
+
+	node->firstFacet = 0;
+	node->numFacets = 0;
+	node->children[0] = CM_BuildPatchTree_r( pw, first, j - first );
+	node->children[1] = CM_BuildPatchTree_r( pw, j, first + count - j );
+	return nodenum;
+}
+
+/*
+==================
+CM_BuildPatchTree
+
+Builds a bounding volume tree over the facets so traces only
+test the facets near them
+==================
+*/
+static void CM_BuildPatchTree( patchWork_t *pw ) {
+	int		i;
+
+	pw->numNodes = 0;
+	if ( !pw->numFacets ) {
+		return;
+	}
+
+	for ( i = 0 ; i < pw->numFacets ; i++ ) {
+		pw->nodeFacets[i] = i;
+	}
+	CM_BuildPatchTree_r( pw, 0, pw->numFacets );
+}
+
+/*
+==================
+CM_PatchFacetsInBounds_r
+==================
+*/
+static void CM_PatchFacetsInBounds_r( const patchCollide_t *pc, int nodenum,
+	const vec3_t mins, const vec3_t maxs, unsigned int *facetBits ) {
+	const patchNode_t	*node;
+	const facet_t	*facet;
+	int			i, facetnum;
+
+	while ( 1 ) {
+		node = &pc->nodes[nodenum];
+		if ( !CM_BoundsIntersect( mins, maxs, node->bounds[0], node->bounds[1] ) ) {
+			return;
+		}
+		if ( node->numFacets ) {
+			break;
+		}
+		CM_PatchFacetsInBounds_r( pc, node->children[0], mins, maxs, facetBits );
+		nodenum = node->children[1];
+	}
+
+	for ( i = 0 ; i < node->numFacets ; i++ ) {
+		facetnum = pc->nodeFacets[ node->firstFacet + i ];
+		facet = &pc->facets[facetnum];
+		if ( CM_BoundsIntersect( mins, maxs, facet->bounds[0], facet->bounds[1] ) ) {
+			facetBits[ facetnum >> 5 ] |= 1u << ( facetnum & 31 );
+		}
+	}
+}
+
+/*
+==================
+CM_PatchFacetsInBounds
+
+Sets a bit for every facet that can collide with something inside mins/maxs,
+returns qfalse if there are none.  The caller tests them in facet order,
+so ties between facets resolve the same as testing all of them.
+==================
+*/
+static qboolean CM_PatchFacetsInBounds( const patchCollide_t *pc,
+	const vec3_t mins, const vec3_t maxs, unsigned int *facetBits ) {
+	int		i;
+
+#ifndef BSPC
+	if ( !cm_patchTree->integer ) {
+		for ( i = 0 ; i < pc->numFacets ; i++ ) {
+			facetBits[ i >> 5 ] |= 1u << ( i & 31 );
+		}
+		return pc->numFacets > 0;
+	}
+#endif
+
+	if ( !pc->numNodes ) {
+		return qfalse;
+	}
+
+	Com_Memset( facetBits, 0, ( ( pc->numFacets + 31 ) >> 5 ) * sizeof( *facetBits ) );
+	CM_PatchFacetsInBounds_r( pc, 0, mins, maxs, facetBits );
+
+	for ( i = 0 ; i < ( pc->numFacets + 31 ) >> 5 ; i++ ) {
+		if ( facetBits[i] ) {
+			return qtrue;
+		}
+	}
+	return qfalse;
+}
+
+#define	FACET_IN_BITS(bits, i)	( (bits)[ (i) >> 5 ] & ( 1u << ( (i) & 31 ) ) )
+
 /*
 ==================
 CM_PatchCollideFromGrid
 ==================
 */
-static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
+static void CM_PatchCollideFromGrid( patchWork_t *pw, cGrid_t *grid ) {
 	int				i, j;
 	float			*p1, *p2, *p3;
-	int				gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2];
+	int				(*gridPlanes)[MAX_GRID_SIZE][2];
 	facet_t			*facet;
 	int				borders[4];
 	int				noAdjust[4];
 
-	numPlanes = 0;
-	numFacets = 0;
+	gridPlanes = pw->gridPlanes;
+	pw->numPlanes = 0;
+	pw->numFacets = 0;
+	for ( i = 0 ; i < PLANE_HASHES ; i++ ) {
+		pw->planeHash[i] = -1;
+	}
 
 	// find the planes for each triangle of the grid
 	for ( i = 0 ; i < grid->width - 1 ; i++ ) {
@@ -995,12 +1261,12 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 			p1 = grid->points[i][j];
 			p2 = grid->points[i+1][j];
 			p3 = grid->points[i+1][j+1];
-			gridPlanes[i][j][0] = CM_FindPlane( p1, p2, p3 );
+			gridPlanes[i][j][0] = CM_FindPlane( pw, p1, p2, p3 );
 
 			p1 = grid->points[i+1][j+1];
 			p2 = grid->points[i][j+1];
 			p3 = grid->points[i][j];
-			gridPlanes[i][j][1] = CM_FindPlane( p1, p2, p3 );
+			gridPlanes[i][j][1] = CM_FindPlane( pw, p1, p2, p3 );
 		}
 	}
 
@@ -1016,7 +1282,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 			} 
 			noAdjust[EN_TOP] = ( borders[EN_TOP] == gridPlanes[i][j][0] );
 			if ( borders[EN_TOP] == -1 || noAdjust[EN_TOP] ) {
-				borders[EN_TOP] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 0 );
+				borders[EN_TOP] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 0 );
 			}
 
 			borders[EN_BOTTOM] = -1;
@@ -1027,7 +1293,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 			}
 			noAdjust[EN_BOTTOM] = ( borders[EN_BOTTOM] == gridPlanes[i][j][1] );
 			if ( borders[EN_BOTTOM] == -1 || noAdjust[EN_BOTTOM] ) {
-				borders[EN_BOTTOM] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 2 );
+				borders[EN_BOTTOM] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 2 );
 			}
 
 			borders[EN_LEFT] = -1;
@@ -1038,7 +1304,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 			}
 			noAdjust[EN_LEFT] = ( borders[EN_LEFT] == gridPlanes[i][j][1] );
 			if ( borders[EN_LEFT] == -1 || noAdjust[EN_LEFT] ) {
-				borders[EN_LEFT] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 3 );
+				borders[EN_LEFT] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 3 );
 			}
 
 			borders[EN_RIGHT] = -1;
@@ -1049,13 +1315,13 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 			}
 			noAdjust[EN_RIGHT] = ( borders[EN_RIGHT] == gridPlanes[i][j][0] );
 			if ( borders[EN_RIGHT] == -1 || noAdjust[EN_RIGHT] ) {
-				borders[EN_RIGHT] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 1 );
+				borders[EN_RIGHT] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 1 );
 			}
 
-			if ( numFacets == MAX_FACETS ) {
-				Com_Error( ERR_DROP, "MAX_FACETS" );
+			if ( pw->numFacets == MAX_FACETS ) {
+				CM_PatchError( pw, "MAX_FACETS" );
 			}
-			facet = &facets[numFacets];
+			facet = &pw->facets[pw->numFacets];
 			Com_Memset( facet, 0, sizeof( *facet ) );
 
 			if ( gridPlanes[i][j][0] == gridPlanes[i][j][1] ) {
@@ -1072,10 +1338,10 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 				facet->borderNoAdjust[2] = noAdjust[EN_BOTTOM];
 				facet->borderPlanes[3] = borders[EN_LEFT];
 				facet->borderNoAdjust[3] = noAdjust[EN_LEFT];
-				CM_SetBorderInward( facet, grid, gridPlanes, i, j, -1 );
-				if ( CM_ValidateFacet( facet ) ) {
-					CM_AddFacetBevels( facet );
-					numFacets++;
+				CM_SetBorderInward( pw, facet, grid, gridPlanes, i, j, -1 );
+				if ( CM_ValidateFacet( pw, facet ) ) {
+					CM_AddFacetBevels( pw, facet );
+					pw->numFacets++;
 				}
 			} else {
 				// two seperate triangles
@@ -1089,19 +1355,19 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 				if ( facet->borderPlanes[2] == -1 ) {
 					facet->borderPlanes[2] = borders[EN_BOTTOM];
 					if ( facet->borderPlanes[2] == -1 ) {
-						facet->borderPlanes[2] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 4 );
+						facet->borderPlanes[2] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 4 );
 					}
 				}
- 				CM_SetBorderInward( facet, grid, gridPlanes, i, j, 0 );
-				if ( CM_ValidateFacet( facet ) ) {
-					CM_AddFacetBevels( facet );
-					numFacets++;
+ 				CM_SetBorderInward( pw, facet, grid, gridPlanes, i, j, 0 );
+				if ( CM_ValidateFacet( pw, facet ) ) {
+					CM_AddFacetBevels( pw, facet );
+					pw->numFacets++;
 				}
 
-				if ( numFacets == MAX_FACETS ) {
-					Com_Error( ERR_DROP, "MAX_FACETS" );
+				if ( pw->numFacets == MAX_FACETS ) {
+					CM_PatchError( pw, "MAX_FACETS" );
 				}
-				facet = &facets[numFacets];
+				facet = &pw->facets[pw->numFacets];
 				Com_Memset( facet, 0, sizeof( *facet ) );
 
 				facet->surfacePlane = gridPlanes[i][j][1];
@@ -1114,106 +1380,263 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 				if ( facet->borderPlanes[2] == -1 ) {
 					facet->borderPlanes[2] = borders[EN_TOP];
 					if ( facet->borderPlanes[2] == -1 ) {
-						facet->borderPlanes[2] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 5 );
+						facet->borderPlanes[2] = CM_EdgePlaneNum( pw, grid, gridPlanes, i, j, 5 );
 					}
 				}
-				CM_SetBorderInward( facet, grid, gridPlanes, i, j, 1 );
-				if ( CM_ValidateFacet( facet ) ) {
-					CM_AddFacetBevels( facet );
-					numFacets++;
+				CM_SetBorderInward( pw, facet, grid, gridPlanes, i, j, 1 );
+				if ( CM_ValidateFacet( pw, facet ) ) {
+					CM_AddFacetBevels( pw, facet );
+					pw->numFacets++;
 				}
 			}
 		}
 	}
+}
 
-	// copy the results out
-	pf->numPlanes = numPlanes;
-	pf->numFacets = numFacets;
-	pf->facets = Hunk_Alloc( numFacets * sizeof( *pf->facets ), h_high );
-	Com_Memcpy( pf->facets, facets, numFacets * sizeof( *pf->facets ) );
-	pf->planes = Hunk_Alloc( numPlanes * sizeof( *pf->planes ), h_high );
-	Com_Memcpy( pf->planes, planes, numPlanes * sizeof( *pf->planes ) );
+
+/*
+===================
+CM_AllocPatchWork
+===================
+*/
+patchWork_t *CM_AllocPatchWork( void ) {
+	patchWork_t	*pw;
+
+	// too big for the stack of a thread, and the zone isn't thread safe
+	pw = malloc( sizeof( *pw ) );
+	if ( !pw ) {
+		Com_Error( ERR_FATAL, "CM_AllocPatchWork: couldn't allocate %i bytes", (int)sizeof( *pw ) );
+	}
+	return pw;
+}
+
+/*
+===================
+CM_FreePatchWork
+===================
+*/
+void CM_FreePatchWork( patchWork_t *pw ) {
+	free( pw );
 }
 
+/*
+===================
+CM_PatchBlockSize
+
+A patch collide is kept in one block: the patchCollide_t,
+then its planes, facets, nodes and nodeFacets
+===================
+*/
+int CM_PatchBlockSize( const patchCollide_t *pc ) {
+	return sizeof( *pc ) + pc->numPlanes * sizeof( *pc->planes )
+		+ pc->numFacets * sizeof( *pc->facets ) + pc->numNodes * sizeof( *pc->nodes )
+		+ pc->numFacets * sizeof( *pc->nodeFacets );
+}
+
+/*
+===================
+CM_SetPatchBlockPointers
+===================
+*/
+static void CM_SetPatchBlockPointers( patchCollide_t *pc ) {
+	pc->planes = (patchPlane_t *)( pc + 1 );
+	pc->facets = (facet_t *)( pc->planes + pc->numPlanes );
+	pc->nodes = (patchNode_t *)( pc->facets + pc->numFacets );
+	pc->nodeFacets = (int *)( pc->nodes + pc->numNodes );
+}
 
 /*
 ===================
-CM_GeneratePatchCollide
+CM_GeneratePatchBlock
 
 Creates an internal structure that will be used to perform
 collision detection with a patch mesh.
 
 Points is packed as concatenated rows.
+
+Can run on any thread, with a patchWork_t of its own.  Returns a block
+that has to be freed with free(), see CM_HunkPatchBlock, or NULL with
+pw->error set if the patch is bad.  Warnings are left in pw->messages.
 ===================
 */
-struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points ) {
+patchCollide_t *CM_GeneratePatchBlock( patchWork_t *pw, int width, int height, vec3_t *points ) {
 	patchCollide_t	*pf;
-	cGrid_t			grid;
-	int				i, j;
+	cGrid_t			*grid;
+	vec3_t			bounds[2];
+	int				i, j, size;
+
+	pw->error[0] = 0;
+	pw->messages[0] = 0;
+	if ( setjmp( pw->abort ) ) {
+		// release the windings the aborted step was still holding
+		FreeActiveWindings();
+		SetWindingErrorHandler( NULL, NULL );
+		return NULL;
+	}
+	SetWindingErrorHandler( CM_PatchWindingError, pw );
 
 	if ( width <= 2 || height <= 2 || !points ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: bad parameters: (%i, %i, %p)",
+		CM_PatchError( pw, "CM_GeneratePatchFacets: bad parameters: (%i, %i, %p)",
 			width, height, (void *)points );
 	}
 
 	if ( !(width & 1) || !(height & 1) ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: even sizes are invalid for quadratic meshes" );
+		CM_PatchError( pw, "CM_GeneratePatchFacets: even sizes are invalid for quadratic meshes" );
 	}
 
 	if ( width > MAX_GRID_SIZE || height > MAX_GRID_SIZE ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: source is > MAX_GRID_SIZE" );
+		CM_PatchError( pw, "CM_GeneratePatchFacets: source is > MAX_GRID_SIZE" );
 	}
 
 	// build a grid
-	grid.width = width;
-	grid.height = height;
-	grid.wrapWidth = qfalse;
-	grid.wrapHeight = qfalse;
+	grid = &pw->grid;
+	grid->width = width;
+	grid->height = height;
+	grid->wrapWidth = qfalse;
+	grid->wrapHeight = qfalse;
 	for ( i = 0 ; i < width ; i++ ) {
 		for ( j = 0 ; j < height ; j++ ) {
-			VectorCopy( points[j*width + i], grid.points[i][j] );
+			VectorCopy( points[j*width + i], grid->points[i][j] );
 		}
 	}
 
 	// subdivide the grid
-	CM_SetGridWrapWidth( &grid );
-	CM_SubdivideGridColumns( &grid );
-	CM_RemoveDegenerateColumns( &grid );
+	CM_SetGridWrapWidth( grid );
+	CM_SubdivideGridColumns( grid );
+	CM_RemoveDegenerateColumns( grid );
 
-	CM_TransposeGrid( &grid );
+	CM_TransposeGrid( grid );
 
-	CM_SetGridWrapWidth( &grid );
-	CM_SubdivideGridColumns( &grid );
-	CM_RemoveDegenerateColumns( &grid );
+	CM_SetGridWrapWidth( grid );
+	CM_SubdivideGridColumns( grid );
+	CM_RemoveDegenerateColumns( grid );
 
 	// we now have a grid of points exactly on the curve
 	// the aproximate surface defined by these points will be
 	// collided against
-	pf = Hunk_Alloc( sizeof( *pf ), h_high );
-	ClearBounds( pf->bounds[0], pf->bounds[1] );
-	for ( i = 0 ; i < grid.width ; i++ ) {
-		for ( j = 0 ; j < grid.height ; j++ ) {
-			AddPointToBounds( grid.points[i][j], pf->bounds[0], pf->bounds[1] );
+	ClearBounds( bounds[0], bounds[1] );
+	for ( i = 0 ; i < grid->width ; i++ ) {
+		for ( j = 0 ; j < grid->height ; j++ ) {
+			AddPointToBounds( grid->points[i][j], bounds[0], bounds[1] );
 		}
 	}
 
-	c_totalPatchBlocks += ( grid.width - 1 ) * ( grid.height - 1 );
+	CM_AtomicAdd( &c_totalPatchBlocks, ( grid->width - 1 ) * ( grid->height - 1 ) );
 
 	// generate a bsp tree for the surface
-	CM_PatchCollideFromGrid( &grid, pf );
+	CM_PatchCollideFromGrid( pw, grid );
+	CM_BuildPatchTree( pw );
+
+	// copy the results out
+	size = sizeof( *pf ) + pw->numPlanes * sizeof( *pf->planes )
+		+ pw->numFacets * ( sizeof( *pf->facets ) + sizeof( *pf->nodeFacets ) )
+		+ pw->numNodes * sizeof( *pf->nodes );
+	pf = malloc( size );
+	if ( !pf ) {
+		CM_PatchError( pw, "CM_GeneratePatchBlock: couldn't allocate %i bytes", size );
+	}
+	Com_Memset( pf, 0, sizeof( *pf ) );
+	pf->numPlanes = pw->numPlanes;
+	pf->numFacets = pw->numFacets;
+	pf->numNodes = pw->numNodes;
+	CM_SetPatchBlockPointers( pf );
+	Com_Memcpy( pf->planes, pw->planes, pw->numPlanes * sizeof( *pf->planes ) );
+	Com_Memcpy( pf->facets, pw->facets, pw->numFacets * sizeof( *pf->facets ) );
+	Com_Memcpy( pf->nodes, pw->nodes, pw->numNodes * sizeof( *pf->nodes ) );
+	Com_Memcpy( pf->nodeFacets, pw->nodeFacets, pw->numFacets * sizeof( *pf->nodeFacets ) );
 
 	// expand by one unit for epsilon purposes
-	pf->bounds[0][0] -= 1;
-	pf->bounds[0][1] -= 1;
-	pf->bounds[0][2] -= 1;
+	pf->bounds[0][0] = bounds[0][0] - 1;
+	pf->bounds[0][1] = bounds[0][1] - 1;
+	pf->bounds[0][2] = bounds[0][2] - 1;
 
-	pf->bounds[1][0] += 1;
-	pf->bounds[1][1] += 1;
-	pf->bounds[1][2] += 1;
+	pf->bounds[1][0] = bounds[1][0] + 1;
+	pf->bounds[1][1] = bounds[1][1] + 1;
+	pf->bounds[1][2] = bounds[1][2] + 1;
 
+	SetWindingErrorHandler( NULL, NULL );
 	return pf;
 }
 
+/*
+===================
+CM_ValidatePatchBlock
+
+Checks a block read back from a file can't index out of itself
+===================
+*/
+qboolean CM_ValidatePatchBlock( const patchCollide_t *pc, int size ) {
+	const facet_t		*facet;
+	const patchNode_t	*node;
+	const int			*nodeFacets;
+	int					i, j;
+
+	if ( size < (int)sizeof( *pc ) ) {
+		return qfalse;
+	}
+	if ( pc->numPlanes < 0 || pc->numPlanes > MAX_PATCH_PLANES
+		|| pc->numFacets < 0 || pc->numFacets > MAX_FACETS
+		|| pc->numNodes < 0 || pc->numNodes > MAX_FACETS * 2
+		|| ( pc->numFacets && !pc->numNodes ) ) {
+		return qfalse;
+	}
+	if ( size != CM_PatchBlockSize( pc ) ) {
+		return qfalse;
+	}
+
+	// the pointers in it are garbage until CM_HunkPatchBlock
+	facet = (const facet_t *)( (const patchPlane_t *)( pc + 1 ) + pc->numPlanes );
+	node = (const patchNode_t *)( facet + pc->numFacets );
+	nodeFacets = (const int *)( node + pc->numNodes );
+
+	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
+		if ( facet->surfacePlane < 0 || facet->surfacePlane >= pc->numPlanes
+			|| facet->numBorders < 0 || facet->numBorders > ARRAY_LEN( facet->borderPlanes ) ) {
+			return qfalse;
+		}
+		for ( j = 0 ; j < facet->numBorders ; j++ ) {
+			if ( facet->borderPlanes[j] < 0 || facet->borderPlanes[j] >= pc->numPlanes ) {
+				return qfalse;
+			}
+		}
+	}
+	for ( i = 0 ; i < pc->numNodes ; i++, node++ ) {
+		if ( node->numFacets ) {
+			if ( node->numFacets < 0 || node->firstFacet < 0
+				|| node->firstFacet + node->numFacets > pc->numFacets ) {
+				return qfalse;
+			}
+		} else if ( node->children[0] <= i || node->children[0] >= pc->numNodes
+			|| node->children[1] <= i || node->children[1] >= pc->numNodes ) {
+			return qfalse;
+		}
+	}
+	for ( i = 0 ; i < pc->numFacets ; i++ ) {
+		if ( nodeFacets[i] < 0 || nodeFacets[i] >= pc->numFacets ) {
+			return qfalse;
+		}
+	}
+	return qtrue;
+}
+
+/*
+===================
+CM_HunkPatchBlock
+
+Copies a block from CM_GeneratePatchBlock or a file onto the hunk
+===================
+*/
+patchCollide_t *CM_HunkPatchBlock( const patchCollide_t *block ) {
+	patchCollide_t	*pc;
+	int				size;
+
+	size = CM_PatchBlockSize( block );
+	pc = Hunk_Alloc( size, h_high );
+	Com_Memcpy( pc, block, size );
+	CM_SetPatchBlockPointers( pc );
+	return pc;
+}
+
 /*
 ================================================================================
 
@@ -1238,9 +1661,8 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 	int			i, j, k;
 	float		offset;
 	float		d1, d2;
-#ifndef BSPC
-	static cvar_t *cv;
-#endif //BSPC
+	unsigned int	facetBits[MAX_FACETS / 32];
+	byte		planeUsed[MAX_PATCH_PLANES];
 
 #ifndef BSPC
 	if ( !cm_playerCurveClip->integer || !tw->isPoint ) {
@@ -1248,9 +1670,28 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 	}
 #endif
 
-	// determine the trace's relationship to all planes
+	if ( !CM_PatchFacetsInBounds( pc, tw->bounds[0], tw->bounds[1], facetBits ) ) {
+		return;
+	}
+
+	// only the planes of the facets near the trace are needed
+	Com_Memset( planeUsed, 0, pc->numPlanes );
+	facet = pc->facets;
+	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
+		if ( FACET_IN_BITS( facetBits, i ) ) {
+			planeUsed[facet->surfacePlane] = qtrue;
+			for ( j = 0 ; j < facet->numBorders ; j++ ) {
+				planeUsed[facet->borderPlanes[j]] = qtrue;
+			}
+		}
+	}
+
+	// determine the trace's relationship to those planes
 	planes = pc->planes;
 	for ( i = 0 ; i < pc->numPlanes ; i++, planes++ ) {
+		if ( !planeUsed[i] ) {
+			continue;
+		}
 		offset = DotProduct( tw->offsets[ planes->signbits ], planes->plane );
 		d1 = DotProduct( tw->start, planes->plane ) - planes->plane[3] + offset;
 		d2 = DotProduct( tw->end, planes->plane ) - planes->plane[3] + offset;
@@ -1273,6 +1714,9 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 	// see if any of the surface planes are intersected
 	facet = pc->facets;
 	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
+		if ( !FACET_IN_BITS( facetBits, i ) ) {
+			continue;
+		}
 		if ( !frontFacing[facet->surfacePlane] ) {
 			continue;
 		}
@@ -1298,10 +1742,7 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 		if ( j == facet->numBorders ) {
 			// we hit this facet
 #ifndef BSPC
-			if (!cv) {
-				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-			}
-			if (cv->integer) {
+			if (cm_debugSurfaceUpdate->integer) {
 				debugPatchCollide = pc;
 				debugFacet = facet;
 			}
@@ -1382,9 +1823,7 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 	facet_t	*facet;
 	float plane[4] = {0, 0, 0, 0}, bestplane[4] = {0, 0, 0, 0};
 	vec3_t startp, endp;
-#ifndef BSPC
-	static cvar_t *cv;
-#endif //BSPC
+	unsigned int facetBits[MAX_FACETS / 32];
 
 	if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
 				pc->bounds[0], pc->bounds[1] ) ) {
@@ -1396,8 +1835,15 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 		return;
 	}
 
+	if ( !CM_PatchFacetsInBounds( pc, tw->bounds[0], tw->bounds[1], facetBits ) ) {
+		return;
+	}
+
 	facet = pc->facets;
 	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
+		if ( !FACET_IN_BITS( facetBits, i ) ) {
+			continue;
+		}
 		enterFrac = -1.0;
 		leaveFrac = 1.0;
 		hitnum = -1;
@@ -1485,10 +1931,7 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 					enterFrac = 0;
 				}
 #ifndef BSPC
-				if (!cv) {
-					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-				}
-				if (cv && cv->integer) {
+				if (cm_debugSurfaceUpdate->integer) {
 					debugPatchCollide = pc;
 					debugFacet = facet;
 				}
@@ -1523,13 +1966,20 @@ qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchColli
 	facet_t	*facet;
 	float plane[4];
 	vec3_t startp;
+	unsigned int facetBits[MAX_FACETS / 32];
 
 	if (tw->isPoint) {
 		return qfalse;
 	}
+	if ( !CM_PatchFacetsInBounds( pc, tw->bounds[0], tw->bounds[1], facetBits ) ) {
+		return qfalse;
+	}
 	//
 	facet = pc->facets;
 	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
+		if ( !FACET_IN_BITS( facetBits, i ) ) {
+			continue;
+		}
 		planes = &pc->planes[ facet->surfacePlane ];
 		VectorCopy(planes->plane, plane);
 		plane[3] = planes->plane[3];
@@ -20,6 +20,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#include <setjmp.h>
+
 //#define	CULL_BBOX
 
 /*
@@ -27,7 +29,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 This file does not reference any globals, and has these entry points:
 
 void CM_ClearLevelPatches( void );
-struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, const vec3_t *points );
+patchCollide_t *CM_GeneratePatchBlock( patchWork_t *pw, int width, int height, vec3_t *points );
+patchCollide_t *CM_HunkPatchBlock( const patchCollide_t *block );
 void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 void CM_DrawDebugSurface( void (*drawPoly)(int color, int numPoints, flaot *points) );
@@ -74,14 +77,28 @@ typedef struct {
 	int			borderPlanes[4+6+16];
 	int			borderInward[4+6+16];
 	qboolean	borderNoAdjust[4+6+16];
+	vec3_t		bounds[2];		// of the bevelled facet, see CM_AddFacetBevels
 } facet_t;
 
+#define	PATCH_LEAF_FACETS	4
+
+// a node of the bounding volume tree over the facets, see CM_BuildPatchTree
+typedef struct {
+	vec3_t	bounds[2];
+	int		children[2];		// node numbers, unused for leafs
+	int		firstFacet;			// leafs: into patchCollide_t->nodeFacets
+	int		numFacets;			// 0 for inner nodes
+} patchNode_t;
+
 typedef struct patchCollide_s {
 	vec3_t	bounds[2];
 	int		numPlanes;			// surface planes plus edge planes
 	patchPlane_t	*planes;
 	int		numFacets;
 	facet_t	*facets;
+	int		numNodes;			// node 0 is the root
+	patchNode_t	*nodes;
+	int		*nodeFacets;		// facet numbers in leaf order
 } patchCollide_t;
 
 
@@ -99,5 +116,36 @@ typedef struct {
 #define	PLANE_TRI_EPSILON	0.1
 #define	WRAP_POINT_EPSILON	0.1
 
+// planes are hashed by whole units of their absolute distance
+#define	PLANE_HASHES		1024
+
+// everything a patch collide is generated in, one per thread
+typedef struct patchWork_s {
+	cGrid_t			grid;
+	int				gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2];
+
+	int				numPlanes;
+	patchPlane_t	planes[MAX_PATCH_PLANES];
+	int				planeHash[PLANE_HASHES];	// first plane of each bucket, -1 for none
+	int				planeChain[MAX_PATCH_PLANES];	// next plane in the same bucket
+
+	int				numFacets;
+	facet_t			facets[MAX_FACETS];
+
+	int				numNodes;
+	patchNode_t		nodes[MAX_FACETS * 2];
+	int				nodeFacets[MAX_FACETS];
+
+	// generation can't Com_Error or Com_Printf off the main thread
+	jmp_buf			abort;
+	char			error[MAX_STRING_CHARS];
+	char			messages[MAX_STRING_CHARS];
+} patchWork_t;
+
 
-struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points );
+patchWork_t *CM_AllocPatchWork( void );
+void CM_FreePatchWork( patchWork_t *pw );
+patchCollide_t *CM_GeneratePatchBlock( patchWork_t *pw, int width, int height, vec3_t *points );
+int CM_PatchBlockSize( const patchCollide_t *pc );
+qboolean CM_ValidatePatchBlock( const patchCollide_t *pc, int size );
+patchCollide_t *CM_HunkPatchBlock( const patchCollide_t *block );
@@ -26,12 +26,22 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "cm_local.h"
 
 
-// counters are only bumped when running single threaded,
-// because they are an awful coherence problem
-int	c_active_windings;
-int	c_peak_windings;
-int	c_winding_allocs;
-int	c_winding_points;
+// counters are per thread, patch collides are generated on several threads
+CM_THREADLOCAL int	c_active_windings;
+CM_THREADLOCAL int	c_peak_windings;
+CM_THREADLOCAL int	c_winding_allocs;
+CM_THREADLOCAL int	c_winding_points;
+
+// every live winding is linked through a hidden header, so a thread that
+// gives up halfway through a job can release what it was holding
+typedef struct windingLink_s {
+	struct windingLink_s	*prev, *next;
+} windingLink_t;
+
+static CM_THREADLOCAL windingLink_t	*activeWindings;
+
+static CM_THREADLOCAL void	(*windingErrorFunc)( void *data, const char *text );
+static CM_THREADLOCAL void	*windingErrorData;
 
 void pw(winding_t *w)
 {
@@ -41,6 +51,40 @@ void pw(winding_t *w)
 }
 
 
+/*
+=============
+SetWindingErrorHandler
+
+Errors on this thread go to func instead of Com_Error, func must not return
+=============
+*/
+void SetWindingErrorHandler( void (*func)( void *data, const char *text ), void *data )
+{
+	windingErrorFunc = func;
+	windingErrorData = data;
+}
+
+/*
+=============
+WindingError
+=============
+*/
+static void QDECL WindingError( int level, const char *fmt, ... ) __attribute__ ((noreturn, format(printf, 2, 3)));
+static void QDECL WindingError( int level, const char *fmt, ... )
+{
+	va_list		argptr;
+	char		text[MAX_STRING_CHARS];
+
+	va_start (argptr, fmt);
+	Q_vsnprintf (text, sizeof(text), fmt, argptr);
+	va_end (argptr);
+
+	if (windingErrorFunc)
+		windingErrorFunc (windingErrorData, text);
+
+	Com_Error (level, "%s", text);
+}
+
 /*
 =============
 AllocWinding
@@ -48,7 +92,7 @@ AllocWinding
 */
 winding_t	*AllocWinding (int points)
 {
-	winding_t	*w;
+	windingLink_t	*link;
 	int			s;
 
 	c_winding_allocs++;
@@ -57,20 +101,60 @@ winding_t	*AllocWinding (int points)
 	if (c_active_windings > c_peak_windings)
 		c_peak_windings = c_active_windings;
 
+	// not from the zone, patch collides are generated on several threads
 	s = sizeof(vec_t)*3*points + sizeof(int);
-	w = Z_Malloc (s);
-	Com_Memset (w, 0, s); 
-	return w;
+	link = malloc (sizeof(*link) + s);
+	if (!link)
+		WindingError (ERR_FATAL, "AllocWinding: failed on allocation of %i bytes", s);
+	Com_Memset (link + 1, 0, s);
+
+	link->prev = NULL;
+	link->next = activeWindings;
+	if (activeWindings)
+		activeWindings->prev = link;
+	activeWindings = link;
+
+	return (winding_t *)(link + 1);
 }
 
 void FreeWinding (winding_t *w)
 {
+	windingLink_t	*link;
+
 	if (*(unsigned *)w == 0xdeaddead)
-		Com_Error (ERR_FATAL, "FreeWinding: freed a freed winding");
+		WindingError (ERR_FATAL, "FreeWinding: freed a freed winding");
 	*(unsigned *)w = 0xdeaddead;
 
+	link = (windingLink_t *)w - 1;
+	if (link->prev)
+		link->prev->next = link->next;
+	else
+		activeWindings = link->next;
+	if (link->next)
+		link->next->prev = link->prev;
+
 	c_active_windings--;
-	Z_Free (w);
+	free (link);
+}
+
+/*
+=============
+FreeActiveWindings
+
+Releases every winding still allocated by this thread
+=============
+*/
+void FreeActiveWindings( void )
+{
+	windingLink_t	*link, *next;
+
+	for (link = activeWindings ; link ; link = next)
+	{
+		next = link->next;
+		free (link);
+		c_active_windings--;
+	}
+	activeWindings = NULL;
 }
 
 /*
@@ -78,7 +162,7 @@ void FreeWinding (winding_t *w)
 RemoveColinearPoints
 ============
 */
-int	c_removed;
+CM_THREADLOCAL int	c_removed;
 
 void	RemoveColinearPoints (winding_t *w)
 {
@@ -220,7 +304,7 @@ winding_t *BaseWindingForPlane (vec3_t normal, vec_t dist)
 		}
 	}
 	if (x==-1)
-		Com_Error (ERR_DROP, "BaseWindingForPlane: no axis found");
+		WindingError (ERR_DROP, "BaseWindingForPlane: no axis found");
 		
 	VectorCopy (vec3_origin, vup);	
 	switch (x)
@@ -407,9 +491,9 @@ void	ClipWindingEpsilon (winding_t *in, vec3_t normal, vec_t dist,
 	}
 	
 	if (f->numpoints > maxpts || b->numpoints > maxpts)
-		Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+		WindingError (ERR_DROP, "ClipWinding: points exceeded estimate");
 	if (f->numpoints > MAX_POINTS_ON_WINDING || b->numpoints > MAX_POINTS_ON_WINDING)
-		Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+		WindingError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 }
 
 
@@ -506,9 +590,9 @@ void ChopWindingInPlace (winding_t **inout, vec3_t normal, vec_t dist, vec_t eps
 	}
 	
 	if (f->numpoints > maxpts)
-		Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+		WindingError (ERR_DROP, "ClipWinding: points exceeded estimate");
 	if (f->numpoints > MAX_POINTS_ON_WINDING)
-		Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+		WindingError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 
 	FreeWinding (in);
 	*inout = f;
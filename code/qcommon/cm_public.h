@@ -45,6 +45,8 @@ void		CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 						  vec3_t mins, vec3_t maxs,
 						  clipHandle_t model, int brushmask,
 						  const vec3_t origin, const vec3_t angles, int capsule );
+void		CM_TraceBench_f( void );
+void		CM_LeafBench_f( void );
 
 byte		*CM_ClusterPVS (int cluster);
 
@@ -54,6 +56,9 @@ int			CM_PointLeafnum( const vec3_t p );
 // overflow if return listsize and if *lastLeaf != list[listsize-1]
 int			CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list,
 		 					int listsize, int *lastLeaf );
+// also returns how far the bounds can move without changing the leafs touched
+int			CM_BoxLeafnumsSlack( const vec3_t mins, const vec3_t maxs, int *list,
+							int listsize, int *lastLeaf, float *slack );
 
 int			CM_LeafCluster (int leafnum);
 int			CM_LeafArea (int leafnum);
@@ -100,11 +100,10 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum ) {
 
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
-		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
-			continue;	// already checked this brush in another leaf
+		if ( ll->brushBits[brushnum >> 3] & ( 1 << ( brushnum & 7 ) ) ) {
+			continue;	// already stored from another leaf
 		}
-		b->checkcount = cm.checkcount;
+		b = &cm.brushes[brushnum];
 		for ( i = 0 ; i < 3 ; i++ ) {
 			if ( b->bounds[0][i] >= ll->bounds[1][i] || b->bounds[1][i] <= ll->bounds[0][i] ) {
 				break;
@@ -117,6 +116,7 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum ) {
 			ll->overflowed = qtrue;
 			return;
 		}
+		ll->brushBits[brushnum >> 3] |= 1 << ( brushnum & 7 );
 		((cbrush_t **)ll->list)[ ll->count++ ] = b;
 	}
 #if 0
@@ -130,6 +130,91 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum ) {
 #endif
 }
 
+/*
+=============
+CM_PlaneSlack
+
+Returns how far any of the box bounds can move before the box could
+change sides of the plane
+=============
+*/
+static float CM_PlaneSlack( const vec3_t mins, const vec3_t maxs, const cplane_t *plane ) {
+	float	d[2], slack;
+	int		i, b;
+
+	if ( plane->type < 3 ) {
+		slack = fabs( mins[plane->type] - plane->dist );
+		d[0] = fabs( maxs[plane->type] - plane->dist );
+		return d[0] < slack ? d[0] : slack;
+	}
+
+	if ( plane->signbits >= 8 ) {
+		return 0;
+	}
+
+	// same corners as BoxOnPlaneSide
+	d[0] = d[1] = 0;
+	for ( i = 0 ; i < 3 ; i++ ) {
+		b = ( plane->signbits >> i ) & 1;
+		d[b] += plane->normal[i] * maxs[i];
+		d[!b] += plane->normal[i] * mins[i];
+	}
+
+	slack = fabs( d[0] - plane->dist );
+	if ( fabs( d[1] - plane->dist ) < slack ) {
+		slack = fabs( d[1] - plane->dist );
+	}
+
+	// moving every bound by x moves a corner by up to x times the 1-norm of the normal
+	return slack / ( fabs( plane->normal[0] ) + fabs( plane->normal[1] ) + fabs( plane->normal[2] ) );
+}
+
+/*
+=============
+CM_StoreNodeLeafs
+
+Stores every leaf under a node the box covers, which is what going down
+all of the node's planes would find
+=============
+*/
+static void CM_StoreNodeLeafs( leafList_t *ll, const cNode_t *node ) {
+	int		i, count;
+	float	slack;
+
+	if ( ll->slack ) {
+		// the result stays the same while the box covers the node
+		for ( i = 0 ; i < 3 ; i++ ) {
+			slack = node->bounds[0][i] - ll->bounds[0][i];
+			if ( slack < *ll->slack ) {
+				*ll->slack = slack;
+			}
+			slack = ll->bounds[1][i] - node->bounds[1][i];
+			if ( slack < *ll->slack ) {
+				*ll->slack = slack;
+			}
+		}
+	}
+
+	if ( ll->storeLeafs != CM_StoreLeafs ) {
+		for ( i = 0 ; i < node->numLeafs ; i++ ) {
+			ll->storeLeafs( ll, -1 - cm.nodeLeafs[node->firstLeaf + i] );
+		}
+		return;
+	}
+
+	if ( node->lastClusterLeaf != -1 ) {
+		ll->lastLeaf = node->lastClusterLeaf;
+	}
+
+	count = node->numLeafs;
+	if ( count > ll->maxcount - ll->count ) {
+		count = ll->maxcount - ll->count;
+		ll->overflowed = qtrue;
+	}
+	Com_Memcpy( ll->list + ll->count, cm.nodeLeafs + node->firstLeaf, count * sizeof( *ll->list ) );
+	ll->count += count;
+}
+
 /*
 =============
 CM_BoxLeafnums
@@ -141,6 +226,7 @@ void CM_BoxLeafnums_r( leafList_t *ll, int nodenum ) {
 	cplane_t	*plane;
 	cNode_t		*node;
 	int			s;
+	float		slack;
 
 	while (1) {
 		if (nodenum < 0) {
@@ -149,8 +235,30 @@ void CM_BoxLeafnums_r( leafList_t *ll, int nodenum ) {
 		}
 	
 		node = &cm.nodes[nodenum];
+
+		// wide boxes take whole subtrees without testing their planes
+#ifndef BSPC
+		if ( cm_nodeBounds->integer && cm.nodeBoundsValid )
+#else
+		if ( cm.nodeBoundsValid )
+#endif
+		{
+			if ( ll->bounds[0][0] <= node->bounds[0][0] && ll->bounds[1][0] >= node->bounds[1][0]
+				&& ll->bounds[0][1] <= node->bounds[0][1] && ll->bounds[1][1] >= node->bounds[1][1]
+				&& ll->bounds[0][2] <= node->bounds[0][2] && ll->bounds[1][2] >= node->bounds[1][2] ) {
+				CM_StoreNodeLeafs( ll, node );
+				return;
+			}
+		}
+
 		plane = node->plane;
 		s = BoxOnPlaneSide( ll->bounds[0], ll->bounds[1], plane );
+		if ( ll->slack ) {
+			slack = CM_PlaneSlack( ll->bounds[0], ll->bounds[1], plane );
+			if ( slack < *ll->slack ) {
+				*ll->slack = slack;
+			}
+		}
 		if (s == 1) {
 			nodenum = node->children[0];
 		} else if (s == 2) {
@@ -172,7 +280,34 @@ CM_BoxLeafnums
 int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf) {
 	leafList_t	ll;
 
-	cm.checkcount++;
+	VectorCopy( mins, ll.bounds[0] );
+	VectorCopy( maxs, ll.bounds[1] );
+	ll.count = 0;
+	ll.maxcount = listsize;
+	ll.list = list;
+	ll.storeLeafs = CM_StoreLeafs;
+	ll.lastLeaf = 0;
+	ll.overflowed = qfalse;
+	ll.slack = NULL;
+	ll.brushBits = NULL;
+
+	CM_BoxLeafnums_r( &ll, 0 );
+
+	*lastLeaf = ll.lastLeaf;
+	return ll.count;
+}
+
+/*
+==================
+CM_BoxLeafnumsSlack
+
+Same as CM_BoxLeafnums, and also returns how far each of the bounds can
+move while still touching exactly the same leafs, so callers can skip
+the walk when a box has barely moved
+==================
+*/
+int CM_BoxLeafnumsSlack( const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf, float *slack ) {
+	leafList_t	ll;
 
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
@@ -182,9 +317,18 @@ int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsiz
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	ll.slack = slack;
+	ll.brushBits = NULL;
+
+	*slack = WORLD_SIZE;
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
+	*slack -= SLACK_EPSILON;
+	if ( *slack < 0 ) {
+		*slack = 0;
+	}
+
 	*lastLeaf = ll.lastLeaf;
 	return ll.count;
 }
@@ -192,12 +336,26 @@ int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsiz
 /*
 ==================
 CM_BoxBrushes
+
+Brushes in several leafs are stored once, marked in a bit array of the
+calling thread that is cleared again afterwards, so nothing shared is written
 ==================
 */
 int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int listsize ) {
+	static CM_THREADLOCAL byte	*brushBits;
+	static CM_THREADLOCAL int	brushBitsSize;
 	leafList_t	ll;
-
-	cm.checkcount++;
+	int			i, brushnum;
+
+	if ( brushBitsSize < ( cm.numBrushes + 7 ) >> 3 ) {
+		free( brushBits );
+		brushBitsSize = ( cm.numBrushes + 7 ) >> 3;
+		brushBits = calloc( brushBitsSize, 1 );
+		if ( !brushBits ) {
+			brushBitsSize = 0;
+			Com_Error( ERR_FATAL, "CM_BoxBrushes: out of memory" );
+		}
+	}
 
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
@@ -207,12 +365,154 @@ int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int li
 	ll.storeLeafs = CM_StoreBrushes;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	ll.slack = NULL;
+	ll.brushBits = brushBits;
 	
 	CM_BoxLeafnums_r( &ll, 0 );
 
+	for ( i = 0 ; i < ll.count ; i++ ) {
+		brushnum = list[i] - cm.brushes;
+		brushBits[brushnum >> 3] &= ~( 1 << ( brushnum & 7 ) );
+	}
+
 	return ll.count;
 }
 
+#ifndef BSPC
+typedef struct {
+	vec3_t		mins, maxs;
+	int			count[2];
+	int			lastLeaf[2];
+	unsigned	checksum[2];
+	float		slack[2];
+} benchBox_t;
+
+/*
+==================
+CM_LeafBench_f
+
+cm_leafBench [count] [size]
+
+Lists the leafs and brushes in the same random boxes of up to size units
+with cm_nodeBounds off and on, checks the results match and that moving
+a box within its slack doesn't change its leafs
+==================
+*/
+#define	BENCH_LEAFS		1024
+void CM_LeafBench_f( void ) {
+	benchBox_t	*boxes, *bb;
+	int			leafs[BENCH_LEAFS];
+	cbrush_t	*brushes[BENCH_LEAFS];
+	int			i, j, count, seed, pass, start, msec[2], brushMsec[2];
+	int			mismatches, brushMismatches, slackMisses, lastLeaf, numLeafs, numBrushes[2];
+	float		size, half, center, slack[2];
+	vec3_t		worldMins, worldMaxs, mins, maxs;
+	char		value[MAX_CVAR_VALUE_STRING];
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "cm_leafBench: no map loaded\n" );
+		return;
+	}
+
+	count = 20000;
+	size = 1024;
+	if ( Cmd_Argc() > 1 ) {
+		count = atoi( Cmd_Argv( 1 ) );
+		if ( count < 1 ) {
+			count = 1;
+		}
+	}
+	if ( Cmd_Argc() > 2 ) {
+		size = atof( Cmd_Argv( 2 ) );
+	}
+
+	boxes = Hunk_AllocateTempMemory( count * sizeof( *boxes ) );
+
+	CM_ModelBounds( 0, worldMins, worldMaxs );
+	seed = 1;
+	for ( i = 0, bb = boxes ; i < count ; i++, bb++ ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			center = worldMins[j] + Q_random( &seed ) * ( worldMaxs[j] - worldMins[j] );
+			half = Q_random( &seed ) * size * 0.5f;
+			bb->mins[j] = center - half;
+			bb->maxs[j] = center + half;
+		}
+	}
+
+	Cvar_VariableStringBuffer( "cm_nodeBounds", value, sizeof( value ) );
+
+	// alternate the two and keep the best time of each, the first round warms the caches
+	msec[0] = msec[1] = brushMsec[0] = brushMsec[1] = 0x7fffffff;
+	brushMismatches = 0;
+	for ( j = 0 ; j < 10 ; j++ ) {
+		pass = j & 1;
+		Cvar_Set( "cm_nodeBounds", pass ? "1" : "0" );
+
+		start = Sys_Milliseconds();
+		for ( i = 0, bb = boxes ; i < count ; i++, bb++ ) {
+			bb->count[pass] = CM_BoxLeafnumsSlack( bb->mins, bb->maxs, leafs, BENCH_LEAFS,
+				&bb->lastLeaf[pass], &bb->slack[pass] );
+			bb->checksum[pass] = Com_BlockChecksum( leafs, bb->count[pass] * sizeof( leafs[0] ) );
+		}
+		start = Sys_Milliseconds() - start;
+		if ( j >= 2 && start < msec[pass] ) {
+			msec[pass] = start;
+		}
+
+		numBrushes[pass] = 0;
+		start = Sys_Milliseconds();
+		for ( i = 0, bb = boxes ; i < count ; i++, bb++ ) {
+			numBrushes[pass] += CM_BoxBrushes( bb->mins, bb->maxs, brushes, BENCH_LEAFS );
+		}
+		start = Sys_Milliseconds() - start;
+		if ( j >= 2 && start < brushMsec[pass] ) {
+			brushMsec[pass] = start;
+		}
+		if ( pass && numBrushes[0] != numBrushes[1] ) {
+			brushMismatches++;
+		}
+	}
+
+	mismatches = numLeafs = 0;
+	slack[0] = slack[1] = 0;
+	for ( i = 0, bb = boxes ; i < count ; i++, bb++ ) {
+		numLeafs += bb->count[1];
+		if ( bb->count[0] != bb->count[1] || bb->lastLeaf[0] != bb->lastLeaf[1]
+			|| bb->checksum[0] != bb->checksum[1] ) {
+			mismatches++;
+		}
+		slack[0] += bb->slack[0];
+		slack[1] += bb->slack[1];
+	}
+
+	// every bound moved by up to the slack must still give the same leafs
+	slackMisses = 0;
+	for ( i = 0, bb = boxes ; i < count ; i++, bb++ ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			mins[j] = bb->mins[j] + Q_crandom( &seed ) * bb->slack[1];
+			maxs[j] = bb->maxs[j] + Q_crandom( &seed ) * bb->slack[1];
+		}
+		if ( CM_BoxLeafnums( mins, maxs, leafs, BENCH_LEAFS, &lastLeaf ) != bb->count[1]
+			|| Com_BlockChecksum( leafs, bb->count[1] * sizeof( leafs[0] ) ) != bb->checksum[1] ) {
+			slackMisses++;
+		}
+	}
+
+	Cvar_Set( "cm_nodeBounds", value );
+
+	Com_Printf( "%i boxes of up to %g units, %.1f leafs and %.1f brushes each\n", count, size,
+		(float)numLeafs / count, (float)numBrushes[1] / count );
+	Com_Printf( "cm_nodeBounds 0: %i msec leafs, %i msec brushes, %.1f average slack\n",
+		msec[0], brushMsec[0], slack[0] / count );
+	Com_Printf( "cm_nodeBounds 1: %i msec leafs, %i msec brushes, %.1f average slack\n",
+		msec[1], brushMsec[1], slack[1] / count );
+	Com_Printf( "%i leaf lists and %i brush counts differ, %i boxes moved within their slack changed\n",
+		mismatches, brushMismatches, slackMisses );
+
+	Hunk_FreeTempMemory( boxes );
+}
+#endif
+
 
 //====================================================================
 
@@ -346,6 +646,7 @@ void CM_FloodArea_r( int areaNum, int floodnum) {
 
 	area->floodnum = floodnum;
 	area->floodvalid = cm.floodvalid;
+	cm.areaBits[ floodnum * cm.areaBytes + ( areaNum >> 3 ) ] |= 1 << ( areaNum & 7 );
 	con = cm.areaPortals + areaNum * cm.numAreas;
 	for ( i=0 ; i < cm.numAreas  ; i++ ) {
 		if ( con[i] > 0 ) {
@@ -358,35 +659,101 @@ void CM_FloodArea_r( int areaNum, int floodnum) {
 ====================
 CM_FloodAreaConnections
 
+Each flood is numbered with the first area in it, and
+areaBits holds the areas of the flood under that number.
 ====================
 */
 void	CM_FloodAreaConnections( void ) {
 	int		i;
 	cArea_t	*area;
-	int		floodnum;
 
 	// all current floods are now invalid
 	cm.floodvalid++;
-	floodnum = 0;
+	Com_Memset( cm.areaBits, 0, cm.numAreas * cm.areaBytes );
 
 	for (i = 0 ; i < cm.numAreas ; i++) {
 		area = &cm.areas[i];
 		if (area->floodvalid == cm.floodvalid) {
 			continue;		// already flooded into
 		}
-		floodnum++;
-		CM_FloodArea_r (i, floodnum);
+		CM_FloodArea_r (i, i);
+	}
+
+}
+
+/*
+====================
+CM_MergeAreaFloods
+
+Renumbers the smaller of two floods joined by a portal opening.
+====================
+*/
+static void CM_MergeAreaFloods( int flood1, int flood2 ) {
+	byte	*bits1, *bits2;
+	int		count1, count2;
+	int		i;
+
+	bits1 = cm.areaBits + flood1 * cm.areaBytes;
+	bits2 = cm.areaBits + flood2 * cm.areaBytes;
+
+	count1 = count2 = 0;
+	for ( i = 0 ; i < cm.numAreas ; i++ ) {
+		if ( bits1[i >> 3] & ( 1 << ( i & 7 ) ) ) {
+			count1++;
+		} else if ( bits2[i >> 3] & ( 1 << ( i & 7 ) ) ) {
+			count2++;
+		}
+	}
+
+	if ( count1 < count2 ) {
+		CM_MergeAreaFloods( flood2, flood1 );
+		return;
+	}
+
+	for ( i = 0 ; i < cm.numAreas ; i++ ) {
+		if ( bits2[i >> 3] & ( 1 << ( i & 7 ) ) ) {
+			cm.areas[i].floodnum = flood1;
+		}
+	}
+	for ( i = 0 ; i < cm.areaBytes ; i++ ) {
+		bits1[i] |= bits2[i];
+		bits2[i] = 0;
 	}
+}
+
+/*
+====================
+CM_SplitAreaFlood
+
+Refloods only the flood that held a portal that just closed.  Removing one
+connection leaves at most two floods, one on each side of it.
+====================
+*/
+static void CM_SplitAreaFlood( int area1, int area2 ) {
+	int		floodnum;
 
+	floodnum = cm.areas[area1].floodnum;
+	Com_Memset( cm.areaBits + floodnum * cm.areaBytes, 0, cm.areaBytes );
+
+	// areas outside the old flood keep their floodvalid and are never reached
+	cm.floodvalid++;
+	CM_FloodArea_r( area1, area1 );
+	if ( cm.areas[area2].floodvalid != cm.floodvalid ) {
+		CM_FloodArea_r( area2, area2 );
+	}
 }
 
 /*
 ====================
 CM_AdjustAreaPortalState
 
+Only a reference count going between zero and one can change the floods,
+and then only the ones on either side of the portal are touched.
 ====================
 */
 void	CM_AdjustAreaPortalState( int area1, int area2, qboolean open ) {
+	int		count;
+
 	if ( area1 < 0 || area2 < 0 ) {
 		return;
 	}
@@ -397,16 +764,26 @@ void	CM_AdjustAreaPortalState( int area1, int area2, qboolean open ) {
 
 	if ( open ) {
 		cm.areaPortals[ area1 * cm.numAreas + area2 ]++;
-		cm.areaPortals[ area2 * cm.numAreas + area1 ]++;
+		count = ++cm.areaPortals[ area2 * cm.numAreas + area1 ];
 	} else {
 		cm.areaPortals[ area1 * cm.numAreas + area2 ]--;
-		cm.areaPortals[ area2 * cm.numAreas + area1 ]--;
-		if ( cm.areaPortals[ area2 * cm.numAreas + area1 ] < 0 ) {
+		count = --cm.areaPortals[ area2 * cm.numAreas + area1 ];
+		if ( count < 0 ) {
 			Com_Error (ERR_DROP, "CM_AdjustAreaPortalState: negative reference count");
 		}
 	}
 
-	CM_FloodAreaConnections ();
+	if ( area1 == area2 ) {
+		return;
+	}
+
+	if ( open && count == 1 ) {
+		if ( cm.areas[area1].floodnum != cm.areas[area2].floodnum ) {
+			CM_MergeAreaFloods( cm.areas[area1].floodnum, cm.areas[area2].floodnum );
+		}
+	} else if ( !open && count == 0 ) {
+		CM_SplitAreaFlood( area1, area2 );
+	}
 }
 
 /*
@@ -454,10 +831,10 @@ This is used to cull non-visible entities from snapshots
 int CM_WriteAreaBits (byte *buffer, int area)
 {
 	int		i;
-	int		floodnum;
+	byte	*bits;
 	int		bytes;
 
-	bytes = (cm.numAreas+7)>>3;
+	bytes = cm.areaBytes;
 
 #ifndef BSPC
 	if (cm_noAreas->integer || area == -1)
@@ -469,11 +846,10 @@ int CM_WriteAreaBits (byte *buffer, int area)
 	}
 	else
 	{
-		floodnum = cm.areas[area].floodnum;
-		for (i=0 ; i<cm.numAreas ; i++)
+		bits = cm.areaBits + cm.areas[area].floodnum * cm.areaBytes;
+		for (i=0 ; i<bytes ; i++)
 		{
-			if (cm.areas[i].floodnum == floodnum || area == -1)
-				buffer[i>>3] |= 1<<(i&7);
+			buffer[i] |= bits[i];
 		}
 	}
 
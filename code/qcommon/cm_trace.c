@@ -20,6 +20,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 #include "cm_local.h"
+#include "cm_patch.h"
+
+#if idx64
+#include <emmintrin.h>
+#endif
 
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
@@ -234,6 +239,45 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 
 
 
+/*
+================
+CM_NewCheckCount
+
+Gives a trace a new mark for the brushes and patches it tests.  The marks
+are kept in arrays of the calling thread, so concurrent traces never write
+anything shared; the count only goes up, so marks left from other maps
+never match.
+================
+*/
+static CM_THREADLOCAL int	*cm_brushChecks;
+static CM_THREADLOCAL int	*cm_surfaceChecks;
+static CM_THREADLOCAL int	cm_numBrushChecks;
+static CM_THREADLOCAL int	cm_numSurfaceChecks;
+static CM_THREADLOCAL int	cm_checkcount;
+
+static void CM_NewCheckCount( traceWork_t *tw ) {
+	int		numBrushes;
+
+	numBrushes = cm.numBrushes + CM_BOX_SLOTS;
+	if ( cm_numBrushChecks < numBrushes || cm_numSurfaceChecks < cm.numSurfaces || cm_checkcount == INT_MAX ) {
+		free( cm_brushChecks );
+		free( cm_surfaceChecks );
+		cm_numBrushChecks = numBrushes;
+		cm_numSurfaceChecks = cm.numSurfaces;
+		cm_brushChecks = calloc( cm_numBrushChecks, sizeof( *cm_brushChecks ) );
+		cm_surfaceChecks = calloc( cm_numSurfaceChecks + 1, sizeof( *cm_surfaceChecks ) );
+		cm_checkcount = 0;
+		if ( !cm_brushChecks || !cm_surfaceChecks ) {
+			cm_numBrushChecks = cm_numSurfaceChecks = 0;
+			Com_Error( ERR_FATAL, "CM_NewCheckCount: out of memory" );
+		}
+	}
+
+	tw->checkcount = ++cm_checkcount;
+	tw->brushChecks = cm_brushChecks;
+	tw->surfaceChecks = cm_surfaceChecks;
+}
+
 /*
 ================
 CM_TestInLeaf
@@ -241,18 +285,18 @@ CM_TestInLeaf
 */
 void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
+	int			brushnum, surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
 	// test box position against all brushes in the leaf
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
-		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		if ( tw->brushChecks[brushnum] == tw->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->brushChecks[brushnum] = tw->checkcount;
+		b = &cm.brushes[brushnum];
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -271,14 +315,15 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif //BSPC
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->surfaceChecks[surfnum] == tw->checkcount ) {
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->surfaceChecks[surfnum] = tw->checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -427,13 +472,13 @@ void CM_PositionTest( traceWork_t *tw ) {
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
-
-	cm.checkcount++;
+	ll.slack = NULL;
+	ll.brushBits = NULL;
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
 
-	cm.checkcount++;
+	CM_NewCheckCount( tw );
 
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
@@ -474,6 +519,195 @@ void CM_TraceThroughPatch( traceWork_t *tw, cPatch_t *patch ) {
 	}
 }
 
+#if idx64 && !defined( BSPC )
+/*
+================
+CM_SetupBrushSides
+================
+*/
+static void CM_SetupBrushSides( traceWork_t *tw ) {
+	sideTest_t	*st;
+	int			i, j;
+
+	st = &tw->sideTest;
+	for ( i = 0 ; i < 3 ; i++ ) {
+		for ( j = 0 ; j < 4 ; j++ ) {
+			if ( tw->sphere.use ) {
+				// the capsule end closest to a plane depends on the plane, see below
+				st->start[i][j] = tw->start[i] - tw->sphere.offset[i];
+				st->end[i][j] = tw->end[i] - tw->sphere.offset[i];
+				st->start2[i][j] = tw->start[i] + tw->sphere.offset[i];
+				st->end2[i][j] = tw->end[i] + tw->sphere.offset[i];
+				st->lo[i][j] = tw->sphere.offset[i];
+			} else {
+				st->start[i][j] = tw->start[i];
+				st->end[i][j] = tw->end[i];
+				st->lo[i][j] = tw->size[0][i];
+				st->hi[i][j] = tw->size[1][i];
+			}
+		}
+	}
+	for ( j = 0 ; j < 4 ; j++ ) {
+		st->radius[j] = tw->sphere.radius;
+	}
+	st->mode = 1 + !!tw->sphere.use;
+}
+
+// the lanes of a where mask is set, else the lanes of b
+#define	SELECT(mask,a,b)	_mm_or_ps( _mm_and_ps( (mask), _mm_loadu_ps( a ) ), _mm_andnot_ps( (mask), _mm_loadu_ps( b ) ) )
+
+/*
+================
+CM_TraceThroughBrushSides
+
+CM_TraceThroughBrush for four sides at a time from brush->sidePlanes.
+The plane math is done in the same order as the scalar loop and the
+lanes are merged in side order, but with -ffast-math the compiler
+reorders both differently and some capsule fractions come out a float
+rounding apart, so it is only used with cm_simdBrushes set.
+================
+*/
+static void CM_TraceThroughBrushSides( traceWork_t *tw, cbrush_t *brush ) {
+	int			i, lane, numBlocks;
+	int			getout, startout, enterBits, leaveBits;
+	float		enterFrac, leaveFrac, f;
+	cbrushside_t	*leadside;
+	const float	*block;
+	const sideTest_t	*st;
+	float		d1s[4], d2s[4];
+	__m128		nx, ny, nz, dist, d1, d2, t, in, in2;
+	__m128		zero, eps;
+
+	if ( tw->sideTest.mode != 1 + !!tw->sphere.use ) {
+		CM_SetupBrushSides( tw );
+	}
+	st = &tw->sideTest;
+
+	enterFrac = -1.0;
+	leaveFrac = 1.0;
+	leadside = NULL;
+	getout = 0;
+	startout = 0;
+
+	zero = _mm_setzero_ps();
+	eps = _mm_set1_ps( SURFACE_CLIP_EPSILON );
+
+	numBlocks = ( brush->numsides + 3 ) >> 2;
+	for ( i = 0, block = brush->sidePlanes ; i < numBlocks ; i++, block += SIDE_BLOCK_FLOATS ) {
+		nx = _mm_loadu_ps( block );
+		ny = _mm_loadu_ps( block + 4 );
+		nz = _mm_loadu_ps( block + 8 );
+		dist = _mm_loadu_ps( block + 12 );
+
+		if ( tw->sphere.use ) {
+			// adjust the plane distance apropriately for radius
+			dist = _mm_add_ps( dist, _mm_loadu_ps( st->radius ) );
+
+			// find the closest point on the capsule to the plane
+			t = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, _mm_loadu_ps( st->lo[0] ) ),
+				_mm_mul_ps( ny, _mm_loadu_ps( st->lo[1] ) ) ), _mm_mul_ps( nz, _mm_loadu_ps( st->lo[2] ) ) );
+			in = _mm_cmpgt_ps( t, zero );
+
+			d1 = _mm_add_ps( _mm_add_ps(
+				_mm_mul_ps( SELECT( in, st->start[0], st->start2[0] ), nx ),
+				_mm_mul_ps( SELECT( in, st->start[1], st->start2[1] ), ny ) ),
+				_mm_mul_ps( SELECT( in, st->start[2], st->start2[2] ), nz ) );
+			d2 = _mm_add_ps( _mm_add_ps(
+				_mm_mul_ps( SELECT( in, st->end[0], st->end2[0] ), nx ),
+				_mm_mul_ps( SELECT( in, st->end[1], st->end2[1] ), ny ) ),
+				_mm_mul_ps( SELECT( in, st->end[2], st->end2[2] ), nz ) );
+		} else {
+			// adjust the plane distance apropriately for mins/maxs, the maxs
+			// are used on the axes the normal points down, like tw->offsets
+			t = _mm_mul_ps( SELECT( _mm_cmplt_ps( nx, zero ), st->hi[0], st->lo[0] ), nx );
+			t = _mm_add_ps( t, _mm_mul_ps( SELECT( _mm_cmplt_ps( ny, zero ), st->hi[1], st->lo[1] ), ny ) );
+			t = _mm_add_ps( t, _mm_mul_ps( SELECT( _mm_cmplt_ps( nz, zero ), st->hi[2], st->lo[2] ), nz ) );
+			dist = _mm_sub_ps( dist, t );
+
+			d1 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( st->start[0] ), nx ),
+				_mm_mul_ps( _mm_loadu_ps( st->start[1] ), ny ) ), _mm_mul_ps( _mm_loadu_ps( st->start[2] ), nz ) );
+			d2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( st->end[0] ), nx ),
+				_mm_mul_ps( _mm_loadu_ps( st->end[1] ), ny ) ), _mm_mul_ps( _mm_loadu_ps( st->end[2] ), nz ) );
+		}
+		d1 = _mm_sub_ps( d1, dist );
+		d2 = _mm_sub_ps( d2, dist );
+
+		in = _mm_cmpgt_ps( d1, zero );
+		in2 = _mm_cmpgt_ps( d2, zero );
+		getout |= _mm_movemask_ps( in2 );	// endpoint is not in solid
+		startout |= _mm_movemask_ps( in );
+
+		// if completely in front of face, no intersection with the entire brush
+		if ( _mm_movemask_ps( _mm_and_ps( in, _mm_or_ps( _mm_cmpge_ps( d2, eps ), _mm_cmpge_ps( d2, d1 ) ) ) ) ) {
+			return;
+		}
+
+		// the sides that are crossed, entering where d1 > d2
+		in = _mm_or_ps( in, in2 );
+		in2 = _mm_cmpgt_ps( d1, d2 );
+		enterBits = _mm_movemask_ps( _mm_and_ps( in, in2 ) );
+		leaveBits = _mm_movemask_ps( _mm_andnot_ps( in2, in ) );
+		if ( !( enterBits | leaveBits ) ) {
+			continue;
+		}
+
+		// few sides are crossed, so the fractions are left to the scalar
+		// expressions, which SURFACE_CLIP_EPSILON makes double
+		_mm_storeu_ps( d1s, d1 );
+		_mm_storeu_ps( d2s, d2 );
+
+		for ( lane = 0 ; lane < 4 ; lane++ ) {
+			if ( enterBits & ( 1 << lane ) ) {
+				f = (d1s[lane]-SURFACE_CLIP_EPSILON) / (d1s[lane]-d2s[lane]);
+				if ( f < 0 ) {
+					f = 0;
+				}
+				if ( f > enterFrac ) {
+					enterFrac = f;
+					leadside = brush->sides + i * 4 + lane;
+				}
+			} else if ( leaveBits & ( 1 << lane ) ) {
+				f = (d1s[lane]+SURFACE_CLIP_EPSILON) / (d1s[lane]-d2s[lane]);
+				if ( f > 1 ) {
+					f = 1;
+				}
+				if ( f < leaveFrac ) {
+					leaveFrac = f;
+				}
+			}
+		}
+	}
+
+	//
+	// all planes have been checked, and the trace was not
+	// completely outside the brush
+	//
+	if ( !startout ) {	// original point was inside brush
+		tw->trace.startsolid = qtrue;
+		if ( !getout ) {
+			tw->trace.allsolid = qtrue;
+			tw->trace.fraction = 0;
+			tw->trace.contents = brush->contents;
+		}
+		return;
+	}
+
+	if ( enterFrac < leaveFrac ) {
+		if ( enterFrac > -1 && enterFrac < tw->trace.fraction ) {
+			if ( enterFrac < 0 ) {
+				enterFrac = 0;
+			}
+			tw->trace.fraction = enterFrac;
+			if ( leadside != NULL ) {
+				tw->trace.plane = *leadside->plane;
+				tw->trace.surfaceFlags = leadside->surfaceFlags;
+			}
+			tw->trace.contents = brush->contents;
+		}
+	}
+}
+#endif
+
 /*
 ================
 CM_TraceThroughBrush
@@ -502,6 +736,13 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 
 	c_brush_traces++;
 
+#if idx64 && !defined( BSPC )
+	if ( brush->sidePlanes && cm_simdBrushes->integer ) {
+		CM_TraceThroughBrushSides( tw, brush );
+		return;
+	}
+#endif
+
 	getout = qfalse;
 	startout = qfalse;
 
@@ -668,7 +909,7 @@ CM_TraceThroughLeaf
 */
 void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
+	int			brushnum, surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
@@ -676,11 +917,11 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 
-		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( tw->brushChecks[brushnum] == tw->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->brushChecks[brushnum] = tw->checkcount;
+		b = &cm.brushes[brushnum];
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
@@ -704,14 +945,15 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->surfaceChecks[surfnum] == tw->checkcount ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->surfaceChecks[surfnum] = tw->checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -1154,13 +1396,12 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 
 	cmod = CM_ClipHandleToModel( model );
 
-	cm.checkcount++;		// for multi-check avoidance
-
 	c_traces++;				// for statistics, may be zeroed
 
 	// fill in a default trace
 	Com_Memset( &tw, 0, sizeof(tw) );
 	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
+	CM_NewCheckCount( &tw );	// for multi-check avoidance
 	VectorCopy(origin, tw.modelOrigin);
 
 	if (!cm.numNodes) {
@@ -1468,3 +1709,159 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 
 	*results = trace;
 }
+
+#ifndef BSPC
+/*
+===============================================================================
+
+BENCHMARK
+
+===============================================================================
+*/
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			capsule;
+} benchTrace_t;
+
+/*
+================
+CM_SameTrace
+
+With rounding set, fractions and end points may be a float rounding apart
+================
+*/
+static qboolean CM_SameTrace( const trace_t *a, const trace_t *b, qboolean rounding ) {
+	if ( a->allsolid != b->allsolid || a->startsolid != b->startsolid
+		|| a->surfaceFlags != b->surfaceFlags || a->contents != b->contents
+		|| !VectorCompare( a->plane.normal, b->plane.normal ) || a->plane.dist != b->plane.dist ) {
+		return qfalse;
+	}
+	if ( rounding ) {
+		return fabs( a->fraction - b->fraction ) < 1e-6f && Distance( a->endpos, b->endpos ) < 0.01f;
+	}
+	return a->fraction == b->fraction && VectorCompare( a->endpos, b->endpos );
+}
+
+/*
+================
+CM_TraceBench_f
+
+cm_traceBench [count] [cvar]
+
+Sweeps the same random points, player boxes and player capsules into
+brushes and patches with the cvar, cm_simdBrushes by default, off and on,
+and checks the results match
+================
+*/
+void CM_TraceBench_f( void ) {
+	benchTrace_t	*traces, *bt;
+	trace_t		*results[2];
+	int			i, j, count, seed, mismatches, roundings;
+	int			pass, start, msec[2], brushTraces, patchTraces;
+	int			numPatches, target;
+	char		cvar[MAX_CVAR_VALUE_STRING], value[MAX_CVAR_VALUE_STRING];
+	float		size;
+	vec3_t		*bounds;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "cm_traceBench: no map loaded\n" );
+		return;
+	}
+
+	count = 50000;
+	if ( Cmd_Argc() > 1 ) {
+		count = atoi( Cmd_Argv( 1 ) );
+		if ( count < 1 ) {
+			count = 1;
+		}
+	}
+
+	Q_strncpyz( cvar, Cmd_Argc() > 2 ? Cmd_Argv( 2 ) : "cm_simdBrushes", sizeof( cvar ) );
+
+	numPatches = 0;
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( cm.surfaces[i] ) {
+			numPatches++;
+		}
+	}
+
+	traces = Hunk_AllocateTempMemory( count * sizeof( *traces ) );
+	results[0] = Hunk_AllocateTempMemory( count * sizeof( trace_t ) );
+	results[1] = Hunk_AllocateTempMemory( count * sizeof( trace_t ) );
+
+	// from around a random brush or patch to somewhere in it, like things moving into the world
+	seed = 1;
+	for ( i = 0, bt = traces ; i < count ; i++, bt++ ) {
+		target = ( (unsigned)Q_rand( &seed ) >> 8 ) % ( cm.numBrushes + numPatches );
+		if ( target < cm.numBrushes ) {
+			bounds = cm.brushes[target].bounds;
+		} else {
+			target -= cm.numBrushes;
+			for ( j = 0 ; !cm.surfaces[j] || target > 0 ; j++ ) {
+				if ( cm.surfaces[j] ) {
+					target--;
+				}
+			}
+			bounds = cm.surfaces[j]->pc->bounds;
+		}
+		for ( j = 0 ; j < 3 ; j++ ) {
+			size = bounds[1][j] - bounds[0][j];
+			bt->start[j] = bounds[0][j] - 64 + Q_random( &seed ) * ( size + 128 );
+			bt->end[j] = bounds[0][j] + Q_random( &seed ) * size;
+		}
+		if ( i % 3 ) {
+			VectorSet( bt->mins, -15, -15, -24 );
+			VectorSet( bt->maxs, 15, 15, 32 );
+		} else {
+			VectorClear( bt->mins );
+			VectorClear( bt->maxs );
+		}
+		bt->capsule = ( i % 3 == 2 );
+	}
+
+	Cvar_VariableStringBuffer( cvar, value, sizeof( value ) );
+
+	// alternate the two and keep the best time of each, the first round warms the caches
+	msec[0] = msec[1] = 0x7fffffff;
+	for ( j = 0 ; j < 10 ; j++ ) {
+		pass = j & 1;
+		Cvar_Set( cvar, pass ? "1" : "0" );
+
+		brushTraces = c_brush_traces;
+		patchTraces = c_patch_traces;
+		start = Sys_Milliseconds();
+		for ( i = 0, bt = traces ; i < count ; i++, bt++ ) {
+			CM_BoxTrace( &results[pass][i], bt->start, bt->end, bt->mins, bt->maxs,
+				0, CONTENTS_SOLID, bt->capsule );
+		}
+		start = Sys_Milliseconds() - start;
+		if ( j >= 2 && start < msec[pass] ) {
+			msec[pass] = start;
+		}
+		brushTraces = c_brush_traces - brushTraces;
+		patchTraces = c_patch_traces - patchTraces;
+	}
+
+	Cvar_Set( cvar, value );
+
+	mismatches = roundings = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( !CM_SameTrace( &results[0][i], &results[1][i], qtrue ) ) {
+			mismatches++;
+		} else if ( !CM_SameTrace( &results[0][i], &results[1][i], qfalse ) ) {
+			roundings++;
+		}
+	}
+
+	Com_Printf( "%i traces, %i brush and %i patch tests each pass\n", count, brushTraces, patchTraces );
+	Com_Printf( "%s 0: %i msec\n", cvar, msec[0] );
+	Com_Printf( "%s 1: %i msec\n", cvar, msec[1] );
+	Com_Printf( "%i results differ, %i more by a float rounding\n", mismatches, roundings );
+
+	Hunk_FreeTempMemory( results[1] );
+	Hunk_FreeTempMemory( results[0] );
+	Hunk_FreeTempMemory( traces );
+}
+#endif
@@ -30,6 +30,15 @@ int			cvar_modifiedFlags;
 
 #define	MAX_CVARS	2048
 cvar_t		cvar_indexes[MAX_CVARS];
+
+// a native module reads modificationCount without a syscall, so the new
+// value has to be in place before the count changes, see Cvar_Table
+#ifdef _MSC_VER
+#include <intrin.h>
+#define	CVAR_PUBLISH()	_ReadWriteBarrier()
+#else
+#define	CVAR_PUBLISH()	__sync_synchronize()
+#endif
 int			cvar_numIndexes;
 
 #define FILE_HASH_SIZE		256
@@ -605,7 +614,6 @@ cvar_t *Cvar_Set2( const char *var_name, const char *value, qboolean force ) {
 		return var;		// not changed
 
 	var->modified = qtrue;
-	var->modificationCount++;
 	
 	Z_Free (var->string);	// free the old value string
 	
@@ -613,6 +621,9 @@ cvar_t *Cvar_Set2( const char *var_name, const char *value, qboolean force ) {
 	var->value = atof (var->string);
 	var->integer = atoi (var->string);
 
+	CVAR_PUBLISH();
+	var->modificationCount++;
+
 	return var;
 }
 
@@ -1271,6 +1282,18 @@ void	Cvar_Update( vmCvar_t *vmCvar ) {
 	vmCvar->integer = cv->integer;
 }
 
+/*
+=====================
+Cvar_Table
+
+Lets a native module compare modificationCount against its vmCvar_t
+copies itself, and only call Cvar_Update for the cvars that changed
+=====================
+*/
+const cvar_t *Cvar_Table( void ) {
+	return cvar_indexes;
+}
+
 /*
 ==================
 Cvar_CompleteCvarName
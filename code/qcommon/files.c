@@ -3742,6 +3742,35 @@ const char *FS_ReferencedPakNames( void ) {
 	return info;
 }
 
+/*
+=====================
+FS_PakOSPath
+
+Finds the full path of a pk3 named gamedir/basename, as returned by FS_ReferencedPakNames
+=====================
+*/
+qboolean FS_PakOSPath( const char *pakName, char *ospath, int size ) {
+	searchpath_t	*search;
+	const char		*slash;
+	int				len;
+
+	slash = strchr( pakName, '/' );
+	if ( !slash ) {
+		return qfalse;
+	}
+	len = slash - pakName;
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack && !Q_stricmpn( search->pack->pakGamename, pakName, len ) &&
+			!search->pack->pakGamename[len] && !Q_stricmp( search->pack->pakBasename, slash + 1 ) ) {
+			Q_strncpyz( ospath, search->pack->pakFilename, size );
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+
 /*
 =====================
 FS_ClearPakReferences
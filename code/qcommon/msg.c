@@ -288,6 +288,49 @@ void MSG_WriteData( msg_t *buf, const void *data, int length ) {
 	}
 }
 
+/*
+=================
+MSG_WriteBitstream
+
+Appends the first bits of a buffer written by MSG_WriteBits, so
+pre-encoded data can be reused without running it through the
+huffman coder again.  The bits are stored lsb first and unused
+bits of the last byte are always zero.
+=================
+*/
+void MSG_WriteBitstream( msg_t *buf, const byte *data, int bits ) {
+	int		bytes, shift, out, i;
+
+	if ( buf->oob ) {
+		Com_Error( ERR_DROP, "MSG_WriteBitstream: oob message" );
+	}
+
+	bytes = ( bits + 7 ) >> 3;
+	if ( buf->maxsize - buf->cursize < bytes + 4 ) {
+		buf->overflowed = qtrue;
+		return;
+	}
+
+	oldsize += bits;
+
+	out = buf->bit >> 3;
+	shift = buf->bit & 7;
+
+	if ( !shift ) {
+		Com_Memcpy( buf->data + out, data, bytes );
+	} else {
+		// the partial byte at the write position keeps its low bits
+		buf->data[out] &= ( 1 << shift ) - 1;
+		for ( i = 0 ; i < bytes ; i++ ) {
+			buf->data[out + i] |= data[i] << shift;
+			buf->data[out + i + 1] = data[i] >> ( 8 - shift );
+		}
+	}
+
+	buf->bit += bits;
+	buf->cursize = ( buf->bit >> 3 ) + 1;
+}
+
 void MSG_WriteShort( msg_t *sb, int c ) {
 #ifdef PARANOID
 	if (c < ((short)0x8000) || c > (short)0x7fff)
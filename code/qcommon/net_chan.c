@@ -120,7 +120,7 @@ void Netchan_TransmitNextFragment( netchan_t *chan ) {
 
 	// send the qport if we are a client
 	if ( chan->sock == NS_CLIENT ) {
-		MSG_WriteShort( &send, qport->integer );
+		MSG_WriteShort( &send, chan->qport );
 	}
 
 #ifdef LEGACY_PROTOCOL
@@ -202,7 +202,7 @@ void Netchan_Transmit( netchan_t *chan, int length, const byte *data ) {
 
 	// send the qport if we are a client
 	if(chan->sock == NS_CLIENT)
-		MSG_WriteShort(&send, qport->integer);
+		MSG_WriteShort(&send, chan->qport);
 
 #ifdef LEGACY_PROTOCOL
 	if(!chan->compat)
@@ -475,6 +475,79 @@ void NET_SendLoopPacket (netsrc_t sock, int length, const void *data, netadr_t t
 	loop->msgs[i].datalen = length;
 }
 
+/*
+=============================================================================
+
+LOOPBACK SNAPSHOTS
+
+A listen server's own client would decode every snapshot right after the
+server encoded it.  While the client accepts them, the server instead
+fills one of these and only sends the tag in its message, so sequencing
+and drops still follow the netchan.  There are as many as there are
+loopback messages, a snapshot is only lost if its message would be too.
+
+=============================================================================
+*/
+
+static loopSnapshot_t	loopSnapshots[MAX_LOOPBACK];
+static int				loopSnapshotTag;
+static qboolean			loopSnapshotsAccepted;
+
+/*
+=================
+NET_SetLoopSnapshots
+
+Set by the client each frame, it refuses them while recording a
+demo since demos need the encoded snapshots
+=================
+*/
+void NET_SetLoopSnapshots( qboolean accept ) {
+	loopSnapshotsAccepted = accept;
+}
+
+qboolean NET_LoopSnapshotsAccepted( void ) {
+	return loopSnapshotsAccepted;
+}
+
+/*
+=================
+NET_AllocLoopSnapshot
+
+Returns the next snapshot to fill, with its tag set
+=================
+*/
+loopSnapshot_t *NET_AllocLoopSnapshot( void ) {
+	loopSnapshot_t	*snap;
+
+	// never hand out tag 0
+	if ( ++loopSnapshotTag <= 0 ) {
+		loopSnapshotTag = 1;
+	}
+
+	snap = &loopSnapshots[loopSnapshotTag & ( MAX_LOOPBACK - 1 )];
+	snap->tag = loopSnapshotTag;
+
+	return snap;
+}
+
+/*
+=================
+NET_GetLoopSnapshot
+
+Returns NULL if the snapshot has been reused already
+=================
+*/
+const loopSnapshot_t *NET_GetLoopSnapshot( int tag ) {
+	loopSnapshot_t	*snap;
+
+	snap = &loopSnapshots[tag & ( MAX_LOOPBACK - 1 )];
+	if ( tag <= 0 || snap->tag != tag ) {
+		return NULL;
+	}
+
+	return snap;
+}
+
 //=============================================================================
 
 typedef struct packetQueue_s {
@@ -20,6 +20,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// for recvmmsg and sendmmsg
+#	define _GNU_SOURCE
+#endif
+
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 
@@ -81,6 +86,16 @@ static qboolean	winsockInitialized = qfalse;
 #		include <sys/filio.h>
 #	endif
 
+#	ifdef __linux__
+#		include <sys/epoll.h>
+#		define USE_NET_BATCH
+#	endif
+
+#	include <fcntl.h>
+#	include <poll.h>
+#	include <pthread.h>
+#	define USE_NET_THREAD
+
 typedef int SOCKET;
 #	define INVALID_SOCKET		-1
 #	define SOCKET_ERROR			-1
@@ -111,6 +126,14 @@ static cvar_t	*net_mcast6iface;
 
 static cvar_t	*net_dropsim;
 
+#ifdef USE_NET_BATCH
+static cvar_t	*net_batch;
+#endif
+
+#ifdef USE_NET_THREAD
+static cvar_t	*net_thread;
+#endif
+
 static struct sockaddr	socksRelayAddr;
 
 static SOCKET	ip_socket = INVALID_SOCKET;
@@ -145,6 +168,97 @@ typedef struct
 static nip_localaddr_t localIP[MAX_IPS];
 static int numIP;
 
+// packet and syscall counters for net_stats
+typedef struct {
+	int		recvPackets;
+	int		recvCalls;
+	int		sendPackets;
+	int		sendCalls;
+	int		startTime;
+} netStats_t;
+
+static netStats_t netStats;
+
+#ifdef USE_NET_BATCH
+// number of datagrams moved per recvmmsg / sendmmsg call
+#define NET_BATCH_SIZE		32
+// outgoing packets larger than this bypass the send batch
+#define NET_BATCH_PACKETLEN	2048
+
+typedef struct {
+	struct mmsghdr			hdr[NET_BATCH_SIZE];
+	struct iovec			iov[NET_BATCH_SIZE];
+	struct sockaddr_storage	addr[NET_BATCH_SIZE];
+	byte					data[NET_BATCH_SIZE][MAX_MSGLEN + 1];
+} netRecvBatch_t;
+
+typedef struct {
+	struct mmsghdr			hdr[NET_BATCH_SIZE];
+	struct iovec			iov[NET_BATCH_SIZE];
+	struct sockaddr_storage	addr[NET_BATCH_SIZE];
+	SOCKET					sock[NET_BATCH_SIZE];
+	netadrtype_t			type[NET_BATCH_SIZE];
+	byte					data[NET_BATCH_SIZE][NET_BATCH_PACKETLEN];
+	int						count;
+	int						depth;		// nesting of Sys_BeginSendBatch calls
+} netSendBatch_t;
+
+static netRecvBatch_t	netRecvBatch;
+static netSendBatch_t	netSendBatch;
+
+static int		net_epollfd = -1;
+static int		net_epollOpens;		// tells NET_EventBatch about a restart
+
+static void NET_OpenEpoll( void );
+static qboolean NET_EpollAdd( SOCKET sock );
+#endif
+
+#ifdef USE_NET_THREAD
+/*
+The network thread blocks on the sockets, reads every datagram as soon
+as it arrives and hands it to the main thread through a single producer,
+single consumer ring.  The main thread is woken up through a pipe.
+*/
+
+// must be a power of two
+#define NET_QUEUE_SIZE		128
+
+typedef struct {
+	netadr_t	from;
+	int			cursize;
+	int			readcount;
+	byte		data[MAX_MSGLEN + 1];
+} netQueuedPacket_t;
+
+// counters owned by the network thread
+typedef struct {
+	int		recvPackets;
+	int		recvCalls;
+	int		queueFull;
+	int		rejected;
+} netThreadStats_t;
+
+static netQueuedPacket_t	netQueue[NET_QUEUE_SIZE];
+static int		netQueueHead;		// written by the network thread only
+static int		netQueueTail;		// written by the main thread only
+
+static pthread_t	netThread;
+static qboolean		netThreadRunning;
+static int			netThreadStarts;	// tells NET_ProcessQueuedPackets about a restart
+static int			netServerRunning;	// sv_running for the network thread, see NET_SetServerRunning
+static int			netThreadQuit;
+static int			netWakePipe[2] = { -1, -1 };	// network thread -> main thread
+static int			netCtrlPipe[2] = { -1, -1 };	// main thread -> network thread
+
+static netThreadStats_t	netThreadStats;
+static netThreadStats_t	netThreadStatsBase;	// values at the last net_stats
+
+static void NET_StartThread( void );
+static void NET_StopThread( void );
+#endif
+
+static void NET_Stats_f( void );
+
 
 //=============================================================================
 
@@ -513,6 +627,52 @@ qboolean	NET_IsLocalAddress( netadr_t adr ) {
 
 //=============================================================================
 
+/*
+==================
+NET_ReceivedPacket
+
+Fills in the source address of a datagram that has been read into
+net_message and validates its size
+==================
+*/
+static qboolean NET_ReceivedPacket(SOCKET sock, struct sockaddr_storage *from, socklen_t fromlen, int ret, netadr_t *net_from, msg_t *net_message)
+{
+	if(sock == ip_socket)
+	{
+		memset( ((struct sockaddr_in *)from)->sin_zero, 0, 8 );
+	
+		if ( usingSocks && memcmp( from, &socksRelayAddr, fromlen ) == 0 ) {
+			if ( ret < 10 || net_message->data[0] != 0 || net_message->data[1] != 0 || net_message->data[2] != 0 || net_message->data[3] != 1 ) {
+				return qfalse;
+			}
+			net_from->type = NA_IP;
+			net_from->ip[0] = net_message->data[4];
+			net_from->ip[1] = net_message->data[5];
+			net_from->ip[2] = net_message->data[6];
+			net_from->ip[3] = net_message->data[7];
+			net_from->port = *(short *)&net_message->data[8];
+			net_message->readcount = 10;
+		}
+		else {
+			SockadrToNetadr( (struct sockaddr *) from, net_from );
+			net_message->readcount = 0;
+		}
+	}
+	else
+	{
+		SockadrToNetadr((struct sockaddr *) from, net_from);
+		net_message->readcount = 0;
+	}
+
+	if( ret >= net_message->maxsize ) {
+		Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
+		return qfalse;
+	}
+	
+	net_message->cursize = ret;
+	return qtrue;
+}
+
 /*
 ==================
 NET_GetPacket
@@ -526,11 +686,20 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr)
 	struct sockaddr_storage from;
 	socklen_t	fromlen;
 	int		err;
-	
-	if(ip_socket != INVALID_SOCKET && FD_ISSET(ip_socket, fdr))
+	SOCKET	sockets[3];
+	int		i;
+
+	sockets[0] = ip_socket;
+	sockets[1] = ip6_socket;
+	sockets[2] = multicast6_socket != ip6_socket ? multicast6_socket : INVALID_SOCKET;
+
+	for(i = 0; i < ARRAY_LEN(sockets); i++)
 	{
+		if(sockets[i] == INVALID_SOCKET || !FD_ISSET(sockets[i], fdr))
+			continue;
+
 		fromlen = sizeof(from);
-		ret = recvfrom( ip_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen );
+		ret = recvfrom( sockets[i], (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen );
 		
 		if (ret == SOCKET_ERROR)
 		{
@@ -541,99 +710,142 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr)
 		}
 		else
 		{
+			netStats.recvCalls++;
+			netStats.recvPackets++;
 
-			memset( ((struct sockaddr_in *)&from)->sin_zero, 0, 8 );
-		
-			if ( usingSocks && memcmp( &from, &socksRelayAddr, fromlen ) == 0 ) {
-				if ( ret < 10 || net_message->data[0] != 0 || net_message->data[1] != 0 || net_message->data[2] != 0 || net_message->data[3] != 1 ) {
-					return qfalse;
-				}
-				net_from->type = NA_IP;
-				net_from->ip[0] = net_message->data[4];
-				net_from->ip[1] = net_message->data[5];
-				net_from->ip[2] = net_message->data[6];
-				net_from->ip[3] = net_message->data[7];
-				net_from->port = *(short *)&net_message->data[8];
-				net_message->readcount = 10;
-			}
-			else {
-				SockadrToNetadr( (struct sockaddr *) &from, net_from );
-				net_message->readcount = 0;
-			}
-		
-			if( ret >= net_message->maxsize ) {
-				Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
-				return qfalse;
-			}
-			
-			net_message->cursize = ret;
-			return qtrue;
+			return NET_ReceivedPacket(sockets[i], &from, fromlen, ret, net_from, net_message);
 		}
 	}
 	
-	if(ip6_socket != INVALID_SOCKET && FD_ISSET(ip6_socket, fdr))
-	{
-		fromlen = sizeof(from);
-		ret = recvfrom(ip6_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen);
-		
-		if (ret == SOCKET_ERROR)
-		{
-			err = socketError;
+	return qfalse;
+}
 
-			if( err != EAGAIN && err != ECONNRESET )
-				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
-		}
-		else
-		{
-			SockadrToNetadr((struct sockaddr *) &from, net_from);
-			net_message->readcount = 0;
-		
-			if(ret >= net_message->maxsize)
-			{
-				Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
-				return qfalse;
-			}
-			
-			net_message->cursize = ret;
-			return qtrue;
-		}
+//=============================================================================
+
+static char socksBuf[4096];
+
+/*
+==================
+NET_SendError
+==================
+*/
+static void NET_SendError( netadrtype_t type ) {
+	int err = socketError;
+
+	// wouldblock is silent
+	if( err == EAGAIN ) {
+		return;
 	}
 
-	if(multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket && FD_ISSET(multicast6_socket, fdr))
-	{
-		fromlen = sizeof(from);
-		ret = recvfrom(multicast6_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen);
-		
-		if (ret == SOCKET_ERROR)
-		{
-			err = socketError;
+	// some PPP links do not allow broadcasts and return an error
+	if( ( err == EADDRNOTAVAIL ) && ( ( type == NA_BROADCAST ) ) ) {
+		return;
+	}
 
-			if( err != EAGAIN && err != ECONNRESET )
-				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
+	Com_Printf( "Sys_SendPacket: %s\n", NET_ErrorString() );
+}
+
+#ifdef USE_NET_BATCH
+/*
+==================
+NET_FlushSendBatch
+
+Hands all queued packets to the kernel, one sendmmsg per run of
+packets going out through the same socket
+==================
+*/
+static void NET_FlushSendBatch( void ) {
+	int		first, last, ret;
+
+	first = 0;
+	while( first < netSendBatch.count ) {
+		for( last = first + 1; last < netSendBatch.count; last++ ) {
+			if( netSendBatch.sock[last] != netSendBatch.sock[first] )
+				break;
 		}
-		else
-		{
-			SockadrToNetadr((struct sockaddr *) &from, net_from);
-			net_message->readcount = 0;
-		
-			if(ret >= net_message->maxsize)
-			{
-				Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
-				return qfalse;
-			}
-			
-			net_message->cursize = ret;
-			return qtrue;
+
+		ret = sendmmsg( netSendBatch.sock[first], &netSendBatch.hdr[first], last - first, 0 );
+		netStats.sendCalls++;
+
+		if( ret == SOCKET_ERROR ) {
+			// skip the packet that failed and carry on with the rest
+			NET_SendError( netSendBatch.type[first] );
+			ret = 1;
+		}
+		else {
+			netStats.sendPackets += ret;
 		}
+
+		first += ret;
 	}
-	
-	
-	return qfalse;
+
+	netSendBatch.count = 0;
 }
 
-//=============================================================================
+/*
+==================
+NET_QueueSendBatch
 
-static char socksBuf[4096];
+Returns qfalse if the packet has to be sent right away
+==================
+*/
+static qboolean NET_QueueSendBatch( SOCKET sock, netadrtype_t type, struct sockaddr_storage *addr, int length, const void *data ) {
+	int		i;
+
+	if( !netSendBatch.depth || !net_batch || !net_batch->integer || length > NET_BATCH_PACKETLEN ) {
+		return qfalse;
+	}
+
+	i = netSendBatch.count++;
+
+	memcpy( netSendBatch.data[i], data, length );
+	netSendBatch.addr[i] = *addr;
+	netSendBatch.sock[i] = sock;
+	netSendBatch.type[i] = type;
+
+	netSendBatch.iov[i].iov_base = netSendBatch.data[i];
+	netSendBatch.iov[i].iov_len = length;
+
+	memset( &netSendBatch.hdr[i], 0, sizeof( netSendBatch.hdr[i] ) );
+	netSendBatch.hdr[i].msg_hdr.msg_name = &netSendBatch.addr[i];
+	netSendBatch.hdr[i].msg_hdr.msg_namelen = addr->ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+	netSendBatch.hdr[i].msg_hdr.msg_iov = &netSendBatch.iov[i];
+	netSendBatch.hdr[i].msg_hdr.msg_iovlen = 1;
+
+	if( netSendBatch.count == NET_BATCH_SIZE ) {
+		NET_FlushSendBatch();
+	}
+
+	return qtrue;
+}
+#endif
+
+/*
+==================
+Sys_BeginSendBatch
+
+Packets sent until the matching Sys_EndSendBatch may be
+queued up and handed to the kernel in a single call
+==================
+*/
+void Sys_BeginSendBatch( void ) {
+#ifdef USE_NET_BATCH
+	netSendBatch.depth++;
+#endif
+}
+
+/*
+==================
+Sys_EndSendBatch
+==================
+*/
+void Sys_EndSendBatch( void ) {
+#ifdef USE_NET_BATCH
+	if( netSendBatch.depth > 0 && --netSendBatch.depth == 0 ) {
+		NET_FlushSendBatch();
+	}
+#endif
+}
 
 /*
 ==================
@@ -673,25 +885,27 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 		ret = sendto( ip_socket, socksBuf, length+10, 0, &socksRelayAddr, sizeof(socksRelayAddr) );
 	}
 	else {
+#ifdef USE_NET_BATCH
+		if(addr.ss_family == AF_INET || addr.ss_family == AF_INET6)
+		{
+			if(NET_QueueSendBatch(addr.ss_family == AF_INET ? ip_socket : ip6_socket, to.type, &addr, length, data))
+				return;
+		}
+#endif
+
 		if(addr.ss_family == AF_INET)
 			ret = sendto( ip_socket, data, length, 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in) );
 		else if(addr.ss_family == AF_INET6)
 			ret = sendto( ip6_socket, data, length, 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in6) );
 	}
-	if( ret == SOCKET_ERROR ) {
-		int err = socketError;
-
-		// wouldblock is silent
-		if( err == EAGAIN ) {
-			return;
-		}
 
-		// some PPP links do not allow broadcasts and return an error
-		if( ( err == EADDRNOTAVAIL ) && ( ( to.type == NA_BROADCAST ) ) ) {
-			return;
-		}
+	netStats.sendCalls++;
 
-		Com_Printf( "Sys_SendPacket: %s\n", NET_ErrorString() );
+	if( ret == SOCKET_ERROR ) {
+		NET_SendError( to.type );
+	}
+	else {
+		netStats.sendPackets++;
 	}
 }
 
@@ -999,9 +1213,18 @@ Join an ipv6 multicast group
 void NET_JoinMulticast6(void)
 {
 	int err;
+#ifdef USE_NET_THREAD
+	qboolean restart;
+#endif
 	
 	if(ip6_socket == INVALID_SOCKET || multicast6_socket != INVALID_SOCKET || (net_enabled->integer & NET_DISABLEMCAST))
 		return;
+
+#ifdef USE_NET_THREAD
+	// the network thread polls the sockets, it must not see them change
+	restart = netThreadRunning;
+	NET_StopThread();
+#endif
 	
 	if(IN6_IS_ADDR_MULTICAST(&boundto.sin6_addr) || IN6_IS_ADDR_UNSPECIFIED(&boundto.sin6_addr))
 	{
@@ -1028,12 +1251,12 @@ void NET_JoinMulticast6(void)
 			{
 				closesocket(multicast6_socket);
 				multicast6_socket = INVALID_SOCKET;
-				return;
 			}
 		}
 	}
 
-	if (setsockopt(multicast6_socket, IPPROTO_IPV6, IPV6_JOIN_GROUP, (char *) &curgroup, sizeof(curgroup)))
+	if (multicast6_socket != INVALID_SOCKET &&
+		setsockopt(multicast6_socket, IPPROTO_IPV6, IPV6_JOIN_GROUP, (char *) &curgroup, sizeof(curgroup)))
 	{
 		Com_Printf("NET_JoinMulticast6: Couldn't join multicast group: %s\n", NET_ErrorString());
 
@@ -1041,21 +1264,50 @@ void NET_JoinMulticast6(void)
 		{
 			closesocket(multicast6_socket);
 			multicast6_socket = INVALID_SOCKET;
-			return;
 		}
 	}
+
+#ifdef USE_NET_BATCH
+	if(net_epollfd != -1 && multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket)
+		NET_EpollAdd(multicast6_socket);
+#endif
+
+#ifdef USE_NET_THREAD
+	if(restart)
+		NET_StartThread();
+#endif
 }
 
 void NET_LeaveMulticast6()
 {
+#ifdef USE_NET_THREAD
+	qboolean restart;
+#endif
+
 	if(multicast6_socket != INVALID_SOCKET)
 	{
+#ifdef USE_NET_THREAD
+		restart = netThreadRunning;
+		NET_StopThread();
+#endif
+
 		if(multicast6_socket != ip6_socket)
+		{
+#ifdef USE_NET_BATCH
+			if(net_epollfd != -1)
+				epoll_ctl(net_epollfd, EPOLL_CTL_DEL, multicast6_socket, NULL);
+#endif
 			closesocket(multicast6_socket);
+		}
 		else
 			setsockopt(multicast6_socket, IPPROTO_IPV6, IPV6_LEAVE_GROUP, (char *) &curgroup, sizeof(curgroup));
 
 		multicast6_socket = INVALID_SOCKET;
+
+#ifdef USE_NET_THREAD
+		if(restart)
+			NET_StartThread();
+#endif
 	}
 }
 
@@ -1480,6 +1732,18 @@ static qboolean NET_GetCvars( void ) {
 
 	net_dropsim = Cvar_Get("net_dropsim", "", CVAR_TEMP);
 
+#ifdef USE_NET_BATCH
+	net_batch = Cvar_Get( "net_batch", "1", CVAR_LATCH | CVAR_ARCHIVE );
+	modified += net_batch->modified;
+	net_batch->modified = qfalse;
+#endif
+
+#ifdef USE_NET_THREAD
+	net_thread = Cvar_Get( "net_thread", "0", CVAR_LATCH | CVAR_ARCHIVE );
+	modified += net_thread->modified;
+	net_thread->modified = qfalse;
+#endif
+
 	return modified ? qtrue : qfalse;
 }
 
@@ -1529,6 +1793,19 @@ void NET_Config( qboolean enableNetworking ) {
 	}
 
 	if( stop ) {
+#ifdef USE_NET_THREAD
+		NET_StopThread();
+#endif
+
+#ifdef USE_NET_BATCH
+		NET_FlushSendBatch();
+
+		if ( net_epollfd != -1 ) {
+			close( net_epollfd );
+			net_epollfd = -1;
+		}
+#endif
+
 		if ( ip_socket != INVALID_SOCKET ) {
 			closesocket( ip_socket );
 			ip_socket = INVALID_SOCKET;
@@ -1560,6 +1837,15 @@ void NET_Config( qboolean enableNetworking ) {
 		{
 			NET_OpenIP();
 			NET_SetMulticast6();
+#ifdef USE_NET_THREAD
+			if( net_thread->integer )
+				NET_StartThread();
+#endif
+
+#ifdef USE_NET_BATCH
+			if( !NET_ThreadActive() )
+				NET_OpenEpoll();
+#endif
 		}
 	}
 }
@@ -1587,6 +1873,7 @@ void NET_Init( void ) {
 	NET_Config( qtrue );
 	
 	Cmd_AddCommand ("net_restart", NET_Restart_f);
+	Cmd_AddCommand ("net_stats", NET_Stats_f);
 }
 
 
@@ -1608,6 +1895,26 @@ void NET_Shutdown( void ) {
 #endif
 }
 
+/*
+====================
+NET_DispatchPacket
+====================
+*/
+static void NET_DispatchPacket(netadr_t *from, msg_t *netmsg)
+{
+	if(net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f)
+	{
+		// com_dropsim->value percent of incoming packets get dropped.
+		if(rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value))
+			return;          // drop this packet
+	}
+
+	if(com_sv_running->integer)
+		Com_RunAndTimeServerPacket(from, netmsg);
+	else
+		CL_PacketEvent(*from, netmsg);
+}
+
 /*
 ====================
 NET_Event
@@ -1622,69 +1929,586 @@ void NET_Event(fd_set *fdr)
 	netadr_t from;
 	msg_t netmsg;
 	
+	Sys_BeginSendBatch();
+
 	while(1)
 	{
 		MSG_Init(&netmsg, bufData, sizeof(bufData));
 
 		if(NET_GetPacket(&from, &netmsg, fdr))
-		{
-			if(net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f)
-			{
-				// com_dropsim->value percent of incoming packets get dropped.
-				if(rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value))
-					continue;          // drop this packet
-			}
-
-			if(com_sv_running->integer)
-				Com_RunAndTimeServerPacket(&from, &netmsg);
-			else
-				CL_PacketEvent(from, &netmsg);
-		}
+			NET_DispatchPacket(&from, &netmsg);
 		else
 			break;
 	}
+
+	Sys_EndSendBatch();
 }
 
+#ifdef USE_NET_BATCH
 /*
 ====================
-NET_Sleep
-
-Sleeps msec or until something happens on the network
+NET_EpollAdd
 ====================
 */
-void NET_Sleep(int msec)
+static qboolean NET_EpollAdd(SOCKET sock)
 {
-	struct timeval timeout;
-	fd_set fdr;
-	int retval;
-	SOCKET highestfd = INVALID_SOCKET;
+	struct epoll_event ev;
 
-	if(msec < 0)
-		msec = 0;
-
-	FD_ZERO(&fdr);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = sock;
 
-	if(ip_socket != INVALID_SOCKET)
+	if(epoll_ctl(net_epollfd, EPOLL_CTL_ADD, sock, &ev) == -1)
 	{
-		FD_SET(ip_socket, &fdr);
-
-		highestfd = ip_socket;
+		Com_Printf("WARNING: NET_EpollAdd: epoll_ctl: %s\n", NET_ErrorString());
+		return qfalse;
 	}
-	if(ip6_socket != INVALID_SOCKET)
-	{
-		FD_SET(ip6_socket, &fdr);
 
-		if(highestfd == INVALID_SOCKET || ip6_socket > highestfd)
-			highestfd = ip6_socket;
-	}
+	return qtrue;
+}
 
-#ifdef _WIN32
-	if(highestfd == INVALID_SOCKET)
-	{
-		// windows ain't happy when select is called without valid FDs
-		SleepEx(msec, 0);
-		return;
-	}
+/*
+====================
+NET_OpenEpoll
+====================
+*/
+static void NET_OpenEpoll(void)
+{
+	SOCKET sockets[3];
+	int i;
+
+	if(!net_batch->integer)
+		return;
+
+	net_epollfd = epoll_create(3);
+	if(net_epollfd == -1)
+	{
+		Com_Printf("WARNING: NET_OpenEpoll: epoll_create: %s\n", NET_ErrorString());
+		return;
+	}
+	net_epollOpens++;
+
+	sockets[0] = ip_socket;
+	sockets[1] = ip6_socket;
+	sockets[2] = multicast6_socket != ip6_socket ? multicast6_socket : INVALID_SOCKET;
+
+	for(i = 0; i < ARRAY_LEN(sockets); i++)
+	{
+		if(sockets[i] == INVALID_SOCKET)
+			continue;
+
+		if(!NET_EpollAdd(sockets[i]))
+		{
+			close(net_epollfd);
+			net_epollfd = -1;
+			return;
+		}
+	}
+}
+
+/*
+====================
+NET_EventBatch
+
+Drains a socket with recvmmsg and dispatches all received packets
+====================
+*/
+static void NET_EventBatch(SOCKET sock)
+{
+	netadr_t from;
+	msg_t netmsg;
+	int i, ret, err;
+	int opens = net_epollOpens;
+
+	Sys_BeginSendBatch();
+
+	do
+	{
+		for(i = 0; i < NET_BATCH_SIZE; i++)
+		{
+			netRecvBatch.iov[i].iov_base = netRecvBatch.data[i];
+			netRecvBatch.iov[i].iov_len = sizeof(netRecvBatch.data[i]);
+
+			memset(&netRecvBatch.hdr[i], 0, sizeof(netRecvBatch.hdr[i]));
+			netRecvBatch.hdr[i].msg_hdr.msg_name = &netRecvBatch.addr[i];
+			netRecvBatch.hdr[i].msg_hdr.msg_namelen = sizeof(netRecvBatch.addr[i]);
+			netRecvBatch.hdr[i].msg_hdr.msg_iov = &netRecvBatch.iov[i];
+			netRecvBatch.hdr[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		ret = recvmmsg(sock, netRecvBatch.hdr, NET_BATCH_SIZE, MSG_DONTWAIT, NULL);
+
+		if(ret == SOCKET_ERROR)
+		{
+			err = socketError;
+
+			if(err != EAGAIN && err != ECONNRESET)
+				Com_Printf("NET_EventBatch: %s\n", NET_ErrorString());
+			break;
+		}
+
+		netStats.recvCalls++;
+		netStats.recvPackets += ret;
+
+		for(i = 0; i < ret; i++)
+		{
+			MSG_Init(&netmsg, netRecvBatch.data[i], sizeof(netRecvBatch.data[i]));
+
+			if(NET_ReceivedPacket(sock, &netRecvBatch.addr[i], netRecvBatch.hdr[i].msg_hdr.msg_namelen,
+				netRecvBatch.hdr[i].msg_len, &from, &netmsg))
+			{
+				NET_DispatchPacket(&from, &netmsg);
+			}
+
+			// a packet may have caused the network to be restarted,
+			// which closes sock and possibly opens a new epoll set
+			if(net_epollfd == -1 || net_epollOpens != opens)
+			{
+				Sys_EndSendBatch();
+				return;
+			}
+		}
+	} while(ret == NET_BATCH_SIZE);
+
+	Sys_EndSendBatch();
+}
+
+/*
+====================
+NET_SleepEpoll
+====================
+*/
+static void NET_SleepEpoll(int msec)
+{
+	struct epoll_event events[3];
+	int i, retval;
+	int opens = net_epollOpens;
+
+	retval = epoll_wait(net_epollfd, events, ARRAY_LEN(events), msec);
+
+	if(retval == SOCKET_ERROR)
+	{
+		if(socketError != EINTR)
+			Com_Printf("Warning: epoll_wait() syscall failed: %s\n", NET_ErrorString());
+		return;
+	}
+
+	// the other events are stale if the network was restarted
+	for(i = 0; i < retval && net_epollfd != -1 && net_epollOpens == opens; i++)
+		NET_EventBatch(events[i].data.fd);
+}
+#endif
+
+#ifdef USE_NET_THREAD
+/*
+====================
+NET_ThreadDrainSocket
+
+Network thread: reads everything pending on a socket into the queue
+Returns qtrue if anything was queued
+====================
+*/
+static qboolean NET_ThreadDrainSocket(SOCKET sock)
+{
+	static byte scratch[MAX_MSGLEN + 1];
+	netQueuedPacket_t *slot;
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	msg_t netmsg;
+	byte *data;
+	int head, tail, ret;
+	qboolean queued = qfalse;
+
+	while(1)
+	{
+		head = netQueueHead;
+		tail = __atomic_load_n(&netQueueTail, __ATOMIC_ACQUIRE);
+
+		// read into a scratch buffer if the main thread is falling behind,
+		// so that the socket still gets drained
+		if(head - tail >= NET_QUEUE_SIZE)
+		{
+			slot = NULL;
+			data = scratch;
+		}
+		else
+		{
+			slot = &netQueue[head & (NET_QUEUE_SIZE - 1)];
+			data = slot->data;
+		}
+
+		fromlen = sizeof(from);
+		ret = recvfrom(sock, (void *)data, MAX_MSGLEN + 1, 0, (struct sockaddr *) &from, &fromlen);
+
+		if(ret == SOCKET_ERROR)
+			break;
+
+		netThreadStats.recvCalls++;
+		netThreadStats.recvPackets++;
+
+		if(!slot)
+		{
+			netThreadStats.queueFull++;
+			continue;
+		}
+
+		// oversize packets are dropped here rather than reported,
+		// the console is not safe to use from this thread
+		if(ret > MAX_MSGLEN)
+		{
+			netThreadStats.rejected++;
+			continue;
+		}
+
+		Com_Memset(&netmsg, 0, sizeof(netmsg));
+		netmsg.data = data;
+		netmsg.maxsize = MAX_MSGLEN + 1;
+
+		if(!NET_ReceivedPacket(sock, &from, fromlen, ret, &slot->from, &netmsg))
+		{
+			netThreadStats.rejected++;
+			continue;
+		}
+
+		if(__atomic_load_n(&netServerRunning, __ATOMIC_ACQUIRE) && !SV_PrefilterPacket(&slot->from, &netmsg))
+		{
+			netThreadStats.rejected++;
+			continue;
+		}
+
+		slot->cursize = netmsg.cursize;
+		slot->readcount = netmsg.readcount;
+
+		__atomic_store_n(&netQueueHead, head + 1, __ATOMIC_RELEASE);
+		queued = qtrue;
+	}
+
+	return queued;
+}
+
+/*
+====================
+NET_ThreadMain
+====================
+*/
+static void *NET_ThreadMain(void *arg)
+{
+	struct pollfd fds[4];
+	byte junk[64];
+	int i, nfds, ret;
+	qboolean queued;
+
+	while(!__atomic_load_n(&netThreadQuit, __ATOMIC_ACQUIRE))
+	{
+		nfds = 0;
+
+		fds[nfds].fd = netCtrlPipe[0];
+		fds[nfds++].events = POLLIN;
+
+		if(ip_socket != INVALID_SOCKET)
+		{
+			fds[nfds].fd = ip_socket;
+			fds[nfds++].events = POLLIN;
+		}
+		if(ip6_socket != INVALID_SOCKET)
+		{
+			fds[nfds].fd = ip6_socket;
+			fds[nfds++].events = POLLIN;
+		}
+		// the sockets only change while the thread is stopped, see NET_JoinMulticast6
+		if(multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket)
+		{
+			fds[nfds].fd = multicast6_socket;
+			fds[nfds++].events = POLLIN;
+		}
+
+		ret = poll(fds, nfds, -1);
+		if(ret < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+
+		if(fds[0].revents)
+		{
+			while(read(netCtrlPipe[0], junk, sizeof(junk)) > 0)
+				;
+		}
+
+		queued = qfalse;
+		for(i = 1; i < nfds; i++)
+		{
+			if(fds[i].revents & POLLIN)
+				queued |= NET_ThreadDrainSocket(fds[i].fd);
+		}
+
+		if(queued)
+		{
+			// wake up the main thread, a full pipe is as good as a write
+			if(write(netWakePipe[1], "", 1) < 0)
+				;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+====================
+NET_OpenPipe
+====================
+*/
+static qboolean NET_OpenPipe(int fds[2])
+{
+	if(pipe(fds) == -1)
+	{
+		fds[0] = fds[1] = -1;
+		return qfalse;
+	}
+
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	return qtrue;
+}
+
+/*
+====================
+NET_ClosePipe
+====================
+*/
+static void NET_ClosePipe(int fds[2])
+{
+	if(fds[0] != -1)
+		close(fds[0]);
+	if(fds[1] != -1)
+		close(fds[1]);
+
+	fds[0] = fds[1] = -1;
+}
+
+/*
+====================
+NET_StartThread
+====================
+*/
+static void NET_StartThread(void)
+{
+	if(netThreadRunning)
+		return;
+
+	if(!NET_OpenPipe(netWakePipe) || !NET_OpenPipe(netCtrlPipe))
+	{
+		Com_Printf("WARNING: NET_StartThread: pipe: %s\n", NET_ErrorString());
+		NET_ClosePipe(netWakePipe);
+		NET_ClosePipe(netCtrlPipe);
+		return;
+	}
+
+	netQueueHead = netQueueTail = 0;
+	netThreadQuit = 0;
+
+	if(pthread_create(&netThread, NULL, NET_ThreadMain, NULL))
+	{
+		Com_Printf("WARNING: NET_StartThread: couldn't create the network thread\n");
+		NET_ClosePipe(netWakePipe);
+		NET_ClosePipe(netCtrlPipe);
+		return;
+	}
+
+	netThreadRunning = qtrue;
+	netThreadStarts++;
+	Com_Printf("Network thread started\n");
+}
+
+/*
+====================
+NET_StopThread
+
+Must be called before the sockets are closed
+====================
+*/
+static void NET_StopThread(void)
+{
+	if(!netThreadRunning)
+		return;
+
+	__atomic_store_n(&netThreadQuit, 1, __ATOMIC_RELEASE);
+	if(write(netCtrlPipe[1], "", 1) < 0)
+		;
+	pthread_join(netThread, NULL);
+
+	netThreadRunning = qfalse;
+
+	// anything still queued is discarded along with the sockets
+	netQueueHead = netQueueTail = 0;
+
+	NET_ClosePipe(netWakePipe);
+	NET_ClosePipe(netCtrlPipe);
+}
+
+/*
+====================
+NET_SleepThread
+
+Waits for the network thread to queue something
+====================
+*/
+static void NET_SleepThread(int msec)
+{
+	struct pollfd fd;
+	byte junk[64];
+
+	fd.fd = netWakePipe[0];
+	fd.events = POLLIN;
+	fd.revents = 0;
+
+	if(poll(&fd, 1, msec) > 0)
+	{
+		while(read(netWakePipe[0], junk, sizeof(junk)) > 0)
+			;
+	}
+
+	NET_ProcessQueuedPackets();
+}
+#endif
+
+/*
+====================
+NET_SetServerRunning
+
+The network thread can't read cvars, the server publishes whether it is
+running through here
+====================
+*/
+void NET_SetServerRunning(qboolean running)
+{
+#ifdef USE_NET_THREAD
+	__atomic_store_n(&netServerRunning, running ? 1 : 0, __ATOMIC_RELEASE);
+#endif
+}
+
+/*
+====================
+NET_ThreadActive
+
+Returns qtrue if packets are being read by the network thread
+====================
+*/
+qboolean NET_ThreadActive(void)
+{
+#ifdef USE_NET_THREAD
+	return netThreadRunning;
+#else
+	return qfalse;
+#endif
+}
+
+/*
+====================
+NET_ProcessQueuedPackets
+
+Dispatches everything the network thread has queued up, in order
+====================
+*/
+void NET_ProcessQueuedPackets(void)
+{
+#ifdef USE_NET_THREAD
+	byte bufData[MAX_MSGLEN + 1];
+	netQueuedPacket_t *slot;
+	netadr_t from;
+	msg_t netmsg;
+	int starts;
+
+	if(!netThreadRunning)
+		return;
+
+	Sys_BeginSendBatch();
+
+	starts = netThreadStarts;
+	while(netQueueTail != __atomic_load_n(&netQueueHead, __ATOMIC_ACQUIRE))
+	{
+		slot = &netQueue[netQueueTail & (NET_QUEUE_SIZE - 1)];
+
+		// copy the packet out and release the slot before dispatching,
+		// since a packet can drop the server or restart the network
+		MSG_Init(&netmsg, bufData, sizeof(bufData));
+		Com_Memcpy(bufData, slot->data, slot->cursize);
+		netmsg.cursize = slot->cursize;
+		netmsg.readcount = slot->readcount;
+		from = slot->from;
+
+		__atomic_store_n(&netQueueTail, netQueueTail + 1, __ATOMIC_RELEASE);
+
+		NET_DispatchPacket(&from, &netmsg);
+
+		// a packet may have restarted the network, which empties the
+		// queue, and possibly started a new thread filling it again
+		if(!netThreadRunning || netThreadStarts != starts)
+			break;
+	}
+
+	Sys_EndSendBatch();
+#endif
+}
+
+/*
+====================
+NET_Sleep
+
+Sleeps msec or until something happens on the network
+====================
+*/
+void NET_Sleep(int msec)
+{
+	struct timeval timeout;
+	fd_set fdr;
+	int retval;
+	SOCKET highestfd = INVALID_SOCKET;
+
+	if(msec < 0)
+		msec = 0;
+
+#ifdef USE_NET_THREAD
+	if(netThreadRunning)
+	{
+		NET_SleepThread(msec);
+		return;
+	}
+#endif
+
+#ifdef USE_NET_BATCH
+	if(net_epollfd != -1)
+	{
+		NET_SleepEpoll(msec);
+		return;
+	}
+#endif
+
+	FD_ZERO(&fdr);
+
+	if(ip_socket != INVALID_SOCKET)
+	{
+		FD_SET(ip_socket, &fdr);
+
+		highestfd = ip_socket;
+	}
+	if(ip6_socket != INVALID_SOCKET)
+	{
+		FD_SET(ip6_socket, &fdr);
+
+		if(highestfd == INVALID_SOCKET || ip6_socket > highestfd)
+			highestfd = ip6_socket;
+	}
+
+#ifdef _WIN32
+	if(highestfd == INVALID_SOCKET)
+	{
+		// windows ain't happy when select is called without valid FDs
+		SleepEx(msec, 0);
+		return;
+	}
 #endif
 
 	timeout.tv_sec = msec/1000;
@@ -1698,6 +2522,58 @@ void NET_Sleep(int msec)
 		NET_Event(&fdr);
 }
 
+/*
+====================
+NET_Stats_f
+
+Prints packet and syscall rates since the last call
+====================
+*/
+static void NET_Stats_f(void)
+{
+	int now, msec;
+
+	now = Sys_Milliseconds();
+	msec = now - netStats.startTime;
+
+	if(netStats.startTime && msec > 0)
+	{
+		Com_Printf("%.3f seconds\n", msec / 1000.0f);
+		Com_Printf("recv: %i packets (%.0f/s) in %i calls (%.2f packets/call)\n",
+			netStats.recvPackets, netStats.recvPackets * 1000.0f / msec, netStats.recvCalls,
+			netStats.recvCalls ? (float)netStats.recvPackets / netStats.recvCalls : 0.0f);
+		Com_Printf("send: %i packets (%.0f/s) in %i calls (%.2f packets/call)\n",
+			netStats.sendPackets, netStats.sendPackets * 1000.0f / msec, netStats.sendCalls,
+			netStats.sendCalls ? (float)netStats.sendPackets / netStats.sendCalls : 0.0f);
+	}
+	else
+		Com_Printf("net_stats: counters reset\n");
+
+#ifdef USE_NET_THREAD
+	if(netThreadRunning)
+	{
+		netThreadStats_t cur = netThreadStats;
+
+		if(netStats.startTime && msec > 0)
+		{
+			Com_Printf("thread: %i packets (%.0f/s), %i rejected, %i dropped on a full queue\n",
+				cur.recvPackets - netThreadStatsBase.recvPackets,
+				(cur.recvPackets - netThreadStatsBase.recvPackets) * 1000.0f / msec,
+				cur.rejected - netThreadStatsBase.rejected,
+				cur.queueFull - netThreadStatsBase.queueFull);
+		}
+		netThreadStatsBase = cur;
+	}
+#endif
+
+#ifdef USE_NET_BATCH
+	Com_Printf("batched I/O: %s\n", net_epollfd != -1 ? "enabled" : "disabled");
+#endif
+
+	Com_Memset(&netStats, 0, sizeof(netStats));
+	netStats.startTime = now;
+}
+
 /*
 ====================
 NET_Restart_f
@@ -54,6 +54,8 @@ void MSG_Init (msg_t *buf, byte *data, int length);
 void MSG_InitOOB( msg_t *buf, byte *data, int length );
 void MSG_Clear (msg_t *buf);
 void MSG_WriteData (msg_t *buf, const void *data, int length);
+void MSG_WriteBitstream( msg_t *buf, const byte *data, int bits );
+// appends bits previously written to another bitstream message
 void MSG_Bitstream( msg_t *buf );
 
 // TTimo
@@ -186,6 +188,27 @@ qboolean	NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, msg_t *net_messag
 void		NET_JoinMulticast6(void);
 void		NET_LeaveMulticast6(void);
 void		NET_Sleep(int msec);
+qboolean	NET_ThreadActive(void);
+void		NET_SetServerRunning(qboolean running);
+void		NET_ProcessQueuedPackets(void);
+
+// snapshots a server hands to the client in the same process without
+// encoding them, the message itself only carries the tag
+typedef struct {
+	int				tag;
+	int				serverTime;
+	int				snapFlags;
+	int				areabytes;
+	byte			areamask[MAX_MAP_AREA_BYTES];
+	playerState_t	ps;
+	int				numEntities;
+	entityState_t	entities[MAX_SNAPSHOT_ENTITIES];
+} loopSnapshot_t;
+
+void		NET_SetLoopSnapshots( qboolean accept );
+qboolean	NET_LoopSnapshotsAccepted( void );
+loopSnapshot_t	*NET_AllocLoopSnapshot( void );
+const loopSnapshot_t	*NET_GetLoopSnapshot( int tag );
 
 
 #define	MAX_MSGLEN				16384		// max length of a message, which may
@@ -301,6 +324,7 @@ enum svc_ops_e {
 
 // new commands, supported only by ioquake3 protocol but not legacy
 	svc_voip,     // not wrapped in USE_VOIP, so this value is reserved.
+	svc_loopSnapshot,			// [long] tag, only sent to a client in the same process
 };
 
 
@@ -370,6 +394,7 @@ void	VM_Debug( int level );
 
 void	*VM_ArgPtr( intptr_t intValue );
 void	*VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue );
+qboolean	VM_IsNative( vm_t *vm );
 
 #define	VMA(x) VM_ArgPtr(args[x])
 static ID_INLINE float _vmf(intptr_t x)
@@ -509,6 +534,10 @@ void	Cvar_Register( vmCvar_t *vmCvar, const char *varName, const char *defaultVa
 void	Cvar_Update( vmCvar_t *vmCvar );
 // updates an interpreted modules' version of a cvar
 
+const cvar_t	*Cvar_Table( void );
+// the cvars indexed by vmCvar_t handle, so a native module can check
+// modificationCount itself and skip Cvar_Update for unchanged cvars
+
 void 	Cvar_Set( const char *var_name, const char *value );
 // will create the variable with no flags if it doesn't exist
 
@@ -711,6 +740,9 @@ const char *FS_ReferencedPakPureChecksums( void );
 // AND referenced pk3 files. Servers with sv_pure set will get this string 
 // back from clients for pure validation 
 
+qboolean FS_PakOSPath( const char *pakName, char *ospath, int size );
+// Finds the full path of a pk3 named gamedir/basename, as returned by FS_ReferencedPakNames.
+
 void FS_ClearPakReferences( int flags );
 // clears referenced booleans on loaded pk3s
 
@@ -1036,6 +1068,7 @@ void SV_Init( void );
 void SV_Shutdown( char *finalmsg );
 void SV_Frame( int msec );
 void SV_PacketEvent( netadr_t from, msg_t *msg );
+qboolean SV_PrefilterPacket( netadr_t *from, msg_t *msg );
 int SV_FrameMsec(void);
 qboolean SV_GameCommand( void );
 int SV_SendQueuedPackets(void);
@@ -1085,6 +1118,8 @@ cpuFeatures_t Sys_GetProcessorFeatures( void );
 void	Sys_SetErrorText( const char *text );
 
 void	Sys_SendPacket( int length, const void *data, netadr_t to );
+void	Sys_BeginSendBatch( void );
+void	Sys_EndSendBatch( void );
 
 qboolean	Sys_StringToAdr( const char *s, netadr_t *a, netadrtype_t family );
 //Does NOT parse port numbers, only base addresses.
@@ -43,7 +43,6 @@ int		vm_debugLevel;
 // used by Com_Error to get rid of running vm's before longjmp
 static int forced_unload;
 
-#define	MAX_VM		3
 vm_t	vmTable[MAX_VM];
 
 
@@ -73,9 +72,12 @@ void VM_Init( void ) {
 	Cvar_Get( "vm_cgame", "0", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_game", "0", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_ui", "2", CVAR_ARCHIVE );		// !@# SHIP WITH SET TO 2
+	Cvar_Get( "vm_optimize", "1", CVAR_ARCHIVE );	// x86_64 compiler keeps values in registers
+	Cvar_Get( "vm_codeCache", "1", CVAR_ARCHIVE );	// x86_64 compiler saves its code, see VM_LoadCodeCache
 
 	Cmd_AddCommand ("vmprofile", VM_VmProfile_f );
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f );
+	Cmd_AddCommand ("vmsample", VM_Sample_f );
 
 	Com_Memset( vmTable, 0, sizeof( vmTable ) );
 }
@@ -157,10 +159,7 @@ int VM_SymbolToValue( vm_t *vm, const char *symbol ) {
 VM_SymbolForCompiledPointer
 =====================
 */
-#if 0 // 64bit!
 const char *VM_SymbolForCompiledPointer( vm_t *vm, void *code ) {
-	int			i;
-
 	if ( code < (void *)vm->codeBase ) {
 		return "Before code block";
 	}
@@ -168,18 +167,9 @@ const char *VM_SymbolForCompiledPointer( vm_t *vm, void *code ) {
 		return "After code block";
 	}
 
-	// find which original instruction it is after
-	for ( i = 0 ; i < vm->codeLength ; i++ ) {
-		if ( (void *)vm->instructionPointers[i] > code ) {
-			break;
-		}
-	}
-	i--;
-
-	// now look up the bytecode instruction pointer
-	return VM_ValueToSymbol( vm, i );
+	// the symbols of a compiled vm are offsets in the compiled code
+	return VM_ValueToSymbol( vm, (byte *)code - vm->codeBase );
 }
-#endif
 
 
 
@@ -284,6 +274,9 @@ void VM_LoadSymbols( vm_t *vm ) {
 		// convert value from an instruction number to a code offset
 		if ( value >= 0 && value < numInstructions ) {
 			value = vm->instructionPointers[value];
+			if ( vm->compiled ) {
+				value -= (intptr_t)vm->codeBase;
+			}
 		}
 
 		sym->symValue = value;
@@ -857,6 +850,17 @@ void *VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue ) {
 	}
 }
 
+/*
+==============
+VM_IsNative
+
+Only a native module can follow a pointer into the engine
+==============
+*/
+qboolean VM_IsNative( vm_t *vm ) {
+	return vm->entryPoint != NULL;
+}
+
 
 /*
 ==============
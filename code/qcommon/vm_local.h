@@ -185,6 +185,9 @@ struct vm_s {
 };
 
 
+#define	MAX_VM		3
+
+extern	vm_t	vmTable[MAX_VM];
 extern	vm_t	*currentVM;
 extern	int		vm_debugLevel;
 
@@ -197,6 +200,12 @@ int	VM_CallInterpreted( vm_t *vm, int *args );
 vmSymbol_t *VM_ValueToFunctionSymbol( vm_t *vm, int value );
 int VM_SymbolToValue( vm_t *vm, const char *symbol );
 const char *VM_ValueToSymbol( vm_t *vm, int value );
+const char *VM_SymbolForCompiledPointer( vm_t *vm, void *code );
 void VM_LogSyscalls( int *args );
 
 void VM_BlockCopy(unsigned int dest, unsigned int src, size_t n);
+
+// vm_sample.c
+qboolean VM_SampleEnter( void *stack );
+void VM_SampleLeave( void );
+void VM_Sample_f( void );
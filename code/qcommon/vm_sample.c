@@ -0,0 +1,782 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// vm_sample.c -- sampling profiler for the engine and the game modules
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// for dladdr1 and the register names in ucontext_t
+#	define _GNU_SOURCE
+#endif
+
+#include "vm_local.h"
+
+/*
+===============================================================================
+
+SAMPLING PROFILER
+
+"vmsample start" sets a SIGPROF timer, and every tick the thread that
+used the cpu records its stack into a buffer.  The handler only takes the
+registers from the signal context and follows the saved frame pointers,
+which the Linux builds keep, and reads nothing outside the thread's own
+stack.  The walk ends at compiled qvm code, so VM_CallCompiled notes where
+it entered the qvm, and the qvm functions in between are the return
+addresses into the compiled code found on the stack from there.  Threads
+that never entered a vm haven't looked up their stack yet and only record
+where they were.  "vmsample stop" names the
+frames and writes one line of folded stack and count for each different
+stack, which flamegraph.pl and most other flame graph tools read.
+
+Native frames are named from the ELF symbol tables of the modules, qvm
+frames from the .map symbols that VM_LoadSymbols loads with developer 1.
+
+===============================================================================
+*/
+
+#if defined(__linux__) && ( idx64 || id386 )
+#define	VM_SAMPLER
+#endif
+
+#ifdef VM_SAMPLER
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <elf.h>
+#include <ucontext.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define	SAMPLE_FRAMES			64		// walked per sample
+#define	SAMPLE_MAX_FRAMES		128		// with the qvm frames and the ones under VM_CallCompiled
+#define	SAMPLE_ENTRIES			4		// nested VM_CallCompiled noted per thread
+#define	SAMPLE_BUFFER_WORDS		( 2 * 1024 * 1024 )
+#define	SAMPLE_MAX_MODULES		32
+
+#define	SAMPLE_DEFAULT_HZ		997		// not a multiple of the server frame rate
+
+#if idx64
+#define	SAMPLE_PC(uc)			( (uc)->uc_mcontext.gregs[REG_RIP] )
+#define	SAMPLE_SP(uc)			( (uc)->uc_mcontext.gregs[REG_RSP] )
+#define	SAMPLE_FP(uc)			( (uc)->uc_mcontext.gregs[REG_RBP] )
+#define	SAMPLE_ST_TYPE(info)	ELF64_ST_TYPE( info )
+
+// a frame in compiled qvm code is kept as the vm and the code offset, the
+// code may be gone by the time the samples are written
+#define	SAMPLE_VM_BIT			( (uintptr_t)1 << 63 )
+#define	SAMPLE_VM_FRAME(s, ofs)	( SAMPLE_VM_BIT | (uintptr_t)(s) << 32 | (uint32_t)(ofs) )
+#else
+#define	SAMPLE_PC(uc)			( (uc)->uc_mcontext.gregs[REG_EIP] )
+#define	SAMPLE_SP(uc)			( (uc)->uc_mcontext.gregs[REG_ESP] )
+#define	SAMPLE_FP(uc)			( (uc)->uc_mcontext.gregs[REG_EBP] )
+#define	SAMPLE_ST_TYPE(info)	ELF32_ST_TYPE( info )
+#endif
+
+typedef struct {
+	uintptr_t	sp;					// the compiled code runs below this
+	int			numFrames;
+	uintptr_t	frames[SAMPLE_FRAMES / 2];
+} sampleEntry_t;
+
+typedef struct {
+	uintptr_t	value;
+	uintptr_t	size;
+	int			name;				// into strings
+} sampleSymbol_t;
+
+typedef struct {
+	struct link_map	*map;
+	char			name[MAX_QPATH];	// the file name without the path
+	int				numSymbols;
+	sampleSymbol_t	*symbols;			// sorted by value
+	char			*strings;
+} sampleModule_t;
+
+static volatile int		sampleActive;
+static volatile int		sampleHandlers;		// in VM_SampleSignal right now
+static qboolean			sampleInstalled;
+
+static uintptr_t		*sampleBuffer;		// each sample is the frame count and the frames, leaf first
+static volatile int		sampleUsed;
+static volatile int		sampleDropped;
+static int				sampleStartTime;
+
+static __thread sampleEntry_t	sampleEntries[SAMPLE_ENTRIES];
+static __thread int				sampleDepth;
+static __thread uintptr_t		sampleStackTop;		// 0 until VM_SampleThreadStack
+
+static sampleModule_t	sampleModules[SAMPLE_MAX_MODULES];
+static int				numSampleModules;
+
+/*
+=================
+VM_SampleThreadStack
+
+Notes the top of the calling thread's stack, for VM_SampleWalk
+=================
+*/
+static void VM_SampleThreadStack( void ) {
+	pthread_attr_t	attr;
+	void			*addr;
+	size_t			size;
+
+	if ( sampleStackTop || pthread_getattr_np( pthread_self(), &attr ) ) {
+		return;
+	}
+	if ( !pthread_attr_getstack( &attr, &addr, &size ) ) {
+		sampleStackTop = (uintptr_t)addr + size;
+	}
+	pthread_attr_destroy( &attr );
+}
+
+#if idx64
+/*
+=================
+VM_SampleFindCompiled
+
+Returns the vm whose compiled code pc is in, or -1
+=================
+*/
+static int VM_SampleFindCompiled( uintptr_t pc ) {
+	vm_t	*vm;
+	int		i;
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		vm = &vmTable[i];
+		if ( vm->compiled && vm->codeBase && pc - (uintptr_t)vm->codeBase < (uintptr_t)vm->codeLength ) {
+			return i;
+		}
+	}
+	return -1;
+}
+#endif
+
+/*
+=================
+VM_SampleWalk
+
+Follows the frame pointers from fp, each frame holds the caller's frame
+pointer and the return address.  A frame has to be aligned, above the
+last one and below the top of the stack, so a frame pointer that held
+something else ends the walk instead of being read.  Stops after a return
+into compiled qvm code, scan is left at the stack pointer of the caller
+of the last frame.
+=================
+*/
+static int VM_SampleWalk( uintptr_t fp, uintptr_t sp, uintptr_t *frames, int maxFrames, uintptr_t *scan ) {
+	uintptr_t	*frame;
+	int			numFrames;
+
+	numFrames = 0;
+	while ( numFrames < maxFrames && sampleStackTop ) {
+		if ( fp < sp || ( fp & ( sizeof( uintptr_t ) - 1 ) )
+			|| fp > sampleStackTop - 2 * sizeof( uintptr_t ) ) {
+			break;
+		}
+		frame = (uintptr_t *)fp;
+		if ( !frame[1] ) {
+			break;		// the outermost frame
+		}
+		frames[numFrames++] = frame[1];
+		sp = fp + 2 * sizeof( uintptr_t );
+#if idx64
+		// the compiled code doesn't keep frame pointers
+		if ( VM_SampleFindCompiled( frame[1] ) >= 0 ) {
+			break;
+		}
+#endif
+		fp = frame[0];
+	}
+
+	*scan = sp;
+	return numFrames;
+}
+
+/*
+=================
+VM_SampleEnter
+
+Called by VM_CallCompiled before it enters the compiled code with the
+lowest address of its own locals, returns qtrue if VM_SampleLeave has
+to be called after
+=================
+*/
+qboolean VM_SampleEnter( void *stack ) {
+	sampleEntry_t	*entry;
+	uintptr_t		fp, scan;
+
+	if ( !sampleActive ) {
+		return qfalse;
+	}
+	VM_SampleThreadStack();
+
+	// a Com_Error out of the vm leaves entries for frames that are gone
+	while ( sampleDepth > 0 && sampleDepth <= SAMPLE_ENTRIES
+		&& sampleEntries[sampleDepth - 1].sp <= (uintptr_t)stack ) {
+		sampleDepth--;
+	}
+
+	if ( sampleDepth < SAMPLE_ENTRIES ) {
+		// set sp last, the signal can come in the middle of this
+		entry = &sampleEntries[sampleDepth];
+		entry->sp = 0;
+		fp = (uintptr_t)__builtin_frame_address( 0 );
+		entry->numFrames = VM_SampleWalk( fp, fp, entry->frames, ARRAY_LEN( entry->frames ), &scan );
+		entry->sp = (uintptr_t)stack;
+	}
+	sampleDepth++;
+
+	return qtrue;
+}
+
+/*
+=================
+VM_SampleLeave
+=================
+*/
+void VM_SampleLeave( void ) {
+	if ( sampleDepth > 0 ) {
+		sampleDepth--;
+	}
+}
+
+#if idx64
+/*
+=================
+VM_SampleCompiled
+
+If the last frame is in compiled qvm code, adds the qvm functions that
+called it and the native frames under VM_CallCompiled
+=================
+*/
+static int VM_SampleCompiled( uintptr_t *frames, int numFrames, uintptr_t scan ) {
+	sampleEntry_t	*entry;
+	vm_t			*vm;
+	uintptr_t		ofs, value;
+	int				i;
+
+	i = VM_SampleFindCompiled( frames[numFrames - 1] );
+	if ( i < 0 ) {
+		return numFrames;
+	}
+	vm = &vmTable[i];
+	frames[numFrames - 1] = SAMPLE_VM_FRAME( i, frames[numFrames - 1] - (uintptr_t)vm->codeBase );
+
+	if ( sampleDepth < 1 || sampleDepth > SAMPLE_ENTRIES ) {
+		return numFrames;
+	}
+	entry = &sampleEntries[sampleDepth - 1];
+	if ( entry->sp <= scan ) {
+		return numFrames;
+	}
+
+	// calls between qvm functions are direct calls, the procedure call
+	// and syscall helpers before entryOfs only pass them on
+	for ( ; scan < entry->sp && numFrames < SAMPLE_MAX_FRAMES ; scan += sizeof( uintptr_t ) ) {
+		value = *(uintptr_t *)scan;
+		ofs = value - (uintptr_t)vm->codeBase;
+		if ( ofs < (uintptr_t)vm->entryOfs || ofs >= (uintptr_t)vm->codeLength ) {
+			continue;
+		}
+		if ( vm->codeBase[ofs - 5] != 0xE8 ) {		// call rel32
+			continue;
+		}
+		frames[numFrames++] = SAMPLE_VM_FRAME( i, ofs );
+	}
+
+	for ( i = 0 ; i < entry->numFrames && numFrames < SAMPLE_MAX_FRAMES ; i++ ) {
+		frames[numFrames++] = entry->frames[i];
+	}
+
+	return numFrames;
+}
+#endif
+
+/*
+=================
+VM_SampleSignal
+=================
+*/
+static void VM_SampleSignal( int sig, siginfo_t *info, void *context ) {
+	ucontext_t		*uc = context;
+	uintptr_t		frames[SAMPLE_MAX_FRAMES];
+	uintptr_t		pc, scan;
+	int				numFrames, pos;
+	int				savedErrno;
+
+	// counted first, so VM_SampleStop can wait for any that saw sampleActive
+	__sync_add_and_fetch( &sampleHandlers, 1 );
+	if ( !sampleActive ) {
+		__sync_sub_and_fetch( &sampleHandlers, 1 );
+		return;
+	}
+	savedErrno = errno;
+
+	pc = SAMPLE_PC( uc );
+	scan = SAMPLE_SP( uc );
+	numFrames = 0;
+	frames[numFrames++] = pc;
+
+#if idx64
+	// in compiled code the frame pointer is still the one of VM_CallCompiled
+	if ( VM_SampleFindCompiled( pc ) < 0 )
+#endif
+	{
+		numFrames += VM_SampleWalk( SAMPLE_FP( uc ), scan, frames + 1, SAMPLE_FRAMES - 1, &scan );
+	}
+
+#if idx64
+	numFrames = VM_SampleCompiled( frames, numFrames, scan );
+#endif
+
+	pos = __sync_fetch_and_add( &sampleUsed, numFrames + 1 );
+	if ( pos + numFrames + 1 > SAMPLE_BUFFER_WORDS ) {
+		__sync_add_and_fetch( &sampleDropped, 1 );
+	} else {
+		memcpy( &sampleBuffer[pos + 1], frames, numFrames * sizeof( frames[0] ) );
+		sampleBuffer[pos] = numFrames;
+	}
+
+	errno = savedErrno;
+	__sync_sub_and_fetch( &sampleHandlers, 1 );
+}
+
+/*
+=================
+VM_SampleStart
+=================
+*/
+static void VM_SampleStart( int hz ) {
+	struct sigaction	sa;
+	struct itimerval	timer;
+	int					i;
+
+	sampleBuffer = calloc( SAMPLE_BUFFER_WORDS, sizeof( *sampleBuffer ) );
+	if ( !sampleBuffer ) {
+		Com_Printf( "vmsample: couldn't allocate the sample buffer\n" );
+		return;
+	}
+	sampleUsed = 0;
+	sampleDropped = 0;
+
+	// the other threads note their stack when they first enter a vm
+	VM_SampleThreadStack();
+
+	// left installed, a late SIGPROF would end the process otherwise
+	if ( !sampleInstalled ) {
+		Com_Memset( &sa, 0, sizeof( sa ) );
+		sa.sa_sigaction = VM_SampleSignal;
+		sa.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset( &sa.sa_mask );
+		if ( sigaction( SIGPROF, &sa, NULL ) ) {
+			Com_Printf( "vmsample: sigaction failed: %s\n", strerror( errno ) );
+			free( sampleBuffer );
+			sampleBuffer = NULL;
+			return;
+		}
+		sampleInstalled = qtrue;
+	}
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( vmTable[i].compiled && !vmTable[i].numSymbols ) {
+			Com_Printf( "vmsample: %s has no symbols, see VM_LoadSymbols\n", vmTable[i].name );
+		}
+	}
+
+	sampleStartTime = Sys_Milliseconds();
+	sampleActive = 1;
+
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = 1000000 / hz;
+	timer.it_value = timer.it_interval;
+	setitimer( ITIMER_PROF, &timer, NULL );
+
+	Com_Printf( "vmsample: sampling at %i hz\n", hz );
+}
+
+/*
+=================
+VM_SampleFreeModules
+=================
+*/
+static void VM_SampleFreeModules( void ) {
+	int		i;
+
+	for ( i = 0 ; i < numSampleModules ; i++ ) {
+		free( sampleModules[i].symbols );
+		free( sampleModules[i].strings );
+	}
+	numSampleModules = 0;
+}
+
+static int QDECL VM_SampleSymbolSort( const void *a, const void *b ) {
+	const sampleSymbol_t	*sa = a, *sb = b;
+
+	if ( sa->value < sb->value ) {
+		return -1;
+	}
+	return sa->value > sb->value;
+}
+
+/*
+=================
+VM_SampleLoadSymbols
+
+Reads the functions from the symbol table of an ELF file, or the dynamic
+symbols if it was stripped
+=================
+*/
+static void VM_SampleLoadSymbols( sampleModule_t *module, const char *path ) {
+	FILE			*f;
+	ElfW(Ehdr)		ehdr;
+	ElfW(Shdr)		*shdrs, *symtab, *strtab;
+	ElfW(Sym)		*syms;
+	int				i, numSyms;
+
+	f = fopen( path, "rb" );
+	if ( !f ) {
+		return;
+	}
+
+	shdrs = NULL;
+	syms = NULL;
+	if ( fread( &ehdr, sizeof( ehdr ), 1, f ) != 1 || memcmp( ehdr.e_ident, ELFMAG, SELFMAG )
+		|| ehdr.e_ident[EI_CLASS] != ( sizeof( void * ) == 8 ? ELFCLASS64 : ELFCLASS32 )
+		|| ehdr.e_shentsize != sizeof( ElfW(Shdr) ) || !ehdr.e_shnum ) {
+		goto done;
+	}
+
+	shdrs = malloc( ehdr.e_shnum * sizeof( *shdrs ) );
+	if ( fseek( f, ehdr.e_shoff, SEEK_SET ) || fread( shdrs, sizeof( *shdrs ), ehdr.e_shnum, f ) != ehdr.e_shnum ) {
+		goto done;
+	}
+
+	symtab = NULL;
+	for ( i = 0 ; i < ehdr.e_shnum ; i++ ) {
+		if ( shdrs[i].sh_type == SHT_SYMTAB || ( shdrs[i].sh_type == SHT_DYNSYM && !symtab ) ) {
+			symtab = &shdrs[i];
+		}
+	}
+	if ( !symtab || symtab->sh_link >= ehdr.e_shnum || symtab->sh_entsize != sizeof( ElfW(Sym) ) ) {
+		goto done;
+	}
+	strtab = &shdrs[symtab->sh_link];
+
+	numSyms = symtab->sh_size / sizeof( ElfW(Sym) );
+	syms = malloc( numSyms * sizeof( *syms ) );
+	module->strings = malloc( strtab->sh_size + 1 );
+	module->symbols = malloc( numSyms * sizeof( *module->symbols ) );
+	if ( fseek( f, symtab->sh_offset, SEEK_SET ) || fread( syms, sizeof( *syms ), numSyms, f ) != numSyms
+		|| fseek( f, strtab->sh_offset, SEEK_SET ) || fread( module->strings, 1, strtab->sh_size, f ) != strtab->sh_size ) {
+		goto done;
+	}
+	module->strings[strtab->sh_size] = 0;
+
+	for ( i = 0 ; i < numSyms ; i++ ) {
+		if ( SAMPLE_ST_TYPE( syms[i].st_info ) != STT_FUNC || syms[i].st_shndx == SHN_UNDEF
+			|| !syms[i].st_value || syms[i].st_name >= strtab->sh_size ) {
+			continue;
+		}
+		module->symbols[module->numSymbols].value = syms[i].st_value;
+		module->symbols[module->numSymbols].size = syms[i].st_size;
+		module->symbols[module->numSymbols].name = syms[i].st_name;
+		module->numSymbols++;
+	}
+	qsort( module->symbols, module->numSymbols, sizeof( *module->symbols ), VM_SampleSymbolSort );
+
+done:
+	free( shdrs );
+	free( syms );
+	fclose( f );
+}
+
+/*
+=================
+VM_SampleNative
+=================
+*/
+static void VM_SampleNative( uintptr_t addr, char *name, int size ) {
+	sampleModule_t	*module;
+	sampleSymbol_t	*sym;
+	struct link_map	*map;
+	Dl_info			info;
+	uintptr_t		ofs;
+	int				i, lo, hi;
+
+	if ( !dladdr1( (void *)addr, &info, (void **)&map, RTLD_DL_LINKMAP ) || !map ) {
+		Com_sprintf( name, size, "0x%lx", (unsigned long)addr );
+		return;
+	}
+
+	for ( i = 0 ; i < numSampleModules && sampleModules[i].map != map ; i++ ) {
+	}
+	module = &sampleModules[i];
+	if ( i == numSampleModules ) {
+		if ( numSampleModules == SAMPLE_MAX_MODULES ) {
+			Com_sprintf( name, size, "%s", info.dli_sname ? info.dli_sname : "?" );
+			return;
+		}
+		numSampleModules++;
+		Com_Memset( module, 0, sizeof( *module ) );
+		module->map = map;
+		Q_strncpyz( module->name, COM_SkipPath( (char *)info.dli_fname ), sizeof( module->name ) );
+
+		// the executable has no name in its link_map
+		VM_SampleLoadSymbols( module, map->l_name[0] ? map->l_name : "/proc/self/exe" );
+	}
+
+	// find the last symbol at or before the address
+	ofs = addr - map->l_addr;
+	lo = 0;
+	hi = module->numSymbols;
+	while ( lo < hi ) {
+		i = ( lo + hi ) / 2;
+		if ( module->symbols[i].value <= ofs ) {
+			lo = i + 1;
+		} else {
+			hi = i;
+		}
+	}
+	sym = lo ? &module->symbols[lo - 1] : NULL;
+
+	if ( sym && ( !sym->size || ofs < sym->value + sym->size ) ) {
+		Q_strncpyz( name, module->strings + sym->name, size );
+	} else if ( info.dli_sname ) {
+		Q_strncpyz( name, info.dli_sname, size );
+	} else {
+		Q_strncpyz( name, module->name, size );		// stripped, at least the frames merge
+	}
+}
+
+#if idx64
+/*
+=================
+VM_SampleQVM
+=================
+*/
+static void VM_SampleQVM( int slot, int ofs, char *name, int size ) {
+	vm_t	*vm;
+	int		best, bestOfs, i;
+
+	vm = &vmTable[slot];
+	if ( !vm->name[0] || !vm->compiled ) {
+		Com_sprintf( name, size, "vm%i+0x%x", slot, ofs );
+		return;
+	}
+	if ( ofs < vm->entryOfs ) {
+		Com_sprintf( name, size, "%s:syscall", vm->name );		// the helpers from EmitCallDoSyscall on
+		return;
+	}
+	if ( vm->symbols ) {
+		Com_sprintf( name, size, "%s:%s", vm->name, VM_ValueToFunctionSymbol( vm, ofs )->symName );
+		return;
+	}
+
+	// without symbols, the instruction number can be looked up in the .map;
+	// with vm_optimize only the block starts keep their own code offset, the
+	// rest point at one error stub, so this can't be a binary search
+	best = -1;
+	bestOfs = -1;
+	for ( i = 0; i < vm->instructionCount; i++ ) {
+		int	iofs = vm->instructionPointers[i] - (intptr_t)vm->codeBase;
+
+		if ( iofs <= ofs && iofs >= bestOfs ) {
+			best = i;
+			bestOfs = iofs;
+		}
+	}
+	Com_sprintf( name, size, "%s@%i", vm->name, best );
+}
+#endif
+
+static int QDECL VM_SampleStackSort( const void *a, const void *b ) {
+	const uintptr_t	*sa = sampleBuffer + *(const int *)a;
+	const uintptr_t	*sb = sampleBuffer + *(const int *)b;
+
+	if ( sa[0] != sb[0] ) {
+		return sa[0] < sb[0] ? -1 : 1;
+	}
+	return memcmp( sa + 1, sb + 1, sa[0] * sizeof( *sa ) );
+}
+
+typedef struct {
+	char		*line;
+	int			count;
+} sampleStack_t;
+
+static int QDECL VM_SampleLineSort( const void *a, const void *b ) {
+	return strcmp( ( (const sampleStack_t *)a )->line, ( (const sampleStack_t *)b )->line );
+}
+
+/*
+=================
+VM_SampleName
+
+Writes the folded stack of a sample, root first
+=================
+*/
+static void VM_SampleName( const uintptr_t *sample, char *line, int size ) {
+	uintptr_t	frame;
+	char		name[256];
+	int			i;
+
+	line[0] = 0;
+	for ( i = sample[0] ; i >= 1 ; i-- ) {
+		// return addresses are named by the call before them
+		frame = sample[i] - ( i > 1 );
+#if idx64
+		if ( frame & SAMPLE_VM_BIT ) {
+			VM_SampleQVM( ( frame & ~SAMPLE_VM_BIT ) >> 32, (uint32_t)frame, name, sizeof( name ) );
+		} else
+#endif
+		VM_SampleNative( frame, name, sizeof( name ) );
+
+		if ( i != sample[0] ) {
+			Q_strcat( line, size, ";" );
+		}
+		Q_strcat( line, size, name );
+	}
+}
+
+/*
+=================
+VM_SampleStop
+=================
+*/
+static void VM_SampleStop( const char *filename ) {
+	static char			line[SAMPLE_MAX_FRAMES * 64];
+	struct itimerval	timer;
+	fileHandle_t		f;
+	sampleStack_t		*stacks;
+	int					*samples;
+	int					numSamples, numStacks, numLines, limit, pos, count, msec;
+	int					i;
+
+	sampleActive = 0;
+	Com_Memset( &timer, 0, sizeof( timer ) );
+	setitimer( ITIMER_PROF, &timer, NULL );
+	while ( sampleHandlers ) {
+		sched_yield();
+	}
+	msec = Sys_Milliseconds() - sampleStartTime;
+
+	// everything that fit is in one piece at the start
+	limit = MIN( sampleUsed, SAMPLE_BUFFER_WORDS );
+	samples = malloc( ( limit / 2 + 1 ) * sizeof( *samples ) );
+	numSamples = 0;
+	for ( pos = 0 ; pos < limit && sampleBuffer[pos] && pos + 1 + sampleBuffer[pos] <= limit ; pos += 1 + sampleBuffer[pos] ) {
+		samples[numSamples++] = pos;
+	}
+
+	// name each different stack once, then merge the ones that differ
+	// only in where inside the functions they were
+	qsort( samples, numSamples, sizeof( *samples ), VM_SampleStackSort );
+	stacks = malloc( ( numSamples + 1 ) * sizeof( *stacks ) );
+	numStacks = 0;
+	for ( i = 0 ; i < numSamples ; i += count ) {
+		for ( count = 1 ; i + count < numSamples && !VM_SampleStackSort( &samples[i], &samples[i + count] ) ; count++ ) {
+		}
+		VM_SampleName( sampleBuffer + samples[i], line, sizeof( line ) );
+		stacks[numStacks].line = malloc( strlen( line ) + 1 );
+		strcpy( stacks[numStacks].line, line );
+		stacks[numStacks].count = count;
+		numStacks++;
+	}
+	qsort( stacks, numStacks, sizeof( *stacks ), VM_SampleLineSort );
+
+	f = FS_FOpenFileWrite( filename );
+	if ( !f ) {
+		Com_Printf( "vmsample: couldn't write %s\n", filename );
+	}
+
+	numLines = 0;
+	for ( i = 0 ; i < numStacks ; i++ ) {
+		if ( i + 1 < numStacks && !strcmp( stacks[i].line, stacks[i + 1].line ) ) {
+			stacks[i + 1].count += stacks[i].count;
+		} else if ( f ) {
+			FS_Write( stacks[i].line, strlen( stacks[i].line ), f );
+			FS_Printf( f, " %i\n", stacks[i].count );
+			numLines++;
+		}
+		free( stacks[i].line );
+	}
+
+	if ( f ) {
+		FS_FCloseFile( f );
+		Com_Printf( "vmsample: %i samples in %i msec, %i stacks written to %s\n", numSamples, msec, numLines, filename );
+	}
+	if ( sampleDropped ) {
+		Com_Printf( "vmsample: %i samples dropped, the buffer was full\n", sampleDropped );
+	}
+
+	VM_SampleFreeModules();
+	free( stacks );
+	free( samples );
+	free( sampleBuffer );
+	sampleBuffer = NULL;
+}
+
+/*
+=================
+VM_Sample_f
+=================
+*/
+void VM_Sample_f( void ) {
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "start" ) ) {
+		if ( sampleBuffer ) {
+			Com_Printf( "vmsample: already sampling\n" );
+			return;
+		}
+		VM_SampleStart( Cmd_Argc() > 2 ? (int)Com_Clamp( 1, 10000, atoi( Cmd_Argv( 2 ) ) ) : SAMPLE_DEFAULT_HZ );
+		return;
+	}
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "stop" ) ) {
+		if ( !sampleBuffer ) {
+			Com_Printf( "vmsample: not sampling\n" );
+			return;
+		}
+		VM_SampleStop( Cmd_Argc() > 2 ? Cmd_Argv( 2 ) : "vmsample.folded" );
+		return;
+	}
+
+	Com_Printf( "usage: vmsample start [hz] | stop [file]\n" );
+	if ( sampleBuffer ) {
+		Com_Printf( "sampling, %i of %i KB used\n", (int)( MIN( sampleUsed, SAMPLE_BUFFER_WORDS ) * sizeof( *sampleBuffer ) / 1024 ),
+			(int)( SAMPLE_BUFFER_WORDS * sizeof( *sampleBuffer ) / 1024 ) );
+	}
+}
+
+#else
+
+qboolean VM_SampleEnter( void *stack ) {
+	return qfalse;
+}
+
+void VM_SampleLeave( void ) {
+}
+
+void VM_Sample_f( void ) {
+	Com_Printf( "vmsample is not supported on this platform\n" );
+}
+
+#endif
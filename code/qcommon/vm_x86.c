@@ -58,9 +58,17 @@ x86_64:
 
 */
 
+#if idx64
+#define VMFREE_BUFFERS() do {Z_Free(buf); Z_Free(jused); Z_Free(jitRelocs);} while(0)
+#else
 #define VMFREE_BUFFERS() do {Z_Free(buf); Z_Free(jused);} while(0)
+#endif
 static	byte	*buf = NULL;
 static	byte	*jused = NULL;
+#if idx64
+static	int		*jitRelocs = NULL;	// where EmitPtr wrote an address, for the code cache
+static	int		jitNumRelocs, jitMaxRelocs;
+#endif
 static	int		jusedSize = 0;
 static	int		compiledOfs = 0;
 static	byte	*code = NULL;
@@ -89,6 +97,9 @@ typedef enum
 
 static	ELastCommand	LastCommand;
 
+// values the optimizing tier keeps off the opStack, VM_CallCompiled leaves room to write them out
+#define	JIT_MAX_DEPTH	16
+
 static int iss8(int32_t v)
 {
 	return (SCHAR_MIN <= v && v <= SCHAR_MAX);
@@ -149,6 +160,12 @@ static void EmitPtr(void *ptr)
 {
 	intptr_t v = (intptr_t) ptr;
 	
+#if idx64
+	// counted past the end so VM_WriteCodeCache can tell it missed some
+	if(jitNumRelocs < jitMaxRelocs)
+		jitRelocs[jitNumRelocs] = compiledOfs;
+	jitNumRelocs++;
+#endif
 	Emit4(v);
 #if idx64
 	Emit1((v >> 32) & 0xFF);
@@ -1055,227 +1072,1450 @@ qboolean ConstOptimize(vm_t *vm, int callProcOfsSyscall)
 	return qfalse;
 }
 
+#if idx64
+/*
+===============================================================================
+
+OPTIMIZING TIER
+
+With vm_optimize, the values pushed inside a basic block are kept on a
+virtual stack of constants, local addresses and registers, and are only
+written to the opStack at the end of the block or before an instruction
+the tier leaves to the code above.  Constants fold into each other and
+into immediates, local addresses into loads and stores, and loads skip
+the data mask when the address is known to be in range already.
+
+  r10d - r15d	values on the virtual stack
+  xmm0, xmm1	float operations
+
+===============================================================================
+*/
+
+typedef enum {
+	JV_CONST,		// value is the constant
+	JV_LOCAL,		// value is the offset from the program stack
+	JV_REG			// in reg, never larger than max
+} jitKind_t;
+
+typedef struct {
+	jitKind_t	kind;
+	int			value;
+	int			reg;
+	unsigned	max;
+} jitValue_t;
+
+#define	JIT_EAX			0
+#define	JIT_ECX			1
+#define	JIT_EDX			2
+#define	JIT_ESI			6
+#define	JIT_R9			9
+#define	JIT_FIRST_REG	10
+
+static	qboolean	jitOptimize;
+static	jitValue_t	jitStack[JIT_MAX_DEPTH];
+static	int			jitDepth;
+static	int			jitRegsUsed;		// a bit for each of r10 - r15 in use
+
 /*
 =================
-VM_Compile
+JitRex
+Emits the REX prefix for a 32 bit operation, if any of the registers needs it
 =================
 */
-void VM_Compile(vm_t *vm, vmHeader_t *header)
+static void JitRex(int reg, int index, int base)
 {
-	int		op;
-	int		maxLength;
-	int		v;
-	int		i;
-        int		callProcOfsSyscall, callProcOfs, callDoSyscallOfs;
+	int rex;
 
-	jusedSize = header->instructionCount + 2;
+	rex = 0x40 | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+	if(rex != 0x40)
+		Emit1(rex);
+}
 
-	// allocate a very large temp buffer, we will shrink it later
-	maxLength = header->codeLength * 8 + 64;
-	buf = Z_Malloc(maxLength);
-	jused = Z_Malloc(jusedSize);
-	code = Z_Malloc(header->codeLength+32);
-	
-	Com_Memset(jused, 0, jusedSize);
-	Com_Memset(buf, 0, maxLength);
+// op reg, rm
+static void JitOpRR(const char *op, int reg, int rm)
+{
+	JitRex(reg, 0, rm);
+	EmitString(op);
+	Emit1(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
 
-	// copy code in larger buffer and put some zeros at the end
-	// so we can safely look ahead for a few instructions in it
-	// without a chance to get false-positive because of some garbage bytes
-	Com_Memset(code, 0, header->codeLength+32);
-	Com_Memcpy(code, (byte *)header + header->codeOffset, header->codeLength );
+// op reg, [r9 + index]
+static void JitOpData(const char *op, int reg, int index)
+{
+	JitRex(reg, index, JIT_R9);
+	EmitString(op);
+	Emit1(0x04 | ((reg & 7) << 3));
+	Emit1(((index & 7) << 3) | (JIT_R9 & 7));
+}
 
-	// ensure that the optimisation pass knows about all the jump
-	// table targets
-	for( i = 0; i < vm->numJumpTableTargets; i++ ) {
-		jused[ *(int *)(vm->jumpTableTargets + ( i * sizeof( int ) ) ) ] = 1;
+// op reg, [r9 + 0x12345678]
+static void JitOpDataConst(const char *op, int reg, int ofs)
+{
+	JitRex(reg, 0, JIT_R9);
+	EmitString(op);
+	Emit1(0x80 | ((reg & 7) << 3) | (JIT_R9 & 7));
+	Emit4(ofs);
+}
+
+// op reg, [rdi + rbx * 4 + 0x12]
+static void JitOpStack(const char *op, int reg, int ofs)
+{
+	JitRex(reg, 0, 0);
+	EmitString(op);
+	Emit1(0x44 | ((reg & 7) << 3));
+	Emit1(0x9F);
+	Emit1(ofs);
+}
+
+// lea reg, [rsi + 0x12345678]
+static void JitLeaLocal(int reg, int ofs)
+{
+	JitRex(reg, 0, JIT_ESI);
+	Emit1(0x8D);
+	Emit1(0x80 | ((reg & 7) << 3) | JIT_ESI);
+	Emit4(ofs);
+}
+
+// op reg, 0x12345678 with the ModRM extension ext: 0 add, 1 or, 4 and, 5 sub, 6 xor, 7 cmp
+static void JitOpImm(int ext, int reg, int v)
+{
+	JitRex(0, 0, reg);
+	if(iss8(v))
+	{
+		Emit1(0x83);
+		Emit1(0xC0 | (ext << 3) | (reg & 7));
+		Emit1(v);
+	}
+	else
+	{
+		Emit1(0x81);
+		Emit1(0xC0 | (ext << 3) | (reg & 7));
+		Emit4(v);
 	}
+}
 
-	// Start buffer with x86-VM specific procedures
-	compiledOfs = 0;
+// mov reg, 0x12345678
+static void JitMovImm(int reg, int v)
+{
+	JitRex(0, 0, reg);
+	Emit1(0xB8 | (reg & 7));
+	Emit4(v);
+}
 
-	callDoSyscallOfs = compiledOfs;
-	callProcOfs = EmitCallDoSyscall(vm);
-	callProcOfsSyscall = EmitCallProcedure(vm, callDoSyscallOfs);
-	vm->entryOfs = compiledOfs;
+// movd xmm, reg
+static void JitMovdToXmm(int xmm, int reg)
+{
+	Emit1(0x66);
+	JitOpRR("0F 6E", xmm, reg);
+}
 
-	for(pass=0; pass < 3; pass++) {
-	oc0 = -23423;
-	oc1 = -234354;
-	pop0 = -43435;
-	pop1 = -545455;
+// movd reg, xmm
+static void JitMovdFromXmm(int reg, int xmm)
+{
+	Emit1(0x66);
+	JitOpRR("0F 7E", xmm, reg);
+}
 
-	// translate all instructions
-	pc = 0;
-	instruction = 0;
-	//code = (byte *)header + header->codeOffset;
-	compiledOfs = vm->entryOfs;
+static void JitFreeReg(int reg)
+{
+	jitRegsUsed &= ~(1 << reg);
+}
 
-	LastCommand = LAST_COMMAND_NONE;
+/*
+=================
+JitFlush
+Writes the virtual stack out to the opStack
+=================
+*/
+static void JitFlush(void)
+{
+	jitValue_t *v;
+	int i;
 
-	while(instruction < header->instructionCount)
+	for(i = 0; i < jitDepth; i++)
 	{
-		if(compiledOfs > maxLength - 16)
+		v = &jitStack[i];
+
+		switch(v->kind)
 		{
-	        	VMFREE_BUFFERS();
-			Com_Error(ERR_DROP, "VM_CompileX86: maxLength exceeded");
+		case JV_CONST:
+			EmitString("C7 44 9F");		// mov dword ptr 0x12[edi + ebx * 4], 0x12345678
+			Emit1((i + 1) * 4);
+			Emit4(v->value);
+			break;
+		case JV_LOCAL:
+			JitLeaLocal(JIT_EAX, v->value);
+			JitOpStack("89", JIT_EAX, (i + 1) * 4);
+			break;
+		case JV_REG:
+			JitOpStack("89", v->reg, (i + 1) * 4);
+			JitFreeReg(v->reg);
+			break;
 		}
+	}
 
-		vm->instructionPointers[ instruction ] = compiledOfs;
-
-		if ( !vm->jumpTableTargets )
-			jlabel = 1;
-		else 
-			jlabel = jused[ instruction ];
+	if(jitDepth)
+	{
+		STACK_PUSH(jitDepth);		// add bl, jitDepth
+	}
+	jitDepth = 0;
+}
 
-		instruction++;
+static int JitAllocReg(void)
+{
+	int i;
 
-		if(pc > header->codeLength)
+	for(i = JIT_FIRST_REG; i < 16; i++)
+	{
+		if(!(jitRegsUsed & (1 << i)))
 		{
-		        VMFREE_BUFFERS();
-			Com_Error(ERR_DROP, "VM_CompileX86: pc > header->codeLength");
+			jitRegsUsed |= 1 << i;
+			return i;
 		}
+	}
 
-		op = code[ pc ];
-		pc++;
-		switch ( op ) {
-		case 0:
-			break;
-		case OP_BREAK:
-			EmitString("CC");				// int 3
-			break;
-		case OP_ENTER:
-			EmitString("81 EE");				// sub esi, 0x12345678
-			Emit4(Constant4());
-			break;
-		case OP_CONST:
-			if(ConstOptimize(vm, callProcOfsSyscall))
-				break;
+	// all of them are on the virtual stack
+	JitFlush();
+	return JitAllocReg();
+}
 
-			EmitPushStack(vm);
-			EmitString("C7 04 9F");				// mov dword ptr [edi + ebx * 4], 0x12345678
-			lastConst = Constant4();
+static void JitPush(jitKind_t kind, int value, int reg, unsigned max)
+{
+	jitValue_t *v;
 
-			Emit4(lastConst);
-			if(code[pc] == OP_JUMP)
-				JUSED(lastConst);
+	if(jitDepth == JIT_MAX_DEPTH)
+		JitFlush();
 
-			break;
-		case OP_LOCAL:
-			EmitPushStack(vm);
-			EmitString("8D 86");				// lea eax, [0x12345678 + esi]
-			oc0 = oc1;
-			oc1 = Constant4();
-			Emit4(oc1);
-			EmitCommand(LAST_COMMAND_MOV_STACK_EAX);	// mov dword ptr [edi + ebx * 4], eax
-			break;
-		case OP_ARG:
-			EmitMovEAXStack(vm, 0);				// mov eax, dword ptr [edi + ebx * 4]
-			EmitString("8B D6");				// mov edx, esi
-			EmitString("81 C2");				// add edx, 0x12345678
-			Emit4((Constant1() & 0xFF));
-			MASK_REG("E2", vm->dataMask);			// and edx, 0x12345678
-#if idx64
-			EmitRexString(0x41, "89 04 11");		// mov dword ptr [r9 + edx], eax
-#else
-			EmitString("89 82");				// mov dword ptr [edx + 0x12345678], eax
-			Emit4((intptr_t) vm->dataBase);
-#endif
-			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
-			break;
-		case OP_CALL:
-			EmitCallRel(vm, callProcOfs);
-			break;
-		case OP_PUSH:
-			EmitPushStack(vm);
-			break;
-		case OP_POP:
-			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
-			break;
-		case OP_LEAVE:
-			v = Constant4();
-			EmitString("81 C6");				// add	esi, 0x12345678
-			Emit4(v);
-			EmitString("C3");				// ret
-			break;
-		case OP_LOAD4:
-			if (code[pc] == OP_CONST && code[pc+5] == OP_ADD && code[pc+6] == OP_STORE4)
-			{
-				if(oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-				{
-					compiledOfs -= 12;
-					vm->instructionPointers[instruction - 1] = compiledOfs;
-				}
+	v = &jitStack[jitDepth++];
+	v->kind = kind;
+	v->value = value;
+	v->reg = reg;
+	v->max = max;
+}
 
-				pc++;				// OP_CONST
-				v = Constant4();
+static void JitPushReg(int reg, unsigned max)
+{
+	JitPush(JV_REG, 0, reg, max);
+}
 
-				EmitMovEDXStack(vm, vm->dataMask);
-				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-				{
-#if idx64
-					EmitRexString(0x41, "FF 04 11");	// inc dword ptr [r9 + edx]
-#else
-					EmitString("FF 82");			// inc dword ptr [edx + 0x12345678]
-					Emit4((intptr_t) vm->dataBase);
-#endif
-				}
-				else
-				{
-#if idx64
-					EmitRexString(0x41, "8B 04 11");	// mov eax, dword ptr [r9 + edx]
-#else
-					EmitString("8B 82");			// mov eax, dword ptr [edx + 0x12345678]
-					Emit4((intptr_t) vm->dataBase);
-#endif
-					EmitString("05");			// add eax, v
-					Emit4(v);
-					
-					if (oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-					{
-#if idx64
-						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
-#else
-						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
-						Emit4((intptr_t) vm->dataBase);
-#endif
-					}
-					else
-					{
-						EmitCommand(LAST_COMMAND_SUB_BL_1);	// sub bl, 1
-						EmitString("8B 14 9F");			// mov edx, dword ptr [edi + ebx * 4]
-						MASK_REG("E2", vm->dataMask);		// and edx, 0x12345678
-#if idx64
-						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
-#else
-						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
-						Emit4((intptr_t) vm->dataBase);
-#endif
-					}
-				}
+static jitValue_t JitPop(void)
+{
+	jitValue_t v;
 
-				EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
-				pc++;						// OP_ADD
-				pc++;						// OP_STORE
-				instruction += 3;
-				break;
-			}
+	if(jitDepth)
+		return jitStack[--jitDepth];
 
-			if(code[pc] == OP_CONST && code[pc+5] == OP_SUB && code[pc+6] == OP_STORE4)
-			{
-				if(oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-				{
-					compiledOfs -= 12;
-					vm->instructionPointers[instruction - 1] = compiledOfs;
-				}
-				
-				pc++;					// OP_CONST
-				v = Constant4();
+	v.kind = JV_REG;
+	v.value = 0;
+	v.reg = JitAllocReg();
+	v.max = 0xFFFFFFFF;
+	JitOpStack("8B", v.reg, 0);		// mov reg, dword ptr [edi + ebx * 4]
+	STACK_POP(1);				// sub bl, 1
 
-				EmitMovEDXStack(vm, vm->dataMask);
-				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-				{
-#if idx64
+	return v;
+}
+
+/*
+=================
+JitToReg
+Moves a value into a register of its own
+=================
+*/
+static int JitToReg(jitValue_t *v)
+{
+	if(v->kind == JV_REG)
+		return v->reg;
+
+	v->reg = JitAllocReg();
+	if(v->kind == JV_CONST)
+	{
+		JitMovImm(v->reg, v->value);
+		v->max = v->value;
+	}
+	else
+	{
+		JitLeaLocal(v->reg, v->value);
+		v->max = 0xFFFFFFFF;
+	}
+	v->kind = JV_REG;
+
+	return v->reg;
+}
+
+/*
+=================
+JitFold
+Computes an integer operation on two constants, as long as it can't trap
+=================
+*/
+static qboolean JitFold(int op, int a, int b, int *result)
+{
+	switch(op)
+	{
+	case OP_ADD:	*result = (unsigned) a + (unsigned) b;	break;
+	case OP_SUB:	*result = (unsigned) a - (unsigned) b;	break;
+	case OP_MULI:
+	case OP_MULU:	*result = (unsigned) a * (unsigned) b;	break;
+	case OP_BAND:	*result = a & b;			break;
+	case OP_BOR:	*result = a | b;			break;
+	case OP_BXOR:	*result = a ^ b;			break;
+	case OP_LSH:	*result = (unsigned) a << (b & 31);	break;
+	case OP_RSHI:	*result = a >> (b & 31);		break;
+	case OP_RSHU:	*result = (unsigned) a >> (b & 31);	break;
+	case OP_DIVI:
+	case OP_MODI:
+		if(b == 0 || (a == INT_MIN && b == -1))
+			return qfalse;
+		*result = (op == OP_DIVI) ? a / b : a % b;
+		break;
+	case OP_DIVU:
+	case OP_MODU:
+		if(b == 0)
+			return qfalse;
+		*result = (op == OP_DIVU) ? (unsigned) a / (unsigned) b : (unsigned) a % (unsigned) b;
+		break;
+	default:
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+JitIntOp
+Two operand integer arithmetic
+=================
+*/
+static void JitIntOp(int op)
+{
+	jitValue_t a, b;
+	int ra, rb, v;
+	unsigned max;
+
+	b = JitPop();
+	a = JitPop();
+
+	if(a.kind == JV_CONST && b.kind == JV_CONST && JitFold(op, a.value, b.value, &v))
+	{
+		JitPush(JV_CONST, v, 0, 0);
+		return;
+	}
+
+	// address arithmetic on locals stays a local
+	if(a.kind == JV_LOCAL && b.kind == JV_CONST && (op == OP_ADD || op == OP_SUB))
+	{
+		JitPush(JV_LOCAL, op == OP_ADD ? (unsigned) a.value + b.value : (unsigned) a.value - b.value, 0, 0);
+		return;
+	}
+	if(a.kind == JV_CONST && b.kind == JV_LOCAL && op == OP_ADD)
+	{
+		JitPush(JV_LOCAL, (unsigned) a.value + b.value, 0, 0);
+		return;
+	}
+
+	ra = JitToReg(&a);
+	max = 0xFFFFFFFF;
+
+	if(b.kind == JV_CONST && op != OP_DIVI && op != OP_DIVU && op != OP_MODI && op != OP_MODU)
+	{
+		v = b.value;
+
+		switch(op)
+		{
+		case OP_ADD:	JitOpImm(0, ra, v);	break;	// add ra, v
+		case OP_SUB:	JitOpImm(5, ra, v);	break;	// sub ra, v
+		case OP_BAND:
+			JitOpImm(4, ra, v);			// and ra, v
+			max = MIN(a.max, (unsigned) v);
+			break;
+		case OP_BOR:	JitOpImm(1, ra, v);	break;	// or ra, v
+		case OP_BXOR:	JitOpImm(6, ra, v);	break;	// xor ra, v
+		case OP_MULI:
+		case OP_MULU:
+			JitRex(ra, 0, ra);
+			if(iss8(v))
+			{
+				Emit1(0x6B);			// imul ra, ra, 0x12
+				Emit1(0xC0 | ((ra & 7) << 3) | (ra & 7));
+				Emit1(v);
+			}
+			else
+			{
+				Emit1(0x69);			// imul ra, ra, 0x12345678
+				Emit1(0xC0 | ((ra & 7) << 3) | (ra & 7));
+				Emit4(v);
+			}
+			break;
+		case OP_LSH:
+		case OP_RSHI:
+		case OP_RSHU:
+			JitRex(0, 0, ra);
+			Emit1(0xC1);				// shl/sar/shr ra, 0x12
+			Emit1(0xC0 | ((op == OP_LSH ? 4 : op == OP_RSHI ? 7 : 5) << 3) | (ra & 7));
+			Emit1(v & 31);
+			if(op == OP_RSHU)
+				max = a.max >> (v & 31);
+			break;
+		}
+
+		JitPushReg(ra, max);
+		return;
+	}
+
+	rb = JitToReg(&b);
+
+	switch(op)
+	{
+	case OP_ADD:	JitOpRR("01", rb, ra);	break;		// add ra, rb
+	case OP_SUB:	JitOpRR("29", rb, ra);	break;		// sub ra, rb
+	case OP_BAND:
+		JitOpRR("21", rb, ra);				// and ra, rb
+		max = MIN(a.max, b.max);
+		break;
+	case OP_BOR:	JitOpRR("09", rb, ra);	break;		// or ra, rb
+	case OP_BXOR:	JitOpRR("31", rb, ra);	break;		// xor ra, rb
+	case OP_MULI:
+	case OP_MULU:	JitOpRR("0F AF", ra, rb);	break;	// imul ra, rb
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+		JitOpRR("89", rb, JIT_ECX);			// mov ecx, rb
+		JitRex(0, 0, ra);
+		Emit1(0xD3);					// shl/sar/shr ra, cl
+		Emit1(0xC0 | ((op == OP_LSH ? 4 : op == OP_RSHI ? 7 : 5) << 3) | (ra & 7));
+		break;
+	case OP_DIVI:
+	case OP_DIVU:
+	case OP_MODI:
+	case OP_MODU:
+		JitOpRR("89", ra, JIT_EAX);			// mov eax, ra
+		if(op == OP_DIVI || op == OP_MODI)
+			EmitString("99");			// cdq
+		else
+			EmitString("31 D2");			// xor edx, edx
+		JitRex(0, 0, rb);
+		Emit1(0xF7);					// idiv/div rb
+		Emit1(0xC0 | ((op == OP_DIVI || op == OP_MODI ? 7 : 6) << 3) | (rb & 7));
+		if(op == OP_DIVI || op == OP_DIVU)
+			JitOpRR("89", JIT_EAX, ra);		// mov ra, eax
+		else
+			JitOpRR("89", JIT_EDX, ra);		// mov ra, edx
+		break;
+	}
+
+	JitFreeReg(rb);
+	JitPushReg(ra, max);
+}
+
+/*
+=================
+JitFloatOp
+Two operand float arithmetic, SSE gives the same results as the x87 code above
+=================
+*/
+static void JitFloatOp(int op)
+{
+	jitValue_t a, b;
+	int ra, rb;
+
+	b = JitPop();
+	a = JitPop();
+	ra = JitToReg(&a);
+	rb = JitToReg(&b);
+
+	JitMovdToXmm(0, ra);			// movd xmm0, ra
+	JitMovdToXmm(1, rb);			// movd xmm1, rb
+	switch(op)
+	{
+	case OP_ADDF:	EmitString("F3 0F 58 C1");	break;	// addss xmm0, xmm1
+	case OP_SUBF:	EmitString("F3 0F 5C C1");	break;	// subss xmm0, xmm1
+	case OP_MULF:	EmitString("F3 0F 59 C1");	break;	// mulss xmm0, xmm1
+	case OP_DIVF:	EmitString("F3 0F 5E C1");	break;	// divss xmm0, xmm1
+	}
+	JitMovdFromXmm(ra, 0);			// movd ra, xmm0
+
+	JitFreeReg(rb);
+	JitPushReg(ra, 0xFFFFFFFF);
+}
+
+/*
+=================
+JitUnaryOp
+=================
+*/
+static void JitUnaryOp(int op)
+{
+	jitValue_t a;
+	int ra;
+
+	a = JitPop();
+
+	if(a.kind == JV_CONST && op != OP_CVIF && op != OP_CVFI)
+	{
+		switch(op)
+		{
+		case OP_NEGI:	a.value = -(unsigned) a.value;		break;
+		case OP_BCOM:	a.value = ~a.value;			break;
+		case OP_SEX8:	a.value = (signed char) a.value;	break;
+		case OP_SEX16:	a.value = (short) a.value;		break;
+		case OP_NEGF:	a.value ^= 0x80000000;			break;
+		}
+		JitPush(JV_CONST, a.value, 0, 0);
+		return;
+	}
+
+	ra = JitToReg(&a);
+
+	switch(op)
+	{
+	case OP_NEGI:
+		JitRex(0, 0, ra);
+		Emit1(0xF7);				// neg ra
+		Emit1(0xD8 | (ra & 7));
+		break;
+	case OP_BCOM:
+		JitRex(0, 0, ra);
+		Emit1(0xF7);				// not ra
+		Emit1(0xD0 | (ra & 7));
+		break;
+	case OP_SEX8:	JitOpRR("0F BE", ra, ra);	break;	// movsx ra, ra8
+	case OP_SEX16:	JitOpRR("0F BF", ra, ra);	break;	// movsx ra, ra16
+	case OP_NEGF:	JitOpImm(6, ra, 0x80000000);	break;	// xor ra, 0x80000000
+	case OP_CVIF:
+		Emit1(0xF3);
+		JitOpRR("0F 2A", 0, ra);		// cvtsi2ss xmm0, ra
+		JitMovdFromXmm(ra, 0);			// movd ra, xmm0
+		break;
+	case OP_CVFI:
+		JitMovdToXmm(0, ra);			// movd xmm0, ra
+		Emit1(0xF3);
+		JitOpRR("0F 2C", ra, 0);		// cvttss2si ra, xmm0
+		break;
+	}
+
+	JitPushReg(ra, 0xFFFFFFFF);
+}
+
+/*
+=================
+JitLoad
+=================
+*/
+static void JitLoad(vm_t *vm, int op)
+{
+	jitValue_t a;
+	const char *ins;
+	int reg;
+
+	if(op == OP_LOAD4)
+		ins = "8B";		// mov reg, dword ptr
+	else if(op == OP_LOAD2)
+		ins = "0F B7";		// movzx reg, word ptr
+	else
+		ins = "0F B6";		// movzx reg, byte ptr
+
+	a = JitPop();
+
+	if(a.kind == JV_CONST)
+	{
+		reg = JitAllocReg();
+		JitOpDataConst(ins, reg, a.value & vm->dataMask);	// [r9 + 0x12345678]
+	}
+	else if(a.kind == JV_LOCAL)
+	{
+		// allocate first, a flush to free a register goes through eax
+		reg = JitAllocReg();
+		JitLeaLocal(reg, a.value);				// lea reg, [esi + 0x12345678]
+		JitOpImm(4, reg, vm->dataMask);				// and reg, 0x12345678
+		JitOpData(ins, reg, reg);				// [r9 + reg]
+	}
+	else
+	{
+		reg = a.reg;
+		if(a.max > vm->dataMask)
+			JitOpImm(4, reg, vm->dataMask);			// and reg, 0x12345678
+		JitOpData(ins, reg, reg);				// [r9 + reg]
+	}
+
+	JitPushReg(reg, op == OP_LOAD4 ? 0xFFFFFFFF : op == OP_LOAD2 ? 0xFFFF : 0xFF);
+}
+
+/*
+=================
+JitStore
+Stores the top of the stack to the address below it, or with OP_ARG to the program stack
+=================
+*/
+static void JitStore(vm_t *vm, int op, int ofs)
+{
+	jitValue_t v, a;
+	const char *ins;
+	int index, mask, reg;
+
+	v = JitPop();
+
+	if(op == OP_ARG)
+	{
+		a.kind = JV_LOCAL;
+		a.value = ofs;
+		mask = vm->dataMask;
+	}
+	else
+	{
+		a = JitPop();
+		if(op == OP_STORE4)
+			mask = vm->dataMask & ~3;
+		else if(op == OP_STORE2)
+			mask = vm->dataMask & ~1;
+		else
+			mask = vm->dataMask;
+	}
+
+	index = -1;
+	if(a.kind == JV_CONST)
+		ofs = a.value & mask;
+	else if(a.kind == JV_LOCAL)
+	{
+		JitLeaLocal(JIT_EDX, a.value);			// lea edx, [esi + 0x12345678]
+		JitOpImm(4, JIT_EDX, mask);			// and edx, 0x12345678
+		index = JIT_EDX;
+	}
+	else
+	{
+		JitOpImm(4, a.reg, mask);			// and reg, 0x12345678
+		index = a.reg;
+	}
+
+	reg = v.reg;
+	if(v.kind == JV_LOCAL)
+	{
+		JitLeaLocal(JIT_EAX, v.value);			// lea eax, [esi + 0x12345678]
+		reg = JIT_EAX;
+	}
+
+	if(op == OP_STORE2)
+		Emit1(0x66);
+
+	if(v.kind == JV_CONST)
+	{
+		ins = (op == OP_STORE1) ? "C6" : "C7";	// mov [r9 + index], 0x12345678
+		if(index < 0)
+			JitOpDataConst(ins, 0, ofs);
+		else
+			JitOpData(ins, 0, index);
+
+		if(op == OP_STORE1)
+			Emit1(v.value);
+		else if(op == OP_STORE2)
+			Emit2(v.value);
+		else
+			Emit4(v.value);
+	}
+	else
+	{
+		ins = (op == OP_STORE1) ? "88" : "89";	// mov [r9 + index], reg
+		if(index < 0)
+			JitOpDataConst(ins, reg, ofs);
+		else
+			JitOpData(ins, reg, index);
+	}
+
+	if(v.kind == JV_REG)
+		JitFreeReg(v.reg);
+	if(a.kind == JV_REG)
+		JitFreeReg(a.reg);
+}
+
+/*
+=================
+JitCompare
+Conditional jumps, with everything else on the virtual stack written out first
+=================
+*/
+static void JitCompare(vm_t *vm, int op)
+{
+	jitValue_t a, b;
+	int ra, rb;
+
+	b = JitPop();
+	a = JitPop();
+
+	// the flags have to survive until the jump
+	JitFlush();
+
+	ra = JitToReg(&a);
+
+	if(op >= OP_EQF)
+	{
+		rb = JitToReg(&b);
+		JitMovdToXmm(0, ra);			// movd xmm0, ra
+		JitMovdToXmm(1, rb);			// movd xmm1, rb
+		EmitString("0F 2E C1");			// ucomiss xmm0, xmm1
+		JitFreeReg(rb);
+
+		// unordered sets ZF, PF and CF, like C3, C2 and C0 of fcomp
+		switch(op)
+		{
+		case OP_EQF:	EmitJumpIns(vm, "0F 84", Constant4());	break;	// je 0x12345678
+		case OP_NEF:	EmitJumpIns(vm, "0F 85", Constant4());	break;	// jne 0x12345678
+		case OP_LTF:	EmitJumpIns(vm, "0F 82", Constant4());	break;	// jb 0x12345678
+		case OP_LEF:	EmitJumpIns(vm, "0F 86", Constant4());	break;	// jbe 0x12345678
+		case OP_GTF:	EmitJumpIns(vm, "0F 87", Constant4());	break;	// ja 0x12345678
+		case OP_GEF:	EmitJumpIns(vm, "0F 83", Constant4());	break;	// jae 0x12345678
+		}
+	}
+	else
+	{
+		if(b.kind == JV_CONST)
+			JitOpImm(7, ra, b.value);		// cmp ra, 0x12345678
+		else
+		{
+			rb = JitToReg(&b);
+			JitOpRR("39", rb, ra);			// cmp ra, rb
+			JitFreeReg(rb);
+		}
+
+		EmitBranchConditions(vm, op);
+	}
+
+	JitFreeReg(ra);
+}
+
+/*
+=================
+OptimizeOp
+Translates op onto the virtual stack, qfalse leaves it to the code in VM_Compile
+=================
+*/
+static qboolean OptimizeOp(vm_t *vm, int op, int callProcOfsSyscall)
+{
+	jitValue_t v;
+
+	switch(op)
+	{
+	case OP_CONST:
+		v.value = Constant4();
+		if(code[pc] == OP_JUMP)
+			JUSED(v.value);
+		JitPush(JV_CONST, v.value, 0, 0);
+		return qtrue;
+
+	case OP_LOCAL:
+		JitPush(JV_LOCAL, Constant4(), 0, 0);
+		return qtrue;
+
+	case OP_POP:
+		if(!jitDepth)
+			return qfalse;
+		v = JitPop();
+		if(v.kind == JV_REG)
+			JitFreeReg(v.reg);
+		return qtrue;
+
+	case OP_LOAD4:
+	case OP_LOAD2:
+	case OP_LOAD1:
+		JitLoad(vm, op);
+		return qtrue;
+
+	case OP_STORE4:
+	case OP_STORE2:
+	case OP_STORE1:
+		JitStore(vm, op, 0);
+		return qtrue;
+
+	case OP_ARG:
+		JitStore(vm, op, Constant1() & 0xFF);
+		return qtrue;
+
+	case OP_ADD:
+	case OP_SUB:
+	case OP_DIVI:
+	case OP_DIVU:
+	case OP_MODI:
+	case OP_MODU:
+	case OP_MULI:
+	case OP_MULU:
+	case OP_BAND:
+	case OP_BOR:
+	case OP_BXOR:
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+		JitIntOp(op);
+		return qtrue;
+
+	case OP_ADDF:
+	case OP_SUBF:
+	case OP_MULF:
+	case OP_DIVF:
+		JitFloatOp(op);
+		return qtrue;
+
+	case OP_NEGI:
+	case OP_BCOM:
+	case OP_SEX8:
+	case OP_SEX16:
+	case OP_NEGF:
+	case OP_CVIF:
+	case OP_CVFI:
+		JitUnaryOp(op);
+		return qtrue;
+
+	case OP_EQ:
+	case OP_NE:
+	case OP_LTI:
+	case OP_LEI:
+	case OP_GTI:
+	case OP_GEI:
+	case OP_LTU:
+	case OP_LEU:
+	case OP_GTU:
+	case OP_GEU:
+	case OP_EQF:
+	case OP_NEF:
+	case OP_LTF:
+	case OP_LEF:
+	case OP_GTF:
+	case OP_GEF:
+		JitCompare(vm, op);
+		return qtrue;
+
+	case OP_CALL:
+	case OP_JUMP:
+		if(!jitDepth || jitStack[jitDepth - 1].kind != JV_CONST)
+			return qfalse;
+
+		v = JitPop();
+		JitFlush();
+		if(op == OP_CALL)
+			EmitCallConst(vm, v.value, callProcOfsSyscall);
+		else
+			EmitJumpIns(vm, "E9", v.value);		// jmp 0x12345678
+		return qtrue;
+
+	default:
+		break;
+	}
+
+	return qfalse;
+}
+#endif
+
+/*
+=================
+VM_CopyCompiled
+Copies the code to an exact sized buffer with the appropriate permission bits
+=================
+*/
+static void VM_CopyCompiled(vm_t *vm, const byte *src, int length)
+{
+	vm->codeLength = length;
+#ifdef VM_X86_MMAP
+	vm->codeBase = mmap(NULL, length, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(vm->codeBase == MAP_FAILED)
+		Com_Error(ERR_FATAL, "VM_CompileX86: can't mmap memory");
+#elif _WIN32
+	// allocate memory with EXECUTE permissions under windows.
+	vm->codeBase = VirtualAlloc(NULL, length, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+	if(!vm->codeBase)
+		Com_Error(ERR_FATAL, "VM_CompileX86: VirtualAlloc failed");
+#else
+	vm->codeBase = malloc(length);
+	if(!vm->codeBase)
+	        Com_Error(ERR_FATAL, "VM_CompileX86: malloc failed");
+#endif
+
+	Com_Memcpy( vm->codeBase, src, length );
+
+#ifdef VM_X86_MMAP
+	if(mprotect(vm->codeBase, length, PROT_READ|PROT_EXEC))
+		Com_Error(ERR_FATAL, "VM_CompileX86: mprotect failed");
+#elif _WIN32
+	{
+		DWORD oldProtect = 0;
+		
+		// remove write permissions.
+		if(!VirtualProtect(vm->codeBase, length, PAGE_EXECUTE_READ, &oldProtect))
+			Com_Error(ERR_FATAL, "VM_CompileX86: VirtualProtect failed");
+	}
+#endif
+}
+
+#if idx64
+/*
+===============================================================================
+
+CODE CACHE
+
+With vm_codeCache, the compiled code of each qvm is saved next to the
+configs and loaded back instead of compiling it again.  The file holds
+the instruction offsets, the code, and for every address EmitPtr wrote
+the symbol it points to, so it can be put anywhere.  It is only used
+when the qvm code, the jump table, the compiler options and the build
+are the same, and after its checksum and every offset in it are checked.
+
+===============================================================================
+*/
+
+#define	CODE_CACHE_IDENT	(('T'<<24)+('I'<<16)+('J'<<8)+'Q')	// "QJIT"
+#define	CODE_CACHE_VERSION	2		// change with anything the compiler emits
+
+#define	JIT_NUM_SYMBOLS		7
+
+typedef struct {
+	int			ident;				// also tells a cache of the other byte order
+	int			version;
+	int			build;				// checksum of Q3_VERSION
+	int			codeChecksum;		// of the qvm code
+	int			jtrgChecksum;		// of the jump table targets
+	int			instructionCount;
+	int			dataMask;
+	int			optimize;			// vm_optimize asked for, not what the compiler fell back to
+	int			cpuFeatures;
+	int			entryOfs;
+	int			codeLength;
+	int			numRelocs;
+	int			checksum;			// of the whole file, with this 0
+} codeCacheHeader_t;
+
+// followed by the instructionCount offsets, numRelocs codeCacheReloc_t and the code
+typedef struct {
+	int			ofs;
+	int			symbol;
+} codeCacheReloc_t;
+
+/*
+=================
+JitSymbols
+What the addresses in the code can point to
+=================
+*/
+static void JitSymbols(void **symbols)
+{
+	symbols[0] = (void *) DoSyscall;
+	symbols[1] = &vm_syscallNum;
+	symbols[2] = &vm_programStack;
+	symbols[3] = &vm_opStackOfs;
+	symbols[4] = &vm_opStackBase;
+	symbols[5] = &vm_arg;
+	symbols[6] = (void *) Q_VMftol;
+}
+
+/*
+=================
+VM_CodeCachePath
+=================
+*/
+static void VM_CodeCachePath(vm_t *vm, char *path, int size)
+{
+	Com_sprintf(path, size, "%s/vm/%s.jit", FS_GetCurrentGameDir(), vm->name);
+}
+
+/*
+=================
+VM_CodeCacheKey
+Fills in everything the cached code depends on
+=================
+*/
+static void VM_CodeCacheKey(vm_t *vm, vmHeader_t *header, codeCacheHeader_t *key)
+{
+	Com_Memset(key, 0, sizeof(*key));
+	key->ident = CODE_CACHE_IDENT;
+	key->version = CODE_CACHE_VERSION;
+	key->build = Com_BlockChecksum(Q3_VERSION, strlen(Q3_VERSION));
+	key->codeChecksum = Com_BlockChecksum((byte *)header + header->codeOffset, header->codeLength);
+	if(vm->jumpTableTargets)
+		key->jtrgChecksum = Com_BlockChecksum(vm->jumpTableTargets, vm->numJumpTableTargets * 4);
+	key->instructionCount = header->instructionCount;
+	key->dataMask = vm->dataMask;
+	key->optimize = jitOptimize;
+	key->cpuFeatures = Sys_GetProcessorFeatures();
+}
+
+/*
+=================
+VM_LoadCodeCache
+Sets up the vm from the cache, or returns qfalse if it doesn't match
+=================
+*/
+static qboolean VM_LoadCodeCache(vm_t *vm, codeCacheHeader_t *key)
+{
+	char				path[MAX_OSPATH];
+	fileHandle_t		f;
+	byte				*cache, *code;
+	codeCacheHeader_t	header, *h;
+	codeCacheReloc_t	*relocs;
+	int					*ofs;
+	void				*symbols[JIT_NUM_SYMBOLS];
+	int					length, checksum, i;
+	qboolean			ok;
+
+	VM_CodeCachePath(vm, path, sizeof(path));
+	length = FS_SV_FOpenFileRead(path, &f);
+	if(!f)
+		return qfalse;
+
+	// the fixed header decides whether the rest is worth reading
+	ok = (length >= (int)sizeof(header) && FS_Read(&header, sizeof(header), f) == sizeof(header));
+
+	if(ok && (header.ident != key->ident || header.version != key->version || header.build != key->build
+		|| header.codeChecksum != key->codeChecksum || header.jtrgChecksum != key->jtrgChecksum
+		|| header.instructionCount != key->instructionCount || header.dataMask != key->dataMask
+		|| header.optimize != key->optimize || header.cpuFeatures != key->cpuFeatures))
+		ok = qfalse;
+
+	// each size on its own first, so the sum can't overflow
+	if(ok && (header.codeLength <= 0 || header.codeLength > length
+		|| header.numRelocs < 0 || header.numRelocs > length / (int)sizeof(*relocs)
+		|| header.instructionCount < 0 || header.instructionCount > length / 4
+		|| (size_t)length != sizeof(header) + (size_t)header.instructionCount * 4
+			+ (size_t)header.numRelocs * sizeof(*relocs) + (size_t)header.codeLength))
+		ok = qfalse;
+
+	cache = NULL;
+	if(ok)
+	{
+		cache = malloc(length);
+		if(!cache)
+		{
+			Com_Printf(S_COLOR_YELLOW "VM_LoadCodeCache: can't allocate %i bytes for %s\n", length, path);
+			ok = qfalse;
+		}
+	}
+
+	if(ok)
+	{
+		Com_Memcpy(cache, &header, sizeof(header));
+		ok = (FS_Read(cache + sizeof(header), length - sizeof(header), f) == length - (int)sizeof(header));
+	}
+	FS_FCloseFile(f);
+
+	if(!ok)
+	{
+		free(cache);
+		return qfalse;
+	}
+
+	h = (codeCacheHeader_t *)cache;
+	checksum = h->checksum;
+	h->checksum = 0;
+	if(Com_BlockChecksum(cache, length) != checksum)
+	{
+		Com_Printf(S_COLOR_YELLOW "VM_LoadCodeCache: %s is corrupt\n", path);
+		ok = qfalse;
+	}
+
+	ofs = NULL;
+	relocs = NULL;
+	code = NULL;
+	if(ok)
+	{
+		ofs = (int *)(h + 1);
+		relocs = (codeCacheReloc_t *)(ofs + h->instructionCount);
+		code = (byte *)(relocs + h->numRelocs);
+
+		// nothing in the file may point outside the code
+		if(h->entryOfs < 0 || h->entryOfs >= h->codeLength)
+			ok = qfalse;
+	}
+	for(i = 0; ok && i < h->instructionCount; i++)
+	{
+		if(ofs[i] < 0 || ofs[i] >= h->codeLength)
+			ok = qfalse;
+	}
+	for(i = 0; ok && i < h->numRelocs; i++)
+	{
+		if(relocs[i].ofs < 0 || relocs[i].ofs > h->codeLength - (int)sizeof(void *)
+			|| relocs[i].symbol < 0 || relocs[i].symbol >= JIT_NUM_SYMBOLS)
+			ok = qfalse;
+	}
+
+	if(ok)
+	{
+		JitSymbols(symbols);
+		for(i = 0; i < h->numRelocs; i++)
+			Com_Memcpy(code + relocs[i].ofs, &symbols[relocs[i].symbol], sizeof(void *));
+
+		VM_CopyCompiled(vm, code, h->codeLength);
+		vm->entryOfs = h->entryOfs;
+		for(i = 0; i < h->instructionCount; i++)
+			vm->instructionPointers[i] = (intptr_t) vm->codeBase + ofs[i];
+
+		Com_Printf("VM file %s loaded %i bytes of code from %s%s\n", vm->name, h->codeLength,
+			path, h->optimize ? " (optimized)" : "");
+	}
+
+	free(cache);
+	return ok;
+}
+
+/*
+=================
+VM_WriteCodeCache
+Called with the code still in buf and the instruction pointers still offsets
+=================
+*/
+static void VM_WriteCodeCache(vm_t *vm, codeCacheHeader_t *key)
+{
+	char				path[MAX_OSPATH];
+	fileHandle_t		f;
+	byte				*cache;
+	codeCacheHeader_t	*h;
+	codeCacheReloc_t	*relocs;
+	int					*ofs;
+	void				*symbols[JIT_NUM_SYMBOLS];
+	void				*ptr;
+	int					length, i, j;
+
+	if(jitNumRelocs > jitMaxRelocs)
+		return;
+
+	length = sizeof(*h) + vm->instructionCount * 4 + jitNumRelocs * sizeof(*relocs) + compiledOfs;
+	cache = Z_Malloc(length);
+
+	h = (codeCacheHeader_t *)cache;
+	*h = *key;
+	h->entryOfs = vm->entryOfs;
+	h->codeLength = compiledOfs;
+	h->numRelocs = jitNumRelocs;
+
+	ofs = (int *)(h + 1);
+	for(i = 0; i < vm->instructionCount; i++)
+		ofs[i] = vm->instructionPointers[i];
+
+	JitSymbols(symbols);
+	relocs = (codeCacheReloc_t *)(ofs + vm->instructionCount);
+	for(i = 0; i < jitNumRelocs; i++)
+	{
+		Com_Memcpy(&ptr, buf + jitRelocs[i], sizeof(ptr));
+		for(j = 0; j < JIT_NUM_SYMBOLS && symbols[j] != ptr; j++)
+			;
+		if(j == JIT_NUM_SYMBOLS)
+		{
+			Com_DPrintf("VM_WriteCodeCache: unknown address at %i\n", jitRelocs[i]);
+			Z_Free(cache);
+			return;
+		}
+		relocs[i].ofs = jitRelocs[i];
+		relocs[i].symbol = j;
+	}
+	Com_Memcpy(relocs + jitNumRelocs, buf, compiledOfs);
+
+	h->checksum = Com_BlockChecksum(cache, length);
+
+	VM_CodeCachePath(vm, path, sizeof(path));
+	f = FS_SV_FOpenFileWrite(path);
+	if(f)
+	{
+		FS_Write(cache, length, f);
+		FS_FCloseFile(f);
+	}
+	else
+		Com_DPrintf("Couldn't write %s\n", path);
+
+	Z_Free(cache);
+}
+#endif
+
+/*
+=================
+VM_Compile
+=================
+*/
+void VM_Compile(vm_t *vm, vmHeader_t *header)
+{
+	int		op;
+	int		maxLength;
+	int		v;
+	int		i;
+	int		margin;
+        int		callProcOfsSyscall, callProcOfs, callDoSyscallOfs;
+#if idx64
+	codeCacheHeader_t	key;
+	qboolean	codeCache;
+	int		prologueRelocs;
+#endif
+
+	jusedSize = header->instructionCount + 2;
+
+#if idx64
+	jitOptimize = Cvar_VariableIntegerValue( "vm_optimize" ) && vm->jumpTableTargets;
+
+	codeCache = Cvar_VariableIntegerValue( "vm_codeCache" );
+	if(codeCache)
+	{
+		VM_CodeCacheKey(vm, header, &key);
+		if(VM_LoadCodeCache(vm, &key))
+		{
+			vm->destroy = VM_Destroy_Compiled;
+			return;
+		}
+	}
+#endif
+
+	// allocate a very large temp buffer, we will shrink it later
+	maxLength = header->codeLength * 8 + 64 + 256;
+	buf = Z_Malloc(maxLength);
+	jused = Z_Malloc(jusedSize);
+	code = Z_Malloc(header->codeLength+32);
+#if idx64
+	// at most one address for each instruction, and the ones in EmitCallDoSyscall
+	jitMaxRelocs = header->instructionCount + 16;
+	jitRelocs = Z_Malloc(jitMaxRelocs * sizeof(*jitRelocs));
+	jitNumRelocs = 0;
+#endif
+	
+	Com_Memset(jused, 0, jusedSize);
+	Com_Memset(buf, 0, maxLength);
+
+	// copy code in larger buffer and put some zeros at the end
+	// so we can safely look ahead for a few instructions in it
+	// without a chance to get false-positive because of some garbage bytes
+	Com_Memset(code, 0, header->codeLength+32);
+	Com_Memcpy(code, (byte *)header + header->codeOffset, header->codeLength );
+
+	// ensure that the optimisation pass knows about all the jump
+	// table targets
+	for( i = 0; i < vm->numJumpTableTargets; i++ ) {
+		jused[ *(int *)(vm->jumpTableTargets + ( i * sizeof( int ) ) ) ] = 1;
+	}
+
+	// Start buffer with x86-VM specific procedures
+	compiledOfs = 0;
+
+	callDoSyscallOfs = compiledOfs;
+	callProcOfs = EmitCallDoSyscall(vm);
+	callProcOfsSyscall = EmitCallProcedure(vm, callDoSyscallOfs);
+	vm->entryOfs = compiledOfs;
+#if idx64
+	prologueRelocs = jitNumRelocs;
+#endif
+
+	for(pass=0; pass < 3; pass++) {
+#if idx64
+	// only the last pass is kept
+	jitNumRelocs = prologueRelocs;
+	// a whole block written out before one instruction can take more than the usual margin
+	margin = jitOptimize ? 256 : 16;
+	jitDepth = 0;
+	jitRegsUsed = 0;
+#else
+	margin = 16;
+#endif
+	oc0 = -23423;
+	oc1 = -234354;
+	pop0 = -43435;
+	pop1 = -545455;
+
+	// translate all instructions
+	pc = 0;
+	instruction = 0;
+	//code = (byte *)header + header->codeOffset;
+	compiledOfs = vm->entryOfs;
+
+	LastCommand = LAST_COMMAND_NONE;
+
+	while(instruction < header->instructionCount)
+	{
+		if(compiledOfs > maxLength - margin)
+		{
+#if idx64
+			if(jitOptimize)
+			{
+				// only possible for pathological code, start over without the tier
+				Com_Printf(S_COLOR_YELLOW "VM_CompileX86: %s too large for vm_optimize\n", vm->name);
+				jitOptimize = qfalse;
+				margin = 16;
+				pass = -1;
+				break;
+			}
+#endif
+	        	VMFREE_BUFFERS();
+			Com_Error(ERR_DROP, "VM_CompileX86: maxLength exceeded");
+		}
+
+		if ( !vm->jumpTableTargets )
+			jlabel = 1;
+		else 
+			jlabel = jused[ instruction ];
+
+#if idx64
+		// jumps and calls land with everything on the opStack
+		if(jitOptimize && (jlabel || code[pc] == OP_ENTER))
+		{
+			JitFlush();
+			// remember the block starts for VM_CompileX86 to seal the rest
+			if(pass == 2)
+				jused[instruction] = 1;
+		}
+#endif
+
+		vm->instructionPointers[ instruction ] = compiledOfs;
+
+		instruction++;
+
+		if(pc > header->codeLength)
+		{
+		        VMFREE_BUFFERS();
+			Com_Error(ERR_DROP, "VM_CompileX86: pc > header->codeLength");
+		}
+
+		op = code[ pc ];
+		pc++;
+
+#if idx64
+		if(jitOptimize)
+		{
+			if(OptimizeOp(vm, op, callProcOfsSyscall))
+			{
+				// nothing the peephole checks below look for was emitted
+				pop0 = pop1 = -1;
+				continue;
+			}
+			JitFlush();
+		}
+#endif
+
+		switch ( op ) {
+		case 0:
+			break;
+		case OP_BREAK:
+			EmitString("CC");				// int 3
+			break;
+		case OP_ENTER:
+			EmitString("81 EE");				// sub esi, 0x12345678
+			Emit4(Constant4());
+			break;
+		case OP_CONST:
+			if(ConstOptimize(vm, callProcOfsSyscall))
+				break;
+
+			EmitPushStack(vm);
+			EmitString("C7 04 9F");				// mov dword ptr [edi + ebx * 4], 0x12345678
+			lastConst = Constant4();
+
+			Emit4(lastConst);
+			if(code[pc] == OP_JUMP)
+				JUSED(lastConst);
+
+			break;
+		case OP_LOCAL:
+			EmitPushStack(vm);
+			EmitString("8D 86");				// lea eax, [0x12345678 + esi]
+			oc0 = oc1;
+			oc1 = Constant4();
+			Emit4(oc1);
+			EmitCommand(LAST_COMMAND_MOV_STACK_EAX);	// mov dword ptr [edi + ebx * 4], eax
+			break;
+		case OP_ARG:
+			EmitMovEAXStack(vm, 0);				// mov eax, dword ptr [edi + ebx * 4]
+			EmitString("8B D6");				// mov edx, esi
+			EmitString("81 C2");				// add edx, 0x12345678
+			Emit4((Constant1() & 0xFF));
+			MASK_REG("E2", vm->dataMask);			// and edx, 0x12345678
+#if idx64
+			EmitRexString(0x41, "89 04 11");		// mov dword ptr [r9 + edx], eax
+#else
+			EmitString("89 82");				// mov dword ptr [edx + 0x12345678], eax
+			Emit4((intptr_t) vm->dataBase);
+#endif
+			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
+			break;
+		case OP_CALL:
+			EmitCallRel(vm, callProcOfs);
+			break;
+		case OP_PUSH:
+			EmitPushStack(vm);
+			break;
+		case OP_POP:
+			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
+			break;
+		case OP_LEAVE:
+			v = Constant4();
+			EmitString("81 C6");				// add	esi, 0x12345678
+			Emit4(v);
+			EmitString("C3");				// ret
+			break;
+		case OP_LOAD4:
+			if (code[pc] == OP_CONST && code[pc+5] == OP_ADD && code[pc+6] == OP_STORE4)
+			{
+				if(oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+				{
+					compiledOfs -= 12;
+					vm->instructionPointers[instruction - 1] = compiledOfs;
+				}
+
+				pc++;				// OP_CONST
+				v = Constant4();
+
+				EmitMovEDXStack(vm, vm->dataMask);
+				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+				{
+#if idx64
+					EmitRexString(0x41, "FF 04 11");	// inc dword ptr [r9 + edx]
+#else
+					EmitString("FF 82");			// inc dword ptr [edx + 0x12345678]
+					Emit4((intptr_t) vm->dataBase);
+#endif
+				}
+				else
+				{
+#if idx64
+					EmitRexString(0x41, "8B 04 11");	// mov eax, dword ptr [r9 + edx]
+#else
+					EmitString("8B 82");			// mov eax, dword ptr [edx + 0x12345678]
+					Emit4((intptr_t) vm->dataBase);
+#endif
+					EmitString("05");			// add eax, v
+					Emit4(v);
+					
+					if (oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+					{
+#if idx64
+						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
+#else
+						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
+						Emit4((intptr_t) vm->dataBase);
+#endif
+					}
+					else
+					{
+						EmitCommand(LAST_COMMAND_SUB_BL_1);	// sub bl, 1
+						EmitString("8B 14 9F");			// mov edx, dword ptr [edi + ebx * 4]
+						MASK_REG("E2", vm->dataMask);		// and edx, 0x12345678
+#if idx64
+						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
+#else
+						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
+						Emit4((intptr_t) vm->dataBase);
+#endif
+					}
+				}
+
+				EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
+				pc++;						// OP_ADD
+				pc++;						// OP_STORE
+				instruction += 3;
+				break;
+			}
+
+			if(code[pc] == OP_CONST && code[pc+5] == OP_SUB && code[pc+6] == OP_STORE4)
+			{
+				if(oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+				{
+					compiledOfs -= 12;
+					vm->instructionPointers[instruction - 1] = compiledOfs;
+				}
+				
+				pc++;					// OP_CONST
+				v = Constant4();
+
+				EmitMovEDXStack(vm, vm->dataMask);
+				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+				{
+#if idx64
 					EmitRexString(0x41, "FF 0C 11");	// dec dword ptr [r9 + edx]
 #else
 					EmitString("FF 8A");			// dec dword ptr [edx + 0x12345678]
@@ -1637,42 +2877,40 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 	}
 	}
 
-	// copy to an exact sized buffer with the appropriate permission bits
-	vm->codeLength = compiledOfs;
-#ifdef VM_X86_MMAP
-	vm->codeBase = mmap(NULL, compiledOfs, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-	if(vm->codeBase == MAP_FAILED)
-		Com_Error(ERR_FATAL, "VM_CompileX86: can't mmap memory");
-#elif _WIN32
-	// allocate memory with EXECUTE permissions under windows.
-	vm->codeBase = VirtualAlloc(NULL, compiledOfs, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-	if(!vm->codeBase)
-		Com_Error(ERR_FATAL, "VM_CompileX86: VirtualAlloc failed");
-#else
-	vm->codeBase = malloc(compiledOfs);
-	if(!vm->codeBase)
-	        Com_Error(ERR_FATAL, "VM_CompileX86: malloc failed");
-#endif
+#if idx64
+	if(jitOptimize)
+	{
+		int errJumpOfs = compiledOfs;
 
-	Com_Memcpy( vm->codeBase, buf, compiledOfs );
+		// inside a block, values live in registers and skip the data mask
+		// once checked, so computed jumps and calls must only reach the
+		// block starts; everything else gets sent to a VM_JMP_VIOLATION
+		EmitCallErrJump(vm, callDoSyscallOfs);
 
-#ifdef VM_X86_MMAP
-	if(mprotect(vm->codeBase, compiledOfs, PROT_READ|PROT_EXEC))
-		Com_Error(ERR_FATAL, "VM_CompileX86: mprotect failed");
-#elif _WIN32
-	{
-		DWORD oldProtect = 0;
-		
-		// remove write permissions.
-		if(!VirtualProtect(vm->codeBase, compiledOfs, PAGE_EXECUTE_READ, &oldProtect))
-			Com_Error(ERR_FATAL, "VM_CompileX86: VirtualProtect failed");
+		for(i = 0; i < header->instructionCount; i++)
+		{
+			if(!jused[i])
+				vm->instructionPointers[i] = errJumpOfs;
+		}
 	}
 #endif
 
+	VM_CopyCompiled(vm, buf, compiledOfs);
+
+#if idx64
+	if(codeCache)
+		VM_WriteCodeCache(vm, &key);
+	Z_Free( jitRelocs );
+	jitRelocs = NULL;
+#endif
 	Z_Free( code );
 	Z_Free( buf );
 	Z_Free( jused );
+#if idx64
+	Com_Printf( "VM file %s compiled to %i bytes of code%s\n", vm->name, compiledOfs, jitOptimize ? " (optimized)" : "" );
+#else
 	Com_Printf( "VM file %s compiled to %i bytes of code\n", vm->name, compiledOfs );
+#endif
 
 	vm->destroy = VM_Destroy_Compiled;
 
@@ -1707,13 +2945,16 @@ extern uint8_t qvmcall64(int *programStack, int *opStack, intptr_t *instructionP
 
 int VM_CallCompiled(vm_t *vm, int *args)
 {
-	byte	stack[OPSTACK_SIZE + 15];
+	byte	stack[OPSTACK_SIZE + 4 * JIT_MAX_DEPTH + 15];
 	void	*entryPoint;
 	int		programStack, stackOnEntry;
 	byte	*image;
 	int	*opStack;
 	int		opStackOfs;
 	int		arg;
+#if idx64
+	qboolean	sampled;
+#endif
 
 	currentVM = vm;
 
@@ -1740,6 +2981,11 @@ int VM_CallCompiled(vm_t *vm, int *args)
 	*opStack = 0xDEADBEEF;
 	opStackOfs = 0;
 
+#if idx64
+	// the compiled code runs below stack, see VM_SampleCompiled
+	sampled = VM_SampleEnter( stack );
+#endif
+
 #ifdef _MSC_VER
   #if idx64
 	opStackOfs = qvmcall64(&programStack, opStack, vm->instructionPointers, vm->dataBase);
@@ -1788,6 +3034,11 @@ int VM_CallCompiled(vm_t *vm, int *args)
 	);
 #endif
 
+#if idx64
+	if(sampled)
+		VM_SampleLeave();
+#endif
+
 	if(opStackOfs != 1 || *opStack != 0xDEADBEEF)
 	{
 		Com_Error(ERR_DROP, "opStack corrupted in compiled code");
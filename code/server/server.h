@@ -33,6 +33,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #define	MAX_ENT_CLUSTERS	16
 
+// usercmds a client can have queued between two SV_RunClientThinks,
+// a full queue is run right away
+#define	MAX_PENDING_USERCMDS	64
+
 #ifdef USE_VOIP
 #define VOIP_QUEUE_LENGTH 64
 
@@ -48,6 +52,14 @@ typedef struct voipServerPacket_s
 } voipServerPacket_t;
 #endif
 
+// an entity state captured for snapshots, shared by every client frame
+// that saw the entity in this state
+typedef struct snapshotEntity_s {
+	entityState_t	s;
+	int				refCount;
+	struct snapshotEntity_s	*nextFree;
+} snapshotEntity_t;
+
 typedef struct svEntity_s {
 	struct worldSector_s *worldSector;
 	struct svEntity_s *nextEntityInWorldSector;
@@ -57,7 +69,11 @@ typedef struct svEntity_s {
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
+	vec3_t		leafMins, leafMaxs;	// bounds the clusters and areas were found for
+	float		leafSlack;			// how far those bounds can move before they must be found again
 	int			snapshotCounter;	// used to prevent double adding from portal views
+	snapshotEntity_t	*snapshotState;	// last state captured, reused while unchanged
+	int			snapshotEpoch;		// sv.snapshotEpoch snapshotState was last checked in
 } svEntity_t;
 
 typedef enum {
@@ -76,6 +92,7 @@ typedef struct {
 	// the serverId associated with the current checksumFeed (always <= serverId)
 	int       checksumFeedServerId;	
 	int				snapshotCounter;	// incremented for each snapshot built
+	int				snapshotEpoch;		// incremented whenever entity states may have changed
 	int				timeResidual;		// <= 1000 / sv_frame->value
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	char			*configstrings[MAX_CONFIGSTRINGS];
@@ -93,6 +110,14 @@ typedef struct {
 
 	int				restartTime;
 	int				time;
+
+	// configstrings and baselines as encoded by SV_SendClientGameState,
+	// invalidated whenever either changes
+	qboolean		gamestateValid;
+	int				gamestateBits;
+	byte			gamestateData[MAX_MSGLEN];
+
+	qboolean		gameThinkSync;		// the game takes GAME_CLIENT_THINK_SYNC, see SV_InitGameVM
 } server_t;
 
 
@@ -104,8 +129,7 @@ typedef struct {
 	byte			areabits[MAX_MAP_AREA_BYTES];		// portalarea visibility bits
 	playerState_t	ps;
 	int				num_entities;
-	int				first_entity;		// into the circular sv_packet_entities[]
-										// the entities MUST be in increasing state number
+	snapshotEntity_t	*entities[MAX_SNAPSHOT_ENTITIES];	// the entities MUST be in increasing state number
 										// order, otherwise the delta compression will fail
 	int				messageSent;		// time the message was transmitted
 	int				messageAcked;		// time the message was acked
@@ -130,11 +154,19 @@ typedef struct netchan_buffer_s {
 	struct netchan_buffer_s *next;
 } netchan_buffer_t;
 
+// a reliable server command, shared by every client it was sent to
+typedef struct serverCommand_s {
+	int				refCount;
+	int				bits;				// length of encoded
+	byte			*encoded;			// text as written by MSG_WriteString
+	char			text[1];			// variable sized
+} serverCommand_t;
+
 typedef struct client_s {
 	clientState_t	state;
 	char			userinfo[MAX_INFO_STRING];		// name, etc
 
-	char			reliableCommands[MAX_RELIABLE_COMMANDS][MAX_STRING_CHARS];
+	serverCommand_t	*reliableCommands[MAX_RELIABLE_COMMANDS];
 	int				reliableSequence;		// last added reliable message, not necesarily sent or acknowledged yet
 	int				reliableAcknowledge;	// last acknowledged reliable message
 	int				reliableSent;			// last sent reliable message, not necesarily acknowledged yet
@@ -144,6 +176,8 @@ typedef struct client_s {
 	int				challenge;
 
 	usercmd_t		lastUsercmd;
+	usercmd_t		pendingCmds[MAX_PENDING_USERCMDS];	// waiting for SV_RunClientThinks
+	int				numPendingCmds;
 	int				lastMessageNum;		// for delta compression
 	int				lastClientCommand;	// reliable client message sequence
 	char			lastClientCommandString[MAX_STRING_CHARS];
@@ -235,9 +269,6 @@ typedef struct {
 	int			snapFlagServerBit;			// ^= SNAPFLAG_SERVERCOUNT every SV_SpawnServer()
 
 	client_t	*clients;					// [sv_maxclients->integer];
-	int			numSnapshotEntities;		// sv_maxclients->integer*PACKET_BACKUP*MAX_SNAPSHOT_ENTITIES
-	int			nextSnapshotEntities;		// next snapshotEntities to use
-	entityState_t	*snapshotEntities;		// [numSnapshotEntities]
 	int			nextHeartbeatTime;
 	challenge_t	challenges[MAX_CHALLENGES];	// to prevent invalid IPs from connecting
 	netadr_t	redirectAddress;			// for rcon return messages
@@ -283,12 +314,16 @@ extern	cvar_t	*sv_serverid;
 extern	cvar_t	*sv_minRate;
 extern	cvar_t	*sv_maxRate;
 extern	cvar_t	*sv_dlRate;
+extern	cvar_t	*sv_httpPort;
+extern	cvar_t	*sv_httpHost;
 extern	cvar_t	*sv_minPing;
 extern	cvar_t	*sv_maxPing;
 extern	cvar_t	*sv_gametype;
 extern	cvar_t	*sv_pure;
 extern	cvar_t	*sv_floodProtect;
 extern	cvar_t	*sv_lanForceRate;
+extern	cvar_t	*sv_batchUsercmds;
+extern	cvar_t	*sv_traceCache;
 #ifndef STANDALONE
 extern	cvar_t	*sv_strictAuth;
 #endif
@@ -328,7 +363,9 @@ extern leakyBucket_t outboundLeakyBucket;
 
 qboolean SVC_RateLimit( leakyBucket_t *bucket, int burst, int period );
 qboolean SVC_RateLimitAddress( netadr_t from, int burst, int period );
+qboolean SVC_RateLimitQuery( netadr_t from );
 
+char *SV_ServerInfoString( void );
 void SV_FinalMessage (char *message);
 void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
 
@@ -377,6 +414,7 @@ void SV_DropClient( client_t *drop, const char *reason );
 
 void SV_ExecuteClientCommand( client_t *cl, const char *s, qboolean clientOK );
 void SV_ClientThink (client_t *cl, usercmd_t *cmd);
+void SV_RunClientThinks( void );
 
 int SV_WriteDownloadToClient(client_t *cl , msg_t *msg);
 int SV_SendDownloadMessages(void);
@@ -392,11 +430,17 @@ void SV_Heartbeat_f( void );
 // sv_snapshot.c
 //
 void SV_AddServerCommand( client_t *client, const char *cmd );
+const char *SV_ReliableCommand( client_t *client, int sequence );
+void SV_FreeReliableCommands( client_t *client );
 void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg );
 void SV_WriteFrameToClient (client_t *client, msg_t *msg);
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
+void SV_FreeClientFrames( client_t *client );
+void SV_BeginSnapshotEpoch( void );
+void SV_ClearSnapshotEntities( void );
+void SV_SnapshotPool_f( void );
 
 //
 // sv_game.c
@@ -453,6 +497,11 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void SV_SectorList_f( void );
+void SV_SectorBench_f( void );
+void SV_TraceCache_f( void );
+
+void SV_InvalidateTraceCache( void );
+// drops every SV_Trace and SV_PointContents result kept for sv_traceCache
 
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -490,3 +539,23 @@ void SV_Netchan_Transmit( client_t *client, msg_t *msg);
 int SV_Netchan_TransmitNextFragment(client_t *client);
 qboolean SV_Netchan_Process( client_t *client, msg_t *msg );
 void SV_Netchan_FreeQueue(client_t *client);
+
+//
+// sv_pacing.c
+//
+void SV_PaceClient( client_t *client, int msec, qboolean snapshot );
+// services the client's pending fragments, or a rate delayed snapshot, within msec
+void SV_PaceSentSnapshot( client_t *client );
+int SV_PaceRun( void );
+void SV_PaceClear( void );
+void SV_PaceStats_f( void );
+
+//
+// sv_http.c
+//
+void SV_HTTPUpdate( void );
+// starts or stops the pk3 download server and publishes the referenced paks
+void SV_HTTPShutdown( void );
+const char *SV_HTTPAutoURL( void );
+// the URL clients are sent as sv_dlURL while the admin hasn't set one
+void SV_HTTPStatus_f( void );
@@ -572,7 +572,7 @@ SV_BotGetConsoleMessage
 int SV_BotGetConsoleMessage( int client, char *buf, int size )
 {
 	client_t	*cl;
-	int			index;
+	const char	*msg;
 
 	cl = &svs.clients[client];
 	cl->lastPacketTime = svs.time;
@@ -582,13 +582,13 @@ int SV_BotGetConsoleMessage( int client, char *buf, int size )
 	}
 
 	cl->reliableAcknowledge++;
-	index = cl->reliableAcknowledge & ( MAX_RELIABLE_COMMANDS - 1 );
+	msg = SV_ReliableCommand( cl, cl->reliableAcknowledge );
 
-	if ( !cl->reliableCommands[index][0] ) {
+	if ( !msg[0] ) {
 		return qfalse;
 	}
 
-	Q_strncpyz( buf, cl->reliableCommands[index], size );
+	Q_strncpyz( buf, msg, size );
 	return qtrue;
 }
 
@@ -606,7 +606,7 @@ int EntityInPVS( int client, int entityNum ) {
 	cl = &svs.clients[client];
 	frame = &cl->frames[cl->netchan.outgoingSequence & PACKET_MASK];
 	for ( i = 0; i < frame->num_entities; i++ )	{
-		if ( svs.snapshotEntities[(frame->first_entity + i) % svs.numSnapshotEntities].number == entityNum ) {
+		if ( frame->entities[i]->s.number == entityNum ) {
 			return qtrue;
 		}
 	}
@@ -628,6 +628,6 @@ int SV_BotGetSnapshotEntity( int client, int sequence ) {
 	if (sequence < 0 || sequence >= frame->num_entities) {
 		return -1;
 	}
-	return svs.snapshotEntities[(frame->first_entity + sequence) % svs.numSnapshotEntities].number;
+	return frame->entities[sequence]->s.number;
 }
 
@@ -1316,7 +1316,7 @@ static void SV_Serverinfo_f( void ) {
 	}
 
 	Com_Printf ("Server info settings:\n");
-	Info_Print ( Cvar_InfoString( CVAR_SERVERINFO ) );
+	Info_Print ( SV_ServerInfoString() );
 }
 
 
@@ -1425,6 +1425,11 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f);
 	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand ("sectorbench", SV_SectorBench_f);
+	Cmd_AddCommand ("httpstatus", SV_HTTPStatus_f);
+	Cmd_AddCommand ("pacestats", SV_PaceStats_f);
+	Cmd_AddCommand ("snapshotpool", SV_SnapshotPool_f);
+	Cmd_AddCommand ("tracecache", SV_TraceCache_f);
 	Cmd_AddCommand ("map", SV_Map_f);
 	Cmd_SetCommandCompletionFunc( "map", SV_CompleteMapName );
 #ifndef PRE_RELEASE_DEMO
@@ -1472,6 +1477,11 @@ void SV_RemoveOperatorCommands( void ) {
 	Cmd_RemoveCommand ("dumpuser");
 	Cmd_RemoveCommand ("map_restart");
 	Cmd_RemoveCommand ("sectorlist");
+	Cmd_RemoveCommand ("sectorbench");
+	Cmd_RemoveCommand ("httpstatus");
+	Cmd_RemoveCommand ("pacestats");
+	Cmd_RemoveCommand ("snapshotpool");
+	Cmd_RemoveCommand ("tracecache");
 	Cmd_RemoveCommand ("say");
 #endif
 }
@@ -68,7 +68,7 @@ void SV_GetChallenge(netadr_t from)
 	}
 
 	// Prevent using getchallenge as an amplifier
-	if ( SVC_RateLimitAddress( from, 10, 1000 ) ) {
+	if ( SVC_RateLimitQuery( from ) ) {
 		Com_DPrintf( "SV_GetChallenge: rate limit from %s exceeded, dropping request\n",
 			NET_AdrToString( from ) );
 		return;
@@ -538,6 +538,8 @@ gotnewcl:
 	// build a new connection
 	// accept the new client
 	// this is the only place a client_t is ever initialized
+	SV_FreeReliableCommands( newcl );
+	SV_FreeClientFrames( newcl );
 	*newcl = temp;
 	clientNum = newcl - svs.clients;
 	ent = SV_GentityNum( clientNum );
@@ -700,6 +702,57 @@ void SV_DropClient( client_t *drop, const char *reason ) {
 	}
 }
 
+/*
+================
+SV_WriteGamestate
+
+Writes the configstrings and baselines of the gamestate message,
+encoding them only once for all clients until either changes
+================
+*/
+static void SV_WriteGamestate( msg_t *msg ) {
+	int			start;
+	entityState_t	*base, nullstate;
+	msg_t		cache;
+
+	if ( !sv.gamestateValid ) {
+		MSG_Init( &cache, sv.gamestateData, sizeof( sv.gamestateData ) );
+
+		// write the configstrings
+		for ( start = 0 ; start < MAX_CONFIGSTRINGS ; start++ ) {
+			if (sv.configstrings[start][0]) {
+				MSG_WriteByte( &cache, svc_configstring );
+				MSG_WriteShort( &cache, start );
+				MSG_WriteBigString( &cache, sv.configstrings[start] );
+			}
+		}
+
+		// write the baselines
+		Com_Memset( &nullstate, 0, sizeof( nullstate ) );
+		for ( start = 0 ; start < MAX_GENTITIES; start++ ) {
+			base = &sv.svEntities[start].baseline;
+			if ( !base->number ) {
+				continue;
+			}
+			MSG_WriteByte( &cache, svc_baseline );
+			MSG_WriteDeltaEntity( &cache, &nullstate, base, qtrue );
+		}
+
+		MSG_WriteByte( &cache, svc_EOF );
+
+		if ( cache.overflowed ) {
+			// the client message would overflow as well
+			msg->overflowed = qtrue;
+			return;
+		}
+
+		sv.gamestateBits = cache.bit;
+		sv.gamestateValid = qtrue;
+	}
+
+	MSG_WriteBitstream( msg, sv.gamestateData, sv.gamestateBits );
+}
+
 /*
 ================
 SV_SendClientGameState
@@ -712,8 +765,6 @@ the wrong gamestate.
 ================
 */
 static void SV_SendClientGameState( client_t *client ) {
-	int			start;
-	entityState_t	*base, nullstate;
 	msg_t		msg;
 	byte		msgBuffer[MAX_MSGLEN];
 
@@ -744,27 +795,8 @@ static void SV_SendClientGameState( client_t *client ) {
 	MSG_WriteByte( &msg, svc_gamestate );
 	MSG_WriteLong( &msg, client->reliableSequence );
 
-	// write the configstrings
-	for ( start = 0 ; start < MAX_CONFIGSTRINGS ; start++ ) {
-		if (sv.configstrings[start][0]) {
-			MSG_WriteByte( &msg, svc_configstring );
-			MSG_WriteShort( &msg, start );
-			MSG_WriteBigString( &msg, sv.configstrings[start] );
-		}
-	}
-
-	// write the baselines
-	Com_Memset( &nullstate, 0, sizeof( nullstate ) );
-	for ( start = 0 ; start < MAX_GENTITIES; start++ ) {
-		base = &sv.svEntities[start].baseline;
-		if ( !base->number ) {
-			continue;
-		}
-		MSG_WriteByte( &msg, svc_baseline );
-		MSG_WriteDeltaEntity( &msg, &nullstate, base, qtrue );
-	}
-
-	MSG_WriteByte( &msg, svc_EOF );
+	// write the configstrings and baselines
+	SV_WriteGamestate( &msg );
 
 	MSG_WriteLong( &msg, client - svs.clients);
 
@@ -806,6 +838,9 @@ void SV_ClientEnterWorld( client_t *client, usercmd_t *cmd ) {
 	else
 		memset(&client->lastUsercmd, '\0', sizeof(client->lastUsercmd));
 
+	// anything still queued belongs to the last gamestate
+	client->numPendingCmds = 0;
+
 	// call the game begin function
 	VM_Call( gvm, GAME_CLIENT_BEGIN, client - svs.clients );
 }
@@ -1132,33 +1167,14 @@ int SV_WriteDownloadToClient(client_t *cl, msg_t *msg)
 ==================
 SV_SendQueuedMessages
 
-Send one round of fragments, or queued messages to all clients that have data pending.
+Send the fragments, queued messages and rate delayed snapshots whose time has come.
 Return the shortest time interval for sending next packet to client
 ==================
 */
 
 int SV_SendQueuedMessages(void)
 {
-	int i, retval = -1, nextFragT;
-	client_t *cl;
-	
-	for(i=0; i < sv_maxclients->integer; i++)
-	{
-		cl = &svs.clients[i];
-		
-		if(cl->state)
-		{
-			nextFragT = SV_RateMsec(cl);
-
-			if(!nextFragT)
-				nextFragT = SV_Netchan_TransmitNextFragment(cl);
-
-			if(nextFragT >= 0 && (retval == -1 || retval > nextFragT))
-				retval = nextFragT;
-		}
-	}
-
-	return retval;
+	return SV_PaceRun();
 }
 
 
@@ -1367,6 +1383,7 @@ static void SV_VerifyPaks_f( client_t *cl ) {
 			cl->pureAuthentic = 0;
 			cl->lastSnapshotTime = 0;
 			cl->state = CS_ACTIVE;
+			SV_BeginSnapshotEpoch();
 			SV_SendClientSnapshot( cl );
 			SV_DropClient( cl, "Unpure client detected. Invalid .PK3 files referenced!" );
 		}
@@ -1650,10 +1667,21 @@ static qboolean SV_ClientCommand( client_t *cl, msg_t *msg ) {
 ==================
 SV_ClientThink
 
-Also called by bot code
+Also called by bot code.  Commands from real clients are queued for
+SV_RunClientThinks when sv_batchUsercmds is set and the game supports it,
+bots are already run once per frame by the game.
 ==================
 */
 void SV_ClientThink (client_t *cl, usercmd_t *cmd) {
+	if ( cl->state == CS_ACTIVE && sv_batchUsercmds->integer && sv.gameThinkSync
+		&& cl->netchan.remoteAddress.type != NA_BOT ) {
+		if ( cl->numPendingCmds == MAX_PENDING_USERCMDS ) {
+			SV_RunClientThinks();
+		}
+		cl->pendingCmds[cl->numPendingCmds++] = *cmd;
+		return;
+	}
+
 	cl->lastUsercmd = *cmd;
 
 	if ( cl->state != CS_ACTIVE ) {
@@ -1663,6 +1691,48 @@ void SV_ClientThink (client_t *cl, usercmd_t *cmd) {
 	VM_Call( gvm, GAME_CLIENT_THINK, cl - svs.clients );
 }
 
+/*
+==================
+SV_RunClientThinks
+
+Hands the queued usercmds to the game in rounds: every client with a
+command left gets its next one, then GAME_CLIENT_THINK_SYNC ends the
+round.  Each client's commands still run in order, while the game is
+free to move all the clients of a round at the same time.
+==================
+*/
+void SV_RunClientThinks( void ) {
+	int			i, round, rounds;
+	client_t	*cl;
+
+	rounds = 0;
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		if ( cl->numPendingCmds > rounds ) {
+			rounds = cl->numPendingCmds;
+		}
+	}
+
+	for ( round = 0 ; round < rounds ; round++ ) {
+		for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+			if ( round >= cl->numPendingCmds ) {
+				continue;
+			}
+			if ( cl->state != CS_ACTIVE ) {
+				cl->numPendingCmds = 0;		// kicked during an earlier round
+				continue;
+			}
+			cl->lastUsercmd = cl->pendingCmds[round];
+			VM_Call( gvm, GAME_CLIENT_THINK, i );
+		}
+
+		VM_Call( gvm, GAME_CLIENT_THINK_SYNC );
+	}
+
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		cl->numPendingCmds = 0;
+	}
+}
+
 /*
 ==================
 SV_UserMove
@@ -1705,7 +1775,7 @@ static void SV_UserMove( client_t *cl, msg_t *msg, qboolean delta ) {
 	// also use the message acknowledge
 	key ^= cl->messageAcknowledge;
 	// also use the last acknowledged server command in the key
-	key ^= MSG_HashKey(cl->reliableCommands[ cl->reliableAcknowledge & (MAX_RELIABLE_COMMANDS-1) ], 32);
+	key ^= MSG_HashKey(SV_ReliableCommand( cl, cl->reliableAcknowledge ), 32);
 
 	Com_Memset( &nullcmd, 0, sizeof(nullcmd) );
 	oldcmd = &nullcmd;
@@ -1763,8 +1833,12 @@ static void SV_UserMove( client_t *cl, msg_t *msg, qboolean delta ) {
 		//	continue;
 		//}
 		// don't execute if this is an old cmd which is already executed
-		// these old cmds are included when cl_packetdup > 0
-		if ( cmds[i].serverTime <= cl->lastUsercmd.serverTime ) {
+		// or queued, these old cmds are included when cl_packetdup > 0
+		if ( cl->numPendingCmds ) {
+			if ( cmds[i].serverTime <= cl->pendingCmds[cl->numPendingCmds-1].serverTime ) {
+				continue;
+			}
+		} else if ( cmds[i].serverTime <= cl->lastUsercmd.serverTime ) {
 			continue;
 		}
 		SV_ClientThink (cl, &cmds[ i ]);
@@ -241,7 +241,7 @@ void SV_GetServerinfo( char *buffer, int bufferSize ) {
 	if ( bufferSize < 1 ) {
 		Com_Error( ERR_DROP, "SV_GetServerinfo: bufferSize == %i", bufferSize );
 	}
-	Q_strncpyz( buffer, Cvar_InfoString( CVAR_SERVERINFO ), bufferSize );
+	Q_strncpyz( buffer, SV_ServerInfoString(), bufferSize );
 }
 
 /*
@@ -337,6 +337,11 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		return FS_GetFileList( VMA(1), VMA(2), VMA(3), args[4] );
 	case G_FS_SEEK:
 		return FS_Seek( args[1], args[2], args[3] );
+	case G_CVAR_TABLE:
+		if ( !VM_IsNative( gvm ) ) {
+			return 0;
+		}
+		return (intptr_t)Cvar_Table();
 
 	case G_LOCATE_GAME_DATA:
 		SV_LocateGameData( VMA(1), args[2], args[3], VMA(4), args[5] );
@@ -883,6 +888,10 @@ static void SV_InitGameVM( qboolean restart ) {
 	// use the current msec count for a random seed
 	// init for this gamestate
 	VM_Call (gvm, GAME_INIT, sv.time, Com_Milliseconds(), restart);
+
+	// only a native game that knows GAME_CLIENT_THINK_SYNC runs queued usercmds
+	// in rounds, older games and qvms return -1 from vmMain for it
+	sv.gameThinkSync = VM_IsNative( gvm ) && VM_Call( gvm, GAME_CLIENT_THINK_SYNC ) == 0;
 }
 
 
@@ -0,0 +1,946 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// sv_http.c -- embedded HTTP server for pk3 downloads
+
+#include "server.h"
+
+/*
+===============================================================================
+
+HTTP DOWNLOAD SERVER
+
+A dedicated server with sv_httpPort set runs a small HTTP/1.1 server on its
+own thread, so clients with cURL support fetch missing pk3s through the
+sv_dlURL redirect instead of the game netchan.  Only the pk3s that would be
+offered for UDP download are served.  Files are sent with sendfile(), and
+single byte ranges and keep-alive connections are supported.  The server
+listens on net_ip and net_ip6, as enabled by net_enabled.
+
+The main thread publishes the list of downloadable files after every map
+load; the server thread never touches anything else in the engine.
+
+===============================================================================
+*/
+
+#ifdef __linux__
+
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define HTTP_MAX_CONNECTIONS	32
+#define HTTP_MAX_FILES			256
+#define HTTP_REQUEST_SIZE		2048
+#define HTTP_HEADER_SIZE		512
+#define HTTP_IDLE_TIMEOUT		30000
+#define HTTP_SENDFILE_CHUNK		( 1 << 20 )
+
+typedef enum {
+	HC_FREE,
+	HC_READING,		// waiting for a complete request
+	HC_SENDING		// sending response headers and body
+} httpConnState_t;
+
+typedef struct {
+	httpConnState_t	state;
+	int				sock;
+	int				lastActive;
+
+	char			request[HTTP_REQUEST_SIZE];
+	int				requestLen;
+
+	char			header[HTTP_HEADER_SIZE];
+	int				headerLen;
+	int				headerSent;
+
+	int				fd;				// file being sent, -1 if none
+	off_t			offset;
+	off_t			remaining;
+	qboolean		keepAlive;
+
+	off_t			discard;		// request body bytes still to be skipped
+} httpConnection_t;
+
+typedef struct {
+	char			url[MAX_QPATH];		// gamedir/pakname.pk3
+	char			ospath[MAX_OSPATH];
+} httpFile_t;
+
+typedef struct {
+	qboolean		running;
+	int				port;
+	char			addresses[2][MAX_CVAR_VALUE_STRING];	// net_ip and net_ip6 when started, "" if not enabled
+	int				listenSocks[2];		// IPv4 and IPv6, -1 if not listening
+	int				ctrlPipe[2];
+	int				quit;
+	pthread_t		thread;
+
+	// published by the main thread
+	pthread_mutex_t	filesLock;
+	httpFile_t		files[HTTP_MAX_FILES];
+	int				numFiles;
+
+	// owned by the server thread
+	httpConnection_t	conns[HTTP_MAX_CONNECTIONS];
+	int				numConns;
+	int				requests;
+	int				errors;
+	double			bytesSent;
+} httpServer_t;
+
+static httpServer_t	http = { qfalse, 0, { "", "" }, { -1, -1 }, { -1, -1 }, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+// the URL of this server, sent to clients as sv_dlURL while the admin
+// hasn't set one, see SV_ServerInfoString.  It never goes in the cvar,
+// which is archived and would outlive the server.
+static char	httpAutoURL[MAX_CVAR_VALUE_STRING];
+
+/*
+================
+SV_HTTPCloseConnection
+================
+*/
+static void SV_HTTPCloseConnection( httpConnection_t *c ) {
+	if ( c->fd != -1 ) {
+		close( c->fd );
+		c->fd = -1;
+	}
+	close( c->sock );
+	c->state = HC_FREE;
+	http.numConns--;
+}
+
+/*
+================
+SV_HTTPSetResponse
+================
+*/
+static void SV_HTTPSetResponse( httpConnection_t *c, int status, const char *reason, off_t length, const char *extra ) {
+	c->headerLen = Com_sprintf( c->header, sizeof( c->header ),
+		"HTTP/1.1 %i %s\r\n"
+		"Server: " Q3_VERSION "\r\n"
+		"Content-Type: application/octet-stream\r\n"
+		"Content-Length: %lld\r\n"
+		"Accept-Ranges: bytes\r\n"
+		"%s"
+		"Connection: %s\r\n"
+		"\r\n",
+		status, reason, (long long)length, extra ? extra : "",
+		c->keepAlive ? "keep-alive" : "close" );
+	c->headerSent = 0;
+	c->state = HC_SENDING;
+
+	if ( status >= 400 ) {
+		http.errors++;
+	}
+}
+
+/*
+================
+SV_HTTPDecodePath
+
+Strips the query and percent-decodes a request path in place
+================
+*/
+static qboolean SV_HTTPDecodePath( char *path ) {
+	char	*in, *out;
+	int		hi, lo;
+
+	if ( ( in = strchr( path, '?' ) ) != NULL ) {
+		*in = 0;
+	}
+
+	for ( in = out = path ; *in ; in++, out++ ) {
+		if ( *in == '%' ) {
+			hi = (unsigned char)in[1];
+			lo = hi ? (unsigned char)in[2] : 0;
+			if ( !isxdigit( hi ) || !isxdigit( lo ) ) {
+				return qfalse;
+			}
+			hi = isdigit( hi ) ? hi - '0' : tolower( hi ) - 'a' + 10;
+			lo = isdigit( lo ) ? lo - '0' : tolower( lo ) - 'a' + 10;
+			*out = (char)( ( hi << 4 ) | lo );
+			in += 2;
+		} else {
+			*out = *in;
+		}
+	}
+	*out = 0;
+
+	return qtrue;
+}
+
+/*
+================
+SV_HTTPFindHeader
+
+Returns the value of a request header, or NULL
+================
+*/
+static const char *SV_HTTPFindHeader( const char *headers, const char *name, char *value, int size ) {
+	const char	*line, *end;
+	int			len = strlen( name );
+
+	for ( line = headers ; line && *line ; line = end ? end + 2 : NULL ) {
+		end = strstr( line, "\r\n" );
+		if ( end == line ) {
+			break;		// end of headers
+		}
+		if ( !Q_stricmpn( line, name, len ) && line[len] == ':' ) {
+			line += len + 1;
+			while ( *line == ' ' || *line == '\t' ) {
+				line++;
+			}
+			Q_strncpyz( value, line, end ? MIN( size, end - line + 1 ) : size );
+			return value;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+================
+SV_HTTPParseRange
+
+Parses a single "bytes=" range.  Returns qfalse if it can't be satisfied.
+================
+*/
+static qboolean SV_HTTPParseRange( const char *range, off_t size, off_t *first, off_t *last ) {
+	char	*end;
+
+	if ( Q_stricmpn( range, "bytes=", 6 ) || strchr( range, ',' ) ) {
+		return qfalse;
+	}
+	range += 6;
+
+	if ( *range == '-' ) {
+		// suffix range, the last N bytes
+		off_t suffix = strtoll( range + 1, &end, 10 );
+		if ( end == range + 1 || suffix <= 0 || size == 0 ) {
+			return qfalse;
+		}
+		*first = suffix >= size ? 0 : size - suffix;
+		*last = size - 1;
+		return qtrue;
+	}
+
+	*first = strtoll( range, &end, 10 );
+	if ( end == range || *end != '-' || *first < 0 || *first >= size ) {
+		return qfalse;
+	}
+
+	range = end + 1;
+	if ( !*range ) {
+		*last = size - 1;
+	} else {
+		*last = strtoll( range, &end, 10 );
+		if ( end == range || *last < *first ) {
+			return qfalse;
+		}
+		if ( *last >= size ) {
+			*last = size - 1;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+================
+SV_HTTPHandleRequest
+
+Sets up the response for the complete request in c->request
+================
+*/
+static void SV_HTTPHandleRequest( httpConnection_t *c ) {
+	char		method[16], path[MAX_OSPATH], version[16];
+	char		value[128], ospath[MAX_OSPATH], extra[128];
+	char		*end;
+	const char	*headers;
+	struct stat	st;
+	off_t		first, last;
+	int			i;
+	qboolean	head;
+
+	http.requests++;
+
+	headers = strstr( c->request, "\r\n" );
+	if ( !headers || sscanf( c->request, "%15s %255s %15s", method, path, version ) != 3 ||
+		Q_stricmpn( version, "HTTP/1.", 7 ) ) {
+		c->keepAlive = qfalse;
+		SV_HTTPSetResponse( c, 400, "Bad Request", 0, NULL );
+		return;
+	}
+	headers += 2;
+
+	// HTTP/1.1 defaults to persistent connections, 1.0 has to ask for it
+	if ( SV_HTTPFindHeader( headers, "Connection", value, sizeof( value ) ) ) {
+		c->keepAlive = Q_stricmp( value, "close" ) ? qtrue : qfalse;
+		if ( !Q_stricmp( version, "HTTP/1.0" ) ) {
+			c->keepAlive = Q_stricmp( value, "keep-alive" ) ? qfalse : qtrue;
+		}
+	} else {
+		c->keepAlive = Q_stricmp( version, "HTTP/1.0" ) ? qtrue : qfalse;
+	}
+
+	// bodies are never used, but have to be skipped to find the next request
+	if ( SV_HTTPFindHeader( headers, "Transfer-Encoding", value, sizeof( value ) ) ) {
+		c->keepAlive = qfalse;
+	} else if ( SV_HTTPFindHeader( headers, "Content-Length", value, sizeof( value ) ) ) {
+		c->discard = strtoll( value, &end, 10 );
+		if ( end == value || *end || c->discard < 0 ) {
+			c->discard = 0;
+			c->keepAlive = qfalse;
+			SV_HTTPSetResponse( c, 400, "Bad Request", 0, NULL );
+			return;
+		}
+	}
+
+	head = !strcmp( method, "HEAD" );
+	if ( !head && strcmp( method, "GET" ) ) {
+		SV_HTTPSetResponse( c, 405, "Method Not Allowed", 0, "Allow: GET, HEAD\r\n" );
+		return;
+	}
+
+	if ( path[0] != '/' || !SV_HTTPDecodePath( path ) ) {
+		SV_HTTPSetResponse( c, 400, "Bad Request", 0, NULL );
+		return;
+	}
+
+	// only files from the published list, never a path built from the request
+	ospath[0] = 0;
+	pthread_mutex_lock( &http.filesLock );
+	for ( i = 0 ; i < http.numFiles ; i++ ) {
+		if ( !Q_stricmp( path + 1, http.files[i].url ) ) {
+			Q_strncpyz( ospath, http.files[i].ospath, sizeof( ospath ) );
+			break;
+		}
+	}
+	pthread_mutex_unlock( &http.filesLock );
+
+	if ( !ospath[0] || ( c->fd = open( ospath, O_RDONLY ) ) == -1 ) {
+		SV_HTTPSetResponse( c, 404, "Not Found", 0, NULL );
+		return;
+	}
+
+	if ( fstat( c->fd, &st ) == -1 ) {
+		close( c->fd );
+		c->fd = -1;
+		SV_HTTPSetResponse( c, 404, "Not Found", 0, NULL );
+		return;
+	}
+
+	if ( SV_HTTPFindHeader( headers, "Range", value, sizeof( value ) ) ) {
+		if ( !SV_HTTPParseRange( value, st.st_size, &first, &last ) ) {
+			close( c->fd );
+			c->fd = -1;
+			Com_sprintf( extra, sizeof( extra ), "Content-Range: bytes */%lld\r\n", (long long)st.st_size );
+			SV_HTTPSetResponse( c, 416, "Range Not Satisfiable", 0, extra );
+			return;
+		}
+
+		c->offset = first;
+		c->remaining = last - first + 1;
+		Com_sprintf( extra, sizeof( extra ), "Content-Range: bytes %lld-%lld/%lld\r\n",
+			(long long)first, (long long)last, (long long)st.st_size );
+		SV_HTTPSetResponse( c, 206, "Partial Content", c->remaining, extra );
+	} else {
+		c->offset = 0;
+		c->remaining = st.st_size;
+		SV_HTTPSetResponse( c, 200, "OK", c->remaining, NULL );
+	}
+
+	if ( head ) {
+		close( c->fd );
+		c->fd = -1;
+		c->remaining = 0;
+	}
+}
+
+/*
+================
+SV_HTTPCheckRequest
+
+Starts handling the next request if a complete one has been received
+================
+*/
+static void SV_HTTPCheckRequest( httpConnection_t *c ) {
+	char	*end;
+	int		len;
+
+	// drop the body of the previous request
+	if ( c->discard > 0 ) {
+		len = MIN( c->discard, c->requestLen );
+		memmove( c->request, c->request + len, c->requestLen - len );
+		c->requestLen -= len;
+		c->discard -= len;
+		if ( c->discard > 0 ) {
+			return;
+		}
+	}
+
+	c->request[c->requestLen] = 0;
+
+	end = strstr( c->request, "\r\n\r\n" );
+	if ( !end ) {
+		if ( c->requestLen >= sizeof( c->request ) - 1 ) {
+			c->keepAlive = qfalse;
+			SV_HTTPSetResponse( c, 400, "Bad Request", 0, NULL );
+		}
+		return;
+	}
+
+	len = end + 4 - c->request;
+	end[2] = 0;
+
+	SV_HTTPHandleRequest( c );
+
+	// keep anything pipelined after this request
+	memmove( c->request, c->request + len, c->requestLen - len );
+	c->requestLen -= len;
+}
+
+/*
+================
+SV_HTTPRead
+================
+*/
+static void SV_HTTPRead( httpConnection_t *c ) {
+	int		ret;
+
+	ret = recv( c->sock, c->request + c->requestLen, sizeof( c->request ) - 1 - c->requestLen, 0 );
+	if ( ret <= 0 ) {
+		if ( ret == 0 || ( errno != EAGAIN && errno != EINTR ) ) {
+			SV_HTTPCloseConnection( c );
+		}
+		return;
+	}
+
+	c->requestLen += ret;
+	SV_HTTPCheckRequest( c );
+}
+
+/*
+================
+SV_HTTPWrite
+================
+*/
+static void SV_HTTPWrite( httpConnection_t *c ) {
+	ssize_t	ret;
+
+	if ( c->headerSent < c->headerLen ) {
+		ret = send( c->sock, c->header + c->headerSent, c->headerLen - c->headerSent, MSG_NOSIGNAL );
+		if ( ret < 0 ) {
+			if ( errno != EAGAIN && errno != EINTR ) {
+				SV_HTTPCloseConnection( c );
+			}
+			return;
+		}
+		c->headerSent += ret;
+		if ( c->headerSent < c->headerLen ) {
+			return;
+		}
+	}
+
+	if ( c->remaining > 0 ) {
+		ret = sendfile( c->sock, c->fd, &c->offset, MIN( c->remaining, HTTP_SENDFILE_CHUNK ) );
+		if ( ret <= 0 ) {
+			if ( ret == 0 || ( errno != EAGAIN && errno != EINTR ) ) {
+				SV_HTTPCloseConnection( c );
+			}
+			return;
+		}
+		c->remaining -= ret;
+		http.bytesSent += ret;
+		if ( c->remaining > 0 ) {
+			return;
+		}
+	}
+
+	// response complete
+	if ( c->fd != -1 ) {
+		close( c->fd );
+		c->fd = -1;
+	}
+
+	if ( !c->keepAlive ) {
+		SV_HTTPCloseConnection( c );
+		return;
+	}
+
+	c->state = HC_READING;
+	SV_HTTPCheckRequest( c );
+}
+
+/*
+================
+SV_HTTPAccept
+================
+*/
+static void SV_HTTPAccept( int listenSock ) {
+	httpConnection_t	*c;
+	int					sock, i;
+
+	while ( ( sock = accept( listenSock, NULL, NULL ) ) != -1 ) {
+		for ( i = 0, c = http.conns ; i < HTTP_MAX_CONNECTIONS ; i++, c++ ) {
+			if ( c->state == HC_FREE ) {
+				break;
+			}
+		}
+
+		if ( i == HTTP_MAX_CONNECTIONS ) {
+			close( sock );
+			continue;
+		}
+
+		fcntl( sock, F_SETFL, O_NONBLOCK );
+
+		Com_Memset( c, 0, sizeof( *c ) );
+		c->state = HC_READING;
+		c->sock = sock;
+		c->fd = -1;
+		c->lastActive = Sys_Milliseconds();
+		http.numConns++;
+	}
+}
+
+/*
+================
+SV_HTTPThread
+================
+*/
+static void *SV_HTTPThread( void *arg ) {
+	struct pollfd		fds[HTTP_MAX_CONNECTIONS + 3];
+	httpConnection_t	*owner[HTTP_MAX_CONNECTIONS + 3];
+	httpConnection_t	*c;
+	char				junk[64];
+	int					i, nfds, now;
+
+	while ( !__atomic_load_n( &http.quit, __ATOMIC_ACQUIRE ) ) {
+		nfds = 0;
+
+		fds[nfds].fd = http.ctrlPipe[0];
+		fds[nfds].events = POLLIN;
+		owner[nfds++] = NULL;
+
+		// poll skips the negative fd of a listener that isn't open
+		for ( i = 0 ; i < 2 ; i++ ) {
+			fds[nfds].fd = http.listenSocks[i];
+			fds[nfds].events = POLLIN;
+			owner[nfds++] = NULL;
+		}
+
+		for ( i = 0, c = http.conns ; i < HTTP_MAX_CONNECTIONS ; i++, c++ ) {
+			if ( c->state == HC_FREE ) {
+				continue;
+			}
+			fds[nfds].fd = c->sock;
+			fds[nfds].events = c->state == HC_SENDING ? POLLOUT : POLLIN;
+			owner[nfds++] = c;
+		}
+
+		if ( poll( fds, nfds, 1000 ) < 0 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			break;
+		}
+
+		now = Sys_Milliseconds();
+
+		if ( fds[0].revents ) {
+			while ( read( http.ctrlPipe[0], junk, sizeof( junk ) ) > 0 )
+				;
+		}
+
+		for ( i = 3 ; i < nfds ; i++ ) {
+			c = owner[i];
+
+			if ( fds[i].revents & ( POLLERR | POLLHUP | POLLNVAL ) && !( fds[i].revents & POLLIN ) ) {
+				SV_HTTPCloseConnection( c );
+				continue;
+			}
+
+			if ( fds[i].revents ) {
+				c->lastActive = now;
+				if ( c->state == HC_READING ) {
+					SV_HTTPRead( c );
+				} else {
+					SV_HTTPWrite( c );
+				}
+			} else if ( now - c->lastActive > HTTP_IDLE_TIMEOUT ) {
+				SV_HTTPCloseConnection( c );
+			}
+		}
+
+		for ( i = 1 ; i < 3 ; i++ ) {
+			if ( fds[i].revents & POLLIN ) {
+				SV_HTTPAccept( fds[i].fd );
+			}
+		}
+	}
+
+	for ( i = 0, c = http.conns ; i < HTTP_MAX_CONNECTIONS ; i++, c++ ) {
+		if ( c->state != HC_FREE ) {
+			SV_HTTPCloseConnection( c );
+		}
+	}
+
+	return NULL;
+}
+
+/*
+================
+SV_HTTPListen
+
+Opens a listening socket on the address net_ip or net_ip6 holds,
+returns -1 if it can't be used
+================
+*/
+static int SV_HTTPListen( int family, const char *address, int port ) {
+	struct addrinfo	hints, *res;
+	char			service[16];
+	int				sock, one = 1, err;
+
+	Com_Memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = family;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+	Com_sprintf( service, sizeof( service ), "%i", port );
+
+	err = getaddrinfo( address, service, &hints, &res );
+	if ( err ) {
+		Com_Printf( "WARNING: SV_HTTPListen: couldn't resolve %s: %s\n", address, gai_strerror( err ) );
+		return -1;
+	}
+
+	sock = socket( res->ai_family, res->ai_socktype, res->ai_protocol );
+	if ( sock == -1 ) {
+		Com_Printf( "WARNING: SV_HTTPListen: socket: %s\n", strerror( errno ) );
+		freeaddrinfo( res );
+		return -1;
+	}
+
+	setsockopt( sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+	if ( family == AF_INET6 ) {
+		// the IPv4 listener covers IPv4, as the game sockets do
+		setsockopt( sock, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof( one ) );
+	}
+
+	if ( bind( sock, res->ai_addr, res->ai_addrlen ) == -1 ||
+		listen( sock, 16 ) == -1 ||
+		fcntl( sock, F_SETFL, O_NONBLOCK ) == -1 ) {
+		Com_Printf( "WARNING: SV_HTTPListen: couldn't listen on %s port %i: %s\n",
+			address, port, strerror( errno ) );
+		close( sock );
+		freeaddrinfo( res );
+		return -1;
+	}
+
+	freeaddrinfo( res );
+
+	Com_Printf( "HTTP download server listening on %s port %i\n", address, port );
+
+	return sock;
+}
+
+/*
+================
+SV_HTTPCloseListeners
+================
+*/
+static void SV_HTTPCloseListeners( void ) {
+	int		i;
+
+	for ( i = 0 ; i < 2 ; i++ ) {
+		if ( http.listenSocks[i] != -1 ) {
+			close( http.listenSocks[i] );
+			http.listenSocks[i] = -1;
+		}
+	}
+}
+
+/*
+================
+SV_HTTPStart
+================
+*/
+static qboolean SV_HTTPStart( int port ) {
+	if ( http.addresses[0][0] ) {
+		http.listenSocks[0] = SV_HTTPListen( AF_INET, http.addresses[0], port );
+	}
+	if ( http.addresses[1][0] ) {
+		http.listenSocks[1] = SV_HTTPListen( AF_INET6, http.addresses[1], port );
+	}
+	if ( http.listenSocks[0] == -1 && http.listenSocks[1] == -1 ) {
+		Com_Printf( "WARNING: SV_HTTPStart: no address to listen on\n" );
+		return qfalse;
+	}
+
+	if ( pipe( http.ctrlPipe ) == -1 ) {
+		Com_Printf( "WARNING: SV_HTTPStart: pipe: %s\n", strerror( errno ) );
+		SV_HTTPCloseListeners();
+		return qfalse;
+	}
+	fcntl( http.ctrlPipe[0], F_SETFL, O_NONBLOCK );
+
+	Com_Memset( http.conns, 0, sizeof( http.conns ) );
+	http.numConns = 0;
+	http.quit = 0;
+
+	if ( pthread_create( &http.thread, NULL, SV_HTTPThread, NULL ) ) {
+		Com_Printf( "WARNING: SV_HTTPStart: couldn't create the server thread\n" );
+		close( http.ctrlPipe[0] );
+		close( http.ctrlPipe[1] );
+		SV_HTTPCloseListeners();
+		return qfalse;
+	}
+
+	http.running = qtrue;
+	http.port = port;
+
+	return qtrue;
+}
+
+/*
+================
+SV_HTTPSetAutoURL
+================
+*/
+static void SV_HTTPSetAutoURL( const char *url ) {
+	if ( strcmp( httpAutoURL, url ) ) {
+		Q_strncpyz( httpAutoURL, url, sizeof( httpAutoURL ) );
+		cvar_modifiedFlags |= CVAR_SERVERINFO;
+	}
+}
+
+/*
+================
+SV_HTTPAutoURL
+
+Returns the URL clients are sent as sv_dlURL while it isn't set, or ""
+================
+*/
+const char *SV_HTTPAutoURL( void ) {
+	return httpAutoURL;
+}
+
+/*
+================
+SV_HTTPShutdown
+================
+*/
+void SV_HTTPShutdown( void ) {
+	if ( !http.running ) {
+		return;
+	}
+
+	__atomic_store_n( &http.quit, 1, __ATOMIC_RELEASE );
+	if ( write( http.ctrlPipe[1], "", 1 ) < 0 )
+		;
+	pthread_join( http.thread, NULL );
+
+	close( http.ctrlPipe[0] );
+	close( http.ctrlPipe[1] );
+	SV_HTTPCloseListeners();
+	http.running = qfalse;
+
+	SV_HTTPSetAutoURL( "" );
+
+	Com_Printf( "HTTP download server stopped\n" );
+}
+
+/*
+================
+SV_HTTPUpdateFiles
+
+Publishes the pk3s that may be downloaded on the current map,
+using the same rules as the UDP download path
+================
+*/
+static void SV_HTTPUpdateFiles( void ) {
+	static httpFile_t	files[HTTP_MAX_FILES];
+	const char			*names;
+	char				*name;
+	int					numFiles;
+
+	numFiles = 0;
+	names = FS_ReferencedPakNames();
+
+	// don't use the command tokenizer, the map command may still need its arguments
+	while ( numFiles < HTTP_MAX_FILES ) {
+		name = COM_Parse( (char **)&names );
+		if ( !name[0] ) {
+			break;
+		}
+
+#ifndef STANDALONE
+		if ( FS_idPak( name, BASEGAME, NUM_ID_PAKS ) || FS_idPak( name, BASETA, NUM_TA_PAKS ) ) {
+			continue;
+		}
+#endif
+
+		if ( !FS_PakOSPath( name, files[numFiles].ospath, sizeof( files[numFiles].ospath ) ) ) {
+			continue;
+		}
+
+		Com_sprintf( files[numFiles].url, sizeof( files[numFiles].url ), "%s.pk3", name );
+		numFiles++;
+	}
+
+	pthread_mutex_lock( &http.filesLock );
+	Com_Memcpy( http.files, files, numFiles * sizeof( files[0] ) );
+	http.numFiles = numFiles;
+	pthread_mutex_unlock( &http.filesLock );
+}
+
+/*
+================
+SV_HTTPAddresses
+
+The addresses to listen on, the "any" address for an empty net_ip or
+net_ip6, and "" for a protocol net_enabled has turned off
+================
+*/
+static void SV_HTTPAddresses( char addresses[2][MAX_CVAR_VALUE_STRING] ) {
+	int		enabled;
+
+	Com_Memset( addresses, 0, 2 * sizeof( addresses[0] ) );
+
+	enabled = Cvar_VariableIntegerValue( "net_enabled" );
+	if ( enabled & NET_ENABLEV4 ) {
+		Cvar_VariableStringBuffer( "net_ip", addresses[0], sizeof( addresses[0] ) );
+		if ( !addresses[0][0] ) {
+			Q_strncpyz( addresses[0], "0.0.0.0", sizeof( addresses[0] ) );
+		}
+	}
+	if ( enabled & NET_ENABLEV6 ) {
+		Cvar_VariableStringBuffer( "net_ip6", addresses[1], sizeof( addresses[1] ) );
+		if ( !addresses[1][0] ) {
+			Q_strncpyz( addresses[1], "::", sizeof( addresses[1] ) );
+		}
+	}
+}
+
+/*
+================
+SV_HTTPUpdate
+
+Called after a map has been loaded and the referenced paks are known
+================
+*/
+void SV_HTTPUpdate( void ) {
+	char		addresses[2][MAX_CVAR_VALUE_STRING];
+	const char	*host;
+
+	if ( !com_dedicated->integer || sv_httpPort->integer <= 0 ||
+		!( sv_allowDownload->integer & DLF_ENABLE ) ||
+		( sv_allowDownload->integer & DLF_NO_REDIRECT ) ) {
+		SV_HTTPShutdown();
+		return;
+	}
+
+	SV_HTTPAddresses( addresses );
+	if ( http.running && ( http.port != sv_httpPort->integer ||
+		memcmp( http.addresses, addresses, sizeof( addresses ) ) ) ) {
+		SV_HTTPShutdown();
+	}
+
+	if ( !http.running ) {
+		Com_Memcpy( http.addresses, addresses, sizeof( addresses ) );
+	}
+
+	if ( !http.running && !SV_HTTPStart( sv_httpPort->integer ) ) {
+		return;
+	}
+
+	SV_HTTPUpdateFiles();
+
+	// point clients at ourselves unless the admin has set sv_dlURL
+	host = sv_httpHost->string;
+	if ( !*host ) {
+		host = Cvar_VariableString( "net_ip" );
+		if ( !*host || !strcmp( host, "0.0.0.0" ) ) {
+			Com_DPrintf( "SV_HTTPUpdate: set sv_httpHost to have sv_dlURL set automatically\n" );
+			SV_HTTPSetAutoURL( "" );
+			return;
+		}
+	}
+
+	SV_HTTPSetAutoURL( va( "http://%s:%i", host, http.port ) );
+}
+
+/*
+================
+SV_HTTPStatus_f
+================
+*/
+void SV_HTTPStatus_f( void ) {
+	int		i;
+
+	if ( !http.running ) {
+		Com_Printf( "HTTP download server is not running.\n" );
+		return;
+	}
+
+	Com_Printf( "port %i, %i connections, %i requests, %i errors, %.0f bytes sent\n",
+		http.port, http.numConns, http.requests, http.errors, http.bytesSent );
+	if ( httpAutoURL[0] ) {
+		Com_Printf( "sent to clients as sv_dlURL %s\n", httpAutoURL );
+	}
+
+	pthread_mutex_lock( &http.filesLock );
+	for ( i = 0 ; i < http.numFiles ; i++ ) {
+		Com_Printf( "  /%s\n", http.files[i].url );
+	}
+	pthread_mutex_unlock( &http.filesLock );
+}
+
+#else
+
+void SV_HTTPUpdate( void ) {
+	if ( com_dedicated->integer && sv_httpPort->integer > 0 ) {
+		Com_Printf( "WARNING: the HTTP download server is not supported on this platform\n" );
+	}
+}
+
+void SV_HTTPShutdown( void ) {
+}
+
+const char *SV_HTTPAutoURL( void ) {
+	return "";
+}
+
+void SV_HTTPStatus_f( void ) {
+	Com_Printf( "HTTP download server is not supported on this platform.\n" );
+}
+
+#endif
@@ -123,6 +123,7 @@ void SV_SetConfigstring (int index, const char *val) {
 	// change the string in sv
 	Z_Free( sv.configstrings[index] );
 	sv.configstrings[index] = CopyString( val );
+	sv.gamestateValid = qfalse;
 
 	// send it to all the clients if we aren't
 	// spawning a new server
@@ -230,6 +231,8 @@ static void SV_CreateBaseline( void ) {
 		//
 		sv.svEntities[entnum].baseline = svent->s;
 	}
+
+	sv.gamestateValid = qfalse;
 }
 
 
@@ -270,12 +273,6 @@ static void SV_Startup( void ) {
 	SV_BoundMaxClients( 1 );
 
 	svs.clients = Z_Malloc (sizeof(client_t) * sv_maxclients->integer );
-	if ( com_dedicated->integer ) {
-		svs.numSnapshotEntities = sv_maxclients->integer * PACKET_BACKUP * MAX_SNAPSHOT_ENTITIES;
-	} else {
-		// we don't need nearly as many when playing locally
-		svs.numSnapshotEntities = sv_maxclients->integer * 4 * MAX_SNAPSHOT_ENTITIES;
-	}
 	svs.initialized = qtrue;
 
 	// Don't respect sv_killserver unless a server is actually running
@@ -284,6 +281,7 @@ static void SV_Startup( void ) {
 	}
 
 	Cvar_Set( "sv_running", "1" );
+	NET_SetServerRunning( qtrue );
 	
 	// Join the ipv6 multicast group now that a map is running so clients can scan for us on the local network.
 	NET_JoinMulticast6();
@@ -331,6 +329,12 @@ void SV_ChangeMaxClients( void ) {
 	}
 
 	// free old clients arrays
+	for ( i = 0 ; i < oldMaxClients ; i++ ) {
+		if ( svs.clients[i].state < CS_CONNECTED ) {
+			SV_FreeReliableCommands( &svs.clients[i] );
+			SV_FreeClientFrames( &svs.clients[i] );
+		}
+	}
 	Z_Free( svs.clients );
 
 	// allocate new clients
@@ -346,14 +350,6 @@ void SV_ChangeMaxClients( void ) {
 
 	// free the old clients on the hunk
 	Hunk_FreeTempMemory( oldClients );
-	
-	// allocate new snapshot entities
-	if ( com_dedicated->integer ) {
-		svs.numSnapshotEntities = sv_maxclients->integer * PACKET_BACKUP * MAX_SNAPSHOT_ENTITIES;
-	} else {
-		// we don't need nearly as many when playing locally
-		svs.numSnapshotEntities = sv_maxclients->integer * 4 * MAX_SNAPSHOT_ENTITIES;
-	}
 }
 
 /*
@@ -364,6 +360,8 @@ SV_ClearServer
 static void SV_ClearServer(void) {
 	int i;
 
+	SV_ClearSnapshotEntities();
+
 	for ( i = 0 ; i < MAX_CONFIGSTRINGS ; i++ ) {
 		if ( sv.configstrings[i] ) {
 			Z_Free( sv.configstrings[i] );
@@ -438,10 +436,6 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	// clear pak references
 	FS_ClearPakReferences(0);
 
-	// allocate the snapshot entities on the hunk
-	svs.snapshotEntities = Hunk_Alloc( sizeof(entityState_t)*svs.numSnapshotEntities, h_high );
-	svs.nextSnapshotEntities = 0;
-
 	// toggle the server bit so clients can detect that a
 	// server has changed
 	svs.snapFlagServerBit ^= SNAPFLAG_SERVERCOUNT;
@@ -591,12 +585,15 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	p = FS_ReferencedPakNames();
 	Cvar_Set( "sv_referencedPakNames", p );
 
+	// serve the referenced paks over HTTP, this may set the automatic sv_dlURL
+	SV_HTTPUpdate();
+
 	// save systeminfo and serverinfo strings
 	Q_strncpyz( systemInfo, Cvar_InfoString_Big( CVAR_SYSTEMINFO ), sizeof( systemInfo ) );
 	cvar_modifiedFlags &= ~CVAR_SYSTEMINFO;
 	SV_SetConfigstring( CS_SYSTEMINFO, systemInfo );
 
-	SV_SetConfigstring( CS_SERVERINFO, Cvar_InfoString( CVAR_SERVERINFO ) );
+	SV_SetConfigstring( CS_SERVERINFO, SV_ServerInfoString() );
 	cvar_modifiedFlags &= ~CVAR_SERVERINFO;
 
 	// any media configstring setting now should issue a warning
@@ -674,6 +671,8 @@ void SV_Init (void)
 
 	sv_allowDownload = Cvar_Get ("sv_allowDownload", "0", CVAR_SERVERINFO);
 	Cvar_Get ("sv_dlURL", "", CVAR_SERVERINFO | CVAR_ARCHIVE);
+	sv_httpPort = Cvar_Get ("sv_httpPort", "0", CVAR_ARCHIVE);
+	sv_httpHost = Cvar_Get ("sv_httpHost", "", CVAR_ARCHIVE);
 	
 	sv_master[0] = Cvar_Get("sv_master1", MASTER_SERVER_NAME, 0);
 	sv_master[1] = Cvar_Get("sv_master2", "master.ioquake3.org", 0);
@@ -686,6 +685,8 @@ void SV_Init (void)
 	sv_killserver = Cvar_Get ("sv_killserver", "0", 0);
 	sv_mapChecksum = Cvar_Get ("sv_mapChecksum", "", CVAR_ROM);
 	sv_lanForceRate = Cvar_Get ("sv_lanForceRate", "1", CVAR_ARCHIVE );
+	sv_batchUsercmds = Cvar_Get ("sv_batchUsercmds", "1", CVAR_ARCHIVE );
+	sv_traceCache = Cvar_Get ("sv_traceCache", "0", CVAR_ARCHIVE );
 #ifndef STANDALONE
 	sv_strictAuth = Cvar_Get ("sv_strictAuth", "1", CVAR_ARCHIVE );
 #endif
@@ -727,6 +728,7 @@ void SV_FinalMessage( char *message ) {
 				}
 				// force a snapshot to be sent
 				cl->lastSnapshotTime = 0;
+				SV_BeginSnapshotEpoch();
 				SV_SendClientSnapshot( cl );
 			}
 		}
@@ -757,6 +759,8 @@ void SV_Shutdown( char *finalmsg ) {
 
 	SV_RemoveOperatorCommands();
 	SV_MasterShutdown();
+	SV_HTTPShutdown();
+	SV_PaceClear();
 	SV_ShutdownGameProgs();
 
 	// free current level
@@ -768,13 +772,17 @@ void SV_Shutdown( char *finalmsg ) {
 		int index;
 		
 		for(index = 0; index < sv_maxclients->integer; index++)
+		{
 			SV_FreeClient(&svs.clients[index]);
+			SV_FreeReliableCommands(&svs.clients[index]);
+		}
 		
 		Z_Free(svs.clients);
 	}
 	Com_Memset( &svs, 0, sizeof( svs ) );
 
 	Cvar_Set( "sv_running", "0" );
+	NET_SetServerRunning( qfalse );
 	Cvar_Set("ui_singlePlayerActive", "0");
 
 	Com_Printf( "---------------------------\n" );
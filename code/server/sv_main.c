@@ -51,12 +51,16 @@ cvar_t	*sv_serverid;
 cvar_t	*sv_minRate;
 cvar_t	*sv_maxRate;
 cvar_t	*sv_dlRate;
+cvar_t	*sv_httpPort;			// port of the embedded pk3 download server, 0 = off
+cvar_t	*sv_httpHost;			// host name used for the automatic sv_dlURL
 cvar_t	*sv_minPing;
 cvar_t	*sv_maxPing;
 cvar_t	*sv_gametype;
 cvar_t	*sv_pure;
 cvar_t	*sv_floodProtect;
 cvar_t	*sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates to 99999 (bug #491)
+cvar_t	*sv_batchUsercmds;		// queue usercmds and run them all at the start of a frame, for games that support it
+cvar_t	*sv_traceCache;			// remember identical traces and point contents within a frame
 #ifndef STANDALONE
 cvar_t	*sv_strictAuth;
 #endif
@@ -101,52 +105,84 @@ static char	*SV_ExpandNewlines( char *in ) {
 
 /*
 ======================
-SV_ReplacePendingServerCommands
+SV_CreateServerCommand
 
-FIXME: This is ugly
+Encodes a command once so it can be shared by every client it is sent
+to.  The returned command holds one reference for the caller.
 ======================
 */
-#if 0 // unused
-static int SV_ReplacePendingServerCommands( client_t *client, const char *cmd ) {
-	int i, index, csnum1, csnum2;
-
-	for ( i = client->reliableSent+1; i <= client->reliableSequence; i++ ) {
-		index = i & ( MAX_RELIABLE_COMMANDS - 1 );
-		//
-		if ( !Q_strncmp(cmd, client->reliableCommands[ index ], strlen("cs")) ) {
-			sscanf(cmd, "cs %i", &csnum1);
-			sscanf(client->reliableCommands[ index ], "cs %i", &csnum2);
-			if ( csnum1 == csnum2 ) {
-				Q_strncpyz( client->reliableCommands[ index ], cmd, sizeof( client->reliableCommands[ index ] ) );
-				/*
-				if ( client->netchan.remoteAddress.type != NA_BOT ) {
-					Com_Printf( "WARNING: client %i removed double pending config string %i: %s\n", client-svs.clients, csnum1, cmd );
-				}
-				*/
-				return qtrue;
-			}
-		}
+static serverCommand_t *SV_CreateServerCommand( const char *cmd ) {
+	static byte		buffer[MAX_MSGLEN];
+	serverCommand_t	*command;
+	msg_t			msg;
+	char			text[MAX_STRING_CHARS];
+	int				len, bytes;
+
+	Q_strncpyz( text, cmd, sizeof( text ) );
+	len = strlen( text );
+
+	MSG_Init( &msg, buffer, sizeof( buffer ) );
+	MSG_WriteString( &msg, text );
+	bytes = ( msg.bit + 7 ) >> 3;
+
+	command = Z_Malloc( sizeof( *command ) + len + bytes );
+	command->refCount = 1;
+	command->bits = msg.bit;
+	command->encoded = (byte *)command->text + len + 1;
+	Com_Memcpy( command->text, text, len + 1 );
+	Com_Memcpy( command->encoded, buffer, bytes );
+
+	return command;
+}
+
+/*
+======================
+SV_ReleaseServerCommand
+======================
+*/
+static void SV_ReleaseServerCommand( serverCommand_t *command ) {
+	if ( command && --command->refCount == 0 ) {
+		Z_Free( command );
 	}
-	return qfalse;
 }
-#endif
 
 /*
 ======================
-SV_AddServerCommand
+SV_ReliableCommand
 
-The given command will be transmitted to the client, and is guaranteed to
-not have future snapshot_t executed before it is executed
+Returns the text of a queued reliable command, or an empty string
 ======================
 */
-void SV_AddServerCommand( client_t *client, const char *cmd ) {
-	int		index, i;
+const char *SV_ReliableCommand( client_t *client, int sequence ) {
+	serverCommand_t	*command = client->reliableCommands[ sequence & ( MAX_RELIABLE_COMMANDS - 1 ) ];
+
+	return command ? command->text : "";
+}
+
+/*
+======================
+SV_FreeReliableCommands
+
+Releases the commands held by a client slot before it is
+reinitialized or freed
+======================
+*/
+void SV_FreeReliableCommands( client_t *client ) {
+	int		i;
 
-	// this is very ugly but it's also a waste to for instance send multiple config string updates
-	// for the same config string index in one snapshot
-//	if ( SV_ReplacePendingServerCommands( client, cmd ) ) {
-//		return;
-//	}
+	for ( i = 0 ; i < MAX_RELIABLE_COMMANDS ; i++ ) {
+		SV_ReleaseServerCommand( client->reliableCommands[i] );
+		client->reliableCommands[i] = NULL;
+	}
+}
+
+/*
+======================
+SV_AddSharedServerCommand
+======================
+*/
+static void SV_AddSharedServerCommand( client_t *client, serverCommand_t *command ) {
+	int		index, i;
 
 	// do not send commands until the gamestate has been sent
 	if( client->state < CS_PRIMED )
@@ -160,14 +196,36 @@ void SV_AddServerCommand( client_t *client, const char *cmd ) {
 	if ( client->reliableSequence - client->reliableAcknowledge == MAX_RELIABLE_COMMANDS + 1 ) {
 		Com_Printf( "===== pending server commands =====\n" );
 		for ( i = client->reliableAcknowledge + 1 ; i <= client->reliableSequence ; i++ ) {
-			Com_Printf( "cmd %5d: %s\n", i, client->reliableCommands[ i & (MAX_RELIABLE_COMMANDS-1) ] );
+			Com_Printf( "cmd %5d: %s\n", i, SV_ReliableCommand( client, i ) );
 		}
-		Com_Printf( "cmd %5d: %s\n", i, cmd );
+		Com_Printf( "cmd %5d: %s\n", i, command->text );
 		SV_DropClient( client, "Server command overflow" );
 		return;
 	}
 	index = client->reliableSequence & ( MAX_RELIABLE_COMMANDS - 1 );
-	Q_strncpyz( client->reliableCommands[ index ], cmd, sizeof( client->reliableCommands[ index ] ) );
+	SV_ReleaseServerCommand( client->reliableCommands[ index ] );
+	client->reliableCommands[ index ] = command;
+	command->refCount++;
+}
+
+/*
+======================
+SV_AddServerCommand
+
+The given command will be transmitted to the client, and is guaranteed to
+not have future snapshot_t executed before it is executed
+======================
+*/
+void SV_AddServerCommand( client_t *client, const char *cmd ) {
+	serverCommand_t	*command;
+
+	// do not send commands until the gamestate has been sent
+	if( client->state < CS_PRIMED )
+		return;
+
+	command = SV_CreateServerCommand( cmd );
+	SV_AddSharedServerCommand( client, command );
+	SV_ReleaseServerCommand( command );
 }
 
 
@@ -184,6 +242,7 @@ void QDECL SV_SendServerCommand(client_t *cl, const char *fmt, ...) {
 	va_list		argptr;
 	byte		message[MAX_MSGLEN];
 	client_t	*client;
+	serverCommand_t	*command;
 	int			j;
 	
 	va_start (argptr,fmt);
@@ -208,10 +267,12 @@ void QDECL SV_SendServerCommand(client_t *cl, const char *fmt, ...) {
 		Com_Printf ("broadcast: %s\n", SV_ExpandNewlines((char *)message) );
 	}
 
-	// send the data to all relevent clients
+	// send the data to all relevent clients, sharing one encoded copy
+	command = SV_CreateServerCommand( (char *)message );
 	for (j = 0, client = svs.clients; j < sv_maxclients->integer ; j++, client++) {
-		SV_AddServerCommand( client, (char *)message );
+		SV_AddSharedServerCommand( client, command );
 	}
+	SV_ReleaseServerCommand( command );
 }
 
 
@@ -520,30 +581,192 @@ qboolean SVC_RateLimitAddress( netadr_t from, int burst, int period ) {
 
 /*
 ================
-SVC_Status
+SVC_RateLimitQuery
 
-Responds with all the info that qplug or qspy can see about the server
-and all connected players.  Used for getting detailed information after
-the simple info query.
+Per address limit shared by all connectionless queries.  While the
+network thread is running it owns the address buckets and has already
+applied this limit before the packet was queued.
 ================
 */
-static void SVC_Status( netadr_t from ) {
+qboolean SVC_RateLimitQuery( netadr_t from ) {
+	if ( NET_ThreadActive() ) {
+		return qfalse;
+	}
+
+	return SVC_RateLimitAddress( from, 10, 1000 );
+}
+
+/*
+================
+SV_ServerInfoString
+
+The serverinfo cvars, with the HTTP download server's own URL as
+sv_dlURL while the admin hasn't set it
+================
+*/
+char *SV_ServerInfoString( void ) {
+	static char	info[MAX_INFO_STRING];
+	const char	*url;
+
+	Q_strncpyz( info, Cvar_InfoString( CVAR_SERVERINFO ), sizeof( info ) );
+
+	url = SV_HTTPAutoURL();
+	if ( *url && !*Cvar_VariableString( "sv_dlURL" ) ) {
+		Info_SetValueForKey( info, "sv_dlURL", url );
+	}
+
+	return info;
+}
+
+// getstatus and getinfo responses shared by all queries in a frame
+typedef struct {
+	qboolean	valid;
+	int			time;			// svs.time the responses were built at
+	int			serverId;
+	qboolean	singlePlayer;	// don't respond at all
+
+	char		serverInfo[MAX_INFO_STRING];	// statusResponse info, before the challenge
+	char		players[MAX_MSGLEN];
+	char		info[MAX_INFO_STRING];			// infoResponse keys that follow the challenge
+} queryCache_t;
+
+static queryCache_t	queryCache;
+
+/*
+================
+SVC_UpdateQueryCache
+
+The getstatus and getinfo responses are built at most once per server
+frame and shared by all queries in that frame, only the challenge is
+added per request.  Anything that changes between frames shows up in
+the next one.
+================
+*/
+static void SVC_UpdateQueryCache( void ) {
 	char	player[1024];
-	char	status[MAX_MSGLEN];
 	int		i;
 	client_t	*cl;
 	playerState_t	*ps;
 	int		statusLength;
 	int		playerLength;
+	int		count, humans;
+	char	*gamedir;
+	char	*info;
+
+	if ( queryCache.valid && queryCache.time == svs.time && queryCache.serverId == sv.serverId ) {
+		return;
+	}
+
+	queryCache.valid = qtrue;
+	queryCache.time = svs.time;
+	queryCache.serverId = sv.serverId;
+
+	// ignore if we are in single player
+	queryCache.singlePlayer = ( Cvar_VariableValue( "g_gametype" ) == GT_SINGLE_PLAYER ||
+		Cvar_VariableValue("ui_singlePlayerActive") ) ? qtrue : qfalse;
+	if ( queryCache.singlePlayer ) {
+		return;
+	}
+
+	//
+	// getstatus
+	//
+	Q_strncpyz( queryCache.serverInfo, SV_ServerInfoString(), sizeof( queryCache.serverInfo ) );
+
+	queryCache.players[0] = 0;
+	statusLength = 0;
+
+	for (i=0 ; i < sv_maxclients->integer ; i++) {
+		cl = &svs.clients[i];
+		if ( cl->state >= CS_CONNECTED ) {
+			ps = SV_GameClientNum( i );
+			Com_sprintf (player, sizeof(player), "%i %i \"%s\"\n", 
+				ps->persistant[PERS_SCORE], cl->ping, cl->name);
+			playerLength = strlen(player);
+			if (statusLength + playerLength >= sizeof(queryCache.players) ) {
+				break;		// can't hold any more
+			}
+			strcpy (queryCache.players + statusLength, player);
+			statusLength += playerLength;
+		}
+	}
+
+	//
+	// getinfo
+	//
+
+	// don't count privateclients
+	count = humans = 0;
+	for ( i = sv_privateClients->integer ; i < sv_maxclients->integer ; i++ ) {
+		if ( svs.clients[i].state >= CS_CONNECTED ) {
+			count++;
+			if (svs.clients[i].netchan.remoteAddress.type != NA_BOT) {
+				humans++;
+			}
+		}
+	}
+
+	info = queryCache.info;
+	info[0] = 0;
+
+	Info_SetValueForKey( info, "gamename", com_gamename->string );
+
+#ifdef LEGACY_PROTOCOL
+	if(com_legacyprotocol->integer > 0)
+		Info_SetValueForKey(info, "protocol", va("%i", com_legacyprotocol->integer));
+	else
+#endif
+		Info_SetValueForKey(info, "protocol", va("%i", com_protocol->integer));
+
+	Info_SetValueForKey( info, "hostname", sv_hostname->string );
+	Info_SetValueForKey( info, "mapname", sv_mapname->string );
+	Info_SetValueForKey( info, "clients", va("%i", count) );
+	Info_SetValueForKey(info, "g_humanplayers", va("%i", humans));
+	Info_SetValueForKey( info, "sv_maxclients", 
+		va("%i", sv_maxclients->integer - sv_privateClients->integer ) );
+	Info_SetValueForKey( info, "gametype", va("%i", sv_gametype->integer ) );
+	Info_SetValueForKey( info, "pure", va("%i", sv_pure->integer ) );
+	Info_SetValueForKey(info, "g_needpass", va("%d", Cvar_VariableIntegerValue("g_needpass")));
+
+#ifdef USE_VOIP
+	if (sv_voip->integer) {
+		Info_SetValueForKey( info, "voip", va("%i", sv_voip->integer ) );
+	}
+#endif
+
+	if( sv_minPing->integer ) {
+		Info_SetValueForKey( info, "minPing", va("%i", sv_minPing->integer) );
+	}
+	if( sv_maxPing->integer ) {
+		Info_SetValueForKey( info, "maxPing", va("%i", sv_maxPing->integer) );
+	}
+	gamedir = Cvar_VariableString( "fs_game" );
+	if( *gamedir ) {
+		Info_SetValueForKey( info, "game", gamedir );
+	}
+}
+
+/*
+================
+SVC_Status
+
+Responds with all the info that qplug or qspy can see about the server
+and all connected players.  Used for getting detailed information after
+the simple info query.
+================
+*/
+static void SVC_Status( netadr_t from ) {
 	char	infostring[MAX_INFO_STRING];
 
+	SVC_UpdateQueryCache();
+
 	// ignore if we are in single player
-	if ( Cvar_VariableValue( "g_gametype" ) == GT_SINGLE_PLAYER || Cvar_VariableValue("ui_singlePlayerActive")) {
+	if ( queryCache.singlePlayer ) {
 		return;
 	}
 
 	// Prevent using getstatus as an amplifier
-	if ( SVC_RateLimitAddress( from, 10, 1000 ) ) {
+	if ( SVC_RateLimitQuery( from ) ) {
 		Com_DPrintf( "SVC_Status: rate limit from %s exceeded, dropping request\n",
 			NET_AdrToString( from ) );
 		return;
@@ -560,31 +783,13 @@ static void SVC_Status( netadr_t from ) {
 	if(strlen(Cmd_Argv(1)) > 128)
 		return;
 
-	strcpy( infostring, Cvar_InfoString( CVAR_SERVERINFO ) );
+	strcpy( infostring, queryCache.serverInfo );
 
 	// echo back the parameter to status. so master servers can use it as a challenge
 	// to prevent timed spoofed reply packets that add ghost servers
 	Info_SetValueForKey( infostring, "challenge", Cmd_Argv(1) );
 
-	status[0] = 0;
-	statusLength = 0;
-
-	for (i=0 ; i < sv_maxclients->integer ; i++) {
-		cl = &svs.clients[i];
-		if ( cl->state >= CS_CONNECTED ) {
-			ps = SV_GameClientNum( i );
-			Com_sprintf (player, sizeof(player), "%i %i \"%s\"\n", 
-				ps->persistant[PERS_SCORE], cl->ping, cl->name);
-			playerLength = strlen(player);
-			if (statusLength + playerLength >= sizeof(status) ) {
-				break;		// can't hold any more
-			}
-			strcpy (status + statusLength, player);
-			statusLength += playerLength;
-		}
-	}
-
-	NET_OutOfBandPrint( NS_SERVER, from, "statusResponse\n%s\n%s", infostring, status );
+	NET_OutOfBandPrint( NS_SERVER, from, "statusResponse\n%s\n%s", infostring, queryCache.players );
 }
 
 /*
@@ -596,17 +801,17 @@ if a user is interested in a server to do a full status
 ================
 */
 void SVC_Info( netadr_t from ) {
-	int		i, count, humans;
-	char	*gamedir;
 	char	infostring[MAX_INFO_STRING];
 
+	SVC_UpdateQueryCache();
+
 	// ignore if we are in single player
-	if ( Cvar_VariableValue( "g_gametype" ) == GT_SINGLE_PLAYER || Cvar_VariableValue("ui_singlePlayerActive")) {
+	if ( queryCache.singlePlayer ) {
 		return;
 	}
 
 	// Prevent using getinfo as an amplifier
-	if ( SVC_RateLimitAddress( from, 10, 1000 ) ) {
+	if ( SVC_RateLimitQuery( from ) ) {
 		Com_DPrintf( "SVC_Info: rate limit from %s exceeded, dropping request\n",
 			NET_AdrToString( from ) );
 		return;
@@ -628,58 +833,12 @@ void SVC_Info( netadr_t from ) {
 	if(strlen(Cmd_Argv(1)) > 128)
 		return;
 
-	// don't count privateclients
-	count = humans = 0;
-	for ( i = sv_privateClients->integer ; i < sv_maxclients->integer ; i++ ) {
-		if ( svs.clients[i].state >= CS_CONNECTED ) {
-			count++;
-			if (svs.clients[i].netchan.remoteAddress.type != NA_BOT) {
-				humans++;
-			}
-		}
-	}
-
 	infostring[0] = 0;
 
 	// echo back the parameter to status. so servers can use it as a challenge
 	// to prevent timed spoofed reply packets that add ghost servers
 	Info_SetValueForKey( infostring, "challenge", Cmd_Argv(1) );
-
-	Info_SetValueForKey( infostring, "gamename", com_gamename->string );
-
-#ifdef LEGACY_PROTOCOL
-	if(com_legacyprotocol->integer > 0)
-		Info_SetValueForKey(infostring, "protocol", va("%i", com_legacyprotocol->integer));
-	else
-#endif
-		Info_SetValueForKey(infostring, "protocol", va("%i", com_protocol->integer));
-
-	Info_SetValueForKey( infostring, "hostname", sv_hostname->string );
-	Info_SetValueForKey( infostring, "mapname", sv_mapname->string );
-	Info_SetValueForKey( infostring, "clients", va("%i", count) );
-	Info_SetValueForKey(infostring, "g_humanplayers", va("%i", humans));
-	Info_SetValueForKey( infostring, "sv_maxclients", 
-		va("%i", sv_maxclients->integer - sv_privateClients->integer ) );
-	Info_SetValueForKey( infostring, "gametype", va("%i", sv_gametype->integer ) );
-	Info_SetValueForKey( infostring, "pure", va("%i", sv_pure->integer ) );
-	Info_SetValueForKey(infostring, "g_needpass", va("%d", Cvar_VariableIntegerValue("g_needpass")));
-
-#ifdef USE_VOIP
-	if (sv_voip->integer) {
-		Info_SetValueForKey( infostring, "voip", va("%i", sv_voip->integer ) );
-	}
-#endif
-
-	if( sv_minPing->integer ) {
-		Info_SetValueForKey( infostring, "minPing", va("%i", sv_minPing->integer) );
-	}
-	if( sv_maxPing->integer ) {
-		Info_SetValueForKey( infostring, "maxPing", va("%i", sv_maxPing->integer) );
-	}
-	gamedir = Cvar_VariableString( "fs_game" );
-	if( *gamedir ) {
-		Info_SetValueForKey( infostring, "game", gamedir );
-	}
+	Q_strcat( infostring, sizeof( infostring ), queryCache.info );
 
 	NET_OutOfBandPrint( NS_SERVER, from, "infoResponse\n%s", infostring );
 }
@@ -713,7 +872,7 @@ static void SVC_RemoteCommand( netadr_t from, msg_t *msg ) {
 	char *cmd_aux;
 
 	// Prevent using rcon as an amplifier and make dictionary attacks impractical
-	if ( SVC_RateLimitAddress( from, 10, 1000 ) ) {
+	if ( SVC_RateLimitQuery( from ) ) {
 		Com_DPrintf( "SVC_RemoteCommand: rate limit from %s exceeded, dropping request\n",
 			NET_AdrToString( from ) );
 		return;
@@ -820,6 +979,50 @@ static void SV_ConnectionlessPacket( netadr_t from, msg_t *msg ) {
 	}
 }
 
+/*
+=================
+SV_PrefilterPacket
+
+Called from the network thread before a packet is queued for the main
+thread, so it must not touch anything but the packet itself and the
+address rate limit buckets.  Returns qfalse if the packet should be
+dropped right away.
+=================
+*/
+qboolean SV_PrefilterPacket( netadr_t *from, msg_t *msg ) {
+	static const char *queries[] = { "getstatus", "getinfo", "getchallenge", "rcon" };
+	const byte	*data;
+	const char	*s;
+	int			i, len;
+
+	// a SOCKS relay header is still in front of the payload
+	data = msg->data + msg->readcount;
+	len = msg->cursize - msg->readcount;
+
+	// too short to hold a sequence number or the connectionless marker
+	if ( len < 4 ) {
+		return qfalse;
+	}
+
+	if ( LittleLong( *(const int *)data ) != -1 ) {
+		// sequenced packets also carry the qport
+		return len >= 6 ? qtrue : qfalse;
+	}
+
+	s = (const char *)data + 4;
+	len -= 4;
+
+	for ( i = 0 ; i < ARRAY_LEN( queries ) ; i++ ) {
+		int n = strlen( queries[i] );
+
+		if ( len >= n && !Q_stricmpn( s, queries[i], n ) ) {
+			return SVC_RateLimitAddress( *from, 10, 1000 ) ? qfalse : qtrue;
+		}
+	}
+
+	return qtrue;
+}
+
 //============================================================================
 
 /*
@@ -1071,6 +1274,9 @@ void SV_Frame( int msec ) {
 		return;
 	}
 
+	// run the usercmds that came in since the last frame
+	SV_RunClientThinks();
+
 	// allow pause if only the local client is connected
 	if ( SV_CheckPaused() ) {
 		return;
@@ -1102,12 +1308,6 @@ void SV_Frame( int msec ) {
 		Cbuf_AddText( va( "map %s\n", Cvar_VariableString( "mapname" ) ) );
 		return;
 	}
-	// this can happen considerably earlier when lots of clients play and the map doesn't change
-	if ( svs.nextSnapshotEntities >= 0x7FFFFFFE - svs.numSnapshotEntities ) {
-		SV_Shutdown( "Restarting server due to numSnapshotEntities wrapping" );
-		Cbuf_AddText( va( "map %s\n", Cvar_VariableString( "mapname" ) ) );
-		return;
-	}
 
 	if( sv.restartTime && sv.time >= sv.restartTime ) {
 		sv.restartTime = 0;
@@ -1117,7 +1317,7 @@ void SV_Frame( int msec ) {
 
 	// update infostrings if anything has been changed
 	if ( cvar_modifiedFlags & CVAR_SERVERINFO ) {
-		SV_SetConfigstring( CS_SERVERINFO, Cvar_InfoString( CVAR_SERVERINFO ) );
+		SV_SetConfigstring( CS_SERVERINFO, SV_ServerInfoString() );
 		cvar_modifiedFlags &= ~CVAR_SERVERINFO;
 	}
 	if ( cvar_modifiedFlags & CVAR_SYSTEMINFO ) {
@@ -1146,6 +1346,9 @@ void SV_Frame( int msec ) {
 		VM_Call (gvm, GAME_RUN_FRAME, sv.time);
 	}
 
+	// cached traces only last a frame
+	SV_InvalidateTraceCache();
+
 	if ( com_speeds->integer ) {
 		time_game = Sys_Milliseconds () - startTime;
 	}
@@ -110,7 +110,7 @@ static void SV_Netchan_Decode( client_t *client, msg_t *msg ) {
 	msg->bit = sbit;
 	msg->readcount = srdc;
 
-	string = (byte *)client->reliableCommands[ reliableAcknowledge & (MAX_RELIABLE_COMMANDS-1) ];
+	string = (byte *)SV_ReliableCommand( client, reliableAcknowledge );
 	index = 0;
 	//
 	key = client->challenge ^ serverId ^ messageAcknowledge;
@@ -243,6 +243,8 @@ void SV_Netchan_Transmit( client_t *client, msg_t *msg)
 		// insert it in the queue, the message will be encoded and sent later
 		*client->netchan_end_queue = netbuf;
 		client->netchan_end_queue = &(*client->netchan_end_queue)->next;
+
+		SV_PaceClient(client, SV_RateMsec(client), qfalse);
 	}
 	else
 	{
@@ -251,6 +253,10 @@ void SV_Netchan_Transmit( client_t *client, msg_t *msg)
 			SV_Netchan_Encode(client, msg, client->lastClientCommandString);
 #endif
 		Netchan_Transmit( &client->netchan, msg->cursize, msg->data );
+
+		// schedule the remaining fragments
+		if(client->netchan.unsentFragments)
+			SV_PaceClient(client, SV_RateMsec(client), qfalse);
 	}
 }
 
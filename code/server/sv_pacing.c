@@ -0,0 +1,429 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// sv_pacing.c -- per client send scheduling
+
+#include "server.h"
+
+/*
+===============================================================================
+
+PACKET PACING
+
+Each client slot has one timer holding the time its rate allows the next
+packet.  Timers live in a two level timer wheel: 256 one millisecond slots,
+and 64 slots of 256 msec that are cascaded into the first level as time
+reaches them.  Only clients with something to send are on the wheel, so
+idle and spectating clients cost nothing between server frames.
+
+A timer is armed when a message had to be fragmented or queued, and when a
+snapshot was held back by the client's rate.  When it fires the next
+fragment or the delayed snapshot goes out right away instead of waiting
+for the next server frame.
+
+===============================================================================
+*/
+
+#define PACE_WHEEL0_BITS	8
+#define PACE_WHEEL0_SIZE	( 1 << PACE_WHEEL0_BITS )
+#define PACE_WHEEL1_BITS	6
+#define PACE_WHEEL1_SIZE	( 1 << PACE_WHEEL1_BITS )
+// furthest a timer can be set, anything later is clamped
+#define PACE_MAX_DELAY		( PACE_WHEEL0_SIZE * ( PACE_WHEEL1_SIZE - 1 ) )
+
+typedef struct {
+	int			expires;
+	int			level;			// -1 when not on the wheel
+	int			slot;
+	int			prev, next;		// client numbers, -1 ends the list
+	qboolean	snapshot;		// send a rate delayed snapshot when it fires
+} paceTimer_t;
+
+typedef struct {
+	qboolean	initialized;
+	int			now;			// next tick to run
+	int			numTimers;
+
+	paceTimer_t	timers[MAX_CLIENTS];
+	int			wheel0[PACE_WHEEL0_SIZE];
+	int			wheel1[PACE_WHEEL1_SIZE];
+	unsigned	used0[PACE_WHEEL0_SIZE / 32];
+	unsigned	used1[PACE_WHEEL1_SIZE / 32];
+
+	int			fired;			// statistics
+	int			snapshots;
+} pacing_t;
+
+static pacing_t	pace;
+
+/*
+================
+SV_PaceInit
+================
+*/
+static void SV_PaceInit( void ) {
+	int		i;
+
+	Com_Memset( &pace, 0, sizeof( pace ) );
+
+	for ( i = 0 ; i < MAX_CLIENTS ; i++ ) {
+		pace.timers[i].level = -1;
+	}
+	for ( i = 0 ; i < PACE_WHEEL0_SIZE ; i++ ) {
+		pace.wheel0[i] = -1;
+	}
+	for ( i = 0 ; i < PACE_WHEEL1_SIZE ; i++ ) {
+		pace.wheel1[i] = -1;
+	}
+
+	pace.now = Sys_Milliseconds();
+	pace.initialized = qtrue;
+}
+
+/*
+================
+SV_PaceUnlink
+================
+*/
+static void SV_PaceUnlink( int num ) {
+	paceTimer_t	*t = &pace.timers[num];
+	int			*head;
+	unsigned	*used;
+
+	if ( t->level < 0 ) {
+		return;
+	}
+
+	if ( t->level == 0 ) {
+		head = &pace.wheel0[t->slot];
+		used = pace.used0;
+	} else {
+		head = &pace.wheel1[t->slot];
+		used = pace.used1;
+	}
+
+	if ( t->prev != -1 ) {
+		pace.timers[t->prev].next = t->next;
+	} else {
+		*head = t->next;
+	}
+	if ( t->next != -1 ) {
+		pace.timers[t->next].prev = t->prev;
+	}
+
+	if ( *head == -1 ) {
+		used[t->slot >> 5] &= ~( 1u << ( t->slot & 31 ) );
+	}
+
+	t->level = -1;
+	pace.numTimers--;
+}
+
+/*
+================
+SV_PaceLink
+================
+*/
+static void SV_PaceLink( int num ) {
+	paceTimer_t	*t = &pace.timers[num];
+	int			*head;
+	unsigned	*used;
+	int			delta;
+
+	delta = t->expires - pace.now;
+	if ( delta < 0 ) {
+		t->expires = pace.now;
+		delta = 0;
+	} else if ( delta > PACE_MAX_DELAY ) {
+		t->expires = pace.now + PACE_MAX_DELAY;
+		delta = PACE_MAX_DELAY;
+	}
+
+	if ( delta < PACE_WHEEL0_SIZE ) {
+		t->level = 0;
+		t->slot = t->expires & ( PACE_WHEEL0_SIZE - 1 );
+		head = &pace.wheel0[t->slot];
+		used = pace.used0;
+	} else {
+		t->level = 1;
+		t->slot = ( t->expires >> PACE_WHEEL0_BITS ) & ( PACE_WHEEL1_SIZE - 1 );
+		head = &pace.wheel1[t->slot];
+		used = pace.used1;
+	}
+
+	t->prev = -1;
+	t->next = *head;
+	if ( *head != -1 ) {
+		pace.timers[*head].prev = num;
+	}
+	*head = num;
+	used[t->slot >> 5] |= 1u << ( t->slot & 31 );
+
+	pace.numTimers++;
+}
+
+/*
+================
+SV_PaceClient
+
+Makes sure the client gets serviced within msec
+================
+*/
+void SV_PaceClient( client_t *client, int msec, qboolean snapshot ) {
+	int			num = client - svs.clients;
+	paceTimer_t	*t;
+	int			expires;
+
+	if ( num < 0 || num >= MAX_CLIENTS ) {
+		return;
+	}
+
+	if ( !pace.initialized ) {
+		SV_PaceInit();
+	}
+
+	t = &pace.timers[num];
+	if ( snapshot ) {
+		t->snapshot = qtrue;
+	}
+
+	expires = Sys_Milliseconds() + ( msec > 0 ? msec : 0 );
+	if ( t->level >= 0 ) {
+		if ( t->expires - expires <= 0 ) {
+			return;		// already due earlier
+		}
+		SV_PaceUnlink( num );
+	}
+
+	t->expires = expires;
+	SV_PaceLink( num );
+}
+
+/*
+================
+SV_PaceFire
+
+Sends whatever the client's timer was armed for, and rearms it
+if more has to wait for the client's rate
+================
+*/
+static void SV_PaceFire( int num ) {
+	client_t	*cl;
+	paceTimer_t	*t = &pace.timers[num];
+	int			msec;
+
+	pace.fired++;
+
+	if ( num >= sv_maxclients->integer ) {
+		t->snapshot = qfalse;
+		return;
+	}
+
+	cl = &svs.clients[num];
+	if ( !cl->state ) {
+		t->snapshot = qfalse;
+		return;
+	}
+
+	if ( cl->netchan.unsentFragments || cl->netchan_start_queue ) {
+		msec = SV_RateMsec( cl );
+		if ( !msec ) {
+			msec = SV_Netchan_TransmitNextFragment( cl );
+		}
+
+		if ( cl->netchan.unsentFragments || cl->netchan_start_queue ) {
+			SV_PaceClient( cl, msec, qfalse );
+			return;
+		}
+
+		// the held back snapshot was dropped, delta compression
+		// would have broken on it
+		t->snapshot = qfalse;
+		return;
+	}
+
+	if ( t->snapshot ) {
+		if ( sv.state != SS_GAME || *cl->downloadName ) {
+			t->snapshot = qfalse;
+			return;
+		}
+
+		msec = SV_RateMsec( cl );
+		if ( msec > 0 ) {
+			SV_PaceClient( cl, msec, qfalse );
+			return;
+		}
+
+		t->snapshot = qfalse;
+		pace.snapshots++;
+
+		// entity states may have changed since the server frame
+		SV_BeginSnapshotEpoch();
+		SV_SendClientSnapshot( cl );
+		cl->lastSnapshotTime = svs.time;
+		cl->rateDelayed = qfalse;
+	}
+}
+
+/*
+================
+SV_PaceSentSnapshot
+
+Called when a snapshot went out with the server frame,
+so a delayed one is not sent again
+================
+*/
+void SV_PaceSentSnapshot( client_t *client ) {
+	int		num = client - svs.clients;
+
+	if ( num >= 0 && num < MAX_CLIENTS ) {
+		pace.timers[num].snapshot = qfalse;
+	}
+}
+
+/*
+================
+SV_PaceFindSlot
+
+Returns the first used slot at or after start, wrapping around, or -1
+================
+*/
+static int SV_PaceFindSlot( const unsigned *used, int size, int start ) {
+	int			words = size >> 5;
+	int			i, word, slot;
+	unsigned	bits;
+
+	// the start word is checked again last for the slots before start
+	for ( i = 0 ; i <= words ; i++ ) {
+		word = ( ( start >> 5 ) + i ) % words;
+		bits = used[word];
+		if ( i == 0 ) {
+			bits &= ~0u << ( start & 31 );
+		}
+		if ( bits ) {
+			for ( slot = word << 5 ; !( bits & 1 ) ; bits >>= 1 ) {
+				slot++;
+			}
+			return slot;
+		}
+	}
+
+	return -1;
+}
+
+/*
+================
+SV_PaceRun
+
+Fires all expired timers.  Returns the number of msec until the
+next timer expires, or -1 if no client is waiting.
+================
+*/
+int SV_PaceRun( void ) {
+	int		now, num, next, slot, wait, start, block, cascade;
+
+	if ( !pace.initialized ) {
+		SV_PaceInit();
+	}
+
+	now = Sys_Milliseconds();
+
+	if ( !pace.numTimers ) {
+		pace.now = now + 1;
+		return -1;
+	}
+
+	for ( ; pace.now - now <= 0 ; pace.now++ ) {
+		// entering a new level 0 revolution, cascade the level 1 slot
+		if ( !( pace.now & ( PACE_WHEEL0_SIZE - 1 ) ) ) {
+			slot = ( pace.now >> PACE_WHEEL0_BITS ) & ( PACE_WHEEL1_SIZE - 1 );
+			for ( num = pace.wheel1[slot] ; num != -1 ; num = next ) {
+				next = pace.timers[num].next;
+				SV_PaceUnlink( num );
+				SV_PaceLink( num );
+			}
+		}
+
+		slot = pace.now & ( PACE_WHEEL0_SIZE - 1 );
+		while ( ( num = pace.wheel0[slot] ) != -1 ) {
+			SV_PaceUnlink( num );
+			SV_PaceFire( num );
+		}
+
+		if ( !pace.numTimers ) {
+			pace.now = now + 1;
+			return -1;
+		}
+	}
+
+	wait = INT_MAX;
+
+	// level 0 slots cover the next PACE_WHEEL0_SIZE msec in order
+	start = pace.now & ( PACE_WHEEL0_SIZE - 1 );
+	slot = SV_PaceFindSlot( pace.used0, PACE_WHEEL0_SIZE, start );
+	if ( slot != -1 ) {
+		wait = ( ( slot - start ) & ( PACE_WHEEL0_SIZE - 1 ) ) + pace.now - now;
+	}
+
+	// a level 1 slot can come due first, wake up when it is cascaded
+	block = ( pace.now + PACE_WHEEL0_SIZE - 1 ) >> PACE_WHEEL0_BITS;
+	start = block & ( PACE_WHEEL1_SIZE - 1 );
+	slot = SV_PaceFindSlot( pace.used1, PACE_WHEEL1_SIZE, start );
+	if ( slot != -1 ) {
+		cascade = ( ( block + ( ( slot - start ) & ( PACE_WHEEL1_SIZE - 1 ) ) ) << PACE_WHEEL0_BITS ) - now;
+		if ( cascade < wait ) {
+			wait = cascade;
+		}
+	}
+
+	return wait == INT_MAX ? -1 : wait;
+}
+
+/*
+================
+SV_PaceClear
+
+Drops all timers, called when the client array goes away
+================
+*/
+void SV_PaceClear( void ) {
+	pace.initialized = qfalse;
+}
+
+/*
+================
+SV_PaceStats_f
+================
+*/
+void SV_PaceStats_f( void ) {
+	int		i;
+
+	Com_Printf( "%i clients waiting, %i timers fired, %i paced snapshots\n",
+		pace.numTimers, pace.fired, pace.snapshots );
+
+	for ( i = 0 ; i < MAX_CLIENTS && pace.initialized ; i++ ) {
+		if ( pace.timers[i].level >= 0 ) {
+			Com_Printf( "  client %2i: due in %i msec%s\n", i,
+				pace.timers[i].expires - Sys_Milliseconds(),
+				pace.timers[i].snapshot ? ", snapshot" : "" );
+		}
+	}
+}
@@ -45,6 +45,195 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+Snapshot entity states live in a pool shared by all clients.  An entity's
+state is copied once when it changes and every client frame that includes
+it references the same copy, so the memory needed follows how much the
+world changes instead of sv_maxclients.  A state is freed when the entity
+and the last client frame referencing it have moved on.
+
+=============================================================================
+*/
+
+#define SNAPSHOT_POOL_CHUNK		256
+
+typedef struct snapshotChunk_s {
+	struct snapshotChunk_s	*next;
+	snapshotEntity_t		entities[SNAPSHOT_POOL_CHUNK];
+} snapshotChunk_t;
+
+static snapshotChunk_t	*snapshotChunks;
+static snapshotEntity_t	*snapshotFree;
+static int				snapshotPoolSize;
+static int				snapshotPoolUsed;
+
+// statistics
+static int				snapshotStatesCompared;
+static int				snapshotStatesChanged;
+static int				snapshotEntitiesReferenced;
+static int				snapshotDeltasSkipped;
+
+/*
+=============
+SV_AllocSnapshotEntity
+=============
+*/
+static snapshotEntity_t *SV_AllocSnapshotEntity( void ) {
+	snapshotChunk_t		*chunk;
+	snapshotEntity_t	*state;
+	int					i;
+
+	if ( !snapshotFree ) {
+		chunk = Z_Malloc( sizeof( *chunk ) );
+		chunk->next = snapshotChunks;
+		snapshotChunks = chunk;
+
+		for ( i = 0 ; i < SNAPSHOT_POOL_CHUNK ; i++ ) {
+			chunk->entities[i].nextFree = snapshotFree;
+			snapshotFree = &chunk->entities[i];
+		}
+		snapshotPoolSize += SNAPSHOT_POOL_CHUNK;
+	}
+
+	state = snapshotFree;
+	snapshotFree = state->nextFree;
+	snapshotPoolUsed++;
+
+	state->refCount = 0;
+	return state;
+}
+
+/*
+=============
+SV_ReleaseSnapshotEntity
+=============
+*/
+static void SV_ReleaseSnapshotEntity( snapshotEntity_t *state ) {
+	if ( !state || --state->refCount > 0 ) {
+		return;
+	}
+
+	state->nextFree = snapshotFree;
+	snapshotFree = state;
+	snapshotPoolUsed--;
+}
+
+/*
+=============
+SV_BeginSnapshotEpoch
+
+Called before building snapshots when game code may have run since the
+last ones, so entity states get compared again.  Within an epoch each
+entity is compared at most once, however many clients see it.
+=============
+*/
+void SV_BeginSnapshotEpoch( void ) {
+	sv.snapshotEpoch++;
+}
+
+/*
+=============
+SV_SnapshotEntityForState
+
+Returns a referenced copy of the entity's current state,
+sharing the previous copy if nothing has changed
+=============
+*/
+static snapshotEntity_t *SV_SnapshotEntityForState( svEntity_t *svEnt, const entityState_t *s ) {
+	snapshotEntity_t	*state = svEnt->snapshotState;
+
+	snapshotEntitiesReferenced++;
+
+	if ( !state || svEnt->snapshotEpoch != sv.snapshotEpoch ) {
+		snapshotStatesCompared++;
+
+		if ( !state || memcmp( &state->s, s, sizeof( *s ) ) ) {
+			// the entity keeps a reference so the next snapshot can compare against it
+			snapshotStatesChanged++;
+			SV_ReleaseSnapshotEntity( state );
+			state = SV_AllocSnapshotEntity();
+			state->s = *s;
+			state->refCount = 1;
+			svEnt->snapshotState = state;
+		}
+		svEnt->snapshotEpoch = sv.snapshotEpoch;
+	}
+
+	state->refCount++;
+	return state;
+}
+
+/*
+=============
+SV_FreeClientFrames
+
+Releases the entity states referenced by a client slot's frames
+=============
+*/
+void SV_FreeClientFrames( client_t *client ) {
+	clientSnapshot_t	*frame;
+	int					i, j;
+
+	for ( i = 0, frame = client->frames ; i < PACKET_BACKUP ; i++, frame++ ) {
+		for ( j = 0 ; j < frame->num_entities ; j++ ) {
+			SV_ReleaseSnapshotEntity( frame->entities[j] );
+		}
+		frame->num_entities = 0;
+	}
+}
+
+/*
+=============
+SV_ClearSnapshotEntities
+
+Drops every snapshot entity state, called when the level is cleared.
+No frame from before can be delta'd from after that anyway.
+=============
+*/
+void SV_ClearSnapshotEntities( void ) {
+	snapshotChunk_t	*chunk, *next;
+	int				i;
+
+	if ( svs.clients ) {
+		for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
+			SV_FreeClientFrames( &svs.clients[i] );
+		}
+	}
+
+	for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+		sv.svEntities[i].snapshotState = NULL;
+	}
+
+	for ( chunk = snapshotChunks ; chunk ; chunk = next ) {
+		next = chunk->next;
+		Z_Free( chunk );
+	}
+
+	snapshotChunks = NULL;
+	snapshotFree = NULL;
+	snapshotPoolSize = 0;
+	snapshotPoolUsed = 0;
+}
+
+/*
+=============
+SV_SnapshotPool_f
+=============
+*/
+void SV_SnapshotPool_f( void ) {
+	Com_Printf( "%i snapshot entity states in use, %i allocated (%i KB)\n",
+		snapshotPoolUsed, snapshotPoolSize, snapshotPoolSize * (int)sizeof( snapshotEntity_t ) / 1024 );
+	Com_Printf( "%i entities referenced, %i states compared, %i changed, %i unchanged deltas skipped\n",
+		snapshotEntitiesReferenced, snapshotStatesCompared, snapshotStatesChanged, snapshotDeltasSkipped );
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		snapshotEntitiesReferenced = snapshotStatesCompared = 0;
+		snapshotStatesChanged = snapshotDeltasSkipped = 0;
+	}
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -73,18 +262,27 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 		if ( newindex >= to->num_entities ) {
 			newnum = 9999;
 		} else {
-			newent = &svs.snapshotEntities[(to->first_entity+newindex) % svs.numSnapshotEntities];
+			newent = &to->entities[newindex]->s;
 			newnum = newent->number;
 		}
 
 		if ( oldindex >= from_num_entities ) {
 			oldnum = 9999;
 		} else {
-			oldent = &svs.snapshotEntities[(from->first_entity+oldindex) % svs.numSnapshotEntities];
+			oldent = &from->entities[oldindex]->s;
 			oldnum = oldent->number;
 		}
 
 		if ( newnum == oldnum ) {
+			// both frames sharing the same state means nothing changed,
+			// which is exactly when the delta would emit no bytes
+			if ( to->entities[newindex] == from->entities[oldindex] ) {
+				snapshotDeltasSkipped++;
+				oldindex++;
+				newindex++;
+				continue;
+			}
+
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emited if the entity has not changed at all
@@ -114,6 +312,35 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 
 
+/*
+==================
+SV_WriteLoopSnapshotToClient
+
+Hands the snapshot to a client in the same process without encoding it,
+the message only carries the tag to find it by
+==================
+*/
+static void SV_WriteLoopSnapshotToClient( client_t *client, clientSnapshot_t *frame,
+	int serverTime, int snapFlags, msg_t *msg ) {
+	loopSnapshot_t	*snap;
+	int				i;
+
+	snap = NET_AllocLoopSnapshot();
+
+	snap->serverTime = serverTime;
+	snap->snapFlags = snapFlags;
+	snap->areabytes = frame->areabytes;
+	Com_Memcpy( snap->areamask, frame->areabits, frame->areabytes );
+	snap->ps = frame->ps;
+	snap->numEntities = frame->num_entities;
+	for ( i = 0 ; i < frame->num_entities ; i++ ) {
+		snap->entities[i] = frame->entities[i]->s;
+	}
+
+	MSG_WriteByte( msg, svc_loopSnapshot );
+	MSG_WriteLong( msg, snap->tag );
+}
+
 /*
 ==================
 SV_WriteSnapshotToClient
@@ -124,6 +351,7 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 	int					lastframe;
 	int					i;
 	int					snapFlags;
+	int					serverTime;
 
 	// this is the snapshot we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
@@ -143,21 +371,8 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 		// we have a valid snapshot to delta from
 		oldframe = &client->frames[ client->deltaMessage & PACKET_MASK ];
 		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
-
-		// the snapshot's entities may still have rolled off the buffer, though
-		if ( oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities ) {
-			Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
-			oldframe = NULL;
-			lastframe = 0;
-		}
 	}
 
-	MSG_WriteByte (msg, svc_snapshot);
-
-	// NOTE, MRE: now sent at the start of every message from server to client
-	// let the client know which reliable clientCommands we have received
-	//MSG_WriteLong( msg, client->lastClientCommand );
-
 	// send over the current server time so the client can drift
 	// its view of time to try to match
 	if( client->oldServerTime ) {
@@ -167,14 +382,11 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 		// the client's perspective this time is strictly speaking
 		// incorrect, but since it'll be busy loading a map at
 		// the time it doesn't really matter.
-		MSG_WriteLong (msg, sv.time + client->oldServerTime);
+		serverTime = sv.time + client->oldServerTime;
 	} else {
-		MSG_WriteLong (msg, sv.time);
+		serverTime = sv.time;
 	}
 
-	// what we are delta'ing from
-	MSG_WriteByte (msg, lastframe);
-
 	snapFlags = svs.snapFlagServerBit;
 	if ( client->rateDelayed ) {
 		snapFlags |= SNAPFLAG_RATE_DELAYED;
@@ -183,6 +395,23 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 		snapFlags |= SNAPFLAG_NOT_ACTIVE;
 	}
 
+	// the local client takes it as it is
+	if ( client->netchan.remoteAddress.type == NA_LOOPBACK && NET_LoopSnapshotsAccepted() ) {
+		SV_WriteLoopSnapshotToClient( client, frame, serverTime, snapFlags, msg );
+		return;
+	}
+
+	MSG_WriteByte (msg, svc_snapshot);
+
+	// NOTE, MRE: now sent at the start of every message from server to client
+	// let the client know which reliable clientCommands we have received
+	//MSG_WriteLong( msg, client->lastClientCommand );
+
+	MSG_WriteLong (msg, serverTime);
+
+	// what we are delta'ing from
+	MSG_WriteByte (msg, lastframe);
+
 	MSG_WriteByte (msg, snapFlags);
 
 	// send over the areabits
@@ -217,12 +446,20 @@ SV_UpdateServerCommandsToClient
 */
 void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg ) {
 	int		i;
+	serverCommand_t	*command;
 
 	// write any unacknowledged serverCommands
 	for ( i = client->reliableAcknowledge + 1 ; i <= client->reliableSequence ; i++ ) {
 		MSG_WriteByte( msg, svc_serverCommand );
 		MSG_WriteLong( msg, i );
-		MSG_WriteString( msg, client->reliableCommands[ i & (MAX_RELIABLE_COMMANDS-1) ] );
+
+		// commands are encoded once when they are added
+		command = client->reliableCommands[ i & (MAX_RELIABLE_COMMANDS-1) ];
+		if ( command ) {
+			MSG_WriteBitstream( msg, command->encoded, command->bits );
+		} else {
+			MSG_WriteString( msg, "" );
+		}
 	}
 	client->reliableSent = client->reliableSequence;
 }
@@ -445,7 +682,6 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	snapshotEntityNumbers_t		entityNumbers;
 	int							i;
 	sharedEntity_t				*ent;
-	entityState_t				*state;
 	svEntity_t					*svEnt;
 	sharedEntity_t				*clent;
 	int							clientNum;
@@ -462,6 +698,9 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	Com_Memset( frame->areabits, 0, sizeof( frame->areabits ) );
 
   // https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=62
+	for ( i = 0 ; i < frame->num_entities ; i++ ) {
+		SV_ReleaseSnapshotEntity( frame->entities[i] );
+	}
 	frame->num_entities = 0;
 	
 	clent = client->gentity;
@@ -504,19 +743,12 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		((int *)frame->areabits)[i] = ((int *)frame->areabits)[i] ^ -1;
 	}
 
-	// copy the entity states out
+	// reference the entity states, copying only the ones that changed
 	frame->num_entities = 0;
-	frame->first_entity = svs.nextSnapshotEntities;
 	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ ) {
 		ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
-		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
-		*state = ent->s;
-		svs.nextSnapshotEntities++;
-		// this should never hit, map should always be restarted first in SV_Frame
-		if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
-			Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
-		}
-		frame->num_entities++;
+		svEnt = SV_SvEntityForGentity( ent );
+		frame->entities[frame->num_entities++] = SV_SnapshotEntityForState( svEnt, &ent->s );
 	}
 }
 
@@ -642,9 +874,15 @@ SV_SendClientMessages
 */
 void SV_SendClientMessages(void)
 {
-	int		i;
+	int		i, rateMsec;
 	client_t	*c;
 
+	// let the network layer hand all snapshots to the kernel at once
+	Sys_BeginSendBatch();
+
+	// the game has run since the last snapshots were built
+	SV_BeginSnapshotEpoch();
+
 	// send a message to each connected client
 	for(i=0; i < sv_maxclients->integer; i++)
 	{
@@ -670,17 +908,22 @@ void SV_SendClientMessages(void)
 			if(svs.time - c->lastSnapshotTime < c->snapshotMsec * com_timescale->value)
 				continue;		// It's not time yet
 
-			if(SV_RateMsec(c) > 0)
+			if((rateMsec = SV_RateMsec(c)) > 0)
 			{
-				// Not enough time since last packet passed through the line
+				// Not enough time since last packet passed through the line,
+				// send it as soon as the rate allows instead of next frame
 				c->rateDelayed = qtrue;
+				SV_PaceClient(c, rateMsec, qtrue);
 				continue;
 			}
 		}
 
 		// generate and send a new message
 		SV_SendClientSnapshot(c);
+		SV_PaceSentSnapshot(c);
 		c->lastSnapshotTime = svs.time;
 		c->rateDelayed = qfalse;
 	}
+
+	Sys_EndSendBatch();
 }
@@ -23,6 +23,18 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "server.h"
 
+// area queries and traces can run on several of the game module's threads at once
+#ifdef _MSC_VER
+#include <intrin.h>
+#define	SV_TryLock(p)		( _InterlockedCompareExchange( (volatile long *)(p), 1, 0 ) == 0 )
+#define	SV_Unlock(p)		_InterlockedExchange( (volatile long *)(p), 0 )
+#define	SV_AtomicAdd(p, n)	_InterlockedExchangeAdd( (volatile long *)(p), (n) )
+#else
+#define	SV_TryLock(p)		__sync_bool_compare_and_swap( (p), 0, 1 )
+#define	SV_Unlock(p)		__sync_lock_release( (p) )
+#define	SV_AtomicAdd(p, n)	__sync_fetch_and_add( (p), (n) )
+#endif
+
 /*
 ================
 SV_ClipHandleForEntity
@@ -54,9 +66,17 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent ) {
 ENTITY CHECKING
 
 To avoid linearly searching through lists of entities during environment testing,
-the world is carved up with an evenly spaced, axially aligned bsp tree.  Entities
-are kept in chains either at the final leafs, or at the first node that splits
-them, which prevents having to deal with multiple fragments of a single entity.
+the world is carved up with an axially aligned loose kd-tree.  The tree is split
+along the longest axis of each node, including the vertical one, until the nodes
+reach AREA_MIN_SIZE, so large maps get more sectors and small maps fewer.
+
+Each split plane has a band of AREA_LOOSENESS * node size around it, and an entity
+may descend into either child as long as it stays within that child's loose
+bounds.  This keeps small entities that straddle a split plane out of the
+upper node chains, which would otherwise be scanned by every query.
+
+Entities are kept in chains either at the final leafs, or at the first node that
+splits them, which prevents having to deal with multiple fragments of a single entity.
 
 ===============================================================================
 */
@@ -64,16 +84,28 @@ them, which prevents having to deal with multiple fragments of a single entity.
 typedef struct worldSector_s {
 	int		axis;		// -1 = leaf node
 	float	dist;
+	float	loose;		// half width of the band around dist shared by both children
+	int		depth;
 	struct worldSector_s	*children[2];
 	svEntity_t	*entities;
+	int		numEntities;
 } worldSector_t;
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	64
+#define	AREA_DEPTH		10
+#define	AREA_NODES		( ( 1 << ( AREA_DEPTH + 1 ) ) - 1 )
+#define	AREA_MIN_SIZE	512
+#define	AREA_LOOSENESS	0.125f
 
 worldSector_t	sv_worldSectors[AREA_NODES];
 int			sv_numworldSectors;
 
+// statistics for sectorlist / sectorbench
+static int	sv_sectorLinks;			// total SV_LinkEntity calls that got linked
+static int	sv_sectorRelinks;		// links that stayed in the same sector
+static volatile int	sv_sectorChecks;	// entity bounds tested by SV_AreaEntities
+static int	sv_leafWalks;			// links that had to find their leafs again
+static int	sv_leafReuses;			// links that kept the leafs of the last one
+
 
 /*
 ===============
@@ -82,55 +114,105 @@ SV_SectorList_f
 */
 void SV_SectorList_f( void ) {
 	int				i, c;
+	int				numLeafs, maxDepth, occupied, maxCount, total;
+	int				depthCount[AREA_DEPTH + 1];
 	worldSector_t	*sec;
 	svEntity_t		*ent;
+	qboolean		verbose;
 
-	for ( i = 0 ; i < AREA_NODES ; i++ ) {
+	verbose = ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "all" ) );
+
+	numLeafs = maxDepth = occupied = maxCount = total = 0;
+	Com_Memset( depthCount, 0, sizeof( depthCount ) );
+
+	for ( i = 0 ; i < sv_numworldSectors ; i++ ) {
 		sec = &sv_worldSectors[i];
 
 		c = 0;
 		for ( ent = sec->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
 			c++;
 		}
-		Com_Printf( "sector %i: %i entities\n", i, c );
+		if ( c != sec->numEntities ) {
+			Com_Printf( "WARNING: sector %i: count mismatch (%i != %i)\n", i, c, sec->numEntities );
+		}
+
+		if ( sec->axis == -1 ) {
+			numLeafs++;
+		}
+		if ( sec->depth > maxDepth ) {
+			maxDepth = sec->depth;
+		}
+		if ( c ) {
+			occupied++;
+			depthCount[sec->depth] += c;
+		}
+		if ( c > maxCount ) {
+			maxCount = c;
+		}
+		total += c;
+
+		if ( c && verbose ) {
+			Com_Printf( "sector %i: depth %i, %i entities\n", i, sec->depth, c );
+		}
 	}
+
+	Com_Printf( "%i sectors, %i leafs, depth %i\n", sv_numworldSectors, numLeafs, maxDepth );
+	Com_Printf( "%i entities in %i occupied sectors, max %i, avg %.2f\n", total, occupied,
+		maxCount, occupied ? (float)total / occupied : 0.0f );
+	for ( i = 0 ; i <= maxDepth ; i++ ) {
+		if ( depthCount[i] ) {
+			Com_Printf( "depth %2i: %i entities\n", i, depthCount[i] );
+		}
+	}
+	Com_Printf( "%i links, %i kept in the same sector (%.1f%%)\n", sv_sectorLinks, sv_sectorRelinks,
+		sv_sectorLinks ? 100.0f * sv_sectorRelinks / sv_sectorLinks : 0.0f );
+	Com_Printf( "%i leaf walks, %i skipped (%.1f%%)\n", sv_leafWalks, sv_leafReuses,
+		sv_leafWalks + sv_leafReuses ? 100.0f * sv_leafReuses / ( sv_leafWalks + sv_leafReuses ) : 0.0f );
 }
 
 /*
 ===============
 SV_CreateworldSector
 
-Builds a uniformly subdivided tree for the given world size
+Builds a kd-tree for the given world size, splitting the longest axis
+until the nodes are small enough
 ===============
 */
 static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs ) {
 	worldSector_t	*anode;
 	vec3_t		size;
 	vec3_t		mins1, maxs1, mins2, maxs2;
+	int			axis;
 
 	anode = &sv_worldSectors[sv_numworldSectors];
 	sv_numworldSectors++;
 
-	if (depth == AREA_DEPTH) {
+	anode->depth = depth;
+
+	VectorSubtract (maxs, mins, size);
+	axis = 0;
+	if (size[1] > size[axis]) {
+		axis = 1;
+	}
+	if (size[2] > size[axis]) {
+		axis = 2;
+	}
+
+	if (depth == AREA_DEPTH || size[axis] < 2 * AREA_MIN_SIZE) {
 		anode->axis = -1;
 		anode->children[0] = anode->children[1] = NULL;
 		return anode;
 	}
-	
-	VectorSubtract (maxs, mins, size);
-	if (size[0] > size[1]) {
-		anode->axis = 0;
-	} else {
-		anode->axis = 1;
-	}
 
-	anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
+	anode->axis = axis;
+	anode->dist = 0.5 * (maxs[axis] + mins[axis]);
+	anode->loose = AREA_LOOSENESS * size[axis];
 	VectorCopy (mins, mins1);	
 	VectorCopy (mins, mins2);	
 	VectorCopy (maxs, maxs1);	
 	VectorCopy (maxs, maxs2);	
 	
-	maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
+	maxs1[axis] = mins2[axis] = anode->dist;
 	
 	anode->children[0] = SV_CreateworldSector (depth+1, mins2, maxs2);
 	anode->children[1] = SV_CreateworldSector (depth+1, mins1, maxs1);
@@ -150,6 +232,9 @@ void SV_ClearWorld( void ) {
 
 	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
 	sv_numworldSectors = 0;
+	sv_sectorLinks = sv_sectorRelinks = sv_sectorChecks = 0;
+	sv_leafWalks = sv_leafReuses = 0;
+	SV_InvalidateTraceCache();
 
 	// get world map bounds
 	h = CM_InlineModel( 0 );
@@ -158,6 +243,33 @@ void SV_ClearWorld( void ) {
 }
 
 
+/*
+===============
+SV_SectorForBounds
+
+Finds the deepest world sector node whose loose bounds contain the box
+===============
+*/
+static worldSector_t *SV_SectorForBounds( const vec3_t absmin, const vec3_t absmax ) {
+	worldSector_t	*node;
+
+	node = sv_worldSectors;
+	while (1)
+	{
+		if (node->axis == -1)
+			break;
+		if ( absmin[node->axis] > node->dist - node->loose)
+			node = node->children[0];
+		else if ( absmax[node->axis] < node->dist + node->loose)
+			node = node->children[1];
+		else
+			break;		// crosses the node
+	}
+
+	return node;
+}
+
+
 /*
 ===============
 SV_UnlinkEntity
@@ -172,12 +284,14 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 	ent = SV_SvEntityForGentity( gEnt );
 
 	gEnt->r.linked = qfalse;
+	SV_InvalidateTraceCache();
 
 	ws = ent->worldSector;
 	if ( !ws ) {
 		return;		// not linked in anywhere
 	}
 	ent->worldSector = NULL;
+	ws->numEntities--;
 
 	if ( ws->entities == ent ) {
 		ws->entities = ent->nextEntityInWorldSector;
@@ -195,6 +309,31 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 }
 
 
+/*
+===============
+SV_LeafsUnchanged
+
+Returns qtrue if the entity's box is close enough to the one its
+leafs were last found for that it must touch exactly the same ones
+===============
+*/
+static qboolean SV_LeafsUnchanged( const svEntity_t *ent, const sharedEntity_t *gEnt ) {
+	int		i;
+
+	if ( ent->leafSlack <= 0 ) {
+		return qfalse;
+	}
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		if ( fabs( gEnt->r.absmin[i] - ent->leafMins[i] ) >= ent->leafSlack ||
+			fabs( gEnt->r.absmax[i] - ent->leafMaxs[i] ) >= ent->leafSlack ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
 /*
 ===============
 SV_LinkEntity
@@ -214,10 +353,7 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	svEntity_t	*ent;
 
 	ent = SV_SvEntityForGentity( gEnt );
-
-	if ( ent->worldSector ) {
-		SV_UnlinkEntity( gEnt );	// unlink from old position
-	}
+	SV_InvalidateTraceCache();
 
 	// encode the size into the entityState_t for client prediction
 	if ( gEnt->r.bmodel ) {
@@ -278,6 +414,14 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	gEnt->r.absmax[1] += 1;
 	gEnt->r.absmax[2] += 1;
 
+	// small moves within the slack of the last leaf walk keep
+	// the clusters and areas found by it
+	if ( SV_LeafsUnchanged( ent, gEnt ) ) {
+		sv_leafReuses++;
+		goto linkSector;
+	}
+	sv_leafWalks++;
+
 	// link to PVS leafs
 	ent->numClusters = 0;
 	ent->lastCluster = 0;
@@ -285,12 +429,19 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	ent->areanum2 = -1;
 
 	//get all leafs, including solids
-	num_leafs = CM_BoxLeafnums( gEnt->r.absmin, gEnt->r.absmax,
-		leafs, MAX_TOTAL_ENT_LEAFS, &lastLeaf );
+	num_leafs = CM_BoxLeafnumsSlack( gEnt->r.absmin, gEnt->r.absmax,
+		leafs, MAX_TOTAL_ENT_LEAFS, &lastLeaf, &ent->leafSlack );
+	VectorCopy( gEnt->r.absmin, ent->leafMins );
+	VectorCopy( gEnt->r.absmax, ent->leafMaxs );
 
 	// if none of the leafs were inside the map, the
 	// entity is outside the world and can be considered unlinked
 	if ( !num_leafs ) {
+		ent->leafSlack = 0;
+		if ( ent->worldSector ) {
+			SV_UnlinkEntity( gEnt );
+		}
+		gEnt->r.linked = qfalse;
 		return;
 	}
 
@@ -330,26 +481,29 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 		ent->lastCluster = CM_LeafCluster( lastLeaf );
 	}
 
+linkSector:
 	gEnt->r.linkcount++;
 
 	// find the first world sector node that the ent's box crosses
-	node = sv_worldSectors;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if ( gEnt->r.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if ( gEnt->r.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
+	node = SV_SectorForBounds( gEnt->r.absmin, gEnt->r.absmax );
+
+	sv_sectorLinks++;
+	if ( ent->worldSector == node ) {
+		// still in the same sector, no need to touch the chains
+		sv_sectorRelinks++;
+		gEnt->r.linked = qtrue;
+		return;
 	}
-	
+
+	if ( ent->worldSector ) {
+		SV_UnlinkEntity( gEnt );	// unlink from old position
+	}
+
 	// link it in
 	ent->worldSector = node;
 	ent->nextEntityInWorldSector = node->entities;
 	node->entities = ent;
+	node->numEntities++;
 
 	gEnt->r.linked = qtrue;
 }
@@ -369,6 +523,7 @@ typedef struct {
 	const float	*maxs;
 	int			*list;
 	int			count, maxcount;
+	int			checks;			// added to sv_sectorChecks once per query
 } areaParms_t;
 
 
@@ -386,6 +541,7 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 		next = check->nextEntityInWorldSector;
 
 		gcheck = SV_GEntityForSvEntity( check );
+		ap->checks++;
 
 		if ( gcheck->r.absmin[0] > ap->maxs[0]
 		|| gcheck->r.absmin[1] > ap->maxs[1]
@@ -409,11 +565,11 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 		return;		// terminal node
 	}
 
-	// recurse down both sides
-	if ( ap->maxs[node->axis] > node->dist ) {
+	// recurse down both sides, the loose bands overlap
+	if ( ap->maxs[node->axis] > node->dist - node->loose ) {
 		SV_AreaEntities_r ( node->children[0], ap );
 	}
-	if ( ap->mins[node->axis] < node->dist ) {
+	if ( ap->mins[node->axis] < node->dist + node->loose ) {
 		SV_AreaEntities_r ( node->children[1], ap );
 	}
 }
@@ -431,12 +587,71 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.list = entityList;
 	ap.count = 0;
 	ap.maxcount = maxcount;
+	ap.checks = 0;
 
 	SV_AreaEntities_r( sv_worldSectors, &ap );
+	SV_AtomicAdd( &sv_sectorChecks, ap.checks );
 
 	return ap.count;
 }
 
+/*
+================
+SV_SectorBench_f
+
+Runs a batch of random area queries over the current map and reports
+the average cost, so sector layouts can be compared on stock maps
+================
+*/
+void SV_SectorBench_f( void ) {
+	int			i, j, count, size, found, start, msec;
+	int			checks, seed;
+	int			list[MAX_GENTITIES];
+	vec3_t		worldMins, worldMaxs, mins, maxs;
+
+	if ( !com_sv_running->integer || !sv_numworldSectors ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	count = 100000;
+	size = 256;
+	if ( Cmd_Argc() > 1 ) {
+		count = atoi( Cmd_Argv( 1 ) );
+	}
+	if ( Cmd_Argc() > 2 ) {
+		size = atoi( Cmd_Argv( 2 ) );
+	}
+	if ( count < 1 ) {
+		Com_Printf( "usage: sectorbench [queries] [boxsize]\n" );
+		return;
+	}
+
+	CM_ModelBounds( CM_InlineModel( 0 ), worldMins, worldMaxs );
+
+	// use a fixed seed of our own so runs are reproducible
+	// without touching the shared rand() state
+	seed = 0x5ec7;
+
+	found = 0;
+	checks = sv_sectorChecks;
+	start = Sys_Milliseconds();
+	for ( i = 0 ; i < count ; i++ ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			mins[j] = worldMins[j] + Q_random( &seed ) * ( worldMaxs[j] - worldMins[j] );
+			maxs[j] = mins[j] + Q_random( &seed ) * size;
+		}
+		found += SV_AreaEntities( mins, maxs, list, MAX_GENTITIES );
+	}
+	msec = Sys_Milliseconds() - start;
+	checks = sv_sectorChecks - checks;
+
+	Com_Printf( "%i queries of up to %i units in %i msec (%.3f usec/query)\n",
+		count, size, msec, 1000.0f * msec / count );
+	Com_Printf( "%.2f entities tested, %.2f found per query\n",
+		(float)checks / count, (float)found / count );
+}
+
 
 
 //===========================================================================
@@ -586,23 +801,165 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 
 
 /*
-==================
-SV_Trace
+===============================================================================
 
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
-==================
+TRACE CACHE
+
+Bots and game code repeat many identical queries within a frame: the same
+eye to target traces, point contents of the same spots, damage probes.  With
+sv_traceCache set, SV_Trace and SV_PointContents keep their results in a
+direct mapped table and answer repeats from it.  Queries only match exactly,
+a trace that is merely close can end on the other side of an edge.
+
+Linking or unlinking any entity and the end of each server frame start a new
+generation, which drops every entry at once.  Game code that changes contents
+or owners without relinking can get results from before the change until the
+frame ends, so the cache is off by default.
+
+The game's parallel moves trace under a shared world lock, so several threads
+can look up and store at the same time.  Each slot has a try-lock; a thread
+that finds its slot busy just counts a miss and doesn't store.
+
+===============================================================================
 */
-void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
-	moveclip_t	clip;
-	int			i;
 
-	if ( !mins ) {
-		mins = vec3_origin;
+#define	TRACE_CACHE_SIZE	4096		// must be a power of two
+#define	TRACE_CACHE_POINT	2			// kind of a SV_PointContents query, 0 and 1 are capsule
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			passEntityNum;
+	int			contentmask;
+	int			kind;
+} traceKey_t;
+
+typedef struct {
+	volatile int	lock;
+	int			generation;
+	traceKey_t	key;
+	trace_t		trace;			// point queries keep their result in trace.contents
+} traceCacheEntry_t;
+
+static traceCacheEntry_t	sv_traceSlots[TRACE_CACHE_SIZE];
+static int	sv_traceGeneration = 1;	// never matches a cleared entry
+
+// statistics for tracecache, updated atomically since traces run in parallel
+static volatile int	sv_traceCacheHits;
+static volatile int	sv_traceCacheMisses;
+static volatile int	sv_traceCacheBusy;		// misses because another thread held the slot
+static volatile int	sv_traceCacheFlushes;
+
+
+/*
+================
+SV_InvalidateTraceCache
+================
+*/
+void SV_InvalidateTraceCache( void ) {
+	sv_traceGeneration++;
+	SV_AtomicAdd( &sv_traceCacheFlushes, 1 );
+}
+
+/*
+================
+SV_TraceCacheSlot
+================
+*/
+static traceCacheEntry_t *SV_TraceCacheSlot( const traceKey_t *key ) {
+	const unsigned	*p;
+	unsigned		hash;
+	int				i;
+
+	// FNV-1a over the words of the key
+	p = (const unsigned *)key;
+	hash = 2166136261u;
+	for ( i = 0 ; i < (int)( sizeof( *key ) / sizeof( *p ) ) ; i++ ) {
+		hash = ( hash ^ p[i] ) * 16777619u;
 	}
-	if ( !maxs ) {
-		maxs = vec3_origin;
+	hash ^= hash >> 15;
+
+	return &sv_traceSlots[hash & ( TRACE_CACHE_SIZE - 1 )];
+}
+
+/*
+================
+SV_TraceCacheLookup
+
+Returns qtrue and fills in the trace if the same query was made in this generation
+================
+*/
+static qboolean SV_TraceCacheLookup( traceCacheEntry_t *slot, const traceKey_t *key, int generation, trace_t *trace ) {
+	qboolean	hit;
+
+	if ( !SV_TryLock( &slot->lock ) ) {
+		SV_AtomicAdd( &sv_traceCacheBusy, 1 );
+		SV_AtomicAdd( &sv_traceCacheMisses, 1 );
+		return qfalse;
+	}
+
+	hit = ( slot->generation == generation && !memcmp( &slot->key, key, sizeof( *key ) ) );
+	if ( hit ) {
+		*trace = slot->trace;
+	}
+	SV_Unlock( &slot->lock );
+
+	if ( hit ) {
+		SV_AtomicAdd( &sv_traceCacheHits, 1 );
+	} else {
+		SV_AtomicAdd( &sv_traceCacheMisses, 1 );
+	}
+	return hit;
+}
+
+/*
+================
+SV_TraceCacheStore
+
+The generation is the one the query started in, so a result that raced
+with a relink is never stored as current
+================
+*/
+static void SV_TraceCacheStore( traceCacheEntry_t *slot, const traceKey_t *key, int generation, const trace_t *trace ) {
+	if ( !SV_TryLock( &slot->lock ) ) {
+		return;
 	}
+	slot->generation = generation;
+	slot->key = *key;
+	slot->trace = *trace;
+	SV_Unlock( &slot->lock );
+}
+
+/*
+================
+SV_TraceCache_f
+================
+*/
+void SV_TraceCache_f( void ) {
+	int		lookups;
+
+	lookups = sv_traceCacheHits + sv_traceCacheMisses;
+	Com_Printf( "trace cache is %s, %i slots (%i KB)\n", sv_traceCache->integer ? "on" : "off",
+		TRACE_CACHE_SIZE, (int)sizeof( sv_traceSlots ) / 1024 );
+	Com_Printf( "%i lookups, %i hits (%.1f%%), %i misses on busy slots, %i flushes\n",
+		lookups, sv_traceCacheHits, lookups ? 100.0f * sv_traceCacheHits / lookups : 0.0f,
+		sv_traceCacheBusy, sv_traceCacheFlushes );
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		sv_traceCacheHits = sv_traceCacheMisses = 0;
+		sv_traceCacheBusy = sv_traceCacheFlushes = 0;
+	}
+}
+
+
+/*
+==================
+SV_TraceUncached
+==================
+*/
+static void SV_TraceUncached( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	moveclip_t	clip;
+	int			i;
 
 	Com_Memset ( &clip, 0, sizeof ( moveclip_t ) );
 
@@ -643,14 +1000,57 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 	*results = clip.trace;
 }
 
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	traceKey_t			key;
+	traceCacheEntry_t	*slot;
+	int					generation;
+
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	if ( !sv_traceCache->integer ) {
+		SV_TraceUncached( results, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+		return;
+	}
+
+	VectorCopy( start, key.start );
+	VectorCopy( end, key.end );
+	VectorCopy( mins, key.mins );
+	VectorCopy( maxs, key.maxs );
+	key.passEntityNum = passEntityNum;
+	key.contentmask = contentmask;
+	key.kind = capsule ? 1 : 0;
+
+	generation = sv_traceGeneration;
+	slot = SV_TraceCacheSlot( &key );
+	if ( SV_TraceCacheLookup( slot, &key, generation, results ) ) {
+		return;
+	}
+
+	SV_TraceUncached( results, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+	SV_TraceCacheStore( slot, &key, generation, results );
+}
+
 
 
 /*
 =============
-SV_PointContents
+SV_PointContentsUncached
 =============
 */
-int SV_PointContents( const vec3_t p, int passEntityNum ) {
+static int SV_PointContentsUncached( const vec3_t p, int passEntityNum ) {
 	int			touch[MAX_GENTITIES];
 	sharedEntity_t *hit;
 	int			i, num;
@@ -684,4 +1084,34 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 	return contents;
 }
 
+/*
+=============
+SV_PointContents
+=============
+*/
+int SV_PointContents( const vec3_t p, int passEntityNum ) {
+	traceKey_t			key;
+	traceCacheEntry_t	*slot;
+	trace_t				trace;
+	int					generation;
 
+	if ( !sv_traceCache->integer ) {
+		return SV_PointContentsUncached( p, passEntityNum );
+	}
+
+	Com_Memset( &key, 0, sizeof( key ) );
+	VectorCopy( p, key.start );
+	key.passEntityNum = passEntityNum;
+	key.kind = TRACE_CACHE_POINT;
+
+	generation = sv_traceGeneration;
+	slot = SV_TraceCacheSlot( &key );
+	if ( SV_TraceCacheLookup( slot, &key, generation, &trace ) ) {
+		return trace.contents;
+	}
+
+	Com_Memset( &trace, 0, sizeof( trace ) );
+	trace.contents = SV_PointContentsUncached( p, passEntityNum );
+	SV_TraceCacheStore( slot, &key, generation, &trace );
+	return trace.contents;
+}
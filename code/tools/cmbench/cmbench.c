@@ -0,0 +1,869 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// cmbench.c -- collision model regression checks and benchmarks
+
+/*
+===============================================================================
+
+COLLISION BENCHMARK
+
+Loads a bsp with the engine's own collision model code, from a file or
+out of a pk3, and runs reproducible random queries of every kind through
+it: point, box and capsule traces, position tests, point contents and
+box leaf lists.  Nothing else of the engine is linked in.
+
+The results can be written to a golden file and checked against one
+later, so a change to cm_trace.c, cm_patch.c or cm_test.c can be compared
+with the code before it on the same queries.  Results that only differ
+by float rounding are counted apart from real differences.
+
+Each kind of query is also timed, the best of several rounds.
+
+===============================================================================
+*/
+
+#include "../../qcommon/cm_local.h"
+#include "../../qcommon/unzip.h"
+
+#include <time.h>
+
+#define	CB_GOLDEN_IDENT		(('D'<<24)+('G'<<16)+('M'<<8)+'C')	// "CMGD"
+#define	CB_GOLDEN_VERSION	1
+#define	CB_RESULT_WORDS		12
+#define	CB_MAX_LEAFS		1024
+#define	CB_MAX_REPORTS		10			// differences printed per kind
+#define	CB_TRACE_MASK		( CONTENTS_SOLID | CONTENTS_PLAYERCLIP )
+
+typedef enum {
+	CB_POINT_TRACE,
+	CB_BOX_TRACE,
+	CB_CAPSULE_TRACE,
+	CB_POSITION_TEST,
+	CB_POINT_CONTENTS,
+	CB_BOX_LEAFS,
+	CB_NUM_KINDS
+} cbKind_t;
+
+static const char	*cb_kindNames[CB_NUM_KINDS] = {
+	"point traces",
+	"box traces",
+	"capsule traces",
+	"position tests",
+	"point contents",
+	"box leafs"
+};
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+} cbQuery_t;
+
+// what a query returned, as the golden file keeps it
+typedef struct {
+	int			words[CB_RESULT_WORDS];
+} cbResult_t;
+
+typedef struct {
+	int			ident;
+	int			version;
+	int			checksum;			// of the bsp
+	int			seed;
+	int			count;				// queries of each kind
+	int			numKinds;
+	int			resultWords;
+} cbGoldenHeader_t;
+
+static int			cb_count = 20000;
+static int			cb_seed = 1;
+static int			cb_rounds = 5;
+static const char	*cb_goldenOut;
+static const char	*cb_goldenIn;
+static const char	*cb_bspName;
+static const char	*cb_mapName;		// in a pk3
+
+static byte			*cb_bspData;
+static int			cb_bspLength;
+
+/*
+===============================================================================
+
+ENGINE SERVICES
+
+The collision code linked in expects these from the rest of the engine
+
+===============================================================================
+*/
+
+static cvar_t	*cb_cvars;
+
+cvar_t	*com_developer;
+
+void QDECL Com_Printf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+void QDECL Com_DPrintf( const char *fmt, ... ) {
+}
+
+void QDECL Com_Error( int code, const char *fmt, ... ) {
+	va_list		argptr;
+	char		text[MAX_STRING_CHARS];
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, argptr );
+	va_end( argptr );
+
+	fprintf( stderr, "ERROR: %s\n", text );
+	exit( 2 );
+}
+
+static cvar_t *CB_FindCvar( const char *var_name ) {
+	cvar_t	*var;
+
+	for ( var = cb_cvars ; var ; var = var->next ) {
+		if ( !Q_stricmp( var->name, var_name ) ) {
+			return var;
+		}
+	}
+	return NULL;
+}
+
+static void CB_SetCvarValue( cvar_t *var, const char *value ) {
+	free( var->string );
+	var->string = strdup( value );
+	var->value = atof( value );
+	var->integer = atoi( value );
+}
+
+cvar_t *Cvar_Get( const char *var_name, const char *value, int flags ) {
+	cvar_t	*var;
+
+	var = CB_FindCvar( var_name );
+	if ( var ) {
+		return var;		// set on the command line
+	}
+
+	var = calloc( 1, sizeof( *var ) );
+	var->name = strdup( var_name );
+	CB_SetCvarValue( var, value );
+	var->next = cb_cvars;
+	cb_cvars = var;
+	return var;
+}
+
+cvar_t *Cvar_Set2( const char *var_name, const char *value, qboolean force ) {
+	cvar_t	*var;
+
+	var = Cvar_Get( var_name, value, 0 );
+	CB_SetCvarValue( var, value );
+	return var;
+}
+
+void Cvar_Set( const char *var_name, const char *value ) {
+	Cvar_Set2( var_name, value, qtrue );
+}
+
+void Cvar_VariableStringBuffer( const char *var_name, char *buffer, int bufsize ) {
+	cvar_t	*var;
+
+	var = CB_FindCvar( var_name );
+	Q_strncpyz( buffer, var ? var->string : "", bufsize );
+}
+
+// the console benchmarks in the collision code aren't run from here
+int Cmd_Argc( void ) {
+	return 0;
+}
+
+char *Cmd_Argv( int arg ) {
+	return "";
+}
+
+// CM_DrawDebugSurface is only called by the renderer
+void BotDrawDebugPolygons( void (*drawPoly)( int color, int numPoints, float *points ), int value ) {
+}
+
+#ifdef ZONE_DEBUG
+void *Z_MallocDebug( int size, char *label, char *file, int line ) {
+	return calloc( 1, size );
+}
+#else
+void *Z_Malloc( int size ) {
+	return calloc( 1, size );
+}
+#endif
+
+void Z_Free( void *ptr ) {
+	free( ptr );
+}
+
+void *Hunk_Alloc( int size, ha_pref preference ) {
+	void	*buf;
+
+	buf = calloc( 1, size );
+	if ( !buf ) {
+		Com_Error( ERR_FATAL, "Hunk_Alloc failed on %i", size );
+	}
+	return buf;
+}
+
+void *Hunk_AllocateTempMemory( int size ) {
+	void	*buf;
+
+	buf = malloc( size );
+	if ( !buf ) {
+		Com_Error( ERR_FATAL, "Hunk_AllocateTempMemory failed on %i", size );
+	}
+	return buf;
+}
+
+void Hunk_FreeTempMemory( void *buf ) {
+	free( buf );
+}
+
+/*
+==================
+FS_ReadFile
+
+The only file the collision code reads is the bsp, which is already loaded
+==================
+*/
+long FS_ReadFile( const char *qpath, void **buffer ) {
+	if ( Q_stricmp( qpath, cb_mapName ) ) {
+		if ( buffer ) {
+			*buffer = NULL;
+		}
+		return -1;
+	}
+
+	if ( buffer ) {
+		*buffer = cb_bspData;
+	}
+	return cb_bspLength;
+}
+
+void FS_FreeFile( void *buffer ) {
+}
+
+// there is no patch cache without a game directory
+long FS_SV_FOpenFileRead( const char *filename, fileHandle_t *fp ) {
+	*fp = 0;
+	return -1;
+}
+
+fileHandle_t FS_SV_FOpenFileWrite( const char *filename ) {
+	return 0;
+}
+
+int FS_Read( void *buffer, int len, fileHandle_t f ) {
+	return 0;
+}
+
+int FS_Write( const void *buffer, int len, fileHandle_t h ) {
+	return 0;
+}
+
+void FS_FCloseFile( fileHandle_t f ) {
+}
+
+const char *FS_GetCurrentGameDir( void ) {
+	return BASEGAME;
+}
+
+int Sys_Milliseconds( void ) {
+	static time_t	base;
+	struct timespec	ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	if ( !base ) {
+		base = ts.tv_sec;
+	}
+
+	return ( ts.tv_sec - base ) * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+==================
+CB_Microseconds
+==================
+*/
+static double CB_Microseconds( void ) {
+	struct timespec	ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+
+/*
+===============================================================================
+
+LOADING
+
+===============================================================================
+*/
+
+/*
+==================
+CB_LoadFile
+==================
+*/
+static void CB_LoadFile( const char *path ) {
+	FILE	*f;
+
+	f = fopen( path, "rb" );
+	if ( !f ) {
+		Com_Error( ERR_FATAL, "couldn't open %s", path );
+	}
+	fseek( f, 0, SEEK_END );
+	cb_bspLength = ftell( f );
+	fseek( f, 0, SEEK_SET );
+
+	cb_bspData = Hunk_AllocateTempMemory( cb_bspLength );
+	if ( fread( cb_bspData, 1, cb_bspLength, f ) != cb_bspLength ) {
+		Com_Error( ERR_FATAL, "couldn't read %s", path );
+	}
+	fclose( f );
+}
+
+/*
+==================
+CB_LoadFromPak
+
+Reads the map out of a pk3, or its first bsp if no map is named
+==================
+*/
+static void CB_LoadFromPak( const char *path ) {
+	unzFile			uf;
+	unz_file_info	info;
+	char			name[MAX_QPATH];
+	static char		found[MAX_QPATH];
+	int				err;
+
+	uf = unzOpen( path );
+	if ( !uf ) {
+		Com_Error( ERR_FATAL, "couldn't open %s", path );
+	}
+
+	found[0] = 0;
+	for ( err = unzGoToFirstFile( uf ) ; err == UNZ_OK ; err = unzGoToNextFile( uf ) ) {
+		unzGetCurrentFileInfo( uf, &info, name, sizeof( name ), NULL, 0, NULL, 0 );
+		if ( cb_mapName ? !Q_stricmp( name, cb_mapName ) : !Q_stricmp( COM_GetExtension( name ), "bsp" ) ) {
+			Q_strncpyz( found, name, sizeof( found ) );
+			break;
+		}
+	}
+	if ( !found[0] ) {
+		Com_Error( ERR_FATAL, "no %s in %s", cb_mapName ? cb_mapName : "bsp", path );
+	}
+	cb_mapName = found;
+
+	cb_bspLength = info.uncompressed_size;
+	cb_bspData = Hunk_AllocateTempMemory( cb_bspLength );
+	if ( unzOpenCurrentFile( uf ) != UNZ_OK
+		|| unzReadCurrentFile( uf, cb_bspData, cb_bspLength ) != cb_bspLength ) {
+		Com_Error( ERR_FATAL, "couldn't read %s from %s", cb_mapName, path );
+	}
+	unzCloseCurrentFile( uf );
+	unzClose( uf );
+}
+
+
+/*
+===============================================================================
+
+QUERIES
+
+===============================================================================
+*/
+
+/*
+==================
+CB_RandomTarget
+
+Bounds of a random brush or patch, or of the whole world now and then,
+so most queries end up near something they can hit
+==================
+*/
+static void CB_RandomTarget( int *seed, vec3_t mins, vec3_t maxs ) {
+	clipHandle_t	world;
+	int				target;
+
+	world = CM_InlineModel( 0 );
+	if ( ( Q_rand( seed ) & 3 ) == 0 || !cm.numBrushes ) {
+		CM_ModelBounds( world, mins, maxs );
+		return;
+	}
+
+	target = ( (unsigned)Q_rand( seed ) >> 8 ) % cm.numBrushes;
+	VectorCopy( cm.brushes[target].bounds[0], mins );
+	VectorCopy( cm.brushes[target].bounds[1], maxs );
+}
+
+/*
+==================
+CB_MakeQueries
+
+The same seed and count give the same queries on any machine
+==================
+*/
+static cbQuery_t *CB_MakeQueries( cbKind_t kind, int seed ) {
+	cbQuery_t	*queries, *q;
+	vec3_t		mins, maxs;
+	float		size, half;
+	int			i, j;
+
+	queries = Hunk_AllocateTempMemory( cb_count * sizeof( *queries ) );
+	seed += kind * 7919;
+
+	for ( i = 0, q = queries ; i < cb_count ; i++, q++ ) {
+		CB_RandomTarget( &seed, mins, maxs );
+
+		// from around the target to somewhere in it
+		for ( j = 0 ; j < 3 ; j++ ) {
+			size = maxs[j] - mins[j];
+			q->start[j] = mins[j] - 64 + Q_random( &seed ) * ( size + 128 );
+			q->end[j] = mins[j] + Q_random( &seed ) * size;
+		}
+
+		switch ( kind ) {
+		case CB_BOX_TRACE:
+			// the player box and odd sizes
+			if ( i & 1 ) {
+				VectorSet( q->mins, -15, -15, -24 );
+				VectorSet( q->maxs, 15, 15, 32 );
+			} else {
+				for ( j = 0 ; j < 3 ; j++ ) {
+					q->mins[j] = -Q_random( &seed ) * 48;
+					q->maxs[j] = Q_random( &seed ) * 48;
+				}
+			}
+			break;
+		case CB_CAPSULE_TRACE:
+		case CB_POSITION_TEST:
+			VectorSet( q->mins, -15, -15, -24 );
+			VectorSet( q->maxs, 15, 15, 32 );
+			if ( kind == CB_POSITION_TEST ) {
+				VectorCopy( q->end, q->start );
+			}
+			break;
+		case CB_BOX_LEAFS:
+			for ( j = 0 ; j < 3 ; j++ ) {
+				half = Q_random( &seed ) * 512;
+				q->mins[j] = q->end[j] - half;
+				q->maxs[j] = q->end[j] + half;
+			}
+			break;
+		default:
+			VectorClear( q->mins );
+			VectorClear( q->maxs );
+			break;
+		}
+	}
+
+	return queries;
+}
+
+/*
+==================
+CB_FloatWord
+==================
+*/
+static int CB_FloatWord( float f ) {
+	floatint_t	fi;
+
+	fi.f = f;
+	return fi.i;
+}
+
+/*
+==================
+CB_RunQuery
+==================
+*/
+static void CB_RunQuery( cbKind_t kind, cbQuery_t *q, cbResult_t *result ) {
+	trace_t		tr;
+	int			leafs[CB_MAX_LEAFS];
+	int			count, lastLeaf;
+
+	switch ( kind ) {
+	case CB_POINT_CONTENTS:
+		result->words[0] = CM_PointContents( q->start, 0 );
+		return;
+
+	case CB_BOX_LEAFS:
+		count = CM_BoxLeafnums( q->mins, q->maxs, leafs, CB_MAX_LEAFS, &lastLeaf );
+		result->words[0] = count;
+		result->words[1] = lastLeaf;
+		result->words[2] = Com_BlockChecksum( leafs, count * sizeof( leafs[0] ) );
+		return;
+
+	default:
+		CM_BoxTrace( &tr, q->start, q->end, q->mins, q->maxs, 0, CB_TRACE_MASK, kind == CB_CAPSULE_TRACE );
+		break;
+	}
+
+	result->words[0] = CB_FloatWord( tr.fraction );
+	result->words[1] = CB_FloatWord( tr.endpos[0] );
+	result->words[2] = CB_FloatWord( tr.endpos[1] );
+	result->words[3] = CB_FloatWord( tr.endpos[2] );
+	result->words[4] = CB_FloatWord( tr.plane.normal[0] );
+	result->words[5] = CB_FloatWord( tr.plane.normal[1] );
+	result->words[6] = CB_FloatWord( tr.plane.normal[2] );
+	result->words[7] = CB_FloatWord( tr.plane.dist );
+	result->words[8] = tr.startsolid | ( tr.allsolid << 1 );
+	result->words[9] = tr.contents;
+	result->words[10] = tr.surfaceFlags;
+}
+
+/*
+==================
+CB_CloseResults
+
+Returns qtrue if two trace results only differ by float rounding
+==================
+*/
+static qboolean CB_CloseResults( cbKind_t kind, const cbResult_t *a, const cbResult_t *b ) {
+	floatint_t	fa, fb;
+	int			i;
+
+	if ( kind == CB_POINT_CONTENTS || kind == CB_BOX_LEAFS ) {
+		return qfalse;
+	}
+
+	for ( i = 8 ; i < CB_RESULT_WORDS ; i++ ) {
+		if ( a->words[i] != b->words[i] ) {
+			return qfalse;
+		}
+	}
+
+	for ( i = 0 ; i < 8 ; i++ ) {
+		fa.i = a->words[i];
+		fb.i = b->words[i];
+		// a thousandth of the fraction or the normal, a hundredth of a unit
+		if ( fabs( fa.f - fb.f ) > ( ( i == 0 || ( i >= 4 && i < 7 ) ) ? 0.001f : 0.01f ) ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+==================
+CB_PrintDifference
+==================
+*/
+static void CB_PrintDifference( cbKind_t kind, int num, const cbQuery_t *q,
+	const cbResult_t *golden, const cbResult_t *result ) {
+	int		i;
+
+	printf( "  %s %i: (%g %g %g) to (%g %g %g), box (%g %g %g) (%g %g %g)\n",
+		cb_kindNames[kind], num, q->start[0], q->start[1], q->start[2],
+		q->end[0], q->end[1], q->end[2],
+		q->mins[0], q->mins[1], q->mins[2], q->maxs[0], q->maxs[1], q->maxs[2] );
+	printf( "    golden:" );
+	for ( i = 0 ; i < CB_RESULT_WORDS ; i++ ) {
+		printf( " %08x", golden->words[i] );
+	}
+	printf( "\n    now:   " );
+	for ( i = 0 ; i < CB_RESULT_WORDS ; i++ ) {
+		printf( " %08x", result->words[i] );
+	}
+	printf( "\n" );
+}
+
+
+/*
+===============================================================================
+
+GOLDEN FILES
+
+===============================================================================
+*/
+
+/*
+==================
+CB_WriteGolden
+==================
+*/
+static void CB_WriteGolden( int checksum, cbResult_t *results[CB_NUM_KINDS] ) {
+	cbGoldenHeader_t	header;
+	FILE				*f;
+	int					i, j, k, word;
+
+	f = fopen( cb_goldenOut, "wb" );
+	if ( !f ) {
+		Com_Error( ERR_FATAL, "couldn't write %s", cb_goldenOut );
+	}
+
+	header.ident = LittleLong( CB_GOLDEN_IDENT );
+	header.version = LittleLong( CB_GOLDEN_VERSION );
+	header.checksum = LittleLong( checksum );
+	header.seed = LittleLong( cb_seed );
+	header.count = LittleLong( cb_count );
+	header.numKinds = LittleLong( CB_NUM_KINDS );
+	header.resultWords = LittleLong( CB_RESULT_WORDS );
+	fwrite( &header, sizeof( header ), 1, f );
+
+	for ( i = 0 ; i < CB_NUM_KINDS ; i++ ) {
+		for ( j = 0 ; j < cb_count ; j++ ) {
+			for ( k = 0 ; k < CB_RESULT_WORDS ; k++ ) {
+				word = LittleLong( results[i][j].words[k] );
+				fwrite( &word, sizeof( word ), 1, f );
+			}
+		}
+	}
+
+	if ( fclose( f ) ) {
+		Com_Error( ERR_FATAL, "couldn't write %s", cb_goldenOut );
+	}
+	printf( "wrote %s\n", cb_goldenOut );
+}
+
+/*
+==================
+CB_ReadGolden
+
+Also takes the seed and count from the file, so the same queries are made
+==================
+*/
+static cbResult_t **CB_ReadGolden( int checksum ) {
+	static cbResult_t	*golden[CB_NUM_KINDS];
+	cbGoldenHeader_t	header;
+	FILE				*f;
+	int					i, j, k, word;
+
+	f = fopen( cb_goldenIn, "rb" );
+	if ( !f ) {
+		Com_Error( ERR_FATAL, "couldn't open %s", cb_goldenIn );
+	}
+	if ( fread( &header, sizeof( header ), 1, f ) != 1
+		|| LittleLong( header.ident ) != CB_GOLDEN_IDENT
+		|| LittleLong( header.version ) != CB_GOLDEN_VERSION
+		|| LittleLong( header.numKinds ) != CB_NUM_KINDS
+		|| LittleLong( header.resultWords ) != CB_RESULT_WORDS ) {
+		Com_Error( ERR_FATAL, "%s is not a golden file of this version", cb_goldenIn );
+	}
+	if ( LittleLong( header.checksum ) != checksum ) {
+		Com_Error( ERR_FATAL, "%s was made from another bsp", cb_goldenIn );
+	}
+
+	cb_seed = LittleLong( header.seed );
+	cb_count = LittleLong( header.count );
+	if ( cb_count < 1 ) {
+		Com_Error( ERR_FATAL, "%s is empty", cb_goldenIn );
+	}
+
+	for ( i = 0 ; i < CB_NUM_KINDS ; i++ ) {
+		golden[i] = Hunk_AllocateTempMemory( cb_count * sizeof( cbResult_t ) );
+		for ( j = 0 ; j < cb_count ; j++ ) {
+			for ( k = 0 ; k < CB_RESULT_WORDS ; k++ ) {
+				if ( fread( &word, sizeof( word ), 1, f ) != 1 ) {
+					Com_Error( ERR_FATAL, "%s is truncated", cb_goldenIn );
+				}
+				golden[i][j].words[k] = LittleLong( word );
+			}
+		}
+	}
+
+	fclose( f );
+	return golden;
+}
+
+
+/*
+===============================================================================
+
+MAIN
+
+===============================================================================
+*/
+
+/*
+==================
+CB_Usage
+==================
+*/
+static void CB_Usage( const char *name ) {
+	printf( "usage: %s [options] <file.bsp | file.pk3>\n"
+		"  -m <map>           bsp in the pk3 (the first one)\n"
+		"  -n <count>         queries of each kind (%i)\n"
+		"  -s <seed>          random seed (%i)\n"
+		"  -r <rounds>        timing rounds, the best is kept (%i)\n"
+		"  -w <file>          write the results to a golden file\n"
+		"  -c <file>          check the results against a golden file,\n"
+		"                     with its seed and count\n"
+		"  -v <cvar>=<value>  set a collision cvar, like cm_simdBrushes=0\n"
+		"exits with 1 if the results differ from the golden file\n",
+		name, cb_count, cb_seed, cb_rounds );
+	exit( 2 );
+}
+
+/*
+==================
+CB_SetCvar
+==================
+*/
+static void CB_SetCvar( const char *arg ) {
+	char	name[MAX_CVAR_VALUE_STRING];
+	char	*value;
+
+	Q_strncpyz( name, arg, sizeof( name ) );
+	value = strchr( name, '=' );
+	if ( !value ) {
+		Com_Error( ERR_FATAL, "-v needs <cvar>=<value>" );
+	}
+	*value++ = 0;
+	Cvar_Set( name, value );
+}
+
+int main( int argc, char **argv ) {
+	cbQuery_t	*queries;
+	cbResult_t	*results[CB_NUM_KINDS];
+	cbResult_t	**golden;
+	cbResult_t	scratch;
+	const char	*arg;
+	int			i, j, kind, checksum, reports;
+	int			differences, roundings, totalDifferences, totalRoundings;
+	double		start, usec, best;
+
+	for ( i = 1 ; i < argc ; i++ ) {
+		arg = argv[i];
+		if ( arg[0] != '-' ) {
+			cb_bspName = arg;
+			continue;
+		}
+		if ( i + 1 >= argc || arg[2] ) {
+			CB_Usage( argv[0] );
+		}
+
+		switch ( arg[1] ) {
+		case 'm': cb_mapName = argv[++i]; break;
+		case 'n': cb_count = atoi( argv[++i] ); break;
+		case 's': cb_seed = atoi( argv[++i] ); break;
+		case 'r': cb_rounds = atoi( argv[++i] ); break;
+		case 'w': cb_goldenOut = argv[++i]; break;
+		case 'c': cb_goldenIn = argv[++i]; break;
+		case 'v': CB_SetCvar( argv[++i] ); break;
+		default: CB_Usage( argv[0] );
+		}
+	}
+
+	if ( !cb_bspName ) {
+		CB_Usage( argv[0] );
+	}
+	if ( cb_count < 1 ) {
+		Com_Error( ERR_FATAL, "count must be at least 1" );
+	}
+	if ( cb_rounds < 1 ) {
+		cb_rounds = 1;
+	}
+
+	com_developer = Cvar_Get( "developer", "0", 0 );
+
+	// the bsp is read here and handed to CM_LoadMap through FS_ReadFile
+	if ( !Q_stricmp( COM_GetExtension( cb_bspName ), "pk3" ) ) {
+		CB_LoadFromPak( cb_bspName );
+	} else {
+		CB_LoadFile( cb_bspName );
+		cb_mapName = cb_bspName;
+	}
+
+	start = CB_Microseconds();
+	CM_LoadMap( cb_mapName, qfalse, &checksum );
+	printf( "%s: %i brushes, %i leafs, %i nodes, loaded in %.1f msec\n", cb_mapName,
+		cm.numBrushes, cm.numLeafs, cm.numNodes, ( CB_Microseconds() - start ) / 1000 );
+
+	golden = NULL;
+	if ( cb_goldenIn ) {
+		golden = CB_ReadGolden( checksum );
+	}
+
+	printf( "%i queries of each kind, seed %i\n", cb_count, cb_seed );
+
+	totalDifferences = totalRoundings = 0;
+	for ( kind = 0 ; kind < CB_NUM_KINDS ; kind++ ) {
+		queries = CB_MakeQueries( kind, cb_seed );
+		results[kind] = Hunk_AllocateTempMemory( cb_count * sizeof( cbResult_t ) );
+		Com_Memset( results[kind], 0, cb_count * sizeof( cbResult_t ) );
+
+		// the first round keeps the results, the rest only time
+		best = 0;
+		for ( i = 0 ; i < cb_rounds ; i++ ) {
+			start = CB_Microseconds();
+			for ( j = 0 ; j < cb_count ; j++ ) {
+				CB_RunQuery( kind, &queries[j], i ? &scratch : &results[kind][j] );
+			}
+			usec = CB_Microseconds() - start;
+			if ( !i || usec < best ) {
+				best = usec;
+			}
+		}
+
+		printf( "%-16s %8.3f usec/query %10.0f queries/s", cb_kindNames[kind],
+			best / cb_count, best > 0 ? cb_count * 1000000.0 / best : 0.0 );
+
+		if ( !golden ) {
+			printf( "\n" );
+		} else {
+			differences = roundings = reports = 0;
+			for ( j = 0 ; j < cb_count ; j++ ) {
+				if ( !memcmp( &golden[kind][j], &results[kind][j], sizeof( cbResult_t ) ) ) {
+					continue;
+				}
+				if ( CB_CloseResults( kind, &golden[kind][j], &results[kind][j] ) ) {
+					roundings++;
+					continue;
+				}
+				differences++;
+				if ( reports++ < CB_MAX_REPORTS ) {
+					if ( reports == 1 ) {
+						printf( "\n" );
+					}
+					CB_PrintDifference( kind, j, &queries[j], &golden[kind][j], &results[kind][j] );
+				}
+			}
+			printf( "%s%8i differ %8i by rounding\n", reports ? "  " : "", differences, roundings );
+			totalDifferences += differences;
+			totalRoundings += roundings;
+		}
+
+		Hunk_FreeTempMemory( queries );
+	}
+
+	if ( cb_goldenOut ) {
+		CB_WriteGolden( checksum, results );
+	}
+
+	if ( golden ) {
+		printf( "%i results differ from %s, %i more by float rounding\n",
+			totalDifferences, cb_goldenIn, totalRoundings );
+		return totalDifferences ? 1 : 0;
+	}
+
+	return 0;
+}
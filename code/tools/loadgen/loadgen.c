@@ -0,0 +1,1393 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// loadgen.c -- synthetic clients for server load testing
+
+/*
+===============================================================================
+
+LOAD GENERATOR
+
+Opens a number of client connections to a server, each with its own UDP
+socket, and drives them through the same challenge, connect and gamestate
+handshake as a real client.  Once in the game every connection sends
+usercmds at a fixed rate and parses, delta decodes and acknowledges the
+snapshots it gets back, using the engine's own msg, huffman and netchan
+code, so the server does the same work it would for real players.
+
+Two latencies are reported:
+
+ping	time from sending a usercmd until a snapshot reflects it, as the
+		client computes it for the scoreboard
+delay	arrival time of a snapshot relative to its server time, minus the
+		smallest such difference seen on that connection, i.e. how much
+		later than the fastest snapshot it left the server
+
+The server should run with sv_pure 0, pure servers drop clients that
+don't send pak checksums.
+
+===============================================================================
+*/
+
+#include "../../qcommon/q_shared.h"
+#include "../../qcommon/qcommon.h"
+
+#include <setjmp.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define	LG_MAX_CLIENTS		1024
+#define	LG_PARSE_ENTITIES	( MAX_SNAPSHOT_ENTITIES * 4 )	// must be a power of two
+#define	LG_RESEND_TIME		1000
+#define	LG_TIMEOUT			30000
+#define	LG_HIST_SIZE		1000		// one msec buckets, the last one holds everything above
+
+typedef enum {
+	LG_WAITING,			// not started yet
+	LG_CONNECTING,		// sending getchallenge
+	LG_CHALLENGING,		// sending connect
+	LG_CONNECTED,		// netchan is up, waiting for the gamestate
+	LG_PRIMED,			// got the gamestate, waiting for a snapshot
+	LG_ACTIVE,			// getting snapshots
+	LG_DROPPED
+} lgState_t;
+
+typedef struct {
+	qboolean		valid;
+	int				messageNum;
+	int				deltaNum;
+	int				serverTime;
+	int				snapFlags;
+	playerState_t	ps;
+	int				numEntities;
+	int				parseEntitiesNum;
+} lgSnapshot_t;
+
+typedef struct {
+	int		packetsIn, bytesIn;
+	int		packetsOut, bytesOut;
+	int		snapshots;
+	int		badDeltas;
+	int		dropped;
+	int		gamestates;
+	int		pingTotal, pingCount, pingMax;
+	int		delayTotal, delayCount, delayMax;
+} lgStats_t;
+
+typedef struct {
+	int				num;
+	lgState_t		state;
+	int				socket;
+	int				qport;
+
+	int				startTime;
+	int				connectTime;		// last getchallenge or connect sent
+	int				lastPacketTime;
+	int				challenge;
+	netchan_t		netchan;
+
+	int				serverId;
+	int				checksumFeed;
+	int				clientNum;
+	int				serverMessageSequence;
+	int				serverCommandSequence;
+	char			lastServerCommand[MAX_STRING_CHARS];	// keys the usercmds
+	char			bigConfigstring[BIG_INFO_STRING];
+
+	int				reliableSequence;
+	int				reliableAcknowledge;
+	char			reliableCommand[MAX_STRING_TOKENS];
+
+	entityState_t	baselines[MAX_GENTITIES];
+	lgSnapshot_t	snap;
+	lgSnapshot_t	snapshots[PACKET_BACKUP];
+	entityState_t	parseEntities[LG_PARSE_ENTITIES];
+	int				parseEntitiesNum;
+
+	usercmd_t		cmd;
+	int				nextCmdTime;
+	int				lastSnapRealtime;
+	int				packetRealtime[PACKET_BACKUP];
+	int				packetServerTime[PACKET_BACKUP];
+	int				minSnapOffset;
+
+	// movement
+	int				nextMoveChange;
+	float			yaw;
+
+	lgStats_t		stats;			// since the last report
+	int				totalSnapshots;
+} lgClient_t;
+
+static lgClient_t	*lg_clients[LG_MAX_CLIENTS];
+static int			lg_numClients = 16;
+static int			lg_cmdRate = 30;
+static int			lg_rate = 25000;
+static int			lg_snaps = 20;
+static int			lg_connectInterval = 250;
+static int			lg_duration;
+static int			lg_reportInterval = 5;
+static qboolean		lg_verbose;
+static const char	*lg_moveMode = "random";
+static const char	*lg_password = "";
+static const char	*lg_gameName = GAMENAME_FOR_MASTER;
+static const char	*lg_serverName = "localhost";
+static netadr_t		lg_serverAddress;
+
+static lgClient_t	*lg_current;		// connection Sys_SendPacket sends from
+static jmp_buf		lg_abortFrame;
+static volatile sig_atomic_t	lg_quit;
+
+static lgStats_t	lg_total, lg_interval;
+static int			lg_pingHist[LG_HIST_SIZE];
+static int			lg_delayHist[LG_HIST_SIZE];
+static qboolean		lg_warnedPure;
+
+/*
+===============================================================================
+
+ENGINE SERVICES
+
+The qcommon code linked in expects these from the rest of the engine
+
+===============================================================================
+*/
+
+static cvar_t	lg_nullCvar;
+
+cvar_t	*cl_shownet = &lg_nullCvar;
+cvar_t	*cl_packetdelay = &lg_nullCvar;
+cvar_t	*sv_packetdelay = &lg_nullCvar;
+cvar_t	*com_timescale = &lg_nullCvar;
+
+void QDECL Com_Printf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+/*
+==================
+Com_Error
+
+Aborts processing of the current connection, which gets dropped
+==================
+*/
+void QDECL Com_Error( int code, const char *fmt, ... ) {
+	va_list		argptr;
+	char		text[MAX_STRING_CHARS];
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, argptr );
+	va_end( argptr );
+
+	if ( !lg_current ) {
+		fprintf( stderr, "ERROR: %s\n", text );
+		exit( 1 );
+	}
+
+	printf( "client %i: %s\n", lg_current->num, text );
+	longjmp( lg_abortFrame, 1 );
+}
+
+cvar_t *Cvar_Get( const char *var_name, const char *value, int flags ) {
+	cvar_t	*var;
+
+	// only the netchan debug cvars are asked for
+	var = calloc( 1, sizeof( *var ) );
+	var->integer = atoi( value );
+	var->value = atof( value );
+	return var;
+}
+
+#ifdef ZONE_DEBUG
+void *S_MallocDebug( int size, char *label, char *file, int line ) {
+	return calloc( 1, size );
+}
+#else
+void *S_Malloc( int size ) {
+	return malloc( size );
+}
+#endif
+
+void Z_Free( void *ptr ) {
+	free( ptr );
+}
+
+int Sys_Milliseconds( void ) {
+	static time_t	base;
+	struct timespec	ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	if ( !base ) {
+		base = ts.tv_sec;
+	}
+
+	return ( ts.tv_sec - base ) * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void LG_AdrToSockaddr( netadr_t *a, struct sockaddr_in *s ) {
+	Com_Memset( s, 0, sizeof( *s ) );
+	s->sin_family = AF_INET;
+	Com_Memcpy( &s->sin_addr, a->ip, 4 );
+	s->sin_port = a->port;
+}
+
+qboolean Sys_StringToAdr( const char *s, netadr_t *a, netadrtype_t family ) {
+	struct addrinfo		hints, *res;
+
+	Com_Memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if ( getaddrinfo( s, NULL, &hints, &res ) ) {
+		return qfalse;
+	}
+
+	Com_Memset( a, 0, sizeof( *a ) );
+	a->type = NA_IP;
+	Com_Memcpy( a->ip, &( (struct sockaddr_in *)res->ai_addr )->sin_addr, 4 );
+	freeaddrinfo( res );
+
+	return qtrue;
+}
+
+const char *NET_AdrToString( netadr_t a ) {
+	static char	s[NET_ADDRSTRMAXLEN];
+
+	Com_sprintf( s, sizeof( s ), "%i.%i.%i.%i:%i", a.ip[0], a.ip[1], a.ip[2], a.ip[3], BigShort( a.port ) );
+	return s;
+}
+
+void Sys_SendPacket( int length, const void *data, netadr_t to ) {
+	struct sockaddr_in	addr;
+
+	if ( !lg_current ) {
+		return;
+	}
+
+	LG_AdrToSockaddr( &to, &addr );
+	if ( sendto( lg_current->socket, data, length, 0, (struct sockaddr *)&addr, sizeof( addr ) ) == -1 ) {
+		if ( errno != EAGAIN && errno != EWOULDBLOCK ) {
+			printf( "client %i: sendto: %s\n", lg_current->num, strerror( errno ) );
+		}
+		return;
+	}
+
+	lg_current->stats.packetsOut++;
+	lg_current->stats.bytesOut += length;
+}
+
+/*
+===============================================================================
+
+STATISTICS
+
+===============================================================================
+*/
+
+/*
+==================
+LG_AddStats
+==================
+*/
+static void LG_AddStats( lgStats_t *to, const lgStats_t *from ) {
+	to->packetsIn += from->packetsIn;
+	to->bytesIn += from->bytesIn;
+	to->packetsOut += from->packetsOut;
+	to->bytesOut += from->bytesOut;
+	to->snapshots += from->snapshots;
+	to->badDeltas += from->badDeltas;
+	to->dropped += from->dropped;
+	to->gamestates += from->gamestates;
+	to->pingTotal += from->pingTotal;
+	to->pingCount += from->pingCount;
+	to->delayTotal += from->delayTotal;
+	to->delayCount += from->delayCount;
+	if ( from->pingMax > to->pingMax ) {
+		to->pingMax = from->pingMax;
+	}
+	if ( from->delayMax > to->delayMax ) {
+		to->delayMax = from->delayMax;
+	}
+}
+
+/*
+==================
+LG_Percentile
+==================
+*/
+static int LG_Percentile( const int *hist, float fraction ) {
+	int		i, total, count;
+
+	total = 0;
+	for ( i = 0 ; i < LG_HIST_SIZE ; i++ ) {
+		total += hist[i];
+	}
+	if ( !total ) {
+		return 0;
+	}
+
+	count = 0;
+	for ( i = 0 ; i < LG_HIST_SIZE ; i++ ) {
+		count += hist[i];
+		if ( count >= total * fraction ) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+/*
+==================
+LG_CountActive
+==================
+*/
+static int LG_CountActive( void ) {
+	int		i, c;
+
+	c = 0;
+	for ( i = 0 ; i < lg_numClients ; i++ ) {
+		if ( lg_clients[i]->state == LG_ACTIVE ) {
+			c++;
+		}
+	}
+
+	return c;
+}
+
+/*
+==================
+LG_Report
+
+Prints and resets the statistics since the last report
+==================
+*/
+static void LG_Report( int elapsed, int msec ) {
+	lgStats_t	*s = &lg_interval;
+	int			i;
+	float		sec;
+
+	Com_Memset( s, 0, sizeof( *s ) );
+	for ( i = 0 ; i < lg_numClients ; i++ ) {
+		LG_AddStats( s, &lg_clients[i]->stats );
+		LG_AddStats( &lg_total, &lg_clients[i]->stats );
+		Com_Memset( &lg_clients[i]->stats, 0, sizeof( lgStats_t ) );
+	}
+
+	sec = msec > 0 ? msec * 0.001f : 1;
+
+	printf( "%5is %4i active %7.1f snaps/s  in %8.1f KB/s %6.0f pk/s  out %7.1f KB/s  "
+		"ping %3i/%3i  delay %3i/%3i ms  drops %i  bad %i\n",
+		elapsed / 1000, LG_CountActive(), s->snapshots / sec,
+		s->bytesIn / 1024.0f / sec, s->packetsIn / sec, s->bytesOut / 1024.0f / sec,
+		s->pingCount ? s->pingTotal / s->pingCount : 0, s->pingMax,
+		s->delayCount ? s->delayTotal / s->delayCount : 0, s->delayMax,
+		s->dropped, s->badDeltas );
+	fflush( stdout );
+}
+
+/*
+==================
+LG_FinalReport
+==================
+*/
+static void LG_FinalReport( int msec ) {
+	lgStats_t	*s = &lg_total;
+	float		sec;
+
+	sec = msec > 0 ? msec * 0.001f : 1;
+
+	printf( "\n%i clients, %.1f seconds\n", lg_numClients, sec );
+	printf( "snapshots: %i (%.1f/s), %i bad deltas, %i packets dropped, %i gamestates\n",
+		s->snapshots, s->snapshots / sec, s->badDeltas, s->dropped, s->gamestates );
+	printf( "received:  %i packets, %.1f KB/s, %.0f bytes per snapshot\n",
+		s->packetsIn, s->bytesIn / 1024.0f / sec, s->snapshots ? (float)s->bytesIn / s->snapshots : 0.0f );
+	printf( "sent:      %i packets, %.1f KB/s\n", s->packetsOut, s->bytesOut / 1024.0f / sec );
+	printf( "ping:      avg %i  p50 %i  p90 %i  p99 %i  max %i ms\n",
+		s->pingCount ? s->pingTotal / s->pingCount : 0, LG_Percentile( lg_pingHist, 0.5f ),
+		LG_Percentile( lg_pingHist, 0.9f ), LG_Percentile( lg_pingHist, 0.99f ), s->pingMax );
+	printf( "delay:     avg %i  p50 %i  p90 %i  p99 %i  max %i ms\n",
+		s->delayCount ? s->delayTotal / s->delayCount : 0, LG_Percentile( lg_delayHist, 0.5f ),
+		LG_Percentile( lg_delayHist, 0.9f ), LG_Percentile( lg_delayHist, 0.99f ), s->delayMax );
+}
+
+/*
+===============================================================================
+
+CONNECTIONS
+
+===============================================================================
+*/
+
+/*
+==================
+LG_Drop
+==================
+*/
+static void LG_Drop( lgClient_t *cl, const char *reason ) {
+	if ( cl->state != LG_DROPPED ) {
+		printf( "client %i: dropped: %s\n", cl->num, reason );
+	}
+	cl->state = LG_DROPPED;
+}
+
+/*
+==================
+LG_StartConnection
+==================
+*/
+static void LG_StartConnection( lgClient_t *cl ) {
+	struct sockaddr_in	addr;
+
+	cl->socket = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if ( cl->socket == -1 ) {
+		printf( "client %i: socket: %s\n", cl->num, strerror( errno ) );
+		cl->state = LG_DROPPED;
+		return;
+	}
+
+	Com_Memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = INADDR_ANY;
+	if ( bind( cl->socket, (struct sockaddr *)&addr, sizeof( addr ) ) == -1 ) {
+		printf( "client %i: bind: %s\n", cl->num, strerror( errno ) );
+		cl->state = LG_DROPPED;
+		return;
+	}
+	fcntl( cl->socket, F_SETFL, fcntl( cl->socket, F_GETFL ) | O_NONBLOCK );
+
+	cl->qport = rand() & 0xffff;
+	cl->challenge = ( ( rand() & 0x7fff ) << 16 ) ^ rand() ^ Sys_Milliseconds();
+	cl->state = LG_CONNECTING;
+	cl->connectTime = -99999;
+	cl->lastPacketTime = Sys_Milliseconds();
+}
+
+/*
+==================
+LG_CheckForResend
+==================
+*/
+static void LG_CheckForResend( lgClient_t *cl, int now ) {
+	char	info[MAX_INFO_STRING];
+	char	data[MAX_INFO_STRING + 16];
+	int		len;
+
+	if ( now - cl->connectTime < LG_RESEND_TIME ) {
+		return;
+	}
+	cl->connectTime = now;
+
+	if ( cl->state == LG_CONNECTING ) {
+		NET_OutOfBandPrint( NS_CLIENT, lg_serverAddress, "getchallenge %d %s", cl->challenge, lg_gameName );
+		return;
+	}
+
+	info[0] = 0;
+	Info_SetValueForKey( info, "name", va( "loadgen%i", cl->num ) );
+	Info_SetValueForKey( info, "rate", va( "%i", lg_rate ) );
+	Info_SetValueForKey( info, "snaps", va( "%i", lg_snaps ) );
+	if ( *lg_password ) {
+		Info_SetValueForKey( info, "password", lg_password );
+	}
+	Info_SetValueForKey( info, "protocol", va( "%i", PROTOCOL_VERSION ) );
+	Info_SetValueForKey( info, "qport", va( "%i", cl->qport ) );
+	Info_SetValueForKey( info, "challenge", va( "%i", cl->challenge ) );
+
+	// quoted, the server tokenizes around spaces
+	len = Com_sprintf( data, sizeof( data ), "connect \"%s\"", info );
+	NET_OutOfBandData( NS_CLIENT, lg_serverAddress, (byte *)data, len );
+}
+
+/*
+==================
+LG_ConnectionlessPacket
+==================
+*/
+static void LG_ConnectionlessPacket( lgClient_t *cl, msg_t *msg ) {
+	char	*s;
+	char	*text;
+	char	c[MAX_TOKEN_CHARS];
+
+	MSG_BeginReadingOOB( msg );
+	MSG_ReadLong( msg );	// skip the -1
+
+	s = MSG_ReadStringLine( msg );
+	text = s;
+	Q_strncpyz( c, COM_Parse( &text ), sizeof( c ) );
+
+	if ( !Q_stricmp( c, "challengeResponse" ) ) {
+		int		serverChallenge, clientChallenge;
+
+		if ( cl->state != LG_CONNECTING ) {
+			return;
+		}
+		serverChallenge = atoi( COM_Parse( &text ) );
+		clientChallenge = atoi( COM_Parse( &text ) );
+		if ( clientChallenge != cl->challenge ) {
+			return;
+		}
+
+		cl->challenge = serverChallenge;
+		cl->state = LG_CHALLENGING;
+		cl->connectTime = -99999;
+		return;
+	}
+
+	if ( !Q_stricmp( c, "connectResponse" ) ) {
+		if ( cl->state != LG_CHALLENGING ) {
+			return;
+		}
+		if ( atoi( COM_Parse( &text ) ) != cl->challenge ) {
+			return;
+		}
+
+		Netchan_Setup( NS_CLIENT, &cl->netchan, lg_serverAddress, cl->qport, cl->challenge, qfalse );
+		cl->state = LG_CONNECTED;
+		cl->lastPacketTime = Sys_Milliseconds();
+		// spread the clients' packets over the usercmd interval
+		cl->nextCmdTime = cl->lastPacketTime + cl->num * ( 1000 / lg_cmdRate ) / lg_numClients;
+		return;
+	}
+
+	if ( !Q_stricmp( c, "print" ) ) {
+		// rejections come back as prints while connecting
+		if ( cl->state <= LG_CHALLENGING ) {
+			s = MSG_ReadString( msg );
+			printf( "client %i: %s", cl->num, s );
+		}
+		return;
+	}
+}
+
+/*
+==================
+LG_SystemInfoChanged
+==================
+*/
+static void LG_SystemInfoChanged( lgClient_t *cl, const char *systemInfo ) {
+	cl->serverId = atoi( Info_ValueForKey( systemInfo, "sv_serverid" ) );
+
+	if ( atoi( Info_ValueForKey( systemInfo, "sv_pure" ) ) && !lg_warnedPure ) {
+		printf( "WARNING: the server is pure and will drop these clients, set sv_pure 0\n" );
+		lg_warnedPure = qtrue;
+	}
+}
+
+/*
+==================
+LG_ServerCommand
+
+Only the commands that affect the connection itself are looked at
+==================
+*/
+static void LG_ServerCommand( lgClient_t *cl, const char *s ) {
+	char	*text = (char *)s;
+	char	cmd[MAX_TOKEN_CHARS];
+	int		index;
+
+	Q_strncpyz( cmd, COM_Parse( &text ), sizeof( cmd ) );
+
+	if ( !strcmp( cmd, "disconnect" ) ) {
+		LG_Drop( cl, *text ? COM_Parse( &text ) : "server disconnected" );
+		return;
+	}
+
+	if ( !strcmp( cmd, "cs" ) || !strcmp( cmd, "bcs0" ) || !strcmp( cmd, "bcs1" ) || !strcmp( cmd, "bcs2" ) ) {
+		index = atoi( COM_Parse( &text ) );
+		if ( index != CS_SYSTEMINFO ) {
+			return;
+		}
+
+		// big configstrings come in pieces
+		if ( !strcmp( cmd, "bcs0" ) ) {
+			Q_strncpyz( cl->bigConfigstring, COM_Parse( &text ), sizeof( cl->bigConfigstring ) );
+			return;
+		}
+		if ( !strcmp( cmd, "bcs1" ) ) {
+			Q_strcat( cl->bigConfigstring, sizeof( cl->bigConfigstring ), COM_Parse( &text ) );
+			return;
+		}
+		if ( !strcmp( cmd, "bcs2" ) ) {
+			Q_strcat( cl->bigConfigstring, sizeof( cl->bigConfigstring ), COM_Parse( &text ) );
+			LG_SystemInfoChanged( cl, cl->bigConfigstring );
+			return;
+		}
+
+		LG_SystemInfoChanged( cl, COM_Parse( &text ) );
+	}
+}
+
+/*
+==================
+LG_ParseCommandString
+==================
+*/
+static void LG_ParseCommandString( lgClient_t *cl, msg_t *msg ) {
+	int		seq;
+	char	*s;
+
+	seq = MSG_ReadLong( msg );
+	s = MSG_ReadString( msg );
+
+	// see if we have already executed stored it off
+	if ( cl->serverCommandSequence >= seq ) {
+		return;
+	}
+	cl->serverCommandSequence = seq;
+
+	Q_strncpyz( cl->lastServerCommand, s, sizeof( cl->lastServerCommand ) );
+	LG_ServerCommand( cl, cl->lastServerCommand );
+}
+
+/*
+==================
+LG_ParseGamestate
+==================
+*/
+static void LG_ParseGamestate( lgClient_t *cl, msg_t *msg ) {
+	entityState_t	nullstate;
+	int				i, cmd, newnum;
+	char			*s;
+
+	Com_Memset( &cl->snap, 0, sizeof( cl->snap ) );
+	Com_Memset( cl->snapshots, 0, sizeof( cl->snapshots ) );
+	Com_Memset( cl->baselines, 0, sizeof( cl->baselines ) );
+	Com_Memset( &nullstate, 0, sizeof( nullstate ) );
+	cl->parseEntitiesNum = 0;
+	cl->minSnapOffset = INT_MAX;
+	Com_Memset( &cl->cmd, 0, sizeof( cl->cmd ) );
+	for ( i = 0 ; i < PACKET_BACKUP ; i++ ) {
+		cl->packetServerTime[i] = INT_MAX;
+	}
+
+	cl->serverCommandSequence = MSG_ReadLong( msg );
+
+	while ( 1 ) {
+		cmd = MSG_ReadByte( msg );
+
+		if ( cmd == svc_EOF ) {
+			break;
+		}
+
+		if ( cmd == svc_configstring ) {
+			i = MSG_ReadShort( msg );
+			if ( i < 0 || i >= MAX_CONFIGSTRINGS ) {
+				Com_Error( ERR_DROP, "configstring > MAX_CONFIGSTRINGS" );
+			}
+			s = MSG_ReadBigString( msg );
+			if ( i == CS_SYSTEMINFO ) {
+				LG_SystemInfoChanged( cl, s );
+			}
+		} else if ( cmd == svc_baseline ) {
+			newnum = MSG_ReadBits( msg, GENTITYNUM_BITS );
+			if ( newnum < 0 || newnum >= MAX_GENTITIES ) {
+				Com_Error( ERR_DROP, "Baseline number out of range: %i", newnum );
+			}
+			MSG_ReadDeltaEntity( msg, &nullstate, &cl->baselines[newnum], newnum );
+		} else {
+			Com_Error( ERR_DROP, "bad command byte %i in gamestate", cmd );
+		}
+	}
+
+	cl->clientNum = MSG_ReadLong( msg );
+	cl->checksumFeed = MSG_ReadLong( msg );
+
+	cl->state = LG_PRIMED;
+	cl->stats.gamestates++;
+}
+
+/*
+==================
+LG_DeltaEntity
+==================
+*/
+static void LG_DeltaEntity( lgClient_t *cl, msg_t *msg, lgSnapshot_t *frame, int newnum,
+	entityState_t *old, qboolean unchanged ) {
+	entityState_t	*state;
+
+	state = &cl->parseEntities[cl->parseEntitiesNum & ( LG_PARSE_ENTITIES - 1 )];
+
+	if ( unchanged ) {
+		*state = *old;
+	} else {
+		MSG_ReadDeltaEntity( msg, old, state, newnum );
+	}
+
+	if ( state->number == ( MAX_GENTITIES - 1 ) ) {
+		return;		// entity was delta removed
+	}
+	cl->parseEntitiesNum++;
+	frame->numEntities++;
+}
+
+/*
+==================
+LG_OldEntity
+
+Returns the entity number at oldindex in the old frame, or 99999 past the end
+==================
+*/
+static int LG_OldEntity( lgClient_t *cl, lgSnapshot_t *oldframe, int oldindex, entityState_t **oldstate ) {
+	if ( !oldframe || oldindex >= oldframe->numEntities ) {
+		*oldstate = NULL;
+		return 99999;
+	}
+
+	*oldstate = &cl->parseEntities[( oldframe->parseEntitiesNum + oldindex ) & ( LG_PARSE_ENTITIES - 1 )];
+	return ( *oldstate )->number;
+}
+
+/*
+==================
+LG_ParsePacketEntities
+==================
+*/
+static void LG_ParsePacketEntities( lgClient_t *cl, msg_t *msg, lgSnapshot_t *oldframe, lgSnapshot_t *newframe ) {
+	entityState_t	*oldstate;
+	int				newnum, oldnum, oldindex;
+
+	newframe->parseEntitiesNum = cl->parseEntitiesNum;
+	newframe->numEntities = 0;
+
+	oldindex = 0;
+	oldnum = LG_OldEntity( cl, oldframe, oldindex, &oldstate );
+
+	while ( 1 ) {
+		newnum = MSG_ReadBits( msg, GENTITYNUM_BITS );
+		if ( newnum == ( MAX_GENTITIES - 1 ) ) {
+			break;
+		}
+
+		if ( msg->readcount > msg->cursize ) {
+			Com_Error( ERR_DROP, "LG_ParsePacketEntities: end of message" );
+		}
+
+		// one or more entities from the old packet are unchanged
+		while ( oldnum < newnum ) {
+			LG_DeltaEntity( cl, msg, newframe, oldnum, oldstate, qtrue );
+			oldnum = LG_OldEntity( cl, oldframe, ++oldindex, &oldstate );
+		}
+
+		if ( oldnum == newnum ) {
+			// delta from previous state
+			LG_DeltaEntity( cl, msg, newframe, newnum, oldstate, qfalse );
+			oldnum = LG_OldEntity( cl, oldframe, ++oldindex, &oldstate );
+			continue;
+		}
+
+		// delta from baseline
+		LG_DeltaEntity( cl, msg, newframe, newnum, &cl->baselines[newnum], qfalse );
+	}
+
+	// any remaining entities in the old frame are copied over
+	while ( oldnum != 99999 ) {
+		LG_DeltaEntity( cl, msg, newframe, oldnum, oldstate, qtrue );
+		oldnum = LG_OldEntity( cl, oldframe, ++oldindex, &oldstate );
+	}
+}
+
+/*
+==================
+LG_RecordLatency
+==================
+*/
+static void LG_RecordLatency( lgClient_t *cl, int now ) {
+	int		i, packetNum, ping, offset, delay;
+
+	// same as the client's ping: the newest usercmd the snapshot reflects
+	for ( i = 0 ; i < PACKET_BACKUP ; i++ ) {
+		packetNum = ( cl->netchan.outgoingSequence - 1 - i ) & PACKET_MASK;
+		if ( cl->snap.ps.commandTime >= cl->packetServerTime[packetNum] ) {
+			ping = now - cl->packetRealtime[packetNum];
+			cl->stats.pingTotal += ping;
+			cl->stats.pingCount++;
+			if ( ping > cl->stats.pingMax ) {
+				cl->stats.pingMax = ping;
+			}
+			lg_pingHist[ping < LG_HIST_SIZE ? ping : LG_HIST_SIZE - 1]++;
+			break;
+		}
+	}
+
+	// how much later than the fastest snapshot this one arrived
+	offset = now - cl->snap.serverTime;
+	if ( offset < cl->minSnapOffset ) {
+		cl->minSnapOffset = offset;
+	}
+	delay = offset - cl->minSnapOffset;
+	cl->stats.delayTotal += delay;
+	cl->stats.delayCount++;
+	if ( delay > cl->stats.delayMax ) {
+		cl->stats.delayMax = delay;
+	}
+	lg_delayHist[delay < LG_HIST_SIZE ? delay : LG_HIST_SIZE - 1]++;
+}
+
+/*
+==================
+LG_ParseSnapshot
+==================
+*/
+static void LG_ParseSnapshot( lgClient_t *cl, msg_t *msg, int now ) {
+	lgSnapshot_t	newSnap, *old;
+	byte			areamask[MAX_MAP_AREA_BYTES];
+	int				len, deltaNum, oldMessageNum;
+
+	Com_Memset( &newSnap, 0, sizeof( newSnap ) );
+
+	newSnap.serverTime = MSG_ReadLong( msg );
+	newSnap.messageNum = cl->serverMessageSequence;
+
+	deltaNum = MSG_ReadByte( msg );
+	newSnap.deltaNum = deltaNum ? newSnap.messageNum - deltaNum : -1;
+	newSnap.snapFlags = MSG_ReadByte( msg );
+
+	if ( newSnap.deltaNum <= 0 ) {
+		newSnap.valid = qtrue;		// uncompressed frame
+		old = NULL;
+	} else {
+		old = &cl->snapshots[newSnap.deltaNum & PACKET_MASK];
+		if ( old->valid && old->messageNum == newSnap.deltaNum &&
+			cl->parseEntitiesNum - old->parseEntitiesNum <= LG_PARSE_ENTITIES - MAX_SNAPSHOT_ENTITIES ) {
+			newSnap.valid = qtrue;
+		}
+	}
+
+	len = MSG_ReadByte( msg );
+	if ( len > sizeof( areamask ) ) {
+		Com_Error( ERR_DROP, "LG_ParseSnapshot: Invalid size %d for areamask", len );
+	}
+	MSG_ReadData( msg, areamask, len );
+
+	MSG_ReadDeltaPlayerstate( msg, old ? &old->ps : NULL, &newSnap.ps );
+	LG_ParsePacketEntities( cl, msg, old, &newSnap );
+
+	if ( !newSnap.valid ) {
+		// the next packet will ask for a full one
+		cl->stats.badDeltas++;
+		return;
+	}
+
+	// frames in between were dropped, don't delta from them
+	oldMessageNum = cl->snap.messageNum + 1;
+	if ( newSnap.messageNum - oldMessageNum >= PACKET_BACKUP ) {
+		oldMessageNum = newSnap.messageNum - ( PACKET_BACKUP - 1 );
+	}
+	for ( ; oldMessageNum < newSnap.messageNum ; oldMessageNum++ ) {
+		cl->snapshots[oldMessageNum & PACKET_MASK].valid = qfalse;
+	}
+
+	cl->snap = newSnap;
+	cl->snapshots[newSnap.messageNum & PACKET_MASK] = newSnap;
+	cl->lastSnapRealtime = now;
+	cl->state = LG_ACTIVE;
+	cl->stats.snapshots++;
+	cl->totalSnapshots++;
+
+	LG_RecordLatency( cl, now );
+}
+
+/*
+==================
+LG_ParseServerMessage
+==================
+*/
+static void LG_ParseServerMessage( lgClient_t *cl, msg_t *msg, int now ) {
+	int		cmd;
+
+	MSG_Bitstream( msg );
+
+	cl->reliableAcknowledge = MSG_ReadLong( msg );
+	if ( cl->reliableAcknowledge < cl->reliableSequence - MAX_RELIABLE_COMMANDS ) {
+		cl->reliableAcknowledge = cl->reliableSequence;
+	}
+
+	while ( cl->state != LG_DROPPED ) {
+		if ( msg->readcount > msg->cursize ) {
+			Com_Error( ERR_DROP, "LG_ParseServerMessage: read past end of server message" );
+		}
+
+		cmd = MSG_ReadByte( msg );
+		if ( cmd == svc_EOF ) {
+			break;
+		}
+
+		switch ( cmd ) {
+		case svc_nop:
+			break;
+		case svc_serverCommand:
+			LG_ParseCommandString( cl, msg );
+			break;
+		case svc_gamestate:
+			LG_ParseGamestate( cl, msg );
+			break;
+		case svc_snapshot:
+			LG_ParseSnapshot( cl, msg, now );
+			break;
+		default:
+			// downloads and voip are never asked for
+			Com_Error( ERR_DROP, "LG_ParseServerMessage: unexpected server message %i", cmd );
+		}
+	}
+}
+
+/*
+==================
+LG_PacketEvent
+==================
+*/
+static void LG_PacketEvent( lgClient_t *cl, msg_t *msg, int now ) {
+	cl->stats.packetsIn++;
+	cl->stats.bytesIn += msg->cursize;
+
+	if ( msg->cursize >= 4 && *(int *)msg->data == -1 ) {
+		LG_ConnectionlessPacket( cl, msg );
+		return;
+	}
+
+	if ( cl->state < LG_CONNECTED || cl->state == LG_DROPPED ) {
+		return;
+	}
+
+	if ( msg->cursize < 4 ) {
+		return;
+	}
+
+	if ( !Netchan_Process( &cl->netchan, msg ) ) {
+		return;		// out of order, duplicated or an incomplete fragment
+	}
+	cl->stats.dropped += cl->netchan.dropped;
+
+	cl->serverMessageSequence = LittleLong( *(int *)msg->data );
+	cl->lastPacketTime = now;
+
+	LG_ParseServerMessage( cl, msg, now );
+}
+
+/*
+==================
+LG_BuildCommand
+==================
+*/
+static void LG_BuildCommand( lgClient_t *cl, int now ) {
+	usercmd_t	*cmd = &cl->cmd;
+	int			serverTime;
+
+	// run ahead of the last snapshot by the time since it arrived
+	serverTime = cl->snap.serverTime + ( now - cl->lastSnapRealtime );
+	if ( serverTime <= cmd->serverTime ) {
+		serverTime = cmd->serverTime + 1;
+	}
+	cmd->serverTime = serverTime;
+	cmd->weapon = cl->snap.ps.weapon;
+
+	if ( !Q_stricmp( lg_moveMode, "idle" ) ) {
+		cmd->forwardmove = cmd->rightmove = cmd->upmove = 0;
+		cmd->buttons = 0;
+	} else if ( !Q_stricmp( lg_moveMode, "circle" ) ) {
+		cl->yaw += 90.0f * ( 1000 / lg_cmdRate ) * 0.001f;
+		cmd->forwardmove = 127;
+		cmd->rightmove = 0;
+		cmd->buttons = 0;
+	} else {
+		// wander around, firing now and then
+		if ( now - cl->nextMoveChange >= 0 ) {
+			cl->nextMoveChange = now + 250 + rand() % 1000;
+			cmd->forwardmove = ( rand() % 3 - 1 ) * 127;
+			cmd->rightmove = ( rand() % 3 - 1 ) * 127;
+			cmd->upmove = rand() % 8 ? 0 : 127;
+			cmd->buttons = rand() % 4 ? 0 : BUTTON_ATTACK;
+			cl->yaw += rand() % 180 - 90;
+		}
+	}
+
+	cmd->angles[YAW] = ANGLE2SHORT( cl->yaw ) - cl->snap.ps.delta_angles[YAW];
+}
+
+/*
+==================
+LG_WritePacket
+==================
+*/
+static void LG_WritePacket( lgClient_t *cl, int now ) {
+	msg_t		buf;
+	byte		data[MAX_MSGLEN];
+	usercmd_t	nullcmd;
+	int			i, key, packetNum;
+
+	MSG_Init( &buf, data, sizeof( data ) );
+	MSG_Bitstream( &buf );
+
+	MSG_WriteLong( &buf, cl->serverId );
+	MSG_WriteLong( &buf, cl->serverMessageSequence );
+	MSG_WriteLong( &buf, cl->serverCommandSequence );
+
+	for ( i = cl->reliableAcknowledge + 1 ; i <= cl->reliableSequence ; i++ ) {
+		MSG_WriteByte( &buf, clc_clientCommand );
+		MSG_WriteLong( &buf, i );
+		MSG_WriteString( &buf, cl->reliableCommand );
+	}
+
+	packetNum = cl->netchan.outgoingSequence & PACKET_MASK;
+	cl->packetRealtime[packetNum] = now;
+	cl->packetServerTime[packetNum] = INT_MAX;	// no usercmd in it
+
+	if ( cl->state >= LG_PRIMED ) {
+		LG_BuildCommand( cl, now );
+
+		if ( !cl->snap.valid || cl->serverMessageSequence != cl->snap.messageNum ) {
+			MSG_WriteByte( &buf, clc_moveNoDelta );
+		} else {
+			MSG_WriteByte( &buf, clc_move );
+		}
+		MSG_WriteByte( &buf, 1 );
+
+		key = cl->checksumFeed;
+		key ^= cl->serverMessageSequence;
+		key ^= MSG_HashKey( cl->lastServerCommand, 32 );
+
+		Com_Memset( &nullcmd, 0, sizeof( nullcmd ) );
+		MSG_WriteDeltaUsercmdKey( &buf, key, &nullcmd, &cl->cmd );
+
+		cl->packetServerTime[packetNum] = cl->cmd.serverTime;
+	}
+
+	MSG_WriteByte( &buf, clc_EOF );
+
+	Netchan_Transmit( &cl->netchan, buf.cursize, buf.data );
+	while ( cl->netchan.unsentFragments ) {
+		Netchan_TransmitNextFragment( &cl->netchan );
+	}
+}
+
+/*
+==================
+LG_RunClient
+
+Sends whatever is due, returns the msec until the client needs to run again
+==================
+*/
+static int LG_RunClient( lgClient_t *cl, int now ) {
+	int		interval = 1000 / lg_cmdRate;
+
+	switch ( cl->state ) {
+	case LG_WAITING:
+		if ( now - cl->startTime < 0 ) {
+			return cl->startTime - now;
+		}
+		LG_StartConnection( cl );
+		if ( cl->state == LG_DROPPED ) {
+			return 1000;
+		}
+		// fall through
+	case LG_CONNECTING:
+	case LG_CHALLENGING:
+		LG_CheckForResend( cl, now );
+		return cl->connectTime + LG_RESEND_TIME - now;
+
+	case LG_CONNECTED:
+	case LG_PRIMED:
+	case LG_ACTIVE:
+		if ( now - cl->lastPacketTime > LG_TIMEOUT ) {
+			LG_Drop( cl, "server connection timed out" );
+			return 1000;
+		}
+		if ( now - cl->nextCmdTime < 0 ) {
+			return cl->nextCmdTime - now;
+		}
+		// keep the rate even if a send was late
+		cl->nextCmdTime += interval;
+		if ( now - cl->nextCmdTime >= 0 ) {
+			cl->nextCmdTime = now + interval;
+		}
+		LG_WritePacket( cl, now );
+		return interval;
+
+	default:
+		return 1000;
+	}
+}
+
+/*
+==================
+LG_ReadPackets
+==================
+*/
+static void LG_ReadPackets( lgClient_t *cl ) {
+	struct sockaddr_in	from;
+	socklen_t			fromlen;
+	byte				data[MAX_MSGLEN];
+	msg_t				msg;
+	int					len;
+
+	while ( cl->state != LG_DROPPED ) {
+		fromlen = sizeof( from );
+		len = recvfrom( cl->socket, data, sizeof( data ), 0, (struct sockaddr *)&from, &fromlen );
+		if ( len <= 0 ) {
+			return;
+		}
+
+		// only the server talks to us
+		if ( memcmp( &from.sin_addr, lg_serverAddress.ip, 4 ) || from.sin_port != lg_serverAddress.port ) {
+			continue;
+		}
+
+		MSG_Init( &msg, data, sizeof( data ) );
+		msg.cursize = len;
+
+		LG_PacketEvent( cl, &msg, Sys_Milliseconds() );
+	}
+}
+
+/*
+==================
+LG_Disconnect
+
+Sends the disconnect command like a real client does, so the
+server frees the slots right away
+==================
+*/
+static void LG_Disconnect( void ) {
+	lgClient_t	*cl;
+	int			i, j;
+
+	for ( i = 0 ; i < lg_numClients ; i++ ) {
+		cl = lg_clients[i];
+		if ( cl->state < LG_CONNECTED || cl->state == LG_DROPPED ) {
+			continue;
+		}
+
+		lg_current = cl;
+		if ( setjmp( lg_abortFrame ) ) {
+			continue;
+		}
+
+		Q_strncpyz( cl->reliableCommand, "disconnect", sizeof( cl->reliableCommand ) );
+		cl->reliableSequence++;
+		for ( j = 0 ; j < 3 ; j++ ) {
+			LG_WritePacket( cl, Sys_Milliseconds() );
+		}
+	}
+	lg_current = NULL;
+}
+
+/*
+==================
+LG_Frame
+==================
+*/
+static void LG_Frame( struct pollfd *fds ) {
+	lgClient_t	*cl;
+	int			i, now, wait, msec;
+
+	now = Sys_Milliseconds();
+	wait = 100;
+
+	for ( i = 0 ; i < lg_numClients ; i++ ) {
+		cl = lg_clients[i];
+
+		lg_current = cl;
+		if ( setjmp( lg_abortFrame ) ) {
+			LG_Drop( cl, "bad message" );
+			continue;
+		}
+
+		msec = LG_RunClient( cl, now );
+		if ( msec < wait ) {
+			wait = msec;
+		}
+		fds[i].fd = cl->state != LG_WAITING && cl->state != LG_DROPPED ? cl->socket : -1;
+		fds[i].events = POLLIN;
+	}
+	lg_current = NULL;
+
+	if ( poll( fds, lg_numClients, wait > 0 ? wait : 0 ) <= 0 ) {
+		return;
+	}
+
+	for ( i = 0 ; i < lg_numClients ; i++ ) {
+		if ( !( fds[i].revents & POLLIN ) ) {
+			continue;
+		}
+		cl = lg_clients[i];
+
+		lg_current = cl;
+		if ( setjmp( lg_abortFrame ) ) {
+			LG_Drop( cl, "bad message" );
+			continue;
+		}
+
+		LG_ReadPackets( cl );
+	}
+	lg_current = NULL;
+}
+
+/*
+===============================================================================
+
+MAIN
+
+===============================================================================
+*/
+
+static void LG_Usage( const char *name ) {
+	printf( "usage: %s [options] [server[:port]]\n"
+		"  -n <clients>    number of connections (%i)\n"
+		"  -c <rate>       usercmd packets per second per client (%i)\n"
+		"  -r <rate>       userinfo rate in bytes per second (%i)\n"
+		"  -s <snaps>      userinfo snaps (%i)\n"
+		"  -m <mode>       movement: random, circle or idle (%s)\n"
+		"  -i <msec>       time between starting connections (%i)\n"
+		"  -t <seconds>    run time, 0 runs until interrupted (%i)\n"
+		"  -q <seconds>    report interval (%i)\n"
+		"  -p <password>   server password\n"
+		"  -g <gamename>   game name sent with getchallenge (%s)\n"
+		"  -v              per client summary at exit\n",
+		name, lg_numClients, lg_cmdRate, lg_rate, lg_snaps, lg_moveMode,
+		lg_connectInterval, lg_duration, lg_reportInterval, lg_gameName );
+	exit( 1 );
+}
+
+static void LG_Signal( int sig ) {
+	lg_quit = 1;
+}
+
+int main( int argc, char **argv ) {
+	struct pollfd	*fds;
+	lgClient_t		*cl;
+	const char		*arg;
+	int				i, start, lastReport, now;
+
+	for ( i = 1 ; i < argc ; i++ ) {
+		arg = argv[i];
+		if ( arg[0] != '-' ) {
+			lg_serverName = arg;
+			continue;
+		}
+		if ( !strcmp( arg, "-v" ) ) {
+			lg_verbose = qtrue;
+			continue;
+		}
+		if ( i + 1 >= argc || arg[2] ) {
+			LG_Usage( argv[0] );
+		}
+
+		switch ( arg[1] ) {
+		case 'n': lg_numClients = atoi( argv[++i] ); break;
+		case 'c': lg_cmdRate = atoi( argv[++i] ); break;
+		case 'r': lg_rate = atoi( argv[++i] ); break;
+		case 's': lg_snaps = atoi( argv[++i] ); break;
+		case 'm': lg_moveMode = argv[++i]; break;
+		case 'i': lg_connectInterval = atoi( argv[++i] ); break;
+		case 't': lg_duration = atoi( argv[++i] ); break;
+		case 'q': lg_reportInterval = atoi( argv[++i] ); break;
+		case 'p': lg_password = argv[++i]; break;
+		case 'g': lg_gameName = argv[++i]; break;
+		default: LG_Usage( argv[0] );
+		}
+	}
+
+	if ( lg_numClients < 1 || lg_numClients > LG_MAX_CLIENTS ) {
+		Com_Error( ERR_FATAL, "clients must be between 1 and %i", LG_MAX_CLIENTS );
+	}
+	if ( lg_cmdRate < 1 || lg_cmdRate > 1000 ) {
+		Com_Error( ERR_FATAL, "usercmd rate must be between 1 and 1000" );
+	}
+	if ( lg_reportInterval < 1 ) {
+		lg_reportInterval = 1;
+	}
+
+	if ( !NET_StringToAdr( lg_serverName, &lg_serverAddress, NA_IP ) ) {
+		Com_Error( ERR_FATAL, "couldn't resolve %s", lg_serverName );
+	}
+	if ( !lg_serverAddress.port ) {
+		lg_serverAddress.port = BigShort( PORT_SERVER );
+	}
+
+	Netchan_Init( 0 );
+	srand( time( NULL ) );
+	signal( SIGINT, LG_Signal );
+	signal( SIGTERM, LG_Signal );
+
+	fds = calloc( lg_numClients, sizeof( *fds ) );
+	start = Sys_Milliseconds();
+	for ( i = 0 ; i < lg_numClients ; i++ ) {
+		cl = calloc( 1, sizeof( *cl ) );
+		if ( !cl ) {
+			Com_Error( ERR_FATAL, "out of memory for client %i", i );
+		}
+		cl->num = i;
+		cl->state = LG_WAITING;
+		// stagger the connections, the server rate limits challenges
+		cl->startTime = start + i * lg_connectInterval;
+		lg_clients[i] = cl;
+	}
+
+	printf( "%i clients to %s, %i usercmds/s, rate %i, snaps %i\n", lg_numClients,
+		NET_AdrToString( lg_serverAddress ), lg_cmdRate, lg_rate, lg_snaps );
+
+	lastReport = start;
+	while ( !lg_quit ) {
+		LG_Frame( fds );
+
+		now = Sys_Milliseconds();
+		if ( now - lastReport >= lg_reportInterval * 1000 ) {
+			LG_Report( now - start, now - lastReport );
+			lastReport = now;
+		}
+		if ( lg_duration && now - start >= lg_duration * 1000 ) {
+			break;
+		}
+	}
+
+	// the rest of the last interval, unless it is too short to mean anything
+	now = Sys_Milliseconds();
+	if ( now - lastReport >= 100 ) {
+		LG_Report( now - start, now - lastReport );
+	}
+
+	LG_Disconnect();
+
+	LG_FinalReport( now - start );
+
+	if ( lg_verbose ) {
+		for ( i = 0 ; i < lg_numClients ; i++ ) {
+			cl = lg_clients[i];
+			printf( "client %3i: state %i, client num %i, qport %5i, %i snapshots\n",
+				i, cl->state, cl->clientNum, cl->qport, cl->totalSnapshots );
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,535 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// vmtest.c -- qvm sandbox regression checks
+
+/*
+===============================================================================
+
+QVM SANDBOX CHECKS
+
+Builds a small qvm in memory and runs it through the engine's own vm.c,
+the interpreter and the x86_64 compiler, with and without vm_optimize.
+Nothing else of the engine is linked in.
+
+Besides a few legal computed jumps and calls, the qvm is asked to jump
+and call into the middle of a block.  The optimizing tier keeps values
+in registers inside a block and leaves out the data mask on some of
+them, so landing there would let a crafted qvm read outside its data
+segment; such a jump has to drop with a VM_JMP_VIOLATION instead.
+A local is also loaded while every cache register is taken, so the
+masked address has to survive the flush that frees one.
+
+===============================================================================
+*/
+
+#include "../../qcommon/q_shared.h"
+#include "../../qcommon/qcommon.h"
+#include "../../qcommon/vm_local.h"
+
+#include <setjmp.h>
+
+#define	VT_STACK_SIZE		PROGRAM_STACK_SIZE
+#define	VT_MAX_CODE			256
+
+typedef enum {
+	VT_INTERPRETED,
+	VT_COMPILED,
+	VT_OPTIMIZED,
+	VT_NUM_MODES
+} vtMode_t;
+
+static const char	*vt_modeNames[VT_NUM_MODES] = {
+	"interpreted",
+	"compiled",
+	"optimized"
+};
+
+typedef struct {
+	const char	*name;
+	int			cmd;				// 0 jumps to target, else calls it
+	int			target;				// instruction number
+	int			result;				// -1 when it has to drop
+	vtMode_t	firstMode;			// run in this mode and the ones after it
+} vtCase_t;
+
+/*
+The test program, as instruction numbers:
+
+	 0	ENTER 8			vmMain( cmd, target )
+	 1	LOCAL 20
+	 2	LOAD4			target
+	 3	LOCAL 16
+	 4	LOAD4			cmd
+	 5	CONST 0
+	 6	EQ 9
+	 7	CALL			target()
+	 8	LEAVE 8
+	 9	JUMP			target, jump table entry
+	10	CONST 1			jump table entry
+	11	CONST 2
+	12	ADD
+	13	LEAVE 8			returns 3
+	14	ENTER 8
+	15	CONST 7
+	16	LEAVE 8			returns 7
+	17	ENTER 16
+	18	LOCAL 8
+	19	CONST 1000
+	20	STORE4
+	21	LOCAL 12
+	22	CONST 2000
+	23	STORE4
+	24	CONST 0			six times, fills every cache register
+	25	LOAD4
+	  ...
+	36	LOCAL 8
+	37	LOCAL 12
+	38	LOAD4			2000
+	39	ADD
+	40	LOCAL 8
+	41	SUB			takes the address back off
+	42	ADD			six times, adds up the zeros
+	  ...
+	48	LEAVE 16		returns 2000
+*/
+#define	VT_JUMP_TARGET		10
+#define	VT_JUMP_MIDDLE		12
+#define	VT_CALL_TARGET		14
+#define	VT_CALL_MIDDLE		15
+#define	VT_CALL_REGS		17
+
+static const vtCase_t	vt_cases[] = {
+	{ "jump to a jump table entry",		0, VT_JUMP_TARGET, 3, VT_INTERPRETED },
+	{ "call a function",				1, VT_CALL_TARGET, 7, VT_INTERPRETED },
+	{ "jump past the code",				0, 1000, -1, VT_INTERPRETED },
+	{ "call past the code",				1, 1000, -1, VT_INTERPRETED },
+	{ "load a local, registers full",	1, VT_CALL_REGS, 2000, VT_INTERPRETED },
+
+	// only the optimizing tier tells block starts from the rest
+	{ "jump into a block",				0, VT_JUMP_MIDDLE, -1, VT_OPTIMIZED },
+	{ "call into a block",				1, VT_JUMP_MIDDLE, -1, VT_OPTIMIZED },
+	{ "call into a function",			1, VT_CALL_MIDDLE, -1, VT_OPTIMIZED },
+};
+
+static byte			vt_image[sizeof( vmHeader_t ) + VT_MAX_CODE + 8];
+static int			vt_imageLength;
+
+static qboolean		vt_verbose;
+static jmp_buf		vt_abort;
+static char			vt_error[MAX_STRING_CHARS];
+
+/*
+===============================================================================
+
+ENGINE SERVICES
+
+The vm code linked in expects these from the rest of the engine
+
+===============================================================================
+*/
+
+static cvar_t	*vt_cvars;
+
+cvar_t	*com_developer;
+vm_t	*gvm;
+
+int (QDECL *Q_VMftol)( void );
+
+void QDECL Com_Printf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	if ( !vt_verbose ) {
+		return;
+	}
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+void QDECL Com_DPrintf( const char *fmt, ... ) {
+}
+
+/*
+==================
+Com_Error
+
+Errors from inside a vm call end up back in VT_Run
+==================
+*/
+void QDECL Com_Error( int code, const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( vt_error, sizeof( vt_error ), fmt, argptr );
+	va_end( argptr );
+
+	if ( code == ERR_FATAL ) {
+		fprintf( stderr, "ERROR: %s\n", vt_error );
+		exit( 2 );
+	}
+
+	longjmp( vt_abort, 1 );
+}
+
+static cvar_t *VT_FindCvar( const char *var_name ) {
+	cvar_t	*var;
+
+	for ( var = vt_cvars ; var ; var = var->next ) {
+		if ( !Q_stricmp( var->name, var_name ) ) {
+			return var;
+		}
+	}
+	return NULL;
+}
+
+static void VT_SetCvarValue( cvar_t *var, const char *value ) {
+	free( var->string );
+	var->string = strdup( value );
+	var->value = atof( value );
+	var->integer = atoi( value );
+}
+
+cvar_t *Cvar_Get( const char *var_name, const char *value, int flags ) {
+	cvar_t	*var;
+
+	var = VT_FindCvar( var_name );
+	if ( var ) {
+		return var;
+	}
+
+	var = calloc( 1, sizeof( *var ) );
+	var->name = strdup( var_name );
+	VT_SetCvarValue( var, value );
+	var->next = vt_cvars;
+	vt_cvars = var;
+	return var;
+}
+
+int Cvar_VariableIntegerValue( const char *var_name ) {
+	cvar_t	*var;
+
+	var = VT_FindCvar( var_name );
+	return var ? var->integer : 0;
+}
+
+void Cmd_AddCommand( const char *cmd_name, xcommand_t function ) {
+}
+
+#ifdef ZONE_DEBUG
+void *Z_MallocDebug( int size, char *label, char *file, int line ) {
+	return calloc( 1, size );
+}
+#else
+void *Z_Malloc( int size ) {
+	return calloc( 1, size );
+}
+#endif
+
+void Z_Free( void *ptr ) {
+	free( ptr );
+}
+
+// vm memory is never given back, the tool exits soon enough
+void *Hunk_Alloc( int size, ha_pref preference ) {
+	void	*buf;
+
+	buf = calloc( 1, size );
+	if ( !buf ) {
+		Com_Error( ERR_FATAL, "Hunk_Alloc failed on %i", size );
+	}
+	return buf;
+}
+
+int Hunk_MemoryRemaining( void ) {
+	return 0;
+}
+
+/*
+==================
+FS_FindVM
+
+Every vm is the test program
+==================
+*/
+int FS_FindVM( void **startSearch, char *found, int foundlen, const char *name, int enableDll ) {
+	if ( *startSearch ) {
+		return -1;
+	}
+	*startSearch = vt_image;
+
+	Com_sprintf( found, foundlen, "vm/%s.qvm", name );
+	return VMI_COMPILED;
+}
+
+long FS_ReadFileDir( const char *qpath, void *searchPath, qboolean unpure, void **buffer ) {
+	void	*buf;
+
+	buf = malloc( vt_imageLength );
+	memcpy( buf, vt_image, vt_imageLength );
+	*buffer = buf;
+	return vt_imageLength;
+}
+
+long FS_ReadFile( const char *qpath, void **buffer ) {
+	if ( buffer ) {
+		*buffer = NULL;
+	}
+	return -1;
+}
+
+void FS_FreeFile( void *buffer ) {
+	free( buffer );
+}
+
+qboolean FS_Which( const char *filename, void *searchPath ) {
+	return qtrue;
+}
+
+// no code cache without a home path, see VM_LoadCodeCache
+long FS_SV_FOpenFileRead( const char *filename, fileHandle_t *fp ) {
+	*fp = 0;
+	return -1;
+}
+
+fileHandle_t FS_SV_FOpenFileWrite( const char *filename ) {
+	return 0;
+}
+
+int FS_Read( void *buffer, int len, fileHandle_t f ) {
+	return 0;
+}
+
+int FS_Write( const void *buffer, int len, fileHandle_t h ) {
+	return 0;
+}
+
+void FS_FCloseFile( fileHandle_t f ) {
+}
+
+const char *FS_GetCurrentGameDir( void ) {
+	return BASEGAME;
+}
+
+cpuFeatures_t Sys_GetProcessorFeatures( void ) {
+	return 0;
+}
+
+void *Sys_LoadGameDll( const char *name, intptr_t (QDECL **entryPoint)(int, ...),
+	intptr_t (QDECL *systemcalls)(intptr_t, ...) ) {
+	return NULL;
+}
+
+void Sys_UnloadDll( void *dllHandle ) {
+}
+
+qboolean VM_SampleEnter( void *stack ) {
+	return qfalse;
+}
+
+void VM_SampleLeave( void ) {
+}
+
+void VM_Sample_f( void ) {
+}
+
+static intptr_t VT_SystemCalls( intptr_t *args ) {
+	Com_Error( ERR_DROP, "unexpected system call %i", (int)args[0] );
+	return 0;
+}
+
+
+/*
+===============================================================================
+
+TEST PROGRAM
+
+===============================================================================
+*/
+
+static byte		*vt_code;
+static int		vt_codeLength;
+static int		vt_instructionCount;
+
+static void VT_Op( int op ) {
+	vt_code[vt_codeLength++] = op;
+	vt_instructionCount++;
+}
+
+static void VT_OpArg( int op, int arg ) {
+	VT_Op( op );
+	vt_code[vt_codeLength++] = arg & 0xff;
+	vt_code[vt_codeLength++] = ( arg >> 8 ) & 0xff;
+	vt_code[vt_codeLength++] = ( arg >> 16 ) & 0xff;
+	vt_code[vt_codeLength++] = ( arg >> 24 ) & 0xff;
+}
+
+/*
+==================
+VT_BuildImage
+
+Assembles the program above into a VM_MAGIC_VER2 qvm image
+==================
+*/
+static void VT_BuildImage( void ) {
+	vmHeader_t	*header;
+	int			*trailer;
+	int			i;
+
+	header = (vmHeader_t *)vt_image;
+	vt_code = vt_image + sizeof( *header );
+
+	VT_OpArg( OP_ENTER, 8 );
+	VT_OpArg( OP_LOCAL, 20 );
+	VT_Op( OP_LOAD4 );
+	VT_OpArg( OP_LOCAL, 16 );
+	VT_Op( OP_LOAD4 );
+	VT_OpArg( OP_CONST, 0 );
+	VT_OpArg( OP_EQ, 9 );
+	VT_Op( OP_CALL );
+	VT_OpArg( OP_LEAVE, 8 );
+	VT_Op( OP_JUMP );
+	VT_OpArg( OP_CONST, 1 );
+	VT_OpArg( OP_CONST, 2 );
+	VT_Op( OP_ADD );
+	VT_OpArg( OP_LEAVE, 8 );
+	VT_OpArg( OP_ENTER, 8 );
+	VT_OpArg( OP_CONST, 7 );
+	VT_OpArg( OP_LEAVE, 8 );
+	VT_OpArg( OP_ENTER, 16 );
+	VT_OpArg( OP_LOCAL, 8 );
+	VT_OpArg( OP_CONST, 1000 );
+	VT_Op( OP_STORE4 );
+	VT_OpArg( OP_LOCAL, 12 );
+	VT_OpArg( OP_CONST, 2000 );
+	VT_Op( OP_STORE4 );
+	for ( i = 0 ; i < 6 ; i++ ) {
+		VT_OpArg( OP_CONST, 0 );
+		VT_Op( OP_LOAD4 );
+	}
+	VT_OpArg( OP_LOCAL, 8 );
+	VT_OpArg( OP_LOCAL, 12 );
+	VT_Op( OP_LOAD4 );
+	VT_Op( OP_ADD );
+	VT_OpArg( OP_LOCAL, 8 );
+	VT_Op( OP_SUB );
+	for ( i = 0 ; i < 6 ; i++ ) {
+		VT_Op( OP_ADD );
+	}
+	VT_OpArg( OP_LEAVE, 16 );
+
+	// one data word, then the jump table
+	trailer = (int *)( vt_code + vt_codeLength );
+	trailer[0] = 0;
+	trailer[1] = LittleLong( VT_JUMP_TARGET );
+
+	header->vmMagic = LittleLong( VM_MAGIC_VER2 );
+	header->instructionCount = LittleLong( vt_instructionCount );
+	header->codeOffset = LittleLong( sizeof( *header ) );
+	header->codeLength = LittleLong( vt_codeLength );
+	header->dataOffset = LittleLong( sizeof( *header ) + vt_codeLength );
+	header->dataLength = LittleLong( 4 );
+	header->litLength = 0;
+	header->bssLength = LittleLong( VT_STACK_SIZE );
+	header->jtrgLength = LittleLong( 4 );
+
+	vt_imageLength = sizeof( *header ) + vt_codeLength + 8;
+}
+
+
+/*
+===============================================================================
+
+RUNNING
+
+===============================================================================
+*/
+
+/*
+==================
+VT_Run
+
+Returns qtrue if the case did what it should in the given mode
+==================
+*/
+static qboolean VT_Run( vtMode_t mode, const vtCase_t *c ) {
+	static vm_t	*vm;		// survives the longjmp
+	intptr_t	result;
+
+	Cvar_Get( "vm_optimize", "0", 0 );
+	VT_SetCvarValue( VT_FindCvar( "vm_optimize" ), mode == VT_OPTIMIZED ? "1" : "0" );
+
+	vt_error[0] = 0;
+	vm = NULL;
+	if ( setjmp( vt_abort ) ) {
+		if ( vm ) {
+			VM_Forced_Unload_Start();
+			VM_Free( vm );
+			VM_Forced_Unload_Done();
+		}
+		printf( "%-12s %-28s dropped: %s\n", vt_modeNames[mode], c->name, vt_error );
+		return c->result == -1;
+	}
+
+	vm = VM_Create( "vmtest", VT_SystemCalls, mode == VT_INTERPRETED ? VMI_BYTECODE : VMI_COMPILED );
+	if ( !vm ) {
+		Com_Error( ERR_FATAL, "VM_Create failed" );
+	}
+	result = VM_Call( vm, c->cmd, c->target );
+	VM_Free( vm );
+
+	printf( "%-12s %-28s returned %i\n", vt_modeNames[mode], c->name, (int)result );
+	return result == c->result;
+}
+
+int main( int argc, char **argv ) {
+	int			mode, i;
+	int			failures;
+
+	if ( argc > 1 && !strcmp( argv[1], "-v" ) ) {
+		vt_verbose = qtrue;
+	} else if ( argc > 1 ) {
+		fprintf( stderr, "usage: %s [-v]\n", argv[0] );
+		return 2;
+	}
+
+	com_developer = Cvar_Get( "developer", "0", 0 );
+	Cvar_Get( "vm_codeCache", "0", 0 );
+	VM_Init();
+	VT_BuildImage();
+
+	failures = 0;
+	for ( mode = 0 ; mode < VT_NUM_MODES ; mode++ ) {
+		for ( i = 0 ; i < ARRAY_LEN( vt_cases ) ; i++ ) {
+			if ( mode < vt_cases[i].firstMode ) {
+				continue;
+			}
+			if ( !VT_Run( mode, &vt_cases[i] ) ) {
+				printf( "FAILED\n" );
+				failures++;
+			}
+		}
+	}
+
+	printf( "%i failed\n", failures );
+	return failures ? 1 : 0;
+}